@@ -0,0 +1,179 @@
+#!/usr/bin/perl -w
+
+# Decode access logs written with a "log_format ... binary" format
+# into tab-separated text or JSON lines.
+#
+#   binlog2text.pl [-j] [-n name,name,...] [file ...]
+#
+# Without files, the log is read from the standard input, so compressed
+# logs can be decoded with "zcat access.log.gz | binlog2text.pl".  Field
+# names given with -n are used as JSON keys, otherwise JSON lines are
+# arrays.  In text output, absent values are printed as "-", and tabs,
+# backslashes and control characters in strings are escaped as "\xXX".
+#
+# A record is a 32-bit length of the rest of the record and fields.
+# A field is a type byte and a value: 0 is an absent value, 1 is a 64-bit
+# integer, 2 is a 32-bit length and a string, 3 is a timestamp and 4 is
+# a duration, both in milliseconds as 64-bit integers, 5 and 6 are IPv4
+# and IPv6 addresses.  All numbers are little-endian.
+
+###############################################################################
+
+require 5.010;
+
+use strict;
+use warnings;
+
+use Socket qw/ inet_ntop AF_INET6 /;
+
+my ($json, @names);
+
+while (@ARGV && $ARGV[0] =~ /^-/) {
+	my $opt = shift @ARGV;
+
+	if ($opt eq '-j') {
+		$json = 1;
+
+	} elsif ($opt eq '-n' && @ARGV) {
+		@names = split(/,/, shift @ARGV);
+
+	} else {
+		die "usage: $0 [-j] [-n name,name,...] [file ...]\n";
+	}
+}
+
+push @ARGV, '-' unless @ARGV;
+
+for my $file (@ARGV) {
+	my $in;
+
+	if ($file eq '-') {
+		$in = \*STDIN;
+
+	} else {
+		open($in, '<', $file) or die "$file: $!\n";
+	}
+
+	binmode $in;
+
+	while (1) {
+		my $n = read($in, my $head, 4);
+
+		die "$file: $!\n" unless defined $n;
+		last if $n == 0;
+		die "$file: truncated record\n" if $n != 4;
+
+		my $len = unpack('V', $head);
+
+		$n = read($in, my $record, $len);
+		die "$file: truncated record\n" unless defined $n && $n == $len;
+
+		my @fields = fields($file, $record);
+
+		print $json ? to_json(@fields) : to_text(@fields), "\n";
+	}
+
+	close $in unless $file eq '-';
+}
+
+###############################################################################
+
+# Each field is returned as [ type, value ]
+
+sub fields {
+	my ($file, $record) = @_;
+	my ($pos, @fields) = (0);
+
+	while ($pos < length $record) {
+		my $type = ord substr($record, $pos++, 1);
+		my $value;
+
+		if ($type == 0) {
+			$value = undef;
+
+		} elsif ($type == 2) {
+			my $len = unpack('V', substr($record, $pos, 4));
+			$value = substr($record, $pos + 4, $len);
+			$pos += 4 + $len;
+
+		} elsif ($type == 1 || $type == 3 || $type == 4) {
+			$value = unpack('Q<', substr($record, $pos, 8));
+			$pos += 8;
+
+		} elsif ($type == 5) {
+			$value = join('.', unpack('C4', substr($record, $pos, 4)));
+			$pos += 4;
+
+		} elsif ($type == 6) {
+			$value = inet_ntop(AF_INET6, substr($record, $pos, 16));
+			$pos += 16;
+
+		} else {
+			die "$file: unknown field type $type\n";
+		}
+
+		die "$file: invalid record\n" if $pos > length $record;
+
+		push @fields, [ $type, $value ];
+	}
+
+	return @fields;
+}
+
+sub number {
+	my ($type, $value) = @_;
+
+	return sprintf('%d.%03d', $value / 1000, $value % 1000);
+}
+
+sub to_text {
+	return join("\t", map {
+		my ($type, $value) = @$_;
+
+		!defined $value ? '-'
+			: $type == 2 ? escape_text($value)
+			: $type == 3 || $type == 4 ? number($type, $value)
+			: $value;
+	} @_);
+}
+
+sub escape_text {
+	my ($s) = @_;
+
+	$s =~ s/([\x00-\x1f\\\x7f])/sprintf('\\x%02X', ord $1)/ge;
+
+	return $s;
+}
+
+sub to_json {
+	my @values = map {
+		my ($type, $value) = @$_;
+
+		!defined $value ? 'null'
+			: $type == 1 ? $value
+			: $type == 3 || $type == 4 ? number($type, $value)
+			: '"' . escape_json($value) . '"';
+	} @_;
+
+	return '[' . join(',', @values) . ']' unless @names;
+
+	my @pairs;
+
+	for my $i (0 .. $#values) {
+		my $name = $i < @names ? $names[$i] : "field$i";
+		push @pairs, '"' . escape_json($name) . '":' . $values[$i];
+	}
+
+	return '{' . join(',', @pairs) . '}';
+}
+
+sub escape_json {
+	my ($s) = @_;
+
+	$s =~ s/(["\\])/\\$1/g;
+	$s =~ s/([\x00-\x1f])/sprintf('\\u%04X', ord $1)/ge;
+
+	return $s;
+}
+
+###############################################################################
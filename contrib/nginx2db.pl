@@ -0,0 +1,192 @@
+#!/usr/bin/perl -w
+
+# Compile geo or map entries in the nginx configuration file format
+# into a database for the "database" parameter of the geo and map blocks.
+#
+#   nginx2db.pl geo input output
+#   nginx2db.pl map input output
+#
+# For geo, the input has "address value;", "address/mask value;" or
+# "address-address value;" lines with IPv4 addresses.  Nested networks
+# and ranges are allowed, the most specific one wins.  For map, the input
+# has "key value;" lines, keys are compared case-insensitively.
+#
+# The output is written into a temporary file and renamed, so running
+# nginx workers pick up a complete database.
+
+###############################################################################
+
+require 5.008;
+
+use strict;
+use warnings;
+
+use Compress::Zlib qw/ crc32 /;
+
+my ($type, $input, $output) = @ARGV;
+
+die "usage: $0 geo|map input output\n"
+	unless defined $output && $type =~ /^(geo|map)$/;
+
+open(my $in, '<', $input) or die "$input: $!\n";
+binmode $in;
+
+my (@entries, %keys);
+my $n = 0;
+
+while (<$in>) {
+	# Skip comments and empty lines
+
+	s/#.*//;
+	next if /^\s*$/;
+
+	/^\s*(\S+)\s+("[^"]*"|'[^']*'|[^;\s]*)\s*;\s*$/
+		or die "$input:$.: invalid line\n";
+
+	my ($key, $value) = ($1, $2);
+	$value =~ s/^(["'])(.*)\1$/$2/;
+
+	if ($type eq 'map') {
+		$key = lc $key;
+		warn "$input:$.: duplicate key \"$key\"\n" if exists $keys{$key};
+		$keys{$key} = $value;
+		next;
+	}
+
+	my ($start, $end);
+
+	if ($key =~ /^([\d.]+)-([\d.]+)$/) {
+		($start, $end) = (addr($1), addr($2));
+
+	} elsif ($key =~ m!^([\d.]+)/(\d+)$! && $2 <= 32) {
+		my $mask = $2 ? (0xffffffff << (32 - $2)) & 0xffffffff : 0;
+		$start = addr($1) & $mask;
+		$end = $start | (~$mask & 0xffffffff);
+
+	} elsif ($key =~ /^[\d.]+$/) {
+		$start = $end = addr($key);
+	}
+
+	die "$input:$.: invalid network \"$key\"\n"
+		unless defined $start && defined $end && $start <= $end;
+
+	push @entries, [ $start, $end, $value, $n++ ];
+}
+
+close $in;
+
+my @db;
+
+if ($type eq 'map') {
+	@db = map { [ $_, $keys{$_} ] } sort keys %keys;
+
+} else {
+	@db = flatten(@entries);
+}
+
+# Header, entries, then key and value strings
+
+my $offset = 20 + 16 * @db;
+my ($index, $strings, %values) = ('', '');
+
+for my $e (@db) {
+	my $value = $type eq 'map' ? $e->[1] : $e->[2];
+
+	unless (exists $values{$value}) {
+		$values{$value} = $offset + length $strings;
+		$strings .= $value;
+	}
+
+	if ($type eq 'map') {
+		$index .= pack('L4', $offset + length $strings, length $e->[0],
+			$values{$value}, length $value);
+		$strings .= $e->[0];
+
+	} else {
+		$index .= pack('L4', $e->[0], $e->[1], $values{$value},
+			length $value);
+	}
+}
+
+die "database is too large\n" if $offset + length $strings > 0xffffffff;
+
+my $body = $index . $strings;
+my $header = pack('a4 C C C C L L L', 'NGDB', 1, $type eq 'geo' ? 1 : 2,
+	0, 0, 0x12345678, crc32($body), scalar @db);
+
+open(my $out, '>', "$output.tmp") or die "$output.tmp: $!\n";
+binmode $out;
+print $out $header, $body or die "$output.tmp: $!\n";
+close $out or die "$output.tmp: $!\n";
+
+rename("$output.tmp", $output) or die "$output: $!\n";
+
+###############################################################################
+
+sub addr {
+	my @b = split(/\./, $_[0]);
+
+	return undef unless @b == 4 && !grep { $_ > 255 } @b;
+	return ($b[0] << 24) | ($b[1] << 16) | ($b[2] << 8) | $b[3];
+}
+
+# Split nested ranges into disjoint ones, the innermost range wins;
+# of identical ranges the last one wins
+
+sub flatten {
+	my (@out, @stack);
+	my $cur = 0;
+
+	my $emit = sub {
+		my ($s, $e, $v) = @_;
+
+		return if $s > $e;
+
+		if (@out && $out[-1][1] + 1 == $s && $out[-1][2] eq $v) {
+			$out[-1][1] = $e;
+			return;
+		}
+
+		push @out, [ $s, $e, $v ];
+	};
+
+	for my $r (sort { $a->[0] <=> $b->[0] || $b->[1] <=> $a->[1]
+			|| $a->[3] <=> $b->[3] } @_)
+	{
+		while (@stack && $stack[-1][1] < $r->[0]) {
+			my $top = pop @stack;
+			$emit->($cur, $top->[1], $top->[2]);
+			$cur = $top->[1] + 1;
+		}
+
+		if (@stack) {
+			my $top = $stack[-1];
+
+			die "range " . join('-', map { ntoa($_) } @$r[0, 1])
+				. " overlaps "
+				. join('-', map { ntoa($_) } @$top[0, 1]) . "\n"
+				if $r->[1] > $top->[1];
+
+			$emit->($cur, $r->[0] - 1, $top->[2]);
+
+			pop @stack if $r->[0] == $top->[0] && $r->[1] == $top->[1];
+		}
+
+		$cur = $r->[0];
+		push @stack, $r;
+	}
+
+	while (@stack) {
+		my $top = pop @stack;
+		$emit->($cur, $top->[1], $top->[2]);
+		$cur = $top->[1] + 1;
+	}
+
+	return @out;
+}
+
+sub ntoa {
+	return join('.', unpack('C4', pack('N', $_[0])));
+}
+
+###############################################################################
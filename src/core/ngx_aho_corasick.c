@@ -0,0 +1,221 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+ngx_ac_t *
+ngx_ac_create(ngx_pool_t *pool, ngx_uint_t n, ngx_uint_t caseless)
+{
+    ngx_ac_t  *ac;
+
+    ac = ngx_pcalloc(pool, sizeof(ngx_ac_t));
+    if (ac == NULL) {
+        return NULL;
+    }
+
+    if (ngx_array_init(&ac->patterns, pool, n ? n : 1,
+                       sizeof(ngx_ac_pattern_t))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    ac->pool = pool;
+    ac->caseless = caseless;
+
+    return ac;
+}
+
+
+ngx_int_t
+ngx_ac_add(ngx_ac_t *ac, ngx_str_t *str, ngx_uint_t id)
+{
+    ngx_ac_pattern_t  *pat;
+
+    if (str->len == 0) {
+        return NGX_DECLINED;
+    }
+
+    pat = ngx_array_push(&ac->patterns);
+    if (pat == NULL) {
+        return NGX_ERROR;
+    }
+
+    pat->str = *str;
+    pat->id = id;
+    pat->next = NGX_AC_NONE;
+
+    return NGX_OK;
+}
+
+
+/*
+ * the automaton is a complete DFA over byte classes: bytes which do not
+ * occur in patterns share class 0, and transitions missing in the trie
+ * are resolved through failure links at compile time
+ */
+
+ngx_int_t
+ngx_ac_compile(ngx_ac_t *ac)
+{
+    u_char             c;
+    size_t             size;
+    uint32_t          *next, *dict, *fail, *queue, *depth, s, t, f;
+    ngx_int_t         *match;
+    ngx_uint_t         i, j, k, n, nc, max, head, tail;
+    ngx_ac_pattern_t  *pat;
+
+    pat = ac->patterns.elts;
+    n = ac->patterns.nelts;
+
+    ngx_memzero(ac->classes, sizeof(ac->classes));
+
+    nc = 1;
+    max = 1;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < pat[i].str.len; j++) {
+            c = pat[i].str.data[j];
+
+            if (ac->caseless) {
+                c = ngx_tolower(c);
+            }
+
+            if (ac->classes[c] == 0) {
+                ac->classes[c] = (uint16_t) nc;
+
+                if (ac->caseless) {
+                    ac->classes[ngx_toupper(c)] = (uint16_t) nc;
+                }
+
+                nc++;
+            }
+        }
+
+        max += pat[i].str.len;
+    }
+
+    if (max > 0xffffffff / nc) {
+        return NGX_ERROR;
+    }
+
+    size = max * nc * sizeof(uint32_t);
+
+    next = ngx_alloc(size + 4 * max * sizeof(uint32_t), ac->pool->log);
+    if (next == NULL) {
+        return NGX_ERROR;
+    }
+
+    dict = next + max * nc;
+    depth = dict + max;
+    fail = depth + max;
+    queue = fail + max;
+
+    ngx_memzero(next, size);
+    ngx_memzero(dict, 2 * max * sizeof(uint32_t));
+
+    match = ngx_palloc(ac->pool, max * sizeof(ngx_int_t));
+    if (match == NULL) {
+        ngx_free(next);
+        return NGX_ERROR;
+    }
+
+    for (s = 0; s < max; s++) {
+        match[s] = NGX_AC_NONE;
+    }
+
+    /* trie */
+
+    ac->nstates = 1;
+
+    for (i = 0; i < n; i++) {
+        s = 0;
+
+        for (j = 0; j < pat[i].str.len; j++) {
+            k = ac->classes[pat[i].str.data[j]];
+
+            t = next[s * nc + k];
+
+            if (t == 0) {
+                t = (uint32_t) ac->nstates++;
+                next[s * nc + k] = t;
+                depth[t] = depth[s] + 1;
+            }
+
+            s = t;
+        }
+
+        pat[i].next = match[s];
+        match[s] = (ngx_int_t) i;
+    }
+
+    /* failure and dictionary links, breadth first */
+
+    head = 0;
+    tail = 0;
+
+    for (k = 0; k < nc; k++) {
+        t = next[k];
+
+        if (t) {
+            fail[t] = 0;
+            queue[tail++] = t;
+        }
+    }
+
+    while (head < tail) {
+        s = queue[head++];
+
+        for (k = 0; k < nc; k++) {
+            t = next[s * nc + k];
+            f = next[fail[s] * nc + k];
+
+            if (t == 0) {
+                next[s * nc + k] = f;
+                continue;
+            }
+
+            fail[t] = f;
+            dict[t] = (match[f] != NGX_AC_NONE) ? f : dict[f];
+            queue[tail++] = t;
+        }
+    }
+
+    ac->nclasses = nc;
+
+    ac->next = ngx_palloc(ac->pool, ac->nstates * nc * sizeof(uint32_t));
+    if (ac->next == NULL) {
+        ngx_free(next);
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(ac->next, next, ac->nstates * nc * sizeof(uint32_t));
+
+    ac->dict = ngx_palloc(ac->pool, ac->nstates * sizeof(uint32_t));
+    if (ac->dict == NULL) {
+        ngx_free(next);
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(ac->dict, dict, ac->nstates * sizeof(uint32_t));
+
+    ac->depth = ngx_palloc(ac->pool, ac->nstates * sizeof(uint32_t));
+    if (ac->depth == NULL) {
+        ngx_free(next);
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(ac->depth, depth, ac->nstates * sizeof(uint32_t));
+
+    ac->match = match;
+
+    ngx_free(next);
+
+    return NGX_OK;
+}
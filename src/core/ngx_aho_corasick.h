@@ -0,0 +1,58 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_AHO_CORASICK_H_INCLUDED_
+#define _NGX_AHO_CORASICK_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#define NGX_AC_NONE  -1
+
+
+typedef struct {
+    ngx_str_t        str;
+    ngx_uint_t       id;
+    ngx_int_t        next;
+} ngx_ac_pattern_t;
+
+
+typedef struct {
+    ngx_pool_t      *pool;
+    ngx_array_t      patterns;
+    ngx_uint_t       caseless;
+
+    ngx_uint_t       nclasses;
+    ngx_uint_t       nstates;
+    uint16_t         classes[256];
+
+    uint32_t        *next;
+    ngx_int_t       *match;
+    uint32_t        *dict;
+    uint32_t        *depth;
+} ngx_ac_t;
+
+
+#define ngx_ac_next(ac, state, c)                                             \
+    (ac)->next[(state) * (ac)->nclasses + (ac)->classes[c]]
+
+/* the first state in the suffix chain of "state" with a pattern ending */
+#define ngx_ac_output(ac, state)                                              \
+    ((ac)->match[state] != NGX_AC_NONE ? (state) : (ac)->dict[state])
+
+#define ngx_ac_pattern(ac, n)                                                 \
+    (&((ngx_ac_pattern_t *) (ac)->patterns.elts)[n])
+
+
+ngx_ac_t *ngx_ac_create(ngx_pool_t *pool, ngx_uint_t n, ngx_uint_t caseless);
+ngx_int_t ngx_ac_add(ngx_ac_t *ac, ngx_str_t *str, ngx_uint_t id);
+ngx_int_t ngx_ac_compile(ngx_ac_t *ac);
+
+
+#endif /* _NGX_AHO_CORASICK_H_INCLUDED_ */
@@ -13,7 +13,6 @@
 ngx_os_io_t  ngx_io;
 
 
-static void ngx_drain_connections(ngx_cycle_t *cycle);
 
 
 ngx_listening_t *
@@ -719,6 +718,25 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle)
 #if (NGX_HAVE_DEFERRED_ACCEPT && defined SO_ACCEPTFILTER)
     struct accept_filter_arg   af;
 #endif
+#if (NGX_HAVE_REUSEPORT_CBPF)
+    ngx_core_conf_t           *ccf;
+    struct sock_fprog          prog;
+    struct sock_filter         code[] = {
+        /* A = the CPU which handles the packet */
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+        /* A %= worker_processes */
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, 1 },
+        /* return A as a socket index within the reuseport group */
+        { BPF_RET | BPF_A, 0, 0, 0 }
+    };
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+
+    code[1].k = ccf->worker_processes;
+
+    prog.len = sizeof(code) / sizeof(struct sock_filter);
+    prog.filter = code;
+#endif
 
     ls = cycle->listening.elts;
     for (i = 0; i < cycle->listening.nelts; i++) {
@@ -850,6 +868,30 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle)
         }
 #endif
 
+#if (NGX_HAVE_REUSEPORT_CBPF)
+
+        /*
+         * the program is shared by all sockets of the reuseport group,
+         * and sockets are added to the group in order of workers, so
+         * a connection is steered to the worker with the same number
+         * as the CPU it was received on, which matches the
+         * "worker_cpu_affinity auto" binding
+         */
+
+        if (ls[i].reuseport_cpu && ls[i].worker == 0) {
+            if (setsockopt(ls[i].fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                           (const void *) &prog, sizeof(struct sock_fprog))
+                == -1)
+            {
+                ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                              "setsockopt(SO_ATTACH_REUSEPORT_CBPF) %V failed, "
+                              "ignored",
+                              &ls[i].addr_text);
+            }
+        }
+
+#endif
+
         if (ls[i].listen) {
 
             /* change backlog via listen() */
@@ -1290,7 +1332,7 @@ ngx_reusable_connection(ngx_connection_t *c, ngx_uint_t reusable)
 }
 
 
-static void
+void
 ngx_drain_connections(ngx_cycle_t *cycle)
 {
     ngx_uint_t         i, n;
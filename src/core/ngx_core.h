@@ -69,6 +69,7 @@ typedef void (*ngx_connection_handler_pt)(ngx_connection_t *c);
 #include <ngx_crc.h>
 #include <ngx_crc32.h>
 #include <ngx_murmurhash.h>
+#include <ngx_aho_corasick.h>
 #if (NGX_PCRE)
 #include <ngx_regex.h>
 #endif
@@ -87,6 +88,7 @@ typedef void (*ngx_connection_handler_pt)(ngx_connection_t *c);
 #include <ngx_conf_file.h>
 #include <ngx_module.h>
 #include <ngx_open_file_cache.h>
+#include <ngx_db.h>
 #include <ngx_os.h>
 #include <ngx_connection.h>
 #include <ngx_syslog.h>
@@ -72,6 +72,8 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
     }
     pool->log = log;
 
+    ngx_pool_set_type(pool, NGX_POOL_CYCLE);
+
     cycle = ngx_pcalloc(pool, sizeof(ngx_cycle_t));
     if (cycle == NULL) {
         ngx_destroy_pool(pool);
@@ -454,9 +456,11 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
 
             if (shm_zone[i].tag == oshm_zone[n].tag
                 && shm_zone[i].shm.size == oshm_zone[n].shm.size
+                && shm_zone[i].shm.hugepages == oshm_zone[n].shm.hugepages
                 && !shm_zone[i].noreuse)
             {
                 shm_zone[i].shm.addr = oshm_zone[n].shm.addr;
+                shm_zone[i].shm.hugetlb = oshm_zone[n].shm.hugetlb;
 #if (NGX_WIN32)
                 shm_zone[i].shm.handle = oshm_zone[n].shm.handle;
 #endif
@@ -674,6 +678,7 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
 
             if (oshm_zone[i].tag == shm_zone[n].tag
                 && oshm_zone[i].shm.size == shm_zone[n].shm.size
+                && oshm_zone[i].shm.hugepages == shm_zone[n].shm.hugepages
                 && !oshm_zone[i].noreuse)
             {
                 goto live_shm_zone;
@@ -891,6 +896,7 @@ failed:
 
             if (shm_zone[i].tag == oshm_zone[n].tag
                 && shm_zone[i].shm.size == oshm_zone[n].shm.size
+                && shm_zone[i].shm.hugepages == oshm_zone[n].shm.hugepages
                 && !shm_zone[i].noreuse)
             {
                 goto old_shm_zone_found;
@@ -1341,6 +1347,7 @@ ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag)
     shm_zone->shm.size = size;
     shm_zone->shm.name = *name;
     shm_zone->shm.exists = 0;
+    shm_zone->shm.hugepages = 0;
     shm_zone->init = NULL;
     shm_zone->tag = tag;
     shm_zone->noreuse = 0;
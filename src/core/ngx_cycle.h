@@ -93,6 +93,7 @@ typedef struct {
 
     ngx_int_t                 worker_processes;
     ngx_int_t                 debug_points;
+    ngx_int_t                 pool_cache;
 
     ngx_int_t                 rlimit_nofile;
     off_t                     rlimit_core;
@@ -0,0 +1,435 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+static ngx_int_t ngx_db_load(ngx_db_t *db, ngx_file_mapping_t *fm,
+    ngx_file_info_t *fi);
+static ngx_int_t ngx_db_validate(ngx_db_t *db, ngx_file_mapping_t *fm);
+static void ngx_db_init_event(ngx_db_t *db);
+static void ngx_db_check_handler(ngx_event_t *ev);
+static void ngx_db_check(ngx_db_t *db);
+static ngx_int_t ngx_db_cmp(u_char *s1, size_t len1, u_char *s2, size_t len2);
+static void ngx_db_cleanup(void *data);
+
+
+static ngx_db_header_t  ngx_db_header = {
+    { 'N', 'G', 'D', 'B' }, NGX_DB_VERSION, 0, { 0, 0 }, 0x12345678, 0, 0
+};
+
+
+char *
+ngx_db_conf(ngx_conf_t *cf, ngx_uint_t type, ngx_db_t **dbp)
+{
+    ngx_str_t           *value, s;
+    ngx_uint_t           i;
+    ngx_db_t            *db;
+    ngx_file_info_t      fi;
+    ngx_pool_cleanup_t  *cln;
+
+    value = cf->args->elts;
+
+    if (*dbp) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "duplicate database \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    db = ngx_pcalloc(cf->cycle->pool, sizeof(ngx_db_t));
+    if (db == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    db->name.len = value[1].len;
+    db->name.data = ngx_pstrdup(cf->cycle->pool, &value[1]);
+    if (db->name.data == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (ngx_conf_full_name(cf->cycle, &db->name, 1) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    db->type = type;
+    db->valid = 60;
+
+    for (i = 2; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "valid=", 6) == 0) {
+            s.len = value[i].len - 6;
+            s.data = value[i].data + 6;
+
+            db->valid = ngx_parse_time(&s, 1);
+
+            if (db->valid == (time_t) NGX_ERROR || db->valid == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid parameter \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[i]);
+        return NGX_CONF_ERROR;
+    }
+
+    db->event = ngx_pcalloc(cf->cycle->pool, sizeof(ngx_event_t));
+    if (db->event == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    cln = ngx_pool_cleanup_add(cf->cycle->pool, 0);
+    if (cln == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    db->fm.log = cf->log;
+
+    if (ngx_db_load(db, &db->fm, &fi) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    cln->handler = ngx_db_cleanup;
+    cln->data = db;
+
+    *dbp = db;
+
+    return NGX_CONF_OK;
+}
+
+
+ngx_int_t
+ngx_db_find_range(ngx_db_t *db, uint32_t addr, ngx_str_t *value)
+{
+    ngx_uint_t       lo, hi, m;
+    ngx_db_entry_t  *e;
+
+    if (db->event->handler == NULL) {
+        ngx_db_init_event(db);
+    }
+
+    e = db->entries;
+    lo = 0;
+    hi = db->nentries;
+
+    while (lo < hi) {
+        m = lo + (hi - lo) / 2;
+
+        if (addr < e[m].key) {
+            hi = m;
+
+        } else {
+            lo = m + 1;
+        }
+    }
+
+    if (lo == 0 || addr > e[lo - 1].len) {
+        return NGX_DECLINED;
+    }
+
+    value->len = e[lo - 1].value_len;
+    value->data = (u_char *) db->fm.addr + e[lo - 1].value;
+
+    return NGX_OK;
+}
+
+
+ngx_int_t
+ngx_db_find_key(ngx_db_t *db, ngx_str_t *key, ngx_str_t *value)
+{
+    u_char          *base;
+    ngx_int_t        rc;
+    ngx_uint_t       lo, hi, m;
+    ngx_db_entry_t  *e;
+
+    if (db->event->handler == NULL) {
+        ngx_db_init_event(db);
+    }
+
+    base = db->fm.addr;
+    e = db->entries;
+    lo = 0;
+    hi = db->nentries;
+
+    while (lo < hi) {
+        m = lo + (hi - lo) / 2;
+
+        rc = ngx_db_cmp(key->data, key->len, base + e[m].key, e[m].len);
+
+        if (rc == 0) {
+            value->len = e[m].value_len;
+            value->data = base + e[m].value;
+
+            return NGX_OK;
+        }
+
+        if (rc < 0) {
+            hi = m;
+
+        } else {
+            lo = m + 1;
+        }
+    }
+
+    return NGX_DECLINED;
+}
+
+
+static ngx_int_t
+ngx_db_load(ngx_db_t *db, ngx_file_mapping_t *fm, ngx_file_info_t *fi)
+{
+    fm->name = db->name.data;
+
+    if (ngx_open_file_mapping(fm, fi) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (ngx_db_validate(db, fm) != NGX_OK) {
+        ngx_close_file_mapping(fm);
+        return NGX_ERROR;
+    }
+
+    db->uniq = ngx_file_uniq(fi);
+    db->mtime = ngx_file_mtime(fi);
+    db->size = ngx_file_size(fi);
+    db->fm_mtime = db->mtime;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_CORE, fm->log, 0,
+                   "db \"%V\" loaded, %uz bytes, %ui entries",
+                   &db->name, fm->size, db->nentries);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_db_validate(ngx_db_t *db, ngx_file_mapping_t *fm)
+{
+    u_char           *base;
+    uint32_t          crc32;
+    uint64_t          size;
+    ngx_uint_t        i, n;
+    ngx_db_entry_t   *e;
+    ngx_db_header_t  *header;
+
+    base = fm->addr;
+    size = fm->size;
+    header = fm->addr;
+
+    if (size < sizeof(ngx_db_header_t)
+        || ngx_memcmp(header, &ngx_db_header, 5) != 0
+        || header->endianness != ngx_db_header.endianness)
+    {
+        ngx_log_error(NGX_LOG_CRIT, fm->log, 0,
+                      "incompatible database \"%V\"", &db->name);
+        return NGX_ERROR;
+    }
+
+    if (header->type != db->type) {
+        ngx_log_error(NGX_LOG_CRIT, fm->log, 0,
+                      "database \"%V\" has wrong type %ud",
+                      &db->name, header->type);
+        return NGX_ERROR;
+    }
+
+    n = header->entries;
+
+    if ((uint64_t) n * sizeof(ngx_db_entry_t)
+        > size - sizeof(ngx_db_header_t))
+    {
+        goto invalid;
+    }
+
+    ngx_crc32_init(crc32);
+    ngx_crc32_update(&crc32, base + sizeof(ngx_db_header_t),
+                     fm->size - sizeof(ngx_db_header_t));
+    ngx_crc32_final(crc32);
+
+    if (crc32 != header->crc32) {
+        ngx_log_error(NGX_LOG_CRIT, fm->log, 0,
+                      "database \"%V\" checksum mismatch", &db->name);
+        return NGX_ERROR;
+    }
+
+    e = (ngx_db_entry_t *) (base + sizeof(ngx_db_header_t));
+
+    for (i = 0; i < n; i++) {
+
+        if ((uint64_t) e[i].value + e[i].value_len > size) {
+            goto invalid;
+        }
+
+        if (db->type == NGX_DB_RANGES) {
+            if (e[i].key > e[i].len || (i && e[i].key <= e[i - 1].len)) {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        /* NGX_DB_KEYS */
+
+        if ((uint64_t) e[i].key + e[i].len > size) {
+            goto invalid;
+        }
+
+        if (i && ngx_db_cmp(base + e[i - 1].key, e[i - 1].len,
+                            base + e[i].key, e[i].len)
+                 >= 0)
+        {
+            goto invalid;
+        }
+    }
+
+    db->entries = e;
+    db->nentries = n;
+
+    return NGX_OK;
+
+invalid:
+
+    ngx_log_error(NGX_LOG_CRIT, fm->log, 0,
+                  "invalid database \"%V\"", &db->name);
+
+    return NGX_ERROR;
+}
+
+
+/*
+ * the file is checked by a timer in each worker, armed on the first
+ * lookup, so neither stat() nor validation of a changed file are done
+ * while handling requests
+ */
+
+static void
+ngx_db_init_event(ngx_db_t *db)
+{
+    ngx_event_t  *ev;
+
+    ev = db->event;
+
+    ev->handler = ngx_db_check_handler;
+    ev->data = db;
+    ev->log = ngx_cycle->log;
+    ev->cancelable = 1;
+
+    ngx_add_timer(ev, db->valid * 1000);
+}
+
+
+static void
+ngx_db_check_handler(ngx_event_t *ev)
+{
+    ngx_db_t  *db = ev->data;
+
+    ngx_db_check(db);
+
+    ngx_add_timer(ev, db->valid * 1000);
+}
+
+
+/*
+ * the file is replaced by rename(), a changed file is mapped anew
+ * and the old mapping is released, a broken file is reported once
+ * and the old data remain in use
+ *
+ * a mapped file truncated or rewritten in place would crash workers
+ * on access, so its mapping is released as soon as this is noticed,
+ * and lookups fail until a valid file is found
+ */
+
+static void
+ngx_db_check(ngx_db_t *db)
+{
+    ngx_file_info_t     fi;
+    ngx_file_mapping_t  fm;
+
+    if (db->fm.addr
+        && (ngx_fd_info(db->fm.fd, &fi) == NGX_FILE_ERROR
+            || (size_t) ngx_file_size(&fi) != db->fm.size
+            || ngx_file_mtime(&fi) != db->fm_mtime))
+    {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
+                      "database \"%V\" was modified in place, "
+                      "it must be replaced by rename()", &db->name);
+
+        db->fm.log = ngx_cycle->log;
+        ngx_close_file_mapping(&db->fm);
+
+        db->fm.addr = NULL;
+        db->entries = NULL;
+        db->nentries = 0;
+    }
+
+    if (ngx_file_info(db->name.data, &fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ERR, ngx_cycle->log, ngx_errno,
+                      ngx_file_info_n " \"%V\" failed", &db->name);
+        return;
+    }
+
+    if (ngx_file_uniq(&fi) == db->uniq
+        && ngx_file_mtime(&fi) == db->mtime
+        && ngx_file_size(&fi) == db->size)
+    {
+        return;
+    }
+
+    fm.log = ngx_cycle->log;
+
+    if (ngx_db_load(db, &fm, &fi) != NGX_OK) {
+        db->uniq = ngx_file_uniq(&fi);
+        db->mtime = ngx_file_mtime(&fi);
+        db->size = ngx_file_size(&fi);
+
+        ngx_log_error(NGX_LOG_ERR, ngx_cycle->log, 0,
+                      "database \"%V\" was not reloaded", &db->name);
+        return;
+    }
+
+    if (db->fm.addr) {
+        db->fm.log = ngx_cycle->log;
+        ngx_close_file_mapping(&db->fm);
+    }
+
+    db->fm = fm;
+
+    ngx_log_error(NGX_LOG_NOTICE, ngx_cycle->log, 0,
+                  "database \"%V\" reloaded, %ui entries",
+                  &db->name, db->nentries);
+}
+
+
+static ngx_int_t
+ngx_db_cmp(u_char *s1, size_t len1, u_char *s2, size_t len2)
+{
+    ngx_int_t  rc;
+
+    rc = ngx_memcmp(s1, s2, ngx_min(len1, len2));
+
+    if (rc != 0) {
+        return rc;
+    }
+
+    return (ngx_int_t) len1 - (ngx_int_t) len2;
+}
+
+
+static void
+ngx_db_cleanup(void *data)
+{
+    ngx_db_t  *db = data;
+
+    if (db->fm.addr) {
+        db->fm.log = ngx_cycle->log;
+        ngx_close_file_mapping(&db->fm);
+    }
+}
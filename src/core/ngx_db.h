@@ -0,0 +1,69 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_DB_H_INCLUDED_
+#define _NGX_DB_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+/*
+ * a compiled database is a header followed by entries sorted by key
+ * and by the key and value strings, all offsets are from the file start
+ */
+
+#define NGX_DB_VERSION  1
+
+#define NGX_DB_RANGES   1
+#define NGX_DB_KEYS     2
+
+
+typedef struct {
+    u_char                signature[4];
+    u_char                version;
+    u_char                type;
+    u_char                reserved[2];
+    uint32_t              endianness;
+    uint32_t              crc32;
+    uint32_t              entries;
+} ngx_db_header_t;
+
+
+typedef struct {
+    uint32_t              key;         /* range start or key offset */
+    uint32_t              len;         /* range end or key length */
+    uint32_t              value;
+    uint32_t              value_len;
+} ngx_db_entry_t;
+
+
+typedef struct {
+    ngx_str_t             name;
+    ngx_uint_t            type;
+
+    ngx_file_mapping_t    fm;
+    ngx_db_entry_t       *entries;
+    ngx_uint_t            nentries;
+
+    ngx_file_uniq_t       uniq;
+    time_t                mtime;
+    off_t                 size;
+    time_t                fm_mtime;
+
+    time_t                valid;
+    ngx_event_t          *event;
+} ngx_db_t;
+
+
+char *ngx_db_conf(ngx_conf_t *cf, ngx_uint_t type, ngx_db_t **dbp);
+ngx_int_t ngx_db_find_range(ngx_db_t *db, uint32_t addr, ngx_str_t *value);
+ngx_int_t ngx_db_find_key(ngx_db_t *db, ngx_str_t *key, ngx_str_t *value);
+
+
+#endif /* _NGX_DB_H_INCLUDED_ */
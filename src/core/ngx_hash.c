@@ -9,6 +9,53 @@
 #include <ngx_core.h>
 
 
+#define NGX_HASH_PERFECT_TRIES  (1 << 20)
+
+#define ngx_hash_perfect_key(key)  ((uint64_t) (key) * 0x9e3779b97f4a7c15)
+
+
+static ngx_int_t ngx_hash_wildcard_build(ngx_hash_init_t *hinit,
+    ngx_hash_key_t *names, ngx_uint_t nelts, ngx_uint_t perfect);
+static int ngx_libc_cdecl ngx_hash_perfect_cmp(const void *one,
+    const void *two);
+
+
+static ngx_inline ngx_uint_t
+ngx_hash_perfect_slot(uint64_t h, uint32_t seed, ngx_uint_t n)
+{
+    h ^= (uint64_t) seed * 0xc2b2ae3d27d4eb4f;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+
+    return (ngx_uint_t) (h % n);
+}
+
+
+static void *
+ngx_hash_find_perfect(ngx_hash_perfect_t *ph, ngx_uint_t key, u_char *name,
+    size_t len)
+{
+    uint64_t          h;
+    ngx_hash_slot_t  *slot;
+
+    h = ngx_hash_perfect_key(key);
+
+    slot = &ph->slots[ngx_hash_perfect_slot(h,
+                                            ph->seeds[(h >> 32) % ph->nseeds],
+                                            ph->nslots)];
+
+    if (slot->check != (uint32_t) h
+        || slot->len != len
+        || ngx_memcmp(slot->name, name, len) != 0)
+    {
+        return NULL;
+    }
+
+    return slot->value;
+}
+
+
 void *
 ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len)
 {
@@ -19,6 +66,11 @@ ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len)
     ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0, "hf:\"%*s\"", len, name);
 #endif
 
+    if (hash->size == 0) {
+        return ngx_hash_find_perfect((ngx_hash_perfect_t *) hash->buckets,
+                                     key, name, len);
+    }
+
     elt = hash->buckets[key % hash->size];
 
     if (elt == NULL) {
@@ -482,10 +534,237 @@ found:
 }
 
 
+/*
+ * the perfect hash places keys into nslots slots with no collisions:
+ * keys are split into nseeds groups, and each group, starting from
+ * the largest one, gets a seed which moves all its keys into free slots
+ */
+
+ngx_int_t
+ngx_hash_perfect_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+    ngx_uint_t nelts)
+{
+    u_char              *p, *used;
+    size_t               len;
+    uint32_t             seed;
+    uint64_t            *keys, *groups;
+    ngx_uint_t           i, j, k, n, g, s, nseeds, nslots;
+    ngx_uint_t          *index, *order, *start, *slot;
+    ngx_hash_slot_t     *hs;
+    ngx_hash_perfect_t  *ph;
+
+    n = 0;
+    len = 0;
+
+    for (i = 0; i < nelts; i++) {
+        if (names[i].key.data) {
+            n++;
+            len += names[i].key.len;
+        }
+    }
+
+    nseeds = n / 3 + 1;
+    nslots = n + n / 4 + 1;
+
+    keys = ngx_alloc(2 * n * sizeof(uint64_t) + nseeds * sizeof(uint64_t)
+                     + (3 * n + nseeds + 1) * sizeof(ngx_uint_t) + nslots,
+                     hinit->pool->log);
+    if (keys == NULL) {
+        return NGX_ERROR;
+    }
+
+    groups = keys + 2 * n;
+    index = (ngx_uint_t *) (groups + nseeds);
+    order = index + n;
+    slot = order + n;
+    start = slot + n;
+    used = (u_char *) (start + nseeds + 1);
+
+    for (i = 0, k = 0; i < nelts; i++) {
+        if (names[i].key.data) {
+            keys[n + k] = ngx_hash_perfect_key(names[i].key_hash);
+            keys[k] = keys[n + k];
+            index[k++] = i;
+        }
+    }
+
+    /* keys with equal hashes cannot be told apart */
+
+    ngx_qsort(keys, n, sizeof(uint64_t), ngx_hash_perfect_cmp);
+
+    for (k = 1; k < n; k++) {
+        if (keys[k] == keys[k - 1]) {
+            ngx_free(keys);
+            return ngx_hash_init(hinit, names, nelts);
+        }
+    }
+
+    keys += n;
+
+    ngx_memzero(start, (nseeds + 1) * sizeof(ngx_uint_t));
+
+    for (k = 0; k < n; k++) {
+        start[(keys[k] >> 32) % nseeds + 1]++;
+    }
+
+    for (g = 0; g < nseeds; g++) {
+        groups[g] = ((uint64_t) start[g + 1] << 32) | g;
+        start[g + 1] += start[g];
+    }
+
+    for (k = 0; k < n; k++) {
+        g = (keys[k] >> 32) % nseeds;
+        order[start[g]++] = k;
+    }
+
+    for (g = nseeds; g > 0; g--) {
+        start[g] = start[g - 1];
+    }
+
+    start[0] = 0;
+
+    /* the largest groups are placed first */
+
+    ngx_qsort(groups, nseeds, sizeof(uint64_t), ngx_hash_perfect_cmp);
+
+    ph = ngx_palloc(hinit->pool, sizeof(ngx_hash_perfect_t));
+    if (ph == NULL) {
+        goto failed;
+    }
+
+    ph->seeds = ngx_pcalloc(hinit->pool, nseeds * sizeof(uint32_t));
+    if (ph->seeds == NULL) {
+        goto failed;
+    }
+
+    ngx_memzero(used, nslots);
+
+    for (i = nseeds; i > 0; i--) {
+        g = (ngx_uint_t) (groups[i - 1] & 0xffffffff);
+
+        if (start[g] == start[g + 1]) {
+            break;
+        }
+
+        for (seed = 0; seed < NGX_HASH_PERFECT_TRIES; seed++) {
+
+            for (j = start[g]; j < start[g + 1]; j++) {
+                k = order[j];
+                s = ngx_hash_perfect_slot(keys[k], seed, nslots);
+
+                if (used[s]) {
+                    break;
+                }
+
+                used[s] = 1;
+                slot[k] = s;
+            }
+
+            if (j == start[g + 1]) {
+                break;
+            }
+
+            while (j-- > start[g]) {
+                used[slot[order[j]]] = 0;
+            }
+        }
+
+        if (seed == NGX_HASH_PERFECT_TRIES) {
+            ngx_log_error(NGX_LOG_WARN, hinit->pool->log, 0,
+                          "could not build perfect %s, using buckets",
+                          hinit->name);
+            ngx_free(keys - n);
+            return ngx_hash_init(hinit, names, nelts);
+        }
+
+        ph->seeds[g] = seed;
+    }
+
+    ph->nseeds = nseeds;
+    ph->nslots = nslots;
+
+    ph->slots = ngx_pcalloc(hinit->pool, nslots * sizeof(ngx_hash_slot_t));
+    if (ph->slots == NULL) {
+        goto failed;
+    }
+
+    p = ngx_pnalloc(hinit->pool, len);
+    if (p == NULL) {
+        goto failed;
+    }
+
+    for (k = 0; k < n; k++) {
+        hs = &ph->slots[slot[k]];
+        i = index[k];
+
+        hs->value = names[i].value;
+        hs->name = p;
+        hs->check = (uint32_t) keys[k];
+        hs->len = (u_short) names[i].key.len;
+
+        ngx_strlow(p, names[i].key.data, names[i].key.len);
+        p += names[i].key.len;
+    }
+
+    ngx_free(keys - n);
+
+    if (hinit->hash == NULL) {
+        hinit->hash = ngx_pcalloc(hinit->pool, sizeof(ngx_hash_wildcard_t));
+        if (hinit->hash == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    hinit->hash->buckets = (ngx_hash_elt_t **) ph;
+    hinit->hash->size = 0;
+
+    return NGX_OK;
+
+failed:
+
+    ngx_free(keys - n);
+
+    return NGX_ERROR;
+}
+
+
+static int ngx_libc_cdecl
+ngx_hash_perfect_cmp(const void *one, const void *two)
+{
+    uint64_t  first, second;
+
+    first = *(uint64_t *) one;
+    second = *(uint64_t *) two;
+
+    if (first == second) {
+        return 0;
+    }
+
+    return (first < second) ? -1 : 1;
+}
+
+
 ngx_int_t
 ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts)
 {
+    return ngx_hash_wildcard_build(hinit, names, nelts, 0);
+}
+
+
+ngx_int_t
+ngx_hash_wildcard_perfect_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+    ngx_uint_t nelts)
+{
+    return ngx_hash_wildcard_build(hinit, names, nelts, 1);
+}
+
+
+static ngx_int_t
+ngx_hash_wildcard_build(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+    ngx_uint_t nelts, ngx_uint_t perfect)
+{
+    ngx_int_t             rc;
     size_t                len, dot_len;
     ngx_uint_t            i, n, dot;
     ngx_array_t           curr_names, next_names;
@@ -596,8 +875,8 @@ ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
             h = *hinit;
             h.hash = NULL;
 
-            if (ngx_hash_wildcard_init(&h, (ngx_hash_key_t *) next_names.elts,
-                                       next_names.nelts)
+            if (ngx_hash_wildcard_build(&h, (ngx_hash_key_t *) next_names.elts,
+                                        next_names.nelts, perfect)
                 != NGX_OK)
             {
                 return NGX_ERROR;
@@ -616,10 +895,16 @@ ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
         }
     }
 
-    if (ngx_hash_init(hinit, (ngx_hash_key_t *) curr_names.elts,
-                      curr_names.nelts)
-        != NGX_OK)
-    {
+    if (perfect) {
+        rc = ngx_hash_perfect_init(hinit, (ngx_hash_key_t *) curr_names.elts,
+                                   curr_names.nelts);
+
+    } else {
+        rc = ngx_hash_init(hinit, (ngx_hash_key_t *) curr_names.elts,
+                           curr_names.nelts);
+    }
+
+    if (rc != NGX_OK) {
         return NGX_ERROR;
     }
 
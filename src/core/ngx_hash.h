@@ -20,12 +20,32 @@ typedef struct {
 } ngx_hash_elt_t;
 
 
+/*
+ * a perfect hash has zero size and buckets pointing to ngx_hash_perfect_t
+ */
+
 typedef struct {
     ngx_hash_elt_t  **buckets;
     ngx_uint_t        size;
 } ngx_hash_t;
 
 
+typedef struct {
+    void             *value;
+    u_char           *name;
+    uint32_t          check;
+    u_short           len;
+} ngx_hash_slot_t;
+
+
+typedef struct {
+    uint32_t         *seeds;
+    ngx_uint_t        nseeds;
+    ngx_hash_slot_t  *slots;
+    ngx_uint_t        nslots;
+} ngx_hash_perfect_t;
+
+
 typedef struct {
     ngx_hash_t        hash;
     void             *value;
@@ -107,6 +127,10 @@ ngx_int_t ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts);
 ngx_int_t ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts);
+ngx_int_t ngx_hash_perfect_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+    ngx_uint_t nelts);
+ngx_int_t ngx_hash_wildcard_perfect_init(ngx_hash_init_t *hinit,
+    ngx_hash_key_t *names, ngx_uint_t nelts);
 
 #define ngx_hash(key, c)   ((ngx_uint_t) key * 31 + c)
 ngx_uint_t ngx_hash_key(u_char *data, size_t len);
@@ -9,10 +9,79 @@
 #include <ngx_core.h>
 
 
+#if (NGX_POOL_PROFILE)
+
+#undef ngx_palloc
+#undef ngx_pcalloc
+#undef ngx_pnalloc
+
+#define NGX_POOL_PROFILE_SITES  4096
+
+
+typedef struct {
+    char                 *file;
+    ngx_uint_t            line;
+    ngx_uint_t            alloc;
+    ngx_uint_t            calls;
+    ngx_uint_t            large;
+    size_t                bytes;
+    size_t                max;
+} ngx_pool_site_t;
+
+
+typedef struct {
+    ngx_uint_t            pools;
+    ngx_uint_t            spilled;
+    ngx_uint_t            large;
+    size_t                bytes;
+    size_t                max;
+} ngx_pool_stat_t;
+
+
+static ngx_pool_site_t *ngx_pool_profile_site(char *file, ngx_uint_t line,
+    ngx_uint_t alloc);
+static int ngx_libc_cdecl ngx_pool_profile_cmp(const void *one,
+    const void *two);
+
+
+static ngx_pool_site_t  ngx_pool_sites[NGX_POOL_PROFILE_SITES];
+static ngx_uint_t       ngx_pool_sites_lost;
+static ngx_pool_stat_t  ngx_pool_stats[NGX_POOL_TYPES];
+
+static char  *ngx_pool_type_names[] = {
+    "temp", "cycle", "connection", "request"
+};
+
+static char  *ngx_pool_alloc_names[] = {
+    "palloc", "pcalloc", "pnalloc"
+};
+
+#endif
+
+
 static ngx_inline void *ngx_palloc_small(ngx_pool_t *pool, size_t size,
     ngx_uint_t align);
 static void *ngx_palloc_block(ngx_pool_t *pool, size_t size);
 static void *ngx_palloc_large(ngx_pool_t *pool, size_t size);
+static ngx_pool_t *ngx_get_cached_pool(size_t size);
+static ngx_int_t ngx_put_cached_pool(ngx_pool_t *pool);
+
+
+/*
+ * pools destroyed in a worker are kept on per size free lists linked
+ * through the "current" field and handed out again by ngx_create_pool()
+ */
+
+typedef struct {
+    size_t                size;
+    ngx_uint_t            number;
+    ngx_pool_t           *free;
+} ngx_pool_cache_slot_t;
+
+
+static ngx_pool_cache_slot_t  ngx_pool_cache[NGX_POOL_CACHE_SLOTS];
+
+ngx_uint_t  ngx_pool_cache_max;
 
 
 ngx_pool_t *
@@ -20,6 +89,19 @@ ngx_create_pool(size_t size, ngx_log_t *log)
 {
     ngx_pool_t  *p;
 
+    if (ngx_pool_cache_max) {
+        p = ngx_get_cached_pool(size);
+
+        if (p) {
+            p->log = log;
+#if (NGX_POOL_PROFILE)
+            p->type = NGX_POOL_TEMP;
+            p->allocated = 0;
+#endif
+            return p;
+        }
+    }
+
     p = ngx_memalign(NGX_POOL_ALIGNMENT, size, log);
     /*
         #define ngx_memalign(alignment, size, log)  ngx_alloc(size, log)，
@@ -64,6 +146,10 @@ ngx_create_pool(size_t size, ngx_log_t *log)
     p->large = NULL;
     p->cleanup = NULL;
     p->log = log;
+#if (NGX_POOL_PROFILE)
+    p->type = NGX_POOL_TEMP;
+    p->allocated = 0;
+#endif
     /*
         只有缓存池的父节点，才会用到这几个成员  ，子结点只挂载在p->d.next,并且只负责p->d的数据内容
         子结点没有不适用这几个成员，在创建子结点时last指向ngx_pool_data_t后的位置，之后的所有
@@ -116,6 +202,14 @@ ngx_destroy_pool(ngx_pool_t *pool)
 
 #endif
 
+#if (NGX_POOL_PROFILE)
+    ngx_pool_stats[pool->type].pools++;
+#endif
+
+    if (ngx_pool_cache_max && ngx_put_cached_pool(pool) == NGX_OK) {
+        return;
+    }
+
     for (l = pool->large; l; l = l->next) {
         if (l->alloc) {
             ngx_free(l->alloc);
@@ -553,30 +647,319 @@ ngx_pool_delete_file(void *data)
 }
 
 
-#if 0
 
-static void *
-ngx_get_cached_block(size_t size)
+static ngx_pool_t *
+ngx_get_cached_pool(size_t size)
 {
-    void                     *p;
-    ngx_cached_block_slot_t  *slot;
+    ngx_uint_t              i;
+    ngx_pool_t             *p;
+    ngx_pool_cache_slot_t  *slot;
 
-    if (ngx_cycle->cache == NULL) {
-        return NULL;
-    }
+    for (i = 0; i < NGX_POOL_CACHE_SLOTS; i++) {
+        slot = &ngx_pool_cache[i];
 
-    slot = &ngx_cycle->cache[(size + ngx_pagesize - 1) / ngx_pagesize];
+        if (slot->size != size) {
+            continue;
+        }
 
-    slot->tries++;
+        if (slot->number == 0) {
+            return NULL;
+        }
 
-    if (slot->number) {
-        p = slot->block;
-        slot->block = slot->block->next;
+        p = slot->free;
+        slot->free = p->current;
         slot->number--;
+
+        p->current = p;
+
         return p;
     }
 
     return NULL;
 }
 
+
+static ngx_int_t
+ngx_put_cached_pool(ngx_pool_t *pool)
+{
+    size_t                  size;
+    ngx_uint_t              i, n;
+    ngx_pool_t             *p, *next;
+    ngx_pool_large_t       *l;
+    ngx_pool_cache_slot_t  *slot, *empty;
+
+    size = (size_t) (pool->d.end - (u_char *) pool);
+
+    slot = NULL;
+    empty = NULL;
+
+    for (i = 0; i < NGX_POOL_CACHE_SLOTS; i++) {
+
+        if (ngx_pool_cache[i].size == size) {
+            slot = &ngx_pool_cache[i];
+            break;
+        }
+
+        if (empty == NULL && ngx_pool_cache[i].size == 0) {
+            empty = &ngx_pool_cache[i];
+        }
+    }
+
+    if (slot == NULL) {
+        if (empty == NULL) {
+            return NGX_DECLINED;
+        }
+
+        slot = empty;
+        slot->size = size;
+    }
+
+    if (slot->number >= ngx_pool_cache_max) {
+        return NGX_DECLINED;
+    }
+
+    for (l = pool->large; l; l = l->next) {
+        if (l->alloc) {
+            ngx_free(l->alloc);
+        }
+    }
+
+    pool->d.last = (u_char *) pool + sizeof(ngx_pool_t);
+    pool->d.failed = 0;
+
+    /* keep a few blocks the pool has grown to, free the rest */
+
+    n = 1;
+
+    for (p = pool; p->d.next; p = p->d.next) {
+
+        if (n++ == NGX_POOL_CACHE_BLOCKS) {
+            next = p->d.next;
+            p->d.next = NULL;
+
+            while (next) {
+                p = next;
+                next = p->d.next;
+                ngx_free(p);
+            }
+
+            break;
+        }
+
+        next = p->d.next;
+        next->d.last = ngx_align_ptr((u_char *) next + sizeof(ngx_pool_data_t),
+                                     NGX_ALIGNMENT);
+        next->d.failed = 0;
+    }
+
+    pool->chain = NULL;
+    pool->large = NULL;
+    pool->cleanup = NULL;
+
+    pool->current = slot->free;
+    slot->free = pool;
+    slot->number++;
+
+    return NGX_OK;
+}
+
+
+void
+ngx_pool_flush_cache(void)
+{
+    ngx_uint_t              i;
+    ngx_pool_t             *p, *n;
+    ngx_pool_cache_slot_t  *slot;
+
+    ngx_pool_cache_max = 0;
+
+    for (i = 0; i < NGX_POOL_CACHE_SLOTS; i++) {
+        slot = &ngx_pool_cache[i];
+
+        while (slot->free) {
+            p = slot->free;
+            slot->free = p->current;
+
+            do {
+                n = p->d.next;
+                ngx_free(p);
+                p = n;
+            } while (p);
+        }
+
+        slot->number = 0;
+    }
+}
+
+
+#if (NGX_POOL_PROFILE)
+
+void *
+ngx_palloc_profile(ngx_pool_t *pool, size_t size, ngx_uint_t alloc,
+    char *file, ngx_uint_t line)
+{
+    void             *p;
+    ngx_uint_t        large;
+    ngx_pool_site_t  *site;
+    ngx_pool_stat_t  *stat;
+
+    switch (alloc) {
+
+    case NGX_POOL_PCALLOC:
+        p = ngx_pcalloc(pool, size);
+        break;
+
+    case NGX_POOL_PNALLOC:
+        p = ngx_pnalloc(pool, size);
+        break;
+
+    default: /* NGX_POOL_PALLOC */
+        p = ngx_palloc(pool, size);
+    }
+
+    if (p == NULL) {
+        return NULL;
+    }
+
+#if (NGX_DEBUG_PALLOC)
+    large = 1;
+#else
+    large = (size > pool->max);
+#endif
+
+    site = ngx_pool_profile_site(file, line, alloc);
+
+    if (site) {
+        site->calls++;
+        site->large += large;
+        site->bytes += size;
+
+        if (size > site->max) {
+            site->max = size;
+        }
+    }
+
+    stat = &ngx_pool_stats[pool->type];
+
+    stat->bytes += size;
+    stat->large += large;
+
+    /* allocations which did not fit into the first block of the pool */
+
+    if (!large
+        && ((u_char *) p < (u_char *) pool || (u_char *) p >= pool->d.end))
+    {
+        stat->spilled++;
+    }
+
+    pool->allocated += size;
+
+    if (pool->allocated > stat->max) {
+        stat->max = pool->allocated;
+    }
+
+    return p;
+}
+
+
+static ngx_pool_site_t *
+ngx_pool_profile_site(char *file, ngx_uint_t line, ngx_uint_t alloc)
+{
+    ngx_uint_t        i, n;
+    ngx_pool_site_t  *site;
+
+    i = (((uintptr_t) file >> 3) ^ (line * 2654435761u))
+        % NGX_POOL_PROFILE_SITES;
+
+    for (n = 0; n < NGX_POOL_PROFILE_SITES; n++) {
+        site = &ngx_pool_sites[i];
+
+        if (site->file == file && site->line == line) {
+            return site;
+        }
+
+        if (site->file == NULL) {
+            site->file = file;
+            site->line = line;
+            site->alloc = alloc;
+            return site;
+        }
+
+        i = (i + 1) % NGX_POOL_PROFILE_SITES;
+    }
+
+    ngx_pool_sites_lost++;
+
+    return NULL;
+}
+
+
+void
+ngx_pool_profile_report(ngx_log_t *log)
+{
+    ngx_uint_t        i, n;
+    ngx_pool_site_t  *site, **sites;
+    ngx_pool_stat_t  *stat;
+
+    for (i = 0; i < NGX_POOL_TYPES; i++) {
+        stat = &ngx_pool_stats[i];
+
+        ngx_log_error(NGX_LOG_NOTICE, log, 0,
+                      "pool profile: %s pools:%ui bytes:%uz max:%uz "
+                      "spilled:%ui large:%ui",
+                      ngx_pool_type_names[i], stat->pools, stat->bytes,
+                      stat->max, stat->spilled, stat->large);
+    }
+
+    sites = ngx_alloc(NGX_POOL_PROFILE_SITES * sizeof(ngx_pool_site_t *),
+                      log);
+    if (sites == NULL) {
+        return;
+    }
+
+    n = 0;
+
+    for (i = 0; i < NGX_POOL_PROFILE_SITES; i++) {
+        if (ngx_pool_sites[i].file) {
+            sites[n++] = &ngx_pool_sites[i];
+        }
+    }
+
+    ngx_qsort(sites, n, sizeof(ngx_pool_site_t *), ngx_pool_profile_cmp);
+
+    for (i = 0; i < n; i++) {
+        site = sites[i];
+
+        ngx_log_error(NGX_LOG_NOTICE, log, 0,
+                      "pool profile: %s:%ui %s calls:%ui bytes:%uz max:%uz "
+                      "large:%ui",
+                      site->file, site->line, ngx_pool_alloc_names[site->alloc],
+                      site->calls, site->bytes, site->max, site->large);
+    }
+
+    if (ngx_pool_sites_lost) {
+        ngx_log_error(NGX_LOG_NOTICE, log, 0,
+                      "pool profile: %ui allocations from untracked sites",
+                      ngx_pool_sites_lost);
+    }
+
+    ngx_free(sites);
+}
+
+
+static int ngx_libc_cdecl
+ngx_pool_profile_cmp(const void *one, const void *two)
+{
+    ngx_pool_site_t  *first, *second;
+
+    first = *(ngx_pool_site_t **) one;
+    second = *(ngx_pool_site_t **) two;
+
+    if (first->bytes == second->bytes) {
+        return 0;
+    }
+
+    return (first->bytes < second->bytes) ? 1 : -1;
+}
+
 #endif
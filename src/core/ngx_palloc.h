@@ -13,7 +13,6 @@
 #include <ngx_core.h>
 
 
-ngx_destroy_pool
 #define NGX_MAX_ALLOC_FROM_POOL  (ngx_pagesize - 1)
 
 #define NGX_DEFAULT_POOL_SIZE    (16 * 1024)
@@ -23,6 +22,15 @@ ngx_destroy_pool
     ngx_align((sizeof(ngx_pool_t) + 2 * sizeof(ngx_pool_large_t)),            \
               NGX_POOL_ALIGNMENT)
 
+#define NGX_POOL_CACHE_SLOTS     8
+#define NGX_POOL_CACHE_BLOCKS    4
+
+#define NGX_POOL_TEMP            0
+#define NGX_POOL_CYCLE           1
+#define NGX_POOL_CONNECTION      2
+#define NGX_POOL_REQUEST         3
+#define NGX_POOL_TYPES           4
+
 
 typedef void (*ngx_pool_cleanup_pt)(void *data);
 
@@ -59,6 +67,10 @@ struct ngx_pool_s {
     ngx_pool_large_t     *large;    /* 存储大数据的链表 */
     ngx_pool_cleanup_t   *cleanup;  /* 可自定义回调函数，清除内存块分配的内存 */
     ngx_log_t            *log;      /* 日志 */
+#if (NGX_POOL_PROFILE)
+    ngx_uint_t            type;
+    size_t                allocated;
+#endif
 };
 
 
@@ -104,5 +116,37 @@ void ngx_pool_cleanup_file(void *data);
 // 删除文件回调函数
 void ngx_pool_delete_file(void *data);
 
+void ngx_pool_flush_cache(void);
+
+
+#if (NGX_POOL_PROFILE)
+
+#define NGX_POOL_PALLOC          0
+#define NGX_POOL_PCALLOC         1
+#define NGX_POOL_PNALLOC         2
+
+void *ngx_palloc_profile(ngx_pool_t *pool, size_t size, ngx_uint_t alloc,
+    char *file, ngx_uint_t line);
+void ngx_pool_profile_report(ngx_log_t *log);
+
+#define ngx_palloc(pool, size)                                                \
+    ngx_palloc_profile(pool, size, NGX_POOL_PALLOC, __FILE__, __LINE__)
+#define ngx_pcalloc(pool, size)                                               \
+    ngx_palloc_profile(pool, size, NGX_POOL_PCALLOC, __FILE__, __LINE__)
+#define ngx_pnalloc(pool, size)                                               \
+    ngx_palloc_profile(pool, size, NGX_POOL_PNALLOC, __FILE__, __LINE__)
+
+#define ngx_pool_set_type(pool, t)  (pool)->type = t
+
+#else
+
+#define ngx_pool_set_type(pool, t)
+#define ngx_pool_profile_report(log)
+
+#endif
+
+
+extern ngx_uint_t  ngx_pool_cache_max;
+
 
 #endif /* _NGX_PALLOC_H_INCLUDED_ */
@@ -9,7 +9,131 @@
 #include <ngx_core.h>
 
 
+typedef struct {
+    ngx_array_t        nodes;
+    ngx_array_t        leaves;
+    ngx_uint_t         width;
+} ngx_radix_poptrie_build_t;
+
+
 static ngx_radix_node_t *ngx_radix_alloc(ngx_radix_tree_t *tree);
+static ngx_int_t ngx_radix_poptrie_compile(ngx_radix_tree_t *tree,
+    ngx_uint_t width);
+static ngx_int_t ngx_radix_poptrie_node(ngx_radix_poptrie_build_t *b,
+    ngx_uint_t index, ngx_radix_node_t *rnode, ngx_uint_t depth,
+    uintptr_t value);
+static ngx_radix_node_t *ngx_radix_poptrie_descend(ngx_radix_node_t *node,
+    ngx_uint_t slot, ngx_uint_t bits, ngx_uint_t depth, ngx_uint_t width,
+    uintptr_t *value);
+static ngx_uint_t ngx_radix_count(ngx_radix_node_t *node);
+
+
+#if (NGX_HAVE_GCC_POPCOUNT64)
+
+#define ngx_radix_popcount(x)  __builtin_popcountll(x)
+
+#else
+
+static ngx_inline ngx_uint_t
+ngx_radix_popcount(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+
+    return (ngx_uint_t) ((x * 0x0101010101010101ULL) >> 56);
+}
+
+#endif
+
+/* the bitmap of slots from 0 to "v" inclusive */
+#define ngx_radix_slots(v)     ((((uint64_t) 2) << (v)) - 1)
+
+
+static ngx_inline uintptr_t
+ngx_radix32poptrie_find(ngx_radix_poptrie_t *pt, uint32_t key)
+{
+    uint32_t            n;
+    uint64_t            bits;
+    ngx_uint_t          v;
+    ngx_radix_pnode_t  *node;
+
+    bits = (uint64_t) key << 32;
+
+    n = pt->direct[bits >> (64 - pt->bits)];
+
+    if (n & NGX_RADIX_POPTRIE_LEAF) {
+        return pt->leaves[n & ~NGX_RADIX_POPTRIE_LEAF];
+    }
+
+    node = &pt->nodes[n];
+    bits <<= pt->bits;
+
+    for ( ;; ) {
+        v = (ngx_uint_t) (bits >> 58);
+
+        if (!(node->vector & ((uint64_t) 1 << v))) {
+            break;
+        }
+
+        n = ngx_radix_popcount(node->vector & ngx_radix_slots(v));
+        node = &pt->nodes[node->base1 + n - 1];
+        bits <<= 6;
+    }
+
+    n = ngx_radix_popcount(node->leafvec & ngx_radix_slots(v));
+
+    return pt->leaves[node->base0 + n - 1];
+}
+
+
+#if (NGX_HAVE_INET6)
+
+static ngx_inline uintptr_t
+ngx_radix128poptrie_find(ngx_radix_poptrie_t *pt, u_char *key)
+{
+    uint32_t            n;
+    uint64_t            hi, lo;
+    ngx_uint_t          i, v;
+    ngx_radix_pnode_t  *node;
+
+    hi = 0;
+    lo = 0;
+
+    for (i = 0; i < 8; i++) {
+        hi = (hi << 8) | key[i];
+        lo = (lo << 8) | key[i + 8];
+    }
+
+    n = pt->direct[hi >> (64 - pt->bits)];
+
+    if (n & NGX_RADIX_POPTRIE_LEAF) {
+        return pt->leaves[n & ~NGX_RADIX_POPTRIE_LEAF];
+    }
+
+    node = &pt->nodes[n];
+    hi = (hi << pt->bits) | (lo >> (64 - pt->bits));
+    lo <<= pt->bits;
+
+    for ( ;; ) {
+        v = (ngx_uint_t) (hi >> 58);
+
+        if (!(node->vector & ((uint64_t) 1 << v))) {
+            break;
+        }
+
+        n = ngx_radix_popcount(node->vector & ngx_radix_slots(v));
+        node = &pt->nodes[node->base1 + n - 1];
+        hi = (hi << 6) | (lo >> 58);
+        lo <<= 6;
+    }
+
+    n = ngx_radix_popcount(node->leafvec & ngx_radix_slots(v));
+
+    return pt->leaves[node->base0 + n - 1];
+}
+
+#endif
 
 
 ngx_radix_tree_t *
@@ -27,6 +151,7 @@ ngx_radix_tree_create(ngx_pool_t *pool, ngx_int_t preallocate)
     tree->free = NULL;
     tree->start = NULL;
     tree->size = 0;
+    tree->poptrie = NULL;
 
     tree->root = ngx_radix_alloc(tree);
     if (tree->root == NULL) {
@@ -112,6 +237,8 @@ ngx_radix32tree_insert(ngx_radix_tree_t *tree, uint32_t key, uint32_t mask,
     uint32_t           bit;
     ngx_radix_node_t  *node, *next;
 
+    tree->poptrie = NULL;
+
     bit = 0x80000000;
 
     node = tree->root;
@@ -176,6 +303,8 @@ ngx_radix32tree_delete(ngx_radix_tree_t *tree, uint32_t key, uint32_t mask)
     uint32_t           bit;
     ngx_radix_node_t  *node;
 
+    tree->poptrie = NULL;
+
     bit = 0x80000000;
     node = tree->root;
 
@@ -240,6 +369,10 @@ ngx_radix32tree_find(ngx_radix_tree_t *tree, uint32_t key)
     uintptr_t          value;
     ngx_radix_node_t  *node;
 
+    if (tree->poptrie) {
+        return ngx_radix32poptrie_find(tree->poptrie, key);
+    }
+
     bit = 0x80000000;
     value = NGX_RADIX_NO_VALUE;
     node = tree->root;
@@ -263,6 +396,43 @@ ngx_radix32tree_find(ngx_radix_tree_t *tree, uint32_t key)
 }
 
 
+/* the longest match among the prefixes not longer than "mask" */
+
+uintptr_t
+ngx_radix32tree_find_prefix(ngx_radix_tree_t *tree, uint32_t key,
+    uint32_t mask)
+{
+    uint32_t           bit;
+    uintptr_t          value;
+    ngx_radix_node_t  *node;
+
+    bit = 0x80000000;
+    value = NGX_RADIX_NO_VALUE;
+    node = tree->root;
+
+    while (node) {
+        if (node->value != NGX_RADIX_NO_VALUE) {
+            value = node->value;
+        }
+
+        if (!(mask & bit)) {
+            break;
+        }
+
+        if (key & bit) {
+            node = node->right;
+
+        } else {
+            node = node->left;
+        }
+
+        bit >>= 1;
+    }
+
+    return value;
+}
+
+
 #if (NGX_HAVE_INET6)
 
 ngx_int_t
@@ -273,6 +443,8 @@ ngx_radix128tree_insert(ngx_radix_tree_t *tree, u_char *key, u_char *mask,
     ngx_uint_t         i;
     ngx_radix_node_t  *node, *next;
 
+    tree->poptrie = NULL;
+
     i = 0;
     bit = 0x80;
 
@@ -355,6 +527,8 @@ ngx_radix128tree_delete(ngx_radix_tree_t *tree, u_char *key, u_char *mask)
     ngx_uint_t         i;
     ngx_radix_node_t  *node;
 
+    tree->poptrie = NULL;
+
     i = 0;
     bit = 0x80;
     node = tree->root;
@@ -429,6 +603,48 @@ ngx_radix128tree_find(ngx_radix_tree_t *tree, u_char *key)
     ngx_uint_t         i;
     ngx_radix_node_t  *node;
 
+    if (tree->poptrie) {
+        return ngx_radix128poptrie_find(tree->poptrie, key);
+    }
+
+    i = 0;
+    bit = 0x80;
+    value = NGX_RADIX_NO_VALUE;
+    node = tree->root;
+
+    while (node) {
+        if (node->value != NGX_RADIX_NO_VALUE) {
+            value = node->value;
+        }
+
+        if (key[i] & bit) {
+            node = node->right;
+
+        } else {
+            node = node->left;
+        }
+
+        bit >>= 1;
+
+        if (bit == 0) {
+            i++;
+            bit = 0x80;
+        }
+    }
+
+    return value;
+}
+
+
+uintptr_t
+ngx_radix128tree_find_prefix(ngx_radix_tree_t *tree, u_char *key,
+    u_char *mask)
+{
+    u_char             bit;
+    uintptr_t          value;
+    ngx_uint_t         i;
+    ngx_radix_node_t  *node;
+
     i = 0;
     bit = 0x80;
     value = NGX_RADIX_NO_VALUE;
@@ -439,6 +655,10 @@ ngx_radix128tree_find(ngx_radix_tree_t *tree, u_char *key)
             value = node->value;
         }
 
+        if (i == 16 || !(mask[i] & bit)) {
+            break;
+        }
+
         if (key[i] & bit) {
             node = node->right;
 
@@ -460,6 +680,299 @@ ngx_radix128tree_find(ngx_radix_tree_t *tree, u_char *key)
 #endif
 
 
+ngx_int_t
+ngx_radix32tree_compile(ngx_radix_tree_t *tree)
+{
+    return ngx_radix_poptrie_compile(tree, 32);
+}
+
+
+#if (NGX_HAVE_INET6)
+
+ngx_int_t
+ngx_radix128tree_compile(ngx_radix_tree_t *tree)
+{
+    return ngx_radix_poptrie_compile(tree, 128);
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_radix_poptrie_compile(ngx_radix_tree_t *tree, ngx_uint_t width)
+{
+    uint32_t                    *direct, n;
+    uintptr_t                    value, *leaf;
+    ngx_int_t                    rc;
+    ngx_uint_t                   i, last;
+    ngx_pool_t                  *pool;
+    ngx_radix_node_t            *child;
+    ngx_radix_pnode_t           *node;
+    ngx_radix_poptrie_t         *pt;
+    ngx_radix_poptrie_build_t    b;
+
+    pt = ngx_palloc(tree->pool, sizeof(ngx_radix_poptrie_t));
+    if (pt == NULL) {
+        return NGX_ERROR;
+    }
+
+    /* small trees do not need a large direct array */
+
+    pt->bits = (ngx_radix_count(tree->root) < 16384) ? 8 : 16;
+
+    pt->direct = ngx_palloc(tree->pool, sizeof(uint32_t) << pt->bits);
+    if (pt->direct == NULL) {
+        return NGX_ERROR;
+    }
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, tree->pool->log);
+    if (pool == NULL) {
+        return NGX_ERROR;
+    }
+
+    rc = NGX_ERROR;
+
+    if (ngx_array_init(&b.nodes, pool, 64, sizeof(ngx_radix_pnode_t))
+        != NGX_OK)
+    {
+        goto done;
+    }
+
+    if (ngx_array_init(&b.leaves, pool, 64, sizeof(uintptr_t)) != NGX_OK) {
+        goto done;
+    }
+
+    b.width = width;
+
+    direct = pt->direct;
+    last = (ngx_uint_t) -1;
+
+    for (i = 0; i < ((ngx_uint_t) 1 << pt->bits); i++) {
+
+        value = tree->root->value;
+        child = ngx_radix_poptrie_descend(tree->root, i, pt->bits, 0, width,
+                                          &value);
+
+        if (child) {
+            n = (uint32_t) b.nodes.nelts;
+
+            node = ngx_array_push(&b.nodes);
+            if (node == NULL) {
+                goto done;
+            }
+
+            if (ngx_radix_poptrie_node(&b, n, child, pt->bits, value)
+                != NGX_OK)
+            {
+                goto done;
+            }
+
+            direct[i] = n;
+            last = (ngx_uint_t) -1;
+            continue;
+        }
+
+        if (last != (ngx_uint_t) -1
+            && ((uintptr_t *) b.leaves.elts)[last] == value)
+        {
+            direct[i] = (uint32_t) last | NGX_RADIX_POPTRIE_LEAF;
+            continue;
+        }
+
+        last = b.leaves.nelts;
+
+        leaf = ngx_array_push(&b.leaves);
+        if (leaf == NULL) {
+            goto done;
+        }
+
+        *leaf = value;
+        direct[i] = (uint32_t) last | NGX_RADIX_POPTRIE_LEAF;
+    }
+
+    if (b.nodes.nelts >= NGX_RADIX_POPTRIE_LEAF
+        || b.leaves.nelts >= NGX_RADIX_POPTRIE_LEAF)
+    {
+        goto done;
+    }
+
+    pt->nodes = NULL;
+
+    if (b.nodes.nelts) {
+        pt->nodes = ngx_palloc(tree->pool,
+                               b.nodes.nelts * sizeof(ngx_radix_pnode_t));
+        if (pt->nodes == NULL) {
+            goto done;
+        }
+
+        ngx_memcpy(pt->nodes, b.nodes.elts,
+                   b.nodes.nelts * sizeof(ngx_radix_pnode_t));
+    }
+
+    pt->leaves = ngx_palloc(tree->pool, b.leaves.nelts * sizeof(uintptr_t));
+    if (pt->leaves == NULL) {
+        goto done;
+    }
+
+    ngx_memcpy(pt->leaves, b.leaves.elts, b.leaves.nelts * sizeof(uintptr_t));
+
+    ngx_log_debug4(NGX_LOG_DEBUG_CORE, tree->pool->log, 0,
+                   "radix%ui poptrie: %ui direct bits, %ui nodes, %ui leaves",
+                   width, pt->bits, b.nodes.nelts, b.leaves.nelts);
+
+    tree->poptrie = pt;
+
+    rc = NGX_OK;
+
+done:
+
+    ngx_destroy_pool(pool);
+
+    return rc;
+}
+
+
+static ngx_int_t
+ngx_radix_poptrie_node(ngx_radix_poptrie_build_t *b, ngx_uint_t index,
+    ngx_radix_node_t *rnode, ngx_uint_t depth, uintptr_t value)
+{
+    uint64_t            vector, leafvec;
+    uint32_t            base0, base1;
+    uintptr_t           values[64], *leaf;
+    ngx_uint_t          i, n, first;
+    ngx_radix_node_t   *children[64];
+    ngx_radix_pnode_t  *node;
+
+    vector = 0;
+    n = 0;
+
+    for (i = 0; i < 64; i++) {
+        values[i] = value;
+        children[i] = ngx_radix_poptrie_descend(rnode, i, 6, depth, b->width,
+                                                &values[i]);
+        if (children[i]) {
+            vector |= (uint64_t) 1 << i;
+            n++;
+        }
+    }
+
+    base1 = (uint32_t) b->nodes.nelts;
+
+    if (n && ngx_array_push_n(&b->nodes, n) == NULL) {
+        return NGX_ERROR;
+    }
+
+    base0 = (uint32_t) b->leaves.nelts;
+    leafvec = 0;
+    first = 1;
+
+    for (i = 0; i < 64; i++) {
+
+        if (children[i]) {
+            continue;
+        }
+
+        if (!first && values[i] == ((uintptr_t *) b->leaves.elts)
+                                   [b->leaves.nelts - 1])
+        {
+            continue;
+        }
+
+        leaf = ngx_array_push(&b->leaves);
+        if (leaf == NULL) {
+            return NGX_ERROR;
+        }
+
+        *leaf = values[i];
+        leafvec |= (uint64_t) 1 << i;
+        first = 0;
+    }
+
+    node = &((ngx_radix_pnode_t *) b->nodes.elts)[index];
+
+    node->vector = vector;
+    node->leafvec = leafvec;
+    node->base0 = base0;
+    node->base1 = base1;
+
+    for (i = 0; i < 64; i++) {
+
+        if (children[i] == NULL) {
+            continue;
+        }
+
+        if (ngx_radix_poptrie_node(b, base1++, children[i], depth + 6,
+                                   values[i])
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+/*
+ * follows "bits" bits of "slot" from "node" at "depth" updating the
+ * longest match value, returns the node reached if there are more
+ * specific prefixes below it
+ */
+
+static ngx_radix_node_t *
+ngx_radix_poptrie_descend(ngx_radix_node_t *node, ngx_uint_t slot,
+    ngx_uint_t bits, ngx_uint_t depth, ngx_uint_t width, uintptr_t *value)
+{
+    ngx_uint_t  i;
+
+    for (i = 0; i < bits; i++) {
+
+        if (depth + i == width) {
+            return NULL;
+        }
+
+        if (slot & ((ngx_uint_t) 1 << (bits - 1 - i))) {
+            node = node->right;
+
+        } else {
+            node = node->left;
+        }
+
+        if (node == NULL) {
+            return NULL;
+        }
+
+        if (node->value != NGX_RADIX_NO_VALUE) {
+            *value = node->value;
+        }
+    }
+
+    if (depth + bits >= width
+        || (node->left == NULL && node->right == NULL))
+    {
+        return NULL;
+    }
+
+    return node;
+}
+
+
+static ngx_uint_t
+ngx_radix_count(ngx_radix_node_t *node)
+{
+    ngx_uint_t  n;
+
+    n = 0;
+
+    while (node) {
+        n += 1 + ngx_radix_count(node->left);
+        node = node->right;
+    }
+
+    return n;
+}
+
+
 static ngx_radix_node_t *
 ngx_radix_alloc(ngx_radix_tree_t *tree)
 {
@@ -25,12 +25,38 @@ struct ngx_radix_node_s {
 };
 
 
+/*
+ * a compiled tree is a Poptrie: the first "bits" bits of a key index
+ * the direct array, further levels are 64-ary nodes with bitmaps of
+ * internal children and of leaf runs, children and leaves are addressed
+ * by population counts of the bitmaps
+ */
+
+#define NGX_RADIX_POPTRIE_LEAF  0x80000000
+
+typedef struct {
+    uint64_t           vector;
+    uint64_t           leafvec;
+    uint32_t           base0;
+    uint32_t           base1;
+} ngx_radix_pnode_t;
+
+
+typedef struct {
+    ngx_uint_t          bits;
+    uint32_t           *direct;
+    ngx_radix_pnode_t  *nodes;
+    uintptr_t          *leaves;
+} ngx_radix_poptrie_t;
+
+
 typedef struct {
-    ngx_radix_node_t  *root;
-    ngx_pool_t        *pool;
-    ngx_radix_node_t  *free;
-    char              *start;
-    size_t             size;
+    ngx_radix_node_t     *root;
+    ngx_pool_t           *pool;
+    ngx_radix_node_t     *free;
+    char                 *start;
+    size_t                size;
+    ngx_radix_poptrie_t  *poptrie;
 } ngx_radix_tree_t;
 
 
@@ -42,6 +68,9 @@ ngx_int_t ngx_radix32tree_insert(ngx_radix_tree_t *tree,
 ngx_int_t ngx_radix32tree_delete(ngx_radix_tree_t *tree,
     uint32_t key, uint32_t mask);
 uintptr_t ngx_radix32tree_find(ngx_radix_tree_t *tree, uint32_t key);
+uintptr_t ngx_radix32tree_find_prefix(ngx_radix_tree_t *tree, uint32_t key,
+    uint32_t mask);
+ngx_int_t ngx_radix32tree_compile(ngx_radix_tree_t *tree);
 
 #if (NGX_HAVE_INET6)
 ngx_int_t ngx_radix128tree_insert(ngx_radix_tree_t *tree,
@@ -49,6 +78,9 @@ ngx_int_t ngx_radix128tree_insert(ngx_radix_tree_t *tree,
 ngx_int_t ngx_radix128tree_delete(ngx_radix_tree_t *tree,
     u_char *key, u_char *mask);
 uintptr_t ngx_radix128tree_find(ngx_radix_tree_t *tree, u_char *key);
+uintptr_t ngx_radix128tree_find_prefix(ngx_radix_tree_t *tree, u_char *key,
+    u_char *mask);
+ngx_int_t ngx_radix128tree_compile(ngx_radix_tree_t *tree);
 #endif
 
 
@@ -9,23 +9,63 @@
 #include <ngx_core.h>
 
 
+#define NGX_REGEX_CACHE_MAGIC  0x5845474e    /* "NGEX" */
+
+
 typedef struct {
-    ngx_flag_t  pcre_jit;
+    ngx_flag_t         pcre_jit;
+    size_t             jit_stack_size;
+    ngx_str_t          cache;
 } ngx_regex_conf_t;
 
 
+typedef struct {
+    ngx_str_node_t     sn;
+    ngx_int_t          options;
+    ngx_regex_t        regex;
+    ngx_uint_t         refs;
+    ngx_uint_t         generation;
+    unsigned           studied:1;
+    unsigned           jit:1;
+} ngx_regex_node_t;
+
+
+#if (NGX_PCRE2)
+static void *ngx_regex_malloc(size_t size, void *data);
+static void ngx_regex_free(void *p, void *data);
+#else
 static void * ngx_libc_cdecl ngx_regex_malloc(size_t size);
 static void ngx_libc_cdecl ngx_regex_free(void *p);
-#if (NGX_HAVE_PCRE_JIT)
-static void ngx_pcre_free_studies(void *data);
 #endif
 
+static ngx_int_t ngx_regex_compile_code(ngx_regex_compile_t *rc,
+    ngx_regex_t *re, ngx_pool_t *pool);
+static ngx_int_t ngx_regex_info(ngx_regex_compile_t *rc);
+static void ngx_regex_study(ngx_cycle_t *cycle, ngx_regex_node_t *node,
+    ngx_uint_t jit);
+static void ngx_regex_free_node(ngx_regex_node_t *node);
+static void ngx_regex_cleanup(void *data);
+static ngx_int_t ngx_regex_jit_stack(ngx_cycle_t *cycle, size_t size);
+#if (NGX_PCRE2)
+static void ngx_regex_cache_read(ngx_conf_t *cf, ngx_str_t *name);
+static void ngx_regex_cache_write(ngx_cycle_t *cycle, ngx_str_t *name);
+#endif
+
+static ngx_int_t ngx_regex_literal(ngx_str_t *pattern, u_char *buf,
+    ngx_str_t *prefix, ngx_str_t *literal, ngx_uint_t *caseless);
+static u_char *ngx_regex_skip_class(u_char *p, u_char *last);
+static u_char *ngx_regex_skip_quantifier(u_char *p, u_char *last,
+    ngx_uint_t *optional);
+
 static ngx_int_t ngx_regex_module_init(ngx_cycle_t *cycle);
 
 static void *ngx_regex_create_conf(ngx_cycle_t *cycle);
 static char *ngx_regex_init_conf(ngx_cycle_t *cycle, void *conf);
 
 static char *ngx_regex_pcre_jit(ngx_conf_t *cf, void *post, void *data);
+static char *ngx_regex_pcre_cache(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+
 static ngx_conf_post_t  ngx_regex_pcre_jit_post = { ngx_regex_pcre_jit };
 
 
@@ -38,6 +78,20 @@ static ngx_command_t  ngx_regex_commands[] = {
       offsetof(ngx_regex_conf_t, pcre_jit),
       &ngx_regex_pcre_jit_post },
 
+    { ngx_string("pcre_jit_stack_size"),
+      NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      0,
+      offsetof(ngx_regex_conf_t, jit_stack_size),
+      NULL },
+
+    { ngx_string("pcre_cache"),
+      NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_TAKE1,
+      ngx_regex_pcre_cache,
+      0,
+      0,
+      NULL },
+
       ngx_null_command
 };
 
@@ -65,15 +119,47 @@ ngx_module_t  ngx_regex_module = {
 };
 
 
-static ngx_pool_t  *ngx_pcre_pool;
-static ngx_list_t  *ngx_pcre_studies;
+static ngx_pool_t             *ngx_pcre_pool;
+
+/*
+ * compiled regexes are shared by all configuration cycles of a process:
+ * the tree is keyed by pattern and options, and the list holds the nodes
+ * referenced by the cycle being configured
+ */
+
+static ngx_rbtree_t            ngx_regex_tree;
+static ngx_rbtree_node_t       ngx_regex_sentinel;
+static ngx_list_t             *ngx_regex_nodes;
+static ngx_uint_t              ngx_regex_generation;
+static ngx_uint_t              ngx_regex_cache_dirty;
+static size_t                  ngx_regex_jit_stack_size;
+
+#if (NGX_PCRE2)
+
+static pcre2_compile_context  *ngx_regex_compile_context;
+static pcre2_match_context    *ngx_regex_match_context;
+static pcre2_match_data       *ngx_regex_match_data;
+static ngx_uint_t              ngx_regex_match_data_size;
+static uint32_t                ngx_regex_match_options;
+static pcre2_jit_stack        *ngx_regex_jit_stack_ptr;
+
+#elif (NGX_HAVE_PCRE_JIT)
+
+static pcre_jit_stack         *ngx_regex_jit_stack_ptr;
+
+#endif
 
 
 void
 ngx_regex_init(void)
 {
+#if !(NGX_PCRE2)
     pcre_malloc = ngx_regex_malloc;
     pcre_free = ngx_regex_free;
+#endif
+
+    ngx_rbtree_init(&ngx_regex_tree, &ngx_regex_sentinel,
+                    ngx_str_rbtree_insert_value);
 }
 
 
@@ -94,21 +180,291 @@ ngx_regex_malloc_done(void)
 ngx_int_t
 ngx_regex_compile(ngx_regex_compile_t *rc)
 {
-    int               n, erroff;
-    char             *p;
-    pcre             *re;
-    const char       *errstr;
-    ngx_regex_elt_t  *elt;
+    uint32_t           hash;
+    ngx_regex_node_t  *node, **np;
+
+    if (ngx_regex_nodes == NULL) {
+
+        /* regexes compiled at runtime are allocated from the given pool */
+
+        rc->regex = ngx_pcalloc(rc->pool, sizeof(ngx_regex_t));
+        if (rc->regex == NULL) {
+            goto nomem;
+        }
+
+        if (ngx_regex_compile_code(rc, rc->regex, rc->pool) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        return ngx_regex_info(rc);
+    }
+
+    hash = ngx_crc32_long(rc->pattern.data, rc->pattern.len)
+           ^ (uint32_t) rc->options;
+
+    node = (ngx_regex_node_t *) ngx_str_rbtree_lookup(&ngx_regex_tree,
+                                                      &rc->pattern, hash);
+
+    if (node == NULL) {
+        node = ngx_alloc(sizeof(ngx_regex_node_t) + rc->pattern.len + 1,
+                         rc->pool->log);
+        if (node == NULL) {
+            goto nomem;
+        }
+
+        ngx_memzero(node, sizeof(ngx_regex_node_t));
+
+        node->sn.node.key = hash;
+        node->sn.str.len = rc->pattern.len;
+        node->sn.str.data = (u_char *) &node[1];
+        ngx_memcpy(node->sn.str.data, rc->pattern.data, rc->pattern.len);
+        node->sn.str.data[rc->pattern.len] = '\0';
+
+        node->options = rc->options;
+
+        if (ngx_regex_compile_code(rc, &node->regex, NULL) != NGX_OK) {
+            ngx_free(node);
+            return NGX_ERROR;
+        }
+
+        ngx_rbtree_insert(&ngx_regex_tree, &node->sn.node);
+
+        ngx_regex_cache_dirty = 1;
+    }
+
+    if (node->generation != ngx_regex_generation) {
+        np = ngx_list_push(ngx_regex_nodes);
+        if (np == NULL) {
+            goto nomem;
+        }
+
+        *np = node;
+
+        node->refs++;
+        node->generation = ngx_regex_generation;
+    }
+
+    rc->regex = &node->regex;
+
+    return ngx_regex_info(rc);
+
+nomem:
+
+    rc->err.len = ngx_snprintf(rc->err.data, rc->err.len,
+                               "regex \"%V\" compilation failed: no memory",
+                               &rc->pattern)
+                  - rc->err.data;
+    return NGX_ERROR;
+}
+
+
+#if (NGX_PCRE2)
+
+static ngx_int_t
+ngx_regex_compile_code(ngx_regex_compile_t *rc, ngx_regex_t *re,
+    ngx_pool_t *pool)
+{
+    int                     n;
+    size_t                  erroff;
+    u_char                  errstr[128];
+    uint32_t                options;
+    pcre2_general_context  *gctx;
+
+    if (ngx_regex_compile_context == NULL) {
+        gctx = pcre2_general_context_create(ngx_regex_malloc, ngx_regex_free,
+                                            NULL);
+        if (gctx == NULL) {
+            goto nomem;
+        }
+
+        ngx_regex_compile_context = pcre2_compile_context_create(gctx);
+
+        pcre2_general_context_free(gctx);
+
+        if (ngx_regex_compile_context == NULL) {
+            goto nomem;
+        }
+    }
+
+    options = 0;
+
+    if (rc->options & NGX_REGEX_CASELESS) {
+        options |= PCRE2_CASELESS;
+    }
+
+    ngx_regex_malloc_init(pool);
+
+    re->code = pcre2_compile(rc->pattern.data, rc->pattern.len, options,
+                             &n, &erroff, ngx_regex_compile_context);
+
+    /* ensure that there is no current pool */
+    ngx_regex_malloc_done();
+
+    if (re->code == NULL) {
+        pcre2_get_error_message(n, errstr, sizeof(errstr));
+
+        if (erroff == rc->pattern.len) {
+            rc->err.len = ngx_snprintf(rc->err.data, rc->err.len,
+                              "pcre2_compile() failed: %s in \"%V\"",
+                               errstr, &rc->pattern)
+                          - rc->err.data;
+
+        } else {
+            rc->err.len = ngx_snprintf(rc->err.data, rc->err.len,
+                              "pcre2_compile() failed: %s in \"%V\" at \"%s\"",
+                               errstr, &rc->pattern, rc->pattern.data + erroff)
+                          - rc->err.data;
+        }
+
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+
+nomem:
+
+    rc->err.len = ngx_snprintf(rc->err.data, rc->err.len,
+                               "regex \"%V\" compilation failed: no memory",
+                               &rc->pattern)
+                  - rc->err.data;
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_regex_info(ngx_regex_compile_t *rc)
+{
+    int          n;
+    char        *p;
+    uint32_t     v;
+    PCRE2_SPTR   names;
+    pcre2_code  *re;
+
+    re = rc->regex->code;
+
+    n = pcre2_pattern_info(re, PCRE2_INFO_CAPTURECOUNT, &v);
+    if (n < 0) {
+        p = "pcre2_pattern_info(\"%V\", PCRE2_INFO_CAPTURECOUNT) failed: %d";
+        goto failed;
+    }
+
+    rc->captures = v;
+
+    if (rc->captures == 0) {
+        return NGX_OK;
+    }
+
+    n = pcre2_pattern_info(re, PCRE2_INFO_NAMECOUNT, &v);
+    if (n < 0) {
+        p = "pcre2_pattern_info(\"%V\", PCRE2_INFO_NAMECOUNT) failed: %d";
+        goto failed;
+    }
+
+    rc->named_captures = v;
+
+    if (rc->named_captures == 0) {
+        return NGX_OK;
+    }
+
+    n = pcre2_pattern_info(re, PCRE2_INFO_NAMEENTRYSIZE, &v);
+    if (n < 0) {
+        p = "pcre2_pattern_info(\"%V\", PCRE2_INFO_NAMEENTRYSIZE) failed: %d";
+        goto failed;
+    }
+
+    rc->name_size = v;
+
+    n = pcre2_pattern_info(re, PCRE2_INFO_NAMETABLE, &names);
+    if (n < 0) {
+        p = "pcre2_pattern_info(\"%V\", PCRE2_INFO_NAMETABLE) failed: %d";
+        goto failed;
+    }
+
+    rc->names = (u_char *) names;
+
+    return NGX_OK;
+
+failed:
+
+    rc->err.len = ngx_snprintf(rc->err.data, rc->err.len, p, &rc->pattern, n)
+                  - rc->err.data;
+    return NGX_ERROR;
+}
+
+
+ngx_int_t
+ngx_regex_exec(ngx_regex_t *re, ngx_str_t *s, int *captures, ngx_uint_t size)
+{
+    size_t      *ov;
+    ngx_int_t    rc;
+    ngx_uint_t   n, i;
+
+    if (ngx_regex_match_data == NULL || size > ngx_regex_match_data_size) {
+
+        if (ngx_regex_match_data) {
+            pcre2_match_data_free(ngx_regex_match_data);
+        }
+
+        ngx_regex_match_data_size = size;
+        ngx_regex_match_data = pcre2_match_data_create(size / 3, NULL);
+
+        if (ngx_regex_match_data == NULL) {
+            return PCRE2_ERROR_NOMEMORY;
+        }
+    }
+
+    rc = pcre2_match(re->code, s->data, s->len, 0, ngx_regex_match_options,
+                     ngx_regex_match_data, ngx_regex_match_context);
+
+    if (rc < 0) {
+        return rc;
+    }
+
+    n = pcre2_get_ovector_count(ngx_regex_match_data);
+    ov = pcre2_get_ovector_pointer(ngx_regex_match_data);
+
+    if (n > size / 3) {
+        n = size / 3;
+    }
+
+    for (i = 0; i < n; i++) {
+        captures[i * 2] = ov[i * 2];
+        captures[i * 2 + 1] = ov[i * 2 + 1];
+    }
+
+    /* as pcre_exec(), report that the captures vector was too small */
+
+    if ((ngx_uint_t) rc > size / 3) {
+        rc = 0;
+    }
+
+    return rc;
+}
+
+#else
+
+static ngx_int_t
+ngx_regex_compile_code(ngx_regex_compile_t *rc, ngx_regex_t *re,
+    ngx_pool_t *pool)
+{
+    int          erroff, options;
+    const char  *errstr;
 
-    ngx_regex_malloc_init(rc->pool);
+    options = 0;
 
-    re = pcre_compile((const char *) rc->pattern.data, (int) rc->options,
-                      &errstr, &erroff, NULL);
+    if (rc->options & NGX_REGEX_CASELESS) {
+        options |= PCRE_CASELESS;
+    }
+
+    ngx_regex_malloc_init(pool);
+
+    re->code = pcre_compile((const char *) rc->pattern.data, options,
+                            &errstr, &erroff, NULL);
 
     /* ensure that there is no current pool */
     ngx_regex_malloc_done();
 
-    if (re == NULL) {
+    if (re->code == NULL) {
         if ((size_t) erroff == rc->pattern.len) {
            rc->err.len = ngx_snprintf(rc->err.data, rc->err.len,
                               "pcre_compile() failed: %s in \"%V\"",
@@ -125,24 +481,20 @@ ngx_regex_compile(ngx_regex_compile_t *rc)
         return NGX_ERROR;
     }
 
-    rc->regex = ngx_pcalloc(rc->pool, sizeof(ngx_regex_t));
-    if (rc->regex == NULL) {
-        goto nomem;
-    }
+    re->extra = NULL;
 
-    rc->regex->code = re;
+    return NGX_OK;
+}
 
-    /* do not study at runtime */
 
-    if (ngx_pcre_studies != NULL) {
-        elt = ngx_list_push(ngx_pcre_studies);
-        if (elt == NULL) {
-            goto nomem;
-        }
+static ngx_int_t
+ngx_regex_info(ngx_regex_compile_t *rc)
+{
+    int    n;
+    char  *p;
+    pcre  *re;
 
-        elt->regex = rc->regex;
-        elt->name = rc->pattern.data;
-    }
+    re = rc->regex->code;
 
     n = pcre_fullinfo(re, NULL, PCRE_INFO_CAPTURECOUNT, &rc->captures);
     if (n < 0) {
@@ -183,16 +535,10 @@ failed:
     rc->err.len = ngx_snprintf(rc->err.data, rc->err.len, p, &rc->pattern, n)
                   - rc->err.data;
     return NGX_ERROR;
-
-nomem:
-
-    rc->err.len = ngx_snprintf(rc->err.data, rc->err.len,
-                               "regex \"%V\" compilation failed: no memory",
-                               &rc->pattern)
-                  - rc->err.data;
-    return NGX_ERROR;
 }
 
+#endif
+
 
 ngx_int_t
 ngx_regex_exec_array(ngx_array_t *a, ngx_str_t *s, ngx_log_t *log)
@@ -227,103 +573,1137 @@ ngx_regex_exec_array(ngx_array_t *a, ngx_str_t *s, ngx_log_t *log)
 }
 
 
-static void * ngx_libc_cdecl
-ngx_regex_malloc(size_t size)
+#define NGX_REGEX_LITERAL_MAX  16
+
+#define ngx_regex_isdigit(c)  ((c) >= '0' && (c) <= '9')
+#define ngx_regex_isalpha(c)  (((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'z')
+
+
+ngx_regex_set_t *
+ngx_regex_set_create(ngx_pool_t *pool, ngx_uint_t n)
 {
-    ngx_pool_t      *pool;
-    pool = ngx_pcre_pool;
+    ngx_regex_set_t  *set;
 
-    if (pool) {
-        return ngx_palloc(pool, size);
+    set = ngx_pcalloc(pool, sizeof(ngx_regex_set_t));
+    if (set == NULL) {
+        return NULL;
     }
 
-    return NULL;
-}
+    set->filters = ngx_palloc(pool, n * sizeof(ngx_regex_filter_t));
+    if (set->filters == NULL) {
+        return NULL;
+    }
 
+    set->found = ngx_palloc(pool, n);
+    if (set->found == NULL) {
+        return NULL;
+    }
 
-static void ngx_libc_cdecl
-ngx_regex_free(void *p)
-{
-    return;
-}
+    set->ac = ngx_ac_create(pool, n, 1);
+    if (set->ac == NULL) {
+        return NULL;
+    }
 
+    return set;
+}
 
-#if (NGX_HAVE_PCRE_JIT)
 
-static void
-ngx_pcre_free_studies(void *data)
+ngx_int_t
+ngx_regex_set_add(ngx_regex_set_t *set, ngx_regex_t *re, ngx_str_t *pattern)
 {
-    ngx_list_t *studies = data;
+    u_char              *buf;
+    ngx_str_t            literal;
+    ngx_uint_t           caseless;
+    ngx_regex_filter_t  *f;
+#if (NGX_PCRE2)
+    uint32_t             options;
+#else
+    unsigned long        options;
+#endif
 
-    ngx_uint_t        i;
-    ngx_list_part_t  *part;
-    ngx_regex_elt_t  *elts;
+    f = &set->filters[set->nelts];
 
-    part = &studies->part;
-    elts = part->elts;
+    ngx_str_null(&f->prefix);
+    f->literal = 0;
 
-    for (i = 0; /* void */ ; i++) {
+#if (NGX_PCRE2)
 
-        if (i >= part->nelts) {
-            if (part->next == NULL) {
-                break;
-            }
+    if (pcre2_pattern_info(re->code, PCRE2_INFO_ALLOPTIONS, &options) < 0) {
+        options = PCRE2_CASELESS;
+    }
 
-            part = part->next;
-            elts = part->elts;
-            i = 0;
-        }
+    caseless = (options & PCRE2_CASELESS) ? 1 : 0;
 
-        if (elts[i].regex->extra != NULL) {
-            pcre_free_study(elts[i].regex->extra);
-        }
+#else
+
+    if (pcre_fullinfo(re->code, NULL, PCRE_INFO_OPTIONS, &options) < 0) {
+        options = PCRE_CASELESS;
     }
-}
+
+    caseless = (options & PCRE_CASELESS) ? 1 : 0;
 
 #endif
 
+    buf = ngx_pnalloc(set->ac->pool, pattern->len);
+    if (buf == NULL) {
+        return NGX_ERROR;
+    }
 
-static ngx_int_t
-ngx_regex_module_init(ngx_cycle_t *cycle)
-{
-    int               opt;
-    const char       *errstr;
-    ngx_uint_t        i;
-    ngx_list_part_t  *part;
-    ngx_regex_elt_t  *elts;
+    if (ngx_regex_literal(pattern, buf, &f->prefix, &literal, &caseless)
+        == NGX_OK
+        && literal.len)
+    {
+        f->literal = 1;
 
-    opt = 0;
+        if (ngx_ac_add(set->ac, &literal, set->nelts) == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+    }
 
-#if (NGX_HAVE_PCRE_JIT)
-    {
-    ngx_regex_conf_t    *rcf;
-    ngx_pool_cleanup_t  *cln;
+    f->caseless = caseless;
 
-    rcf = (ngx_regex_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_regex_module);
+    set->nelts++;
+
+    return NGX_OK;
+}
+
+
+ngx_int_t
+ngx_regex_set_compile(ngx_regex_set_t *set)
+{
+    if (set->ac->patterns.nelts == 0) {
+        set->ac = NULL;
+        return NGX_OK;
+    }
+
+    return ngx_ac_compile(set->ac);
+}
+
+
+/*
+ * marks regexes which may match the string: those with an anchored
+ * prefix matching the start of the string and a required literal found
+ * in the string; the array returned is valid until the next scan
+ */
+
+u_char *
+ngx_regex_set_scan(ngx_regex_set_t *set, ngx_str_t *s)
+{
+    u_char              *p, *last;
+    uint32_t             state, m;
+    ngx_int_t            k;
+    ngx_uint_t           i;
+    ngx_ac_t            *ac;
+    ngx_regex_filter_t  *f;
+
+    f = set->filters;
+
+    for (i = 0; i < set->nelts; i++) {
+        set->found[i] = f[i].literal ? 0 : 1;
+    }
+
+    ac = set->ac;
+
+    if (ac) {
+        state = 0;
+        last = s->data + s->len;
+
+        for (p = s->data; p < last; p++) {
+            state = ngx_ac_next(ac, state, *p);
+
+            for (m = ngx_ac_output(ac, state); m; m = ac->dict[m]) {
+                for (k = ac->match[m]; k != NGX_AC_NONE;
+                     k = ngx_ac_pattern(ac, k)->next)
+                {
+                    set->found[ngx_ac_pattern(ac, k)->id] = 1;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < set->nelts; i++) {
+        if (f[i].prefix.len == 0 || set->found[i] == 0) {
+            continue;
+        }
+
+        if (s->len < f[i].prefix.len
+            || (f[i].caseless
+                ? ngx_strncasecmp(s->data, f[i].prefix.data, f[i].prefix.len)
+                : ngx_strncmp(s->data, f[i].prefix.data, f[i].prefix.len))
+               != 0)
+        {
+            set->found[i] = 0;
+        }
+    }
+
+    return set->found;
+}
+
+
+/*
+ * finds an anchored literal prefix and the longest other literal that
+ * every match must contain; patterns using alternation, verbs or inline
+ * options other than "i" are not analyzed
+ */
+
+static ngx_int_t
+ngx_regex_literal(ngx_str_t *pattern, u_char *buf, ngx_str_t *prefix,
+    ngx_str_t *literal, ngx_uint_t *caseless)
+{
+    u_char      *p, *q, *last, *run, ch;
+    size_t       len;
+    ngx_uint_t   lit, optional, anchored, depth, off;
+
+    ngx_str_null(prefix);
+    ngx_str_null(literal);
+
+    p = pattern->data;
+    last = p + pattern->len;
+
+    /* top level alternation and inline options */
+
+    depth = 0;
+
+    for (q = p; q < last; q++) {
+
+        switch (*q) {
+
+        case '\\':
+            if (q + 1 < last && q[1] == 'Q') {
+                return NGX_DECLINED;
+            }
+
+            q++;
+            break;
+
+        case '[':
+            q = ngx_regex_skip_class(q, last);
+
+            if (q == NULL) {
+                return NGX_DECLINED;
+            }
+
+            q--;
+            break;
+
+        case '(':
+            depth++;
+
+            if (q + 1 < last && q[1] == '*') {
+                return NGX_DECLINED;
+            }
+
+            if (q + 1 < last && q[1] == '?') {
+                off = 0;
+
+                for (q += 2; q < last && *q != ')' && *q != ':'; q++) {
+
+                    /* "x" makes whitespace insignificant */
+
+                    if (*q == '^' || *q == 'x') {
+                        return NGX_DECLINED;
+                    }
+
+                    if (*q == '-') {
+                        off = 1;
+                        continue;
+                    }
+
+                    if (!ngx_regex_isalpha(*q)) {
+                        break;
+                    }
+
+                    if (*q == 'i') {
+                        if (!off) {
+                            *caseless = 1;
+                        }
+
+                        continue;
+                    }
+
+                    if (!off) {
+                        return NGX_DECLINED;
+                    }
+                }
+
+                q--;
+            }
+
+            break;
+
+        case ')':
+            depth--;
+            break;
+
+        case '|':
+            if (depth == 0) {
+                return NGX_DECLINED;
+            }
+
+            break;
+        }
+    }
+
+    anchored = 0;
+
+    if (p < last && *p == '^') {
+        anchored = 1;
+        p++;
+    }
+
+    run = buf;
+    len = 0;
+
+    while (p < last) {
+
+        lit = 0;
+        ch = *p;
+
+        switch (ch) {
+
+        case '\\':
+            if (p + 1 == last) {
+                goto done;
+            }
+
+            ch = p[1];
+
+            if (ngx_regex_isalpha(ch) || ngx_regex_isdigit(ch)) {
+                if (ngx_strchr((u_char *) "dDwWsSbBAzZhHvVRX", ch) == NULL) {
+                    goto done;
+                }
+
+            } else {
+                lit = 1;
+            }
+
+            p += 2;
+            break;
+
+        case '[':
+            p = ngx_regex_skip_class(p, last);
+            break;
+
+        case '(':
+            depth = 1;
+
+            for (p++; p < last && depth; p++) {
+                if (*p == '\\') {
+                    p++;
+
+                } else if (*p == '[') {
+                    p = ngx_regex_skip_class(p, last) - 1;
+
+                } else if (*p == '(') {
+                    depth++;
+
+                } else if (*p == ')') {
+                    depth--;
+                }
+            }
+
+            break;
+
+        case '.':
+        case '^':
+        case '$':
+        case '*':
+        case '+':
+        case '?':
+            p++;
+            break;
+
+        case '{':
+            q = ngx_regex_skip_quantifier(p, last, &optional);
+
+            if (q != p) {
+                p = q;
+                break;
+            }
+
+            /* fall through */
+
+        default:
+            lit = 1;
+            p++;
+        }
+
+        q = ngx_regex_skip_quantifier(p, last, &optional);
+
+        if (lit && !optional) {
+            run[len++] = ch;
+        }
+
+        if (lit && q == p) {
+            continue;
+        }
+
+        p = q;
+
+        /* the run of literals ends here */
+
+        if (anchored && run == buf) {
+            prefix->data = run;
+            prefix->len = len;
+
+        } else if (len > literal->len) {
+            literal->data = run;
+            literal->len = len;
+        }
+
+        anchored = 0;
+        run += len;
+        len = 0;
+    }
+
+done:
+
+    if (anchored && run == buf) {
+        prefix->data = run;
+        prefix->len = len;
+
+    } else if (len > literal->len) {
+        literal->data = run;
+        literal->len = len;
+    }
+
+    if (literal->len < 2) {
+        literal->len = 0;
+
+    } else if (literal->len > NGX_REGEX_LITERAL_MAX) {
+        literal->len = NGX_REGEX_LITERAL_MAX;
+    }
+
+    return NGX_OK;
+}
+
+
+/*
+ * skips a character class including POSIX "[:alpha:]", "[.ch.]" and
+ * "[=ch=]" items; returns NULL for "\Q" in a class, which is not parsed
+ */
+
+static u_char *
+ngx_regex_skip_class(u_char *p, u_char *last)
+{
+    u_char  *q;
+
+    p++;
+
+    if (p < last && *p == '^') {
+        p++;
+    }
+
+    if (p < last && *p == ']') {
+        p++;
+    }
+
+    while (p < last && *p != ']') {
+
+        if (*p == '\\') {
+            if (p + 1 < last && p[1] == 'Q') {
+                return NULL;
+            }
+
+            p += 2;
+            continue;
+        }
+
+        if (*p == '[' && p + 1 < last
+            && (p[1] == ':' || p[1] == '.' || p[1] == '='))
+        {
+            for (q = p + 2; q + 1 < last; q++) {
+                if (q[0] == p[1] && q[1] == ']') {
+                    break;
+                }
+            }
+
+            if (q + 1 < last) {
+                p = q + 2;
+                continue;
+            }
+        }
+
+        p++;
+    }
+
+    return (p < last) ? p + 1 : last;
+}
+
+
+static u_char *
+ngx_regex_skip_quantifier(u_char *p, u_char *last, ngx_uint_t *optional)
+{
+    u_char  *q;
+
+    *optional = 0;
+
+    if (p == last) {
+        return p;
+    }
+
+    switch (*p) {
+
+    case '*':
+    case '?':
+        *optional = 1;
+        q = p + 1;
+        break;
+
+    case '+':
+        q = p + 1;
+        break;
+
+    case '{':
+        q = p + 1;
+
+        if (q == last || !ngx_regex_isdigit(*q)) {
+            return p;
+        }
+
+        *optional = (*q == '0');
+
+        while (q < last && ngx_regex_isdigit(*q)) {
+            q++;
+        }
+
+        if (q < last && *q == ',') {
+            q++;
+
+            while (q < last && ngx_regex_isdigit(*q)) {
+                q++;
+            }
+        }
+
+        if (q == last || *q != '}') {
+            *optional = 0;
+            return p;
+        }
+
+        q++;
+        break;
+
+    default:
+        return p;
+    }
+
+    if (q < last && (*q == '?' || *q == '+')) {
+        q++;
+    }
+
+    return q;
+}
+
+
+#if (NGX_PCRE2)
+
+static void *
+ngx_regex_malloc(size_t size, void *data)
+{
+    if (ngx_pcre_pool) {
+        return ngx_palloc(ngx_pcre_pool, size);
+    }
+
+    return ngx_alloc(size, ngx_cycle->log);
+}
+
+
+static void
+ngx_regex_free(void *p, void *data)
+{
+    if (ngx_pcre_pool) {
+        return;
+    }
+
+    ngx_free(p);
+}
+
+#else
+
+static void * ngx_libc_cdecl
+ngx_regex_malloc(size_t size)
+{
+    if (ngx_pcre_pool) {
+        return ngx_palloc(ngx_pcre_pool, size);
+    }
+
+    return ngx_alloc(size, ngx_cycle->log);
+}
+
+
+static void ngx_libc_cdecl
+ngx_regex_free(void *p)
+{
+    if (ngx_pcre_pool) {
+        return;
+    }
+
+    ngx_free(p);
+}
+
+#endif
+
+
+static void
+ngx_regex_study(ngx_cycle_t *cycle, ngx_regex_node_t *node, ngx_uint_t jit)
+{
+#if (NGX_PCRE2)
+
+    int  n;
+
+    if (jit && !node->jit) {
+        n = pcre2_jit_compile(node->regex.code, PCRE2_JIT_COMPLETE);
+
+        if (n != 0) {
+            ngx_log_error(NGX_LOG_INFO, cycle->log, 0,
+                          "JIT compiler does not support pattern: \"%V\"",
+                          &node->sn.str);
+        }
+
+        node->jit = 1;
+    }
+
+#else
+
+    int          opt;
+    const char  *errstr;
+
+    if (node->regex.extra != NULL) {
+#if (NGX_HAVE_PCRE_JIT)
+        pcre_free_study(node->regex.extra);
+#else
+        pcre_free(node->regex.extra);
+#endif
+    }
+
+    opt = 0;
+
+#if (NGX_HAVE_PCRE_JIT)
+    if (jit) {
+        opt = PCRE_STUDY_JIT_COMPILE;
+    }
+#endif
+
+    node->regex.extra = pcre_study(node->regex.code, opt, &errstr);
+
+    if (errstr != NULL) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                      "pcre_study() failed: %s in \"%V\"",
+                      errstr, &node->sn.str);
+    }
+
+#if (NGX_HAVE_PCRE_JIT)
+    if (opt & PCRE_STUDY_JIT_COMPILE) {
+        int n;
+
+        jit = 0;
+        n = pcre_fullinfo(node->regex.code, node->regex.extra,
+                          PCRE_INFO_JIT, &jit);
+
+        if (n != 0 || jit != 1) {
+            ngx_log_error(NGX_LOG_INFO, cycle->log, 0,
+                          "JIT compiler does not support pattern: \"%V\"",
+                          &node->sn.str);
+        }
+
+        jit = 1;
+    }
+#endif
+
+    node->jit = jit ? 1 : 0;
+
+#endif
+
+    node->studied = 1;
+}
+
+
+static void
+ngx_regex_free_node(ngx_regex_node_t *node)
+{
+#if (NGX_PCRE2)
+
+    pcre2_code_free(node->regex.code);
+
+#else
+
+    /*
+     * The PCRE JIT compiler uses mmap for its executable codes, so we
+     * have to explicitly call the pcre_free_study() function to free
+     * this memory.
+     */
+
+    if (node->regex.extra != NULL) {
+#if (NGX_HAVE_PCRE_JIT)
+        pcre_free_study(node->regex.extra);
+#else
+        pcre_free(node->regex.extra);
+#endif
+    }
+
+    pcre_free(node->regex.code);
+
+#endif
+
+    ngx_free(node);
+}
+
+
+static void
+ngx_regex_cleanup(void *data)
+{
+    ngx_list_t *nodes = data;
+
+    ngx_uint_t          i;
+    ngx_list_part_t    *part;
+    ngx_regex_node_t  **elts;
+
+    part = &nodes->part;
+    elts = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            elts = part->elts;
+            i = 0;
+        }
+
+        if (--elts[i]->refs == 0) {
+            ngx_rbtree_delete(&ngx_regex_tree, &elts[i]->sn.node);
+            ngx_regex_free_node(elts[i]);
+        }
+    }
+
+    if (ngx_regex_nodes == nodes) {
+        ngx_regex_nodes = NULL;
+    }
+}
 
-    if (rcf->pcre_jit) {
-        opt = PCRE_STUDY_JIT_COMPILE;
 
-        /*
-         * The PCRE JIT compiler uses mmap for its executable codes, so we
-         * have to explicitly call the pcre_free_study() function to free
-         * this memory.
-         */
+/*
+ * a single JIT stack per process is shared by all regexes instead of
+ * the 32K machine stack used by default
+ */
+
+static ngx_int_t
+ngx_regex_jit_stack(ngx_cycle_t *cycle, size_t size)
+{
+#if (NGX_PCRE2)
+
+    pcre2_jit_stack  *stack;
+
+    if (ngx_regex_match_context == NULL) {
+        ngx_regex_match_context = pcre2_match_context_create(NULL);
+        if (ngx_regex_match_context == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    if (size == ngx_regex_jit_stack_size) {
+        return NGX_OK;
+    }
+
+    stack = NULL;
 
-        cln = ngx_pool_cleanup_add(cycle->pool, 0);
-        if (cln == NULL) {
+    if (size) {
+        stack = pcre2_jit_stack_create(ngx_min(size, 32 * 1024), size, NULL);
+        if (stack == NULL) {
+            ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                          "pcre2_jit_stack_create(%uz) failed", size);
             return NGX_ERROR;
         }
+    }
+
+    pcre2_jit_stack_assign(ngx_regex_match_context, NULL, stack);
+
+    if (ngx_regex_jit_stack_ptr) {
+        pcre2_jit_stack_free(ngx_regex_jit_stack_ptr);
+    }
+
+    ngx_regex_jit_stack_ptr = stack;
+    ngx_regex_jit_stack_size = size;
+
+#elif (NGX_HAVE_PCRE_JIT)
+
+    pcre_jit_stack     *stack;
+    ngx_rbtree_node_t  *node, *root, *sentinel;
+    ngx_regex_node_t   *rn;
+
+    stack = ngx_regex_jit_stack_ptr;
+
+    if (size != ngx_regex_jit_stack_size) {
+        stack = NULL;
+
+        if (size) {
+            stack = pcre_jit_stack_alloc(ngx_min(size, 32 * 1024), size);
+            if (stack == NULL) {
+                ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                              "pcre_jit_stack_alloc(%uz) failed", size);
+                return NGX_ERROR;
+            }
+        }
+    }
+
+    /* the stack is assigned to each study data, including new ones */
+
+    root = ngx_regex_tree.root;
+    sentinel = ngx_regex_tree.sentinel;
+
+    if (root != sentinel) {
+        for (node = ngx_rbtree_min(root, sentinel);
+             node;
+             node = ngx_rbtree_next(&ngx_regex_tree, node))
+        {
+            rn = (ngx_regex_node_t *) node;
+
+            if (rn->regex.extra) {
+                pcre_assign_jit_stack(rn->regex.extra, NULL, stack);
+            }
+        }
+    }
+
+    if (stack != ngx_regex_jit_stack_ptr) {
+        if (ngx_regex_jit_stack_ptr) {
+            pcre_jit_stack_free(ngx_regex_jit_stack_ptr);
+        }
+
+        ngx_regex_jit_stack_ptr = stack;
+        ngx_regex_jit_stack_size = size;
+    }
+
+#endif
+
+    return NGX_OK;
+}
+
+
+#if (NGX_PCRE2)
+
+/*
+ * the cache file holds a header, the options and patterns of the regexes,
+ * and the codes serialized by pcre2_serialize_encode(); JIT code is not
+ * serialized and is recompiled on load
+ */
+
+typedef struct {
+    uint32_t           magic;
+    uint32_t           number;
+    uint32_t           size;
+} ngx_regex_cache_header_t;
+
+
+static void
+ngx_regex_cache_read(ngx_conf_t *cf, ngx_str_t *name)
+{
+    u_char                    *buf, *p, *last;
+    size_t                     size;
+    ssize_t                    n;
+    int32_t                    rc;
+    uint32_t                   i, len, options;
+    ngx_fd_t                   fd;
+    ngx_str_t                  pattern;
+    pcre2_code               **codes;
+    ngx_file_info_t            fi;
+    ngx_regex_node_t          *node;
+    ngx_regex_cache_header_t   h;
+
+    fd = ngx_open_file(name->data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (fd == NGX_INVALID_FILE) {
+        if (ngx_errno != NGX_ENOENT) {
+            ngx_conf_log_error(NGX_LOG_WARN, cf, ngx_errno,
+                               ngx_open_file_n " \"%s\" failed", name->data);
+        }
+
+        return;
+    }
+
+    buf = NULL;
+    codes = NULL;
+
+    if (ngx_fd_info(fd, &fi) == NGX_FILE_ERROR) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, ngx_errno,
+                           ngx_fd_info_n " \"%s\" failed", name->data);
+        goto done;
+    }
+
+    size = ngx_file_size(&fi);
+
+    if (size < sizeof(ngx_regex_cache_header_t)) {
+        goto invalid;
+    }
+
+    buf = ngx_alloc(size, cf->log);
+    if (buf == NULL) {
+        goto done;
+    }
+
+    n = ngx_read_fd(fd, buf, size);
+
+    if (n == -1) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, ngx_errno,
+                           ngx_read_fd_n " \"%s\" failed", name->data);
+        goto done;
+    }
+
+    if ((size_t) n != size) {
+        goto invalid;
+    }
+
+    ngx_memcpy(&h, buf, sizeof(ngx_regex_cache_header_t));
+
+    if (h.magic != NGX_REGEX_CACHE_MAGIC
+        || h.number == 0
+        || h.size > size - sizeof(ngx_regex_cache_header_t))
+    {
+        goto invalid;
+    }
+
+    codes = ngx_alloc(h.number * sizeof(pcre2_code *), cf->log);
+    if (codes == NULL) {
+        goto done;
+    }
+
+    p = buf + sizeof(ngx_regex_cache_header_t);
+    last = buf + size - h.size;
+
+    rc = pcre2_serialize_decode(codes, h.number, last, NULL);
+
+    if (rc != (int32_t) h.number) {
+        if (rc > 0) {
+            for (i = 0; i < (uint32_t) rc; i++) {
+                pcre2_code_free(codes[i]);
+            }
+        }
+
+        goto invalid;
+    }
+
+    for (i = 0; i < h.number; i++) {
+
+        if ((size_t) (last - p) < 2 * sizeof(uint32_t)) {
+            break;
+        }
+
+        ngx_memcpy(&options, p, sizeof(uint32_t));
+        ngx_memcpy(&len, p + sizeof(uint32_t), sizeof(uint32_t));
+        p += 2 * sizeof(uint32_t);
+
+        if ((size_t) (last - p) < len) {
+            break;
+        }
+
+        pattern.len = len;
+        pattern.data = p;
+        p += len;
+
+        node = ngx_alloc(sizeof(ngx_regex_node_t) + len + 1, cf->log);
+        if (node == NULL) {
+            break;
+        }
+
+        ngx_memzero(node, sizeof(ngx_regex_node_t));
+
+        node->sn.node.key = ngx_crc32_long(pattern.data, pattern.len)
+                            ^ options;
+        node->sn.str.len = len;
+        node->sn.str.data = (u_char *) &node[1];
+        ngx_memcpy(node->sn.str.data, pattern.data, len);
+        node->sn.str.data[len] = '\0';
+
+        node->options = options;
+        node->regex.code = codes[i];
+
+        codes[i] = NULL;
+
+        if (ngx_str_rbtree_lookup(&ngx_regex_tree, &node->sn.str,
+                                  node->sn.node.key))
+        {
+            ngx_regex_free_node(node);
+            continue;
+        }
+
+        ngx_rbtree_insert(&ngx_regex_tree, &node->sn.node);
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, cf->log, 0,
+                   "pcre cache: %uD of %uD regexes loaded", i, h.number);
+
+    for ( /* void */ ; i < h.number; i++) {
+        if (codes[i]) {
+            pcre2_code_free(codes[i]);
+        }
+    }
+
+    goto done;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_NOTICE, cf, 0,
+                       "pcre cache \"%s\" is invalid, ignored", name->data);
+
+done:
+
+    if (codes) {
+        ngx_free(codes);
+    }
+
+    if (buf) {
+        ngx_free(buf);
+    }
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_conf_log_error(NGX_LOG_ALERT, cf, ngx_errno,
+                           ngx_close_file_n " \"%s\" failed", name->data);
+    }
+}
+
+
+static void
+ngx_regex_cache_write(ngx_cycle_t *cycle, ngx_str_t *name)
+{
+    u_char                    *buf, *p, *temp;
+    size_t                     size, blob_size;
+    uint8_t                   *blob;
+    int32_t                    rc;
+    uint32_t                   len, options;
+    ngx_fd_t                   fd;
+    ngx_uint_t                 i, n;
+    ngx_list_part_t           *part;
+    ngx_regex_node_t         **elts;
+    const pcre2_code         **codes;
+    ngx_regex_cache_header_t   h;
+
+    n = 0;
+    size = sizeof(ngx_regex_cache_header_t);
+
+    for (part = &ngx_regex_nodes->part; part; part = part->next) {
+        elts = part->elts;
+
+        for (i = 0; i < part->nelts; i++) {
+            size += 2 * sizeof(uint32_t) + elts[i]->sn.str.len;
+            n++;
+        }
+    }
+
+    if (n == 0) {
+        return;
+    }
+
+    codes = ngx_alloc(n * sizeof(pcre2_code *), cycle->log);
+    if (codes == NULL) {
+        return;
+    }
+
+    buf = ngx_alloc(size + name->len + sizeof(".tmp"), cycle->log);
+    if (buf == NULL) {
+        ngx_free(codes);
+        return;
+    }
+
+    p = buf + sizeof(ngx_regex_cache_header_t);
+    n = 0;
+
+    for (part = &ngx_regex_nodes->part; part; part = part->next) {
+        elts = part->elts;
+
+        for (i = 0; i < part->nelts; i++) {
+            codes[n++] = elts[i]->regex.code;
+
+            options = (uint32_t) elts[i]->options;
+            len = (uint32_t) elts[i]->sn.str.len;
+
+            p = ngx_cpymem(p, &options, sizeof(uint32_t));
+            p = ngx_cpymem(p, &len, sizeof(uint32_t));
+            p = ngx_cpymem(p, elts[i]->sn.str.data, len);
+        }
+    }
+
+    rc = pcre2_serialize_encode(codes, n, &blob, &blob_size, NULL);
+
+    ngx_free(codes);
+
+    if (rc < 0) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                      "pcre2_serialize_encode() failed: %d", rc);
+        ngx_free(buf);
+        return;
+    }
+
+    h.magic = NGX_REGEX_CACHE_MAGIC;
+    h.number = (uint32_t) n;
+    h.size = (uint32_t) blob_size;
+
+    ngx_memcpy(buf, &h, sizeof(ngx_regex_cache_header_t));
+
+    temp = buf + size;
+    ngx_sprintf(temp, "%V.tmp%Z", name);
+
+    fd = ngx_open_file(temp, NGX_FILE_WRONLY, NGX_FILE_TRUNCATE,
+                       NGX_FILE_DEFAULT_ACCESS);
+
+    if (fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_CRIT, cycle->log, ngx_errno,
+                      ngx_open_file_n " \"%s\" failed", temp);
+        goto done;
+    }
+
+    if (ngx_write_fd(fd, buf, size) != (ssize_t) size
+        || ngx_write_fd(fd, blob, blob_size) != (ssize_t) blob_size)
+    {
+        ngx_log_error(NGX_LOG_CRIT, cycle->log, ngx_errno,
+                      ngx_write_fd_n " to \"%s\" failed", temp);
+
+        (void) ngx_close_file(fd);
+        (void) ngx_delete_file(temp);
+        goto done;
+    }
 
-        cln->handler = ngx_pcre_free_studies;
-        cln->data = ngx_pcre_studies;
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", temp);
     }
+
+    if (ngx_rename_file(temp, name->data) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, cycle->log, ngx_errno,
+                      ngx_rename_file_n " \"%s\" to \"%V\" failed",
+                      temp, name);
+        (void) ngx_delete_file(temp);
+        goto done;
     }
+
+    ngx_regex_cache_dirty = 0;
+
+done:
+
+    pcre2_serialize_free(blob);
+    ngx_free(buf);
+}
+
 #endif
 
-    ngx_regex_malloc_init(cycle->pool);
 
-    part = &ngx_pcre_studies->part;
+static ngx_int_t
+ngx_regex_module_init(ngx_cycle_t *cycle)
+{
+    ngx_uint_t          i, n;
+    ngx_list_part_t    *part;
+    ngx_regex_conf_t   *rcf;
+    ngx_regex_node_t  **elts, *rn;
+    ngx_rbtree_node_t  *node, *next, *sentinel;
+
+    rcf = (ngx_regex_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_regex_module);
+
+    /* regexes shared with the previous cycle are not studied again */
+
+    n = 0;
+
+    part = &ngx_regex_nodes->part;
     elts = part->elts;
 
     for (i = 0; /* void */ ; i++) {
@@ -338,34 +1718,53 @@ ngx_regex_module_init(ngx_cycle_t *cycle)
             i = 0;
         }
 
-        elts[i].regex->extra = pcre_study(elts[i].regex->code, opt, &errstr);
-
-        if (errstr != NULL) {
-            ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
-                          "pcre_study() failed: %s in \"%s\"",
-                          errstr, elts[i].name);
+        if (elts[i]->studied && elts[i]->jit == (ngx_uint_t) rcf->pcre_jit) {
+            continue;
         }
 
-#if (NGX_HAVE_PCRE_JIT)
-        if (opt & PCRE_STUDY_JIT_COMPILE) {
-            int jit, n;
+        ngx_regex_study(cycle, elts[i], rcf->pcre_jit);
+        n++;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_CORE, cycle->log, 0,
+                   "regex: %ui studied", n);
 
-            jit = 0;
-            n = pcre_fullinfo(elts[i].regex->code, elts[i].regex->extra,
-                              PCRE_INFO_JIT, &jit);
+#if (NGX_PCRE2)
+    ngx_regex_match_options = rcf->pcre_jit ? 0 : PCRE2_NO_JIT;
+#endif
+
+    /* free regexes loaded from cache but not used */
+
+    sentinel = ngx_regex_tree.sentinel;
+
+    if (ngx_regex_tree.root != sentinel) {
+        node = ngx_rbtree_min(ngx_regex_tree.root, sentinel);
 
-            if (n != 0 || jit != 1) {
-                ngx_log_error(NGX_LOG_INFO, cycle->log, 0,
-                              "JIT compiler does not support pattern: \"%s\"",
-                              elts[i].name);
+        while (node) {
+            next = ngx_rbtree_next(&ngx_regex_tree, node);
+            rn = (ngx_regex_node_t *) node;
+
+            if (rn->refs == 0) {
+                ngx_rbtree_delete(&ngx_regex_tree, node);
+                ngx_regex_free_node(rn);
+                ngx_regex_cache_dirty = 1;
             }
+
+            node = next;
         }
-#endif
     }
 
-    ngx_regex_malloc_done();
+    if (ngx_regex_jit_stack(cycle, rcf->jit_stack_size) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+#if (NGX_PCRE2)
+    if (rcf->cache.len && ngx_regex_cache_dirty && !ngx_test_config) {
+        ngx_regex_cache_write(cycle, &rcf->cache);
+    }
+#endif
 
-    ngx_pcre_studies = NULL;
+    ngx_regex_nodes = NULL;
 
     return NGX_OK;
 }
@@ -374,20 +1773,39 @@ ngx_regex_module_init(ngx_cycle_t *cycle)
 static void *
 ngx_regex_create_conf(ngx_cycle_t *cycle)
 {
-    ngx_regex_conf_t  *rcf;
+    ngx_regex_conf_t    *rcf;
+    ngx_pool_cleanup_t  *cln;
 
     rcf = ngx_pcalloc(cycle->pool, sizeof(ngx_regex_conf_t));
     if (rcf == NULL) {
         return NULL;
     }
 
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     rcf->cache = { 0, NULL };
+     */
+
     rcf->pcre_jit = NGX_CONF_UNSET;
+    rcf->jit_stack_size = NGX_CONF_UNSET_SIZE;
 
-    ngx_pcre_studies = ngx_list_create(cycle->pool, 8, sizeof(ngx_regex_elt_t));
-    if (ngx_pcre_studies == NULL) {
+    cln = ngx_pool_cleanup_add(cycle->pool, 0);
+    if (cln == NULL) {
         return NULL;
     }
 
+    ngx_regex_nodes = ngx_list_create(cycle->pool, 8,
+                                      sizeof(ngx_regex_node_t *));
+    if (ngx_regex_nodes == NULL) {
+        return NULL;
+    }
+
+    cln->handler = ngx_regex_cleanup;
+    cln->data = ngx_regex_nodes;
+
+    ngx_regex_generation++;
+
     return rcf;
 }
 
@@ -398,6 +1816,7 @@ ngx_regex_init_conf(ngx_cycle_t *cycle, void *conf)
     ngx_regex_conf_t *rcf = conf;
 
     ngx_conf_init_value(rcf->pcre_jit, 0);
+    ngx_conf_init_size_value(rcf->jit_stack_size, 0);
 
     return NGX_CONF_OK;
 }
@@ -412,7 +1831,21 @@ ngx_regex_pcre_jit(ngx_conf_t *cf, void *post, void *data)
         return NGX_CONF_OK;
     }
 
-#if (NGX_HAVE_PCRE_JIT)
+#if (NGX_PCRE2)
+    {
+    int       r;
+    uint32_t  jit;
+
+    jit = 0;
+    r = pcre2_config(PCRE2_CONFIG_JIT, &jit);
+
+    if (r != 0 || jit != 1) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "PCRE2 library does not support JIT");
+        *fp = 0;
+    }
+    }
+#elif (NGX_HAVE_PCRE_JIT)
     {
     int  jit, r;
 
@@ -433,3 +1866,42 @@ ngx_regex_pcre_jit(ngx_conf_t *cf, void *post, void *data)
 
     return NGX_CONF_OK;
 }
+
+
+static char *
+ngx_regex_pcre_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_regex_conf_t *rcf = conf;
+
+    ngx_str_t  *value;
+
+    if (rcf->cache.data) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    rcf->cache = value[1];
+
+    if (ngx_conf_full_name(cf->cycle, &rcf->cache, 0) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+#if (NGX_PCRE2)
+
+    /* compiled regexes of the previous cycle are better than the file */
+
+    if (ngx_regex_tree.root == ngx_regex_tree.sentinel) {
+        ngx_regex_cache_read(cf, &rcf->cache);
+    }
+
+#else
+
+    ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                       "\"pcre_cache\" requires PCRE2 library, ignored");
+    ngx_str_null(&rcf->cache);
+
+#endif
+
+    return NGX_CONF_OK;
+}
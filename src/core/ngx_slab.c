@@ -54,6 +54,11 @@
      + (uintptr_t) (pool)->start)
 
 
+#define ngx_slab_magazine_size(pool, slot)                                    \
+    ngx_min(NGX_SLAB_MAGAZINE_SIZE,                                          \
+            ngx_pagesize >> ((slot) + (pool)->min_shift))
+
+
 #if (NGX_DEBUG_MALLOC)
 
 #define ngx_slab_junk(p, size)     ngx_memset(p, 0xA5, size)
@@ -69,6 +74,41 @@
 
 #endif
 
+/*
+ * a magazine is a worker's list of free chunks of one size class of a zone,
+ * it is refilled from and drained to the slab in batches of half of its
+ * capacity, which is limited to a page worth of chunks; cached chunks are
+ * counted as free in the slab statistics
+ *
+ * a zone with magazines enabled has an index in the workers' tables of
+ * magazines; the zone must only be used under its own mutex, which also
+ * protects the magazines of the zone, even if used by different threads
+ */
+
+#define NGX_SLAB_MAGAZINE_SIZE      32
+#define NGX_SLAB_MAGAZINE_CLASSES   16
+#define NGX_SLAB_MAGAZINE_ZONES     64
+
+/* small zones do not use magazines as chunks cached could starve them */
+#define NGX_SLAB_MAGAZINE_MIN_ZONE  (1024 * 1024)
+
+
+typedef struct {
+    ngx_slab_pool_t      *pool;
+    ngx_uint_t            count[NGX_SLAB_MAGAZINE_CLASSES];
+    void                 *free[NGX_SLAB_MAGAZINE_CLASSES];
+} ngx_slab_magazine_t;
+
+
+static void *ngx_slab_alloc_chunk(ngx_slab_pool_t *pool, size_t size);
+static void ngx_slab_free_chunk(ngx_slab_pool_t *pool, void *p);
+static ngx_uint_t ngx_slab_size_slot(ngx_slab_pool_t *pool, size_t size);
+static ngx_slab_magazine_t *ngx_slab_magazine(ngx_slab_pool_t *pool);
+static ngx_uint_t ngx_slab_magazine_slot(ngx_slab_pool_t *pool, void *p);
+static void *ngx_slab_magazine_refill(ngx_slab_pool_t *pool,
+    ngx_slab_magazine_t *mag, ngx_uint_t slot);
+static void ngx_slab_magazine_drain(ngx_slab_pool_t *pool,
+    ngx_slab_magazine_t *mag, ngx_uint_t slot, ngx_uint_t n);
 static ngx_slab_page_t *ngx_slab_alloc_pages(ngx_slab_pool_t *pool,
     ngx_uint_t pages);
 static void ngx_slab_free_pages(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
@@ -81,6 +121,11 @@ static ngx_uint_t  ngx_slab_max_size;
 static ngx_uint_t  ngx_slab_exact_size;
 static ngx_uint_t  ngx_slab_exact_shift;
 
+ngx_uint_t         ngx_slab_magazines;
+
+static ngx_uint_t            ngx_slab_magazine_zones;
+static ngx_slab_magazine_t  *ngx_slab_magazine_table[NGX_SLAB_MAGAZINE_ZONES];
+
 
 void
 ngx_slab_sizes_init(void)
@@ -162,6 +207,60 @@ ngx_slab_init(ngx_slab_pool_t *pool)
     pool->log_nomem = 1;
     pool->log_ctx = &pool->zero;
     pool->zero = '\0';
+
+    pool->magazine = 0;
+}
+
+
+/*
+ * enables magazines of workers on a zone initialization; indices are not
+ * reused, so zones created after a number of reloads may not get them
+ */
+
+void
+ngx_slab_init_magazine(ngx_slab_pool_t *pool)
+{
+    if (pool->magazine
+        || pool->end - pool->start < NGX_SLAB_MAGAZINE_MIN_ZONE
+        || ngx_pagesize_shift - pool->min_shift > NGX_SLAB_MAGAZINE_CLASSES
+        || ngx_slab_magazine_zones == NGX_SLAB_MAGAZINE_ZONES - 1)
+    {
+        return;
+    }
+
+    pool->magazine = ++ngx_slab_magazine_zones;
+}
+
+
+void
+ngx_slab_flush_magazines(void)
+{
+    ngx_uint_t            i, slot;
+    ngx_slab_pool_t      *pool;
+    ngx_slab_magazine_t  *mag;
+
+    for (i = 1; i < NGX_SLAB_MAGAZINE_ZONES; i++) {
+        mag = ngx_slab_magazine_table[i];
+
+        if (mag == NULL) {
+            continue;
+        }
+
+        pool = mag->pool;
+
+        ngx_shmtx_lock(&pool->mutex);
+
+        for (slot = 0; slot < NGX_SLAB_MAGAZINE_CLASSES; slot++) {
+            ngx_slab_magazine_drain(pool, mag, slot, mag->count[slot]);
+        }
+
+        ngx_shmtx_unlock(&pool->mutex);
+
+        ngx_free(mag);
+        ngx_slab_magazine_table[i] = NULL;
+    }
+
+    ngx_slab_magazines = 0;
 }
 
 
@@ -182,6 +281,45 @@ ngx_slab_alloc(ngx_slab_pool_t *pool, size_t size)
 
 void *
 ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
+{
+    void                 *p;
+    ngx_uint_t            slot;
+    ngx_slab_magazine_t  *mag;
+
+    mag = (size <= ngx_slab_max_size) ? ngx_slab_magazine(pool) : NULL;
+
+    if (mag) {
+        slot = ngx_slab_size_slot(pool, size);
+        p = mag->free[slot];
+
+        if (p) {
+            mag->free[slot] = *(void **) p;
+            mag->count[slot]--;
+
+            pool->stats[slot].reqs++;
+            pool->stats[slot].used++;
+
+            return p;
+        }
+
+        p = ngx_slab_magazine_refill(pool, mag, slot);
+        if (p) {
+            return p;
+        }
+
+        /* return cached chunks to the zone and try again */
+
+        for (slot = 0; slot < NGX_SLAB_MAGAZINE_CLASSES; slot++) {
+            ngx_slab_magazine_drain(pool, mag, slot, mag->count[slot]);
+        }
+    }
+
+    return ngx_slab_alloc_chunk(pool, size);
+}
+
+
+static void *
+ngx_slab_alloc_chunk(ngx_slab_pool_t *pool, size_t size)
 {
     size_t            s;
     uintptr_t         p, m, mask, *bitmap;
@@ -459,6 +597,50 @@ ngx_slab_free(ngx_slab_pool_t *pool, void *p)
 
 void
 ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p)
+{
+    void                 *c;
+    ngx_uint_t            n, slot;
+    ngx_slab_magazine_t  *mag;
+
+    mag = ngx_slab_magazine(pool);
+
+    if (mag) {
+        slot = ngx_slab_magazine_slot(pool, p);
+
+        if (slot != NGX_SLAB_MAGAZINE_CLASSES) {
+
+            for (c = mag->free[slot]; c; c = *(void **) c) {
+                if (c == p) {
+                    ngx_slab_error(pool, NGX_LOG_ALERT,
+                                   "ngx_slab_free(): chunk is already free");
+                    return;
+                }
+            }
+
+            n = ngx_slab_magazine_size(pool, slot);
+
+            if (mag->count[slot] == n) {
+                ngx_slab_magazine_drain(pool, mag, slot, n / 2);
+            }
+
+            ngx_slab_junk(p, (size_t) 1 << (slot + pool->min_shift));
+
+            *(void **) p = mag->free[slot];
+            mag->free[slot] = p;
+            mag->count[slot]++;
+
+            pool->stats[slot].used--;
+
+            return;
+        }
+    }
+
+    ngx_slab_free_chunk(pool, p);
+}
+
+
+static void
+ngx_slab_free_chunk(ngx_slab_pool_t *pool, void *p)
 {
     size_t            size;
     uintptr_t         slab, m, *bitmap;
@@ -674,6 +856,193 @@ fail:
 }
 
 
+static ngx_uint_t
+ngx_slab_size_slot(ngx_slab_pool_t *pool, size_t size)
+{
+    size_t      s;
+    ngx_uint_t  shift;
+
+    if (size <= pool->min_size) {
+        return 0;
+    }
+
+    shift = 1;
+    for (s = size - 1; s >>= 1; shift++) { /* void */ }
+
+    return shift - pool->min_shift;
+}
+
+
+static ngx_slab_magazine_t *
+ngx_slab_magazine(ngx_slab_pool_t *pool)
+{
+    ngx_slab_magazine_t  *mag;
+
+    if (!ngx_slab_magazines || pool->magazine == 0) {
+        return NULL;
+    }
+
+    mag = ngx_slab_magazine_table[pool->magazine];
+
+    if (mag == NULL) {
+        mag = ngx_calloc(sizeof(ngx_slab_magazine_t), ngx_cycle->log);
+        if (mag == NULL) {
+            return NULL;
+        }
+
+        mag->pool = pool;
+
+        ngx_slab_magazine_table[pool->magazine] = mag;
+    }
+
+    return mag;
+}
+
+
+static ngx_uint_t
+ngx_slab_magazine_slot(ngx_slab_pool_t *pool, void *p)
+{
+    uintptr_t         m, *bitmap;
+    ngx_uint_t        n, shift;
+    ngx_slab_page_t  *page;
+
+    /*
+     * invalid pointers and chunks already free in the slab are left
+     * to ngx_slab_free_chunk() to report
+     */
+
+    if ((u_char *) p < pool->start || (u_char *) p >= pool->end) {
+        return NGX_SLAB_MAGAZINE_CLASSES;
+    }
+
+    page = &pool->pages[((u_char *) p - pool->start) >> ngx_pagesize_shift];
+    n = (uintptr_t) p & (ngx_pagesize - 1);
+
+    switch (ngx_slab_page_type(page)) {
+
+    case NGX_SLAB_SMALL:
+        shift = page->slab & NGX_SLAB_SHIFT_MASK;
+
+        n >>= shift;
+        m = (uintptr_t) 1 << (n % (8 * sizeof(uintptr_t)));
+        bitmap = (uintptr_t *)
+                             ((uintptr_t) p & ~((uintptr_t) ngx_pagesize - 1));
+
+        if (!(bitmap[n / (8 * sizeof(uintptr_t))] & m)) {
+            return NGX_SLAB_MAGAZINE_CLASSES;
+        }
+
+        break;
+
+    case NGX_SLAB_EXACT:
+        shift = ngx_slab_exact_shift;
+
+        if (!(page->slab & ((uintptr_t) 1 << (n >> shift)))) {
+            return NGX_SLAB_MAGAZINE_CLASSES;
+        }
+
+        break;
+
+    case NGX_SLAB_BIG:
+        shift = page->slab & NGX_SLAB_SHIFT_MASK;
+
+        if (!(page->slab
+              & ((uintptr_t) 1 << ((n >> shift) + NGX_SLAB_MAP_SHIFT))))
+        {
+            return NGX_SLAB_MAGAZINE_CLASSES;
+        }
+
+        break;
+
+    default: /* NGX_SLAB_PAGE */
+        return NGX_SLAB_MAGAZINE_CLASSES;
+    }
+
+    if ((uintptr_t) p & (((uintptr_t) 1 << shift) - 1)) {
+        return NGX_SLAB_MAGAZINE_CLASSES;
+    }
+
+    return shift - pool->min_shift;
+}
+
+
+static void *
+ngx_slab_magazine_refill(ngx_slab_pool_t *pool, ngx_slab_magazine_t *mag,
+    ngx_uint_t slot)
+{
+    void        *p;
+    size_t       size;
+    ngx_uint_t   n, log_nomem;
+
+    size = (size_t) 1 << (slot + pool->min_shift);
+
+    /* a failure is logged by the caller if draining magazines does not help */
+
+    log_nomem = pool->log_nomem;
+    pool->log_nomem = 0;
+
+    for (n = ngx_slab_magazine_size(pool, slot) / 2; n; n--) {
+
+        p = ngx_slab_alloc_chunk(pool, size);
+
+        pool->stats[slot].reqs--;
+
+        if (p == NULL) {
+
+            /* a failed allocation is accounted by the caller */
+
+            pool->stats[slot].fails--;
+            break;
+        }
+
+        *(void **) p = mag->free[slot];
+        mag->free[slot] = p;
+        mag->count[slot]++;
+
+        pool->stats[slot].used--;
+    }
+
+    pool->log_nomem = log_nomem;
+
+    p = mag->free[slot];
+
+    if (p) {
+        mag->free[slot] = *(void **) p;
+        mag->count[slot]--;
+
+        pool->stats[slot].reqs++;
+        pool->stats[slot].used++;
+    }
+
+    return p;
+}
+
+
+static void
+ngx_slab_magazine_drain(ngx_slab_pool_t *pool, ngx_slab_magazine_t *mag,
+    ngx_uint_t slot, ngx_uint_t n)
+{
+    void  *p;
+
+    while (n--) {
+        p = mag->free[slot];
+
+        if (p == NULL) {
+            break;
+        }
+
+        mag->free[slot] = *(void **) p;
+        mag->count[slot]--;
+
+        /* the chunk is counted as free already */
+
+        pool->stats[slot].used++;
+
+        ngx_slab_free_chunk(pool, p);
+    }
+}
+
+
 static ngx_slab_page_t *
 ngx_slab_alloc_pages(ngx_slab_pool_t *pool, ngx_uint_t pages)
 {
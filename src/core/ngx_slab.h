@@ -54,19 +54,28 @@ typedef struct {
 
     unsigned          log_nomem:1;
 
+    ngx_uint_t        magazine;
     void             *data;
     void             *addr;
+
+    /* pools placed in the zone with their own mutexes */
+    void             *next;
 } ngx_slab_pool_t;
 
 
 void ngx_slab_sizes_init(void);
 void ngx_slab_init(ngx_slab_pool_t *pool);
+void ngx_slab_init_magazine(ngx_slab_pool_t *pool);
 void *ngx_slab_alloc(ngx_slab_pool_t *pool, size_t size);
 void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size);
 void *ngx_slab_calloc(ngx_slab_pool_t *pool, size_t size);
 void *ngx_slab_calloc_locked(ngx_slab_pool_t *pool, size_t size);
 void ngx_slab_free(ngx_slab_pool_t *pool, void *p);
 void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p);
+void ngx_slab_flush_magazines(void);
+
+
+extern ngx_uint_t  ngx_slab_magazines;
 
 
 #endif /* _NGX_SLAB_H_INCLUDED_ */
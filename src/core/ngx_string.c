@@ -1808,16 +1808,33 @@ ngx_escape_html(u_char *dst, u_char *src, size_t size)
 }
 
 
+#define ngx_escape_json_word(w)                                              \
+    (ngx_swar_hasless(w, 0x20)                                                \
+     | ngx_swar_hasbyte(w, '"') | ngx_swar_hasbyte(w, '\\'))
+
+
 uintptr_t
 ngx_escape_json(u_char *dst, u_char *src, size_t size)
 {
     u_char      ch;
+    uint64_t    w;
     ngx_uint_t  len;
 
     if (dst == NULL) {
         len = 0;
 
         while (size) {
+
+            if (size >= 8) {
+                w = ngx_swar_load(src);
+
+                if (ngx_escape_json_word(w) == 0) {
+                    src += 8;
+                    size -= 8;
+                    continue;
+                }
+            }
+
             ch = *src++;
 
             if (ch == '\\' || ch == '"') {
@@ -1846,6 +1863,19 @@ ngx_escape_json(u_char *dst, u_char *src, size_t size)
     }
 
     while (size) {
+
+        if (size >= 8) {
+            w = ngx_swar_load(src);
+
+            if (ngx_escape_json_word(w) == 0) {
+                ngx_memcpy(dst, src, 8);
+                dst += 8;
+                src += 8;
+                size -= 8;
+                continue;
+            }
+        }
+
         ch = *src++;
 
         if (ch > 0x1f) {
@@ -148,6 +148,31 @@ ngx_copy(u_char *dst, u_char *src, size_t len)
 #define ngx_memcmp(s1, s2, n)  memcmp((const char *) s1, (const char *) s2, n)
 
 
+/*
+ * tests of 8 bytes at once in a 64-bit word: the result is non-zero
+ * if the word has a zero byte, a byte less than n (n <= 128),
+ * or a byte equal to c
+ */
+
+#define ngx_swar_haszero(w)                                                   \
+    (((w) - 0x0101010101010101ULL) & ~(w) & 0x8080808080808080ULL)
+#define ngx_swar_hasless(w, n)                                                \
+    (((w) - 0x0101010101010101ULL * (n)) & ~(w) & 0x8080808080808080ULL)
+#define ngx_swar_hasbyte(w, c)                                                \
+    ngx_swar_haszero((w) ^ (0x0101010101010101ULL * (c)))
+
+
+static ngx_inline uint64_t
+ngx_swar_load(u_char *p)
+{
+    uint64_t  w;
+
+    ngx_memcpy(&w, p, sizeof(uint64_t));
+
+    return w;
+}
+
+
 u_char *ngx_cpystrn(u_char *dst, u_char *src, size_t n);
 u_char *ngx_pstrdup(ngx_pool_t *pool, ngx_str_t *src);
 u_char * ngx_cdecl ngx_sprintf(u_char *buf, const char *fmt, ...);
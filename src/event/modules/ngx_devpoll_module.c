@@ -371,10 +371,14 @@ ngx_devpoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
     dvp.dp_fds = event_list;
     dvp.dp_nfds = (int) nevents;
     dvp.dp_timeout = timer;
+    ngx_event_wait_start();
+
     events = ioctl(dp, DP_POLL, &dvp);
 
     err = (events == -1) ? ngx_errno : 0;
 
+    ngx_event_wait_end();
+
     if (flags & NGX_UPDATE_TIME || ngx_event_timer_alarm) {
         ngx_time_update();
     }
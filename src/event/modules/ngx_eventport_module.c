@@ -460,10 +460,14 @@ ngx_eventport_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
 
     events = 1;
 
+    ngx_event_wait_start();
+
     n = port_getn(ep, event_list, (u_int) nevents, &events, tp);
 
     err = ngx_errno;
 
+    ngx_event_wait_end();
+
     if (flags & NGX_UPDATE_TIME) {
         ngx_time_update();
     }
@@ -254,6 +254,8 @@ ngx_select_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
     work_write_fd_set = master_write_fd_set;
     work_except_fd_set = master_write_fd_set;
 
+    ngx_event_wait_start();
+
     if (max_read || max_write) {
         ready = select(0, &work_read_fd_set, &work_write_fd_set,
                        &work_except_fd_set, tp);
@@ -273,6 +275,8 @@ ngx_select_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
 
     err = (ready == -1) ? ngx_socket_errno : 0;
 
+    ngx_event_wait_end();
+
     if (flags & NGX_UPDATE_TIME) {
         ngx_time_update();
     }
@@ -55,6 +55,11 @@ ngx_uint_t            ngx_accept_events;
 ngx_uint_t            ngx_accept_mutex_held;
 ngx_msec_t            ngx_accept_mutex_delay;
 ngx_int_t             ngx_accept_disabled;
+ngx_msec_t            ngx_overload_lag;
+ngx_uint_t            ngx_overload_backlog;
+ngx_uint_t            ngx_event_overloaded;
+ngx_uint_t            ngx_event_timed;
+ngx_uint_t            ngx_event_wait;
 
 
 #if (NGX_STAT_STUB)
@@ -77,6 +82,13 @@ ngx_atomic_t         *ngx_stat_waiting = &ngx_stat_waiting0;
 #endif
 
 
+#if (NGX_STAT_METRICS)
+
+ngx_event_metrics_t  *ngx_event_metrics;
+
+#endif
+
+
 
 static ngx_command_t  ngx_events_commands[] = {
 
@@ -154,6 +166,27 @@ static ngx_command_t  ngx_event_core_commands[] = {
       offsetof(ngx_event_conf_t, accept_mutex_delay),
       NULL },
 
+    { ngx_string("overload_lag"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      0,
+      offsetof(ngx_event_conf_t, overload_lag),
+      NULL },
+
+    { ngx_string("overload_backlog"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      0,
+      offsetof(ngx_event_conf_t, overload_backlog),
+      NULL },
+
+    { ngx_string("hugepages"),
+      NGX_EVENT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_event_conf_t, hugepages),
+      NULL },
+
     { ngx_string("debug_connection"),
       NGX_EVENT_CONF|NGX_CONF_TAKE1,
       ngx_event_debug_connection,
@@ -193,8 +226,24 @@ ngx_module_t  ngx_event_core_module = {
 void
 ngx_process_events_and_timers(ngx_cycle_t *cycle)
 {
-    ngx_uint_t  flags;
+    ngx_uint_t  flags, begin, now, busy;
     ngx_msec_t  timer, delta;
+#if (NGX_STAT_METRICS)
+    ngx_uint_t  mark, posted;
+#endif
+
+    /* handlers called by an event module itself are timed as well */
+
+    ngx_event_timed = (ngx_overload_lag != 0);
+
+#if (NGX_STAT_METRICS)
+    if (ngx_event_metrics) {
+        ngx_event_timed = 1;
+    }
+#endif
+
+    begin = ngx_event_timed ? ngx_stat_usec() : 0;
+    ngx_event_wait = 0;
 
     if (ngx_timer_resolution) {
         timer = NGX_TIMER_INFINITE;
@@ -219,6 +268,9 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
         if (ngx_accept_disabled > 0) {
             ngx_accept_disabled--;
 
+        } else if (ngx_event_overloaded == NGX_EVENT_OVERLOAD_LAG) {
+            /* leave new connections to other workers */
+
         } else {
             if (ngx_trylock_accept_mutex(cycle) == NGX_ERROR) {
                 return;
@@ -251,17 +303,60 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
                    "timer delta: %M", delta);
 
+#if (NGX_STAT_METRICS)
+    mark = 0;
+
+    if (ngx_event_metrics) {
+        mark = ngx_stat_usec();
+        ngx_stat_histogram_add(&ngx_event_metrics->events,
+                               mark - begin - ngx_event_wait);
+    }
+#endif
+
     ngx_event_process_posted(cycle, &ngx_posted_accept_events);
 
     if (ngx_accept_mutex_held) {
         ngx_shmtx_unlock(&ngx_accept_mutex);
     }
 
+#if (NGX_STAT_METRICS)
+    posted = 0;
+
+    if (ngx_event_metrics) {
+        now = ngx_stat_usec();
+        posted = now - mark;
+        mark = now;
+    }
+#endif
+
     if (delta) {
         ngx_event_expire_timers();
     }
 
+#if (NGX_STAT_METRICS)
+    if (ngx_event_metrics) {
+        now = ngx_stat_usec();
+        ngx_stat_histogram_add(&ngx_event_metrics->timers, now - mark);
+        mark = now;
+    }
+#endif
+
     ngx_event_process_posted(cycle, &ngx_posted_events);
+
+    now = ngx_event_timed ? ngx_stat_usec() : 0;
+    busy = now - begin - ngx_event_wait;
+
+#if (NGX_STAT_METRICS)
+    if (ngx_event_metrics) {
+        ngx_stat_histogram_add(&ngx_event_metrics->posted,
+                               posted + now - mark);
+        ngx_stat_histogram_add(&ngx_event_metrics->loop, busy);
+    }
+#endif
+
+    if (ngx_overload_lag || ngx_overload_backlog) {
+        ngx_event_overload(cycle, busy / 1000);
+    }
 }
 
 
@@ -547,6 +642,7 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     shm.size = size;
     ngx_str_set(&shm.name, "nginx_shared_zone");
     shm.log = cycle->log;
+    shm.hugepages = 0;
 
     if (ngx_shm_alloc(&shm) != NGX_OK) {
         return NGX_ERROR;
@@ -612,6 +708,7 @@ ngx_timer_signal_handler(int signo)
 static ngx_int_t
 ngx_event_process_init(ngx_cycle_t *cycle)
 {
+    size_t               size;
     ngx_uint_t           m, i;
     ngx_event_t         *rev, *wev;
     ngx_listening_t     *ls;
@@ -632,6 +729,10 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         ngx_use_accept_mutex = 0;
     }
 
+    ngx_overload_lag = ecf->overload_lag;
+    ngx_overload_backlog = ecf->overload_backlog;
+    ngx_event_overloaded = 0;
+
 #if (NGX_WIN32)
 
     /*
@@ -726,16 +827,20 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 
 #endif
 
-    cycle->connections =
-        ngx_alloc(sizeof(ngx_connection_t) * cycle->connection_n, cycle->log);
+    size = sizeof(ngx_connection_t) * cycle->connection_n;
+
+    cycle->connections = ecf->hugepages ? ngx_alloc_huge(size, cycle->log)
+                                        : ngx_alloc(size, cycle->log);
     if (cycle->connections == NULL) {
         return NGX_ERROR;
     }
 
     c = cycle->connections;
 
-    cycle->read_events = ngx_alloc(sizeof(ngx_event_t) * cycle->connection_n,
-                                   cycle->log);
+    size = sizeof(ngx_event_t) * cycle->connection_n;
+
+    cycle->read_events = ecf->hugepages ? ngx_alloc_huge(size, cycle->log)
+                                        : ngx_alloc(size, cycle->log);
     if (cycle->read_events == NULL) {
         return NGX_ERROR;
     }
@@ -746,8 +851,8 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         rev[i].instance = 1;
     }
 
-    cycle->write_events = ngx_alloc(sizeof(ngx_event_t) * cycle->connection_n,
-                                    cycle->log);
+    cycle->write_events = ecf->hugepages ? ngx_alloc_huge(size, cycle->log)
+                                         : ngx_alloc(size, cycle->log);
     if (cycle->write_events == NULL) {
         return NGX_ERROR;
     }
@@ -946,6 +1051,80 @@ ngx_send_lowat(ngx_connection_t *c, size_t lowat)
 }
 
 
+ngx_uint_t
+ngx_stat_usec(void)
+{
+#if (NGX_HAVE_CLOCK_MONOTONIC)
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ngx_uint_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+#else
+    struct timeval   tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (ngx_uint_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+
+#if (NGX_STAT_METRICS)
+
+
+/*
+ * bucket bounds are 1, 2, 3, 4, 6, 8, 12, 16, ... microseconds,
+ * that is, powers of two and the midpoints between them
+ */
+
+void
+ngx_stat_histogram_add(ngx_stat_histogram_t *h, ngx_uint_t usec)
+{
+    ngx_uint_t  n, k, v;
+
+    if (usec <= 1) {
+        n = 0;
+
+    } else {
+        v = usec - 1;
+
+        for (k = 0; v >>= 1; k++) { /* void */ }
+
+        /* 2^k < usec <= 2^(k+1) */
+
+        n = (2 * usec <= (ngx_uint_t) 3 << k) ? 2 * k : 2 * k + 1;
+
+        if (n > NGX_STAT_HISTOGRAM_BUCKETS - 1) {
+            n = NGX_STAT_HISTOGRAM_BUCKETS - 1;
+        }
+    }
+
+    /* a histogram may be shared with an old worker after a reload */
+
+    (void) ngx_atomic_fetch_add(&h->sum, usec);
+    (void) ngx_atomic_fetch_add(&h->buckets[n], 1);
+}
+
+
+ngx_uint_t
+ngx_stat_histogram_bound(ngx_uint_t n)
+{
+    if (n == 0) {
+        return 1;
+    }
+
+    if (n & 1) {
+        return (ngx_uint_t) 1 << ((n + 1) / 2);
+    }
+
+    return (ngx_uint_t) 3 << (n / 2 - 1);
+}
+
+#endif
+
+
 static char *
 ngx_events_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -1232,6 +1411,9 @@ ngx_event_core_create_conf(ngx_cycle_t *cycle)
     ecf->multi_accept = NGX_CONF_UNSET;
     ecf->accept_mutex = NGX_CONF_UNSET;
     ecf->accept_mutex_delay = NGX_CONF_UNSET_MSEC;
+    ecf->overload_lag = NGX_CONF_UNSET_MSEC;
+    ecf->overload_backlog = NGX_CONF_UNSET;
+    ecf->hugepages = NGX_CONF_UNSET;
     ecf->name = (void *) NGX_CONF_UNSET;
 
 #if (NGX_DEBUG)
@@ -1331,6 +1513,9 @@ ngx_event_core_init_conf(ngx_cycle_t *cycle, void *conf)
     ngx_conf_init_value(ecf->multi_accept, 0);
     ngx_conf_init_value(ecf->accept_mutex, 0);
     ngx_conf_init_msec_value(ecf->accept_mutex_delay, 500);
+    ngx_conf_init_msec_value(ecf->overload_lag, 0);
+    ngx_conf_init_value(ecf->overload_backlog, 0);
+    ngx_conf_init_value(ecf->hugepages, 0);
 
     return NGX_CONF_OK;
 }
@@ -426,6 +426,10 @@ extern ngx_os_io_t  ngx_io;
 #define ngx_udp_send_chain   ngx_io.udp_send_chain
 
 
+#define NGX_EVENT_OVERLOAD_LAG      1
+#define NGX_EVENT_OVERLOAD_BACKLOG  2
+
+
 #define NGX_EVENT_MODULE      0x544E5645  /* "EVNT" */
 #define NGX_EVENT_CONF        0x02000000
 
@@ -439,6 +443,11 @@ typedef struct {
 
     ngx_msec_t    accept_mutex_delay;
 
+    ngx_msec_t    overload_lag;
+    ngx_int_t     overload_backlog;
+
+    ngx_flag_t    hugepages;
+
     u_char       *name;
 
 #if (NGX_DEBUG)
@@ -466,6 +475,11 @@ extern ngx_uint_t             ngx_accept_events;
 extern ngx_uint_t             ngx_accept_mutex_held;
 extern ngx_msec_t             ngx_accept_mutex_delay;
 extern ngx_int_t              ngx_accept_disabled;
+extern ngx_msec_t             ngx_overload_lag;
+extern ngx_uint_t             ngx_overload_backlog;
+extern ngx_uint_t             ngx_event_overloaded;
+extern ngx_uint_t             ngx_event_timed;
+extern ngx_uint_t             ngx_event_wait;
 
 
 #if (NGX_STAT_STUB)
@@ -481,6 +495,51 @@ extern ngx_atomic_t  *ngx_stat_waiting;
 #endif
 
 
+/*
+ * time spent by an event module waiting for events is excluded from
+ * the event loop duration, which is used by "overload_lag" and metrics
+ */
+
+#define ngx_event_wait_start()                                                \
+    ngx_event_wait = ngx_event_timed ? ngx_stat_usec() : 0
+
+#define ngx_event_wait_end()                                                  \
+    ngx_event_wait = ngx_event_timed ? ngx_stat_usec() - ngx_event_wait : 0
+
+
+ngx_uint_t ngx_stat_usec(void);
+
+
+#if (NGX_STAT_METRICS)
+
+#define NGX_STAT_HISTOGRAM_BUCKETS  49
+
+
+/* log-linear histogram of microseconds, the last bucket is +Inf */
+
+typedef struct {
+    ngx_atomic_uint_t  sum;
+    ngx_atomic_uint_t  buckets[NGX_STAT_HISTOGRAM_BUCKETS];
+} ngx_stat_histogram_t;
+
+
+typedef struct {
+    ngx_stat_histogram_t  loop;
+    ngx_stat_histogram_t  events;
+    ngx_stat_histogram_t  timers;
+    ngx_stat_histogram_t  posted;
+} ngx_event_metrics_t;
+
+
+extern ngx_event_metrics_t  *ngx_event_metrics;
+
+
+void ngx_stat_histogram_add(ngx_stat_histogram_t *h, ngx_uint_t usec);
+ngx_uint_t ngx_stat_histogram_bound(ngx_uint_t n);
+
+#endif
+
+
 #define NGX_UPDATE_TIME         1
 #define NGX_POST_EVENTS         2
 
@@ -505,6 +564,7 @@ void ngx_udp_rbtree_insert_value(ngx_rbtree_node_t *temp,
 void ngx_delete_udp_connection(void *data);
 ngx_int_t ngx_trylock_accept_mutex(ngx_cycle_t *cycle);
 ngx_int_t ngx_enable_accept_events(ngx_cycle_t *cycle);
+void ngx_event_overload(ngx_cycle_t *cycle, ngx_msec_t lag);
 u_char *ngx_accept_log_error(ngx_log_t *log, u_char *buf, size_t len);
 #if (NGX_DEBUG)
 void ngx_debug_accepted_connection(ngx_event_conf_t *ecf, ngx_connection_t *c);
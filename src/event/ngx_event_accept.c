@@ -10,7 +10,12 @@
 #include <ngx_event.h>
 
 
+#define NGX_EVENT_OVERLOAD_INTERVAL  100
+
+
 static ngx_int_t ngx_disable_accept_events(ngx_cycle_t *cycle, ngx_uint_t all);
+static void ngx_event_overload_handler(ngx_event_t *ev);
+static ngx_uint_t ngx_event_accept_backlog(ngx_cycle_t *cycle);
 static void ngx_close_accepted_connection(ngx_connection_t *c);
 
 
@@ -159,6 +164,8 @@ ngx_event_accept(ngx_event_t *ev)
             return;
         }
 
+        ngx_pool_set_type(c->pool, NGX_POOL_CONNECTION);
+
         if (socklen > (socklen_t) sizeof(ngx_sockaddr_t)) {
             socklen = sizeof(ngx_sockaddr_t);
         }
@@ -418,6 +425,154 @@ ngx_disable_accept_events(ngx_cycle_t *cycle, ngx_uint_t all)
 }
 
 
+/*
+ * the worker is considered overloaded if an event loop iteration took
+ * longer than "overload_lag" or the accept queue of its listening
+ * sockets exceeded "overload_backlog" during the last check interval;
+ * an overloaded worker closes idle keepalive connections and modules
+ * reject new connections; if only the lag is exceeded, the worker also
+ * stops accepting on shared listening sockets in favour of other workers,
+ * while a long accept queue is drained by rejecting connections
+ */
+
+void
+ngx_event_overload(ngx_cycle_t *cycle, ngx_msec_t lag)
+{
+    ngx_uint_t                overloaded, backlog;
+
+    static ngx_msec_t         lag_max, next_check;
+    static ngx_event_t        ev;
+    static ngx_connection_t   dumb;
+
+    if (lag > lag_max) {
+        lag_max = lag;
+    }
+
+    if ((ngx_msec_int_t) (ngx_current_msec - next_check) < 0) {
+        goto done;
+    }
+
+    next_check = ngx_current_msec + NGX_EVENT_OVERLOAD_INTERVAL;
+
+    overloaded = 0;
+
+    if (ngx_overload_lag && lag_max >= ngx_overload_lag) {
+        overloaded |= NGX_EVENT_OVERLOAD_LAG;
+    }
+
+    backlog = 0;
+
+    if (ngx_overload_backlog) {
+        backlog = ngx_event_accept_backlog(cycle);
+
+        if (backlog >= ngx_overload_backlog) {
+            overloaded |= NGX_EVENT_OVERLOAD_BACKLOG;
+        }
+    }
+
+    if (overloaded != ngx_event_overloaded) {
+
+        if (overloaded && !ngx_event_overloaded) {
+            ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                          "worker process is overloaded, "
+                          "lag: %M, backlog: %ui", lag_max, backlog);
+
+        } else if (!overloaded) {
+            ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0,
+                          "worker process is no longer overloaded");
+        }
+
+        if (overloaded == NGX_EVENT_OVERLOAD_LAG) {
+            if (ngx_disable_accept_events(cycle, 0) == NGX_ERROR) {
+                return;
+            }
+
+            ngx_accept_mutex_held = 0;
+
+        } else if (ngx_event_overloaded == NGX_EVENT_OVERLOAD_LAG
+                   && !ngx_use_accept_mutex)
+        {
+            if (ngx_enable_accept_events(cycle) == NGX_ERROR) {
+                return;
+            }
+        }
+
+        ngx_event_overloaded = overloaded;
+    }
+
+    lag_max = 0;
+
+done:
+
+    if (!ngx_event_overloaded) {
+        return;
+    }
+
+    ngx_drain_connections(cycle);
+
+    /* keep the event loop running to notice the end of overload */
+
+    if (!ev.timer_set) {
+        ev.handler = ngx_event_overload_handler;
+        ev.data = &dumb;
+        ev.log = cycle->log;
+        ev.cancelable = 1;
+        dumb.fd = (ngx_socket_t) -1;
+
+        ngx_add_timer(&ev, NGX_EVENT_OVERLOAD_INTERVAL);
+    }
+}
+
+
+static void
+ngx_event_overload_handler(ngx_event_t *ev)
+{
+    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, 0, "overload check");
+}
+
+
+static ngx_uint_t
+ngx_event_accept_backlog(ngx_cycle_t *cycle)
+{
+#if (NGX_HAVE_TCP_INFO && NGX_LINUX)
+
+    socklen_t          len;
+    ngx_uint_t         i, backlog;
+    struct tcp_info    ti;
+    ngx_listening_t   *ls;
+
+    backlog = 0;
+
+    ls = cycle->listening.elts;
+    for (i = 0; i < cycle->listening.nelts; i++) {
+
+        if (ls[i].connection == NULL || ls[i].type != SOCK_STREAM) {
+            continue;
+        }
+
+        len = sizeof(struct tcp_info);
+
+        /* for listening sockets tcpi_unacked is the accept queue length */
+
+        if (getsockopt(ls[i].fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == -1) {
+            continue;
+        }
+
+        if (ti.tcpi_unacked > backlog) {
+            backlog = ti.tcpi_unacked;
+        }
+    }
+
+    return backlog;
+
+#else
+
+    return 0;
+
+#endif
+}
+
+
 static void
 ngx_close_accepted_connection(ngx_connection_t *c)
 {
@@ -9,21 +9,88 @@
 #include <ngx_core.h>
 #include <ngx_event.h>
 
+#if (NGX_THREADS)
+#include <ngx_thread_pool.h>
+#endif
+
 
 #define NGX_SSL_PASSWORD_BUFFER_SIZE  4096
 
 
+#define NGX_SSL_CACHE_CERT  0
+#define NGX_SSL_CACHE_PKEY  1
+
+
 typedef struct {
-    ngx_uint_t  engine;   /* unsigned  engine:1; */
+    ngx_uint_t     engine;   /* unsigned  engine:1; */
+    ngx_array_t   *ticket_keys;
 } ngx_openssl_conf_t;
 
 
+struct ngx_ssl_cache_s {
+    ngx_rbtree_t                   rbtree;
+    ngx_rbtree_node_t              sentinel;
+    ngx_queue_t                    expire_queue;
+
+    ngx_uint_t                     current;
+    ngx_uint_t                     max;
+    time_t                         valid;
+    time_t                         inactive;
+};
+
+
+typedef struct {
+    ngx_str_node_t                 sn;
+    ngx_queue_t                    queue;
+
+    ngx_uint_t                     type;
+    void                          *value;
+    STACK_OF(X509)                *chain;
+
+    ngx_file_uniq_t                uniq;
+    time_t                         mtime;
+    time_t                         validated;
+    time_t                         accessed;
+} ngx_ssl_cache_node_t;
+
+
+#ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
+
+typedef struct {
+    ngx_str_t                      name;
+    ngx_file_uniq_t                uniq;
+    time_t                         mtime;
+} ngx_ssl_ticket_key_file_t;
+
+
+typedef struct {
+    ngx_shm_zone_t                *shm_zone;
+    time_t                         timeout;
+    ngx_array_t                   *keys;
+    ngx_array_t                   *files;
+    time_t                         check;
+    ngx_uint_t                     shared;  /* unsigned  shared:1; */
+    ngx_atomic_t                   generation;
+    ngx_event_t                    event;
+} ngx_ssl_ticket_keys_t;
+
+#endif
+
+
 static X509 *ngx_ssl_load_certificate(ngx_pool_t *pool, char **err,
     ngx_str_t *cert, STACK_OF(X509) **chain);
 static EVP_PKEY *ngx_ssl_load_certificate_key(ngx_pool_t *pool, char **err,
     ngx_str_t *key, ngx_array_t *passwords);
 static int ngx_ssl_password_callback(char *buf, int size, int rwflag,
     void *userdata);
+static void *ngx_ssl_cache_fetch(ngx_connection_t *c, ngx_pool_t *pool,
+    ngx_ssl_cache_t *cache, ngx_uint_t type, char **err, ngx_str_t *path,
+    ngx_array_t *passwords, STACK_OF(X509) **chain);
+static void ngx_ssl_cache_expire(ngx_ssl_cache_t *cache, ngx_uint_t n,
+    ngx_log_t *log);
+static void ngx_ssl_cache_free(ngx_ssl_cache_t *cache,
+    ngx_ssl_cache_node_t *cn);
+static void ngx_ssl_cache_cleanup(void *data);
 static int ngx_ssl_verify_callback(int ok, X509_STORE_CTX *x509_store);
 static void ngx_ssl_info_callback(const ngx_ssl_conn_t *ssl_conn, int where,
     int ret);
@@ -37,6 +104,13 @@ static ngx_int_t ngx_ssl_try_early_data(ngx_connection_t *c);
 static void ngx_ssl_handshake_log(ngx_connection_t *c);
 #endif
 static void ngx_ssl_handshake_handler(ngx_event_t *ev);
+#if (NGX_THREADS)
+static ngx_int_t ngx_ssl_handshake_post(ngx_connection_t *c);
+static void ngx_ssl_handshake_thread(void *data, ngx_log_t *log);
+static void ngx_ssl_handshake_thread_event_handler(ngx_event_t *ev);
+static int ngx_ssl_handshake_certificate_callback(ngx_ssl_conn_t *ssl_conn,
+    void *arg);
+#endif
 #ifdef SSL_READ_EARLY_DATA_SUCCESS
 static ssize_t ngx_ssl_recv_early(ngx_connection_t *c, u_char *buf,
     size_t size);
@@ -63,12 +137,30 @@ static ngx_ssl_session_t *ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
 #endif
     u_char *id, int len, int *copy);
 static void ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess);
-static void ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
-    ngx_slab_pool_t *shpool, ngx_uint_t n);
+static ngx_int_t ngx_ssl_session_cache_init_shards(ngx_shm_zone_t *shm_zone,
+    ngx_ssl_session_cache_t *cache);
+static void ngx_ssl_expire_sessions(ngx_ssl_session_shard_t *shard,
+    ngx_uint_t n);
+static void ngx_ssl_free_sess_id(ngx_ssl_session_shard_t *shard,
+    ngx_ssl_sess_id_t *sess_id);
 static void ngx_ssl_session_rbtree_insert_value(ngx_rbtree_node_t *temp,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
 
 #ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
+static ngx_int_t ngx_ssl_session_ticket_key_read(
+    ngx_ssl_ticket_key_file_t *kf, ngx_ssl_session_ticket_key_t *key,
+    ngx_log_t *log);
+static void ngx_ssl_session_ticket_keys_handler(ngx_event_t *ev);
+static void ngx_ssl_session_ticket_keys_check(ngx_ssl_ticket_keys_t *tk,
+    ngx_log_t *log);
+static ngx_int_t ngx_ssl_rotate_ticket_keys(ngx_ssl_ticket_keys_t *tk,
+    ngx_log_t *log);
+static ngx_int_t ngx_ssl_generate_ticket_key(ngx_ssl_session_ticket_key_t *key,
+    ngx_log_t *log);
+static void ngx_ssl_session_ticket_keys_update(ngx_ssl_ticket_keys_t *tk,
+    ngx_ssl_session_ticket_key_t *keys);
+static ngx_uint_t ngx_ssl_session_ticket_key_get(ngx_ssl_ticket_keys_t *tk,
+    u_char *name, ngx_ssl_session_ticket_key_t *key);
 static int ngx_ssl_session_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
     unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx,
     HMAC_CTX *hctx, int enc);
@@ -134,6 +226,31 @@ int  ngx_ssl_certificate_index;
 int  ngx_ssl_next_certificate_index;
 int  ngx_ssl_certificate_name_index;
 int  ngx_ssl_stapling_index;
+#if (NGX_THREADS)
+int  ngx_ssl_handshake_pool_index;
+#endif
+
+
+#if (NGX_THREADS)
+
+typedef struct {
+    ngx_connection_t           *connection;
+
+    /* set in the thread */
+    int                         n;
+    int                         sslerr;
+    ngx_err_t                   err;
+    ngx_uint_t                  logged;
+
+    /* set in the event loop */
+    ngx_uint_t                  busy;
+    ngx_uint_t                  done;
+    ngx_uint_t                  timedout;
+    ngx_uint_t                  events;
+    ngx_uint_t                  closed;
+} ngx_ssl_handshake_ctx_t;
+
+#endif
 
 
 ngx_int_t
@@ -221,6 +338,18 @@ ngx_ssl_init(ngx_log_t *log)
         return NGX_ERROR;
     }
 
+#if (NGX_THREADS)
+
+    ngx_ssl_handshake_pool_index = SSL_CTX_get_ex_new_index(0, NULL, NULL,
+                                                            NULL, NULL);
+    if (ngx_ssl_handshake_pool_index == -1) {
+        ngx_ssl_error(NGX_LOG_ALERT, log, 0,
+                      "SSL_CTX_get_ex_new_index() failed");
+        return NGX_ERROR;
+    }
+
+#endif
+
     ngx_ssl_next_certificate_index = X509_get_ex_new_index(0, NULL, NULL, NULL,
                                                            NULL);
     if (ngx_ssl_next_certificate_index == -1) {
@@ -532,14 +661,22 @@ ngx_ssl_certificate(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *cert,
 
 ngx_int_t
 ngx_ssl_connection_certificate(ngx_connection_t *c, ngx_pool_t *pool,
-    ngx_str_t *cert, ngx_str_t *key, ngx_array_t *passwords)
+    ngx_str_t *cert, ngx_str_t *key, ngx_array_t *passwords,
+    ngx_ssl_cache_t *cache)
 {
     char            *err;
     X509            *x509;
     EVP_PKEY        *pkey;
     STACK_OF(X509)  *chain;
 
-    x509 = ngx_ssl_load_certificate(pool, &err, cert, &chain);
+    if (cache) {
+        x509 = ngx_ssl_cache_fetch(c, pool, cache, NGX_SSL_CACHE_CERT, &err,
+                                   cert, NULL, &chain);
+
+    } else {
+        x509 = ngx_ssl_load_certificate(pool, &err, cert, &chain);
+    }
+
     if (x509 == NULL) {
         if (err != NULL) {
             ngx_ssl_error(NGX_LOG_ERR, c->log, 0,
@@ -577,7 +714,14 @@ ngx_ssl_connection_certificate(ngx_connection_t *c, ngx_pool_t *pool,
 
 #endif
 
-    pkey = ngx_ssl_load_certificate_key(pool, &err, key, passwords);
+    if (cache) {
+        pkey = ngx_ssl_cache_fetch(c, pool, cache, NGX_SSL_CACHE_PKEY, &err,
+                                   key, passwords, NULL);
+
+    } else {
+        pkey = ngx_ssl_load_certificate_key(pool, &err, key, passwords);
+    }
+
     if (pkey == NULL) {
         if (err != NULL) {
             ngx_ssl_error(NGX_LOG_ERR, c->log, 0,
@@ -601,6 +745,287 @@ ngx_ssl_connection_certificate(ngx_connection_t *c, ngx_pool_t *pool,
 }
 
 
+ngx_ssl_cache_t *
+ngx_ssl_cache_create(ngx_pool_t *pool, ngx_uint_t max, time_t valid,
+    time_t inactive)
+{
+    ngx_ssl_cache_t     *cache;
+    ngx_pool_cleanup_t  *cln;
+
+    cache = ngx_pcalloc(pool, sizeof(ngx_ssl_cache_t));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    ngx_rbtree_init(&cache->rbtree, &cache->sentinel,
+                    ngx_str_rbtree_insert_value);
+
+    ngx_queue_init(&cache->expire_queue);
+
+    cache->max = max;
+    cache->valid = valid;
+    cache->inactive = inactive;
+
+    cln = ngx_pool_cleanup_add(pool, 0);
+    if (cln == NULL) {
+        return NULL;
+    }
+
+    cln->handler = ngx_ssl_cache_cleanup;
+    cln->data = cache;
+
+    return cache;
+}
+
+
+static void *
+ngx_ssl_cache_fetch(ngx_connection_t *c, ngx_pool_t *pool,
+    ngx_ssl_cache_t *cache, ngx_uint_t type, char **err, ngx_str_t *path,
+    ngx_array_t *passwords, STACK_OF(X509) **chain)
+{
+    u_char                *p;
+    void                  *value;
+    time_t                 now;
+    uint32_t               hash;
+    ngx_str_t              key;
+    ngx_file_info_t        fi;
+    ngx_ssl_cache_node_t  *cn;
+
+    if (ngx_strncmp(path->data, "data:", sizeof("data:") - 1) == 0
+        || ngx_strncmp(path->data, "engine:", sizeof("engine:") - 1) == 0)
+    {
+        goto load;
+    }
+
+    if (ngx_get_full_name(pool, (ngx_str_t *) &ngx_cycle->conf_prefix, path)
+        != NGX_OK)
+    {
+        *err = NULL;
+        return NULL;
+    }
+
+    /* certificates and keys may be in the same file */
+
+    key.len = path->len + 1;
+    key.data = ngx_pnalloc(pool, key.len);
+    if (key.data == NULL) {
+        *err = NULL;
+        return NULL;
+    }
+
+    key.data[0] = (u_char) ('0' + type);
+    ngx_memcpy(key.data + 1, path->data, path->len);
+
+    hash = ngx_crc32_long(key.data, key.len);
+
+    now = ngx_time();
+
+    ngx_ssl_cache_expire(cache, 1, c->log);
+
+    cn = (ngx_ssl_cache_node_t *) ngx_str_rbtree_lookup(&cache->rbtree, &key,
+                                                         hash);
+
+    if (cn) {
+        if (now - cn->validated < cache->valid) {
+            goto found;
+        }
+
+        if (ngx_file_info(path->data, &fi) != NGX_FILE_ERROR
+            && cn->uniq == ngx_file_uniq(&fi)
+            && cn->mtime == ngx_file_mtime(&fi))
+        {
+            cn->validated = now;
+            goto found;
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                       "ssl cache changed: \"%s\"", path->data);
+
+        ngx_ssl_cache_free(cache, cn);
+    }
+
+    if (ngx_file_info(path->data, &fi) == NGX_FILE_ERROR) {
+        goto load;
+    }
+
+    if (type == NGX_SSL_CACHE_CERT) {
+        value = ngx_ssl_load_certificate(pool, err, path, chain);
+
+    } else {
+        value = ngx_ssl_load_certificate_key(pool, err, path, passwords);
+    }
+
+    if (value == NULL) {
+        return NULL;
+    }
+
+    if (cache->current >= cache->max) {
+        ngx_ssl_cache_expire(cache, 0, c->log);
+    }
+
+    cn = ngx_alloc(sizeof(ngx_ssl_cache_node_t) + key.len + 1, c->log);
+    if (cn == NULL) {
+        return value;
+    }
+
+    p = (u_char *) cn + sizeof(ngx_ssl_cache_node_t);
+    ngx_memcpy(p, key.data, key.len);
+    p[key.len] = '\0';
+
+    cn->sn.node.key = hash;
+    cn->sn.str.len = key.len;
+    cn->sn.str.data = p;
+
+    cn->type = type;
+    cn->value = value;
+    cn->chain = NULL;
+    cn->uniq = ngx_file_uniq(&fi);
+    cn->mtime = ngx_file_mtime(&fi);
+    cn->validated = now;
+    cn->accessed = now;
+
+    ngx_rbtree_insert(&cache->rbtree, &cn->sn.node);
+    ngx_queue_insert_head(&cache->expire_queue, &cn->queue);
+
+    cache->current++;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "ssl cache add: \"%s\", %ui entries",
+                   path->data, cache->current);
+
+    /* the loaded objects are kept in the cache, the caller gets references */
+
+    if (type == NGX_SSL_CACHE_CERT) {
+        cn->chain = *chain;
+        goto found_cert;
+    }
+
+    goto found_key;
+
+found:
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "ssl cache hit: \"%s\"", path->data);
+
+    cn->accessed = now;
+
+    ngx_queue_remove(&cn->queue);
+    ngx_queue_insert_head(&cache->expire_queue, &cn->queue);
+
+    if (type == NGX_SSL_CACHE_CERT) {
+        goto found_cert;
+    }
+
+found_key:
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100001L
+    EVP_PKEY_up_ref(cn->value);
+#else
+    CRYPTO_add(&((EVP_PKEY *) cn->value)->references, 1, CRYPTO_LOCK_EVP_PKEY);
+#endif
+
+    return cn->value;
+
+found_cert:
+
+    *chain = X509_chain_up_ref(cn->chain);
+    if (*chain == NULL) {
+        *err = "X509_chain_up_ref() failed";
+        return NULL;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100001L
+    X509_up_ref(cn->value);
+#else
+    CRYPTO_add(&((X509 *) cn->value)->references, 1, CRYPTO_LOCK_X509);
+#endif
+
+    return cn->value;
+
+load:
+
+    if (type == NGX_SSL_CACHE_CERT) {
+        return ngx_ssl_load_certificate(pool, err, path, chain);
+    }
+
+    return ngx_ssl_load_certificate_key(pool, err, path, passwords);
+}
+
+
+static void
+ngx_ssl_cache_expire(ngx_ssl_cache_t *cache, ngx_uint_t n, ngx_log_t *log)
+{
+    time_t                 now;
+    ngx_queue_t           *q;
+    ngx_ssl_cache_node_t  *cn;
+
+    now = ngx_time();
+
+    /*
+     * n == 1 deletes one or two inactive entries
+     * n == 0 deletes least recently used entry by force
+     * and one or two inactive entries
+     */
+
+    while (n < 3) {
+
+        if (ngx_queue_empty(&cache->expire_queue)) {
+            return;
+        }
+
+        q = ngx_queue_last(&cache->expire_queue);
+
+        cn = ngx_queue_data(q, ngx_ssl_cache_node_t, queue);
+
+        if (n++ != 0 && now - cn->accessed <= cache->inactive) {
+            return;
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
+                       "ssl cache expire: \"%s\"", cn->sn.str.data + 1);
+
+        ngx_ssl_cache_free(cache, cn);
+    }
+}
+
+
+static void
+ngx_ssl_cache_free(ngx_ssl_cache_t *cache, ngx_ssl_cache_node_t *cn)
+{
+    ngx_rbtree_delete(&cache->rbtree, &cn->sn.node);
+    ngx_queue_remove(&cn->queue);
+
+    if (cn->type == NGX_SSL_CACHE_CERT) {
+        X509_free(cn->value);
+        sk_X509_pop_free(cn->chain, X509_free);
+
+    } else {
+        EVP_PKEY_free(cn->value);
+    }
+
+    ngx_free(cn);
+
+    cache->current--;
+}
+
+
+static void
+ngx_ssl_cache_cleanup(void *data)
+{
+    ngx_ssl_cache_t  *cache = data;
+
+    ngx_queue_t           *q;
+    ngx_ssl_cache_node_t  *cn;
+
+    while (!ngx_queue_empty(&cache->expire_queue)) {
+        q = ngx_queue_last(&cache->expire_queue);
+        cn = ngx_queue_data(q, ngx_ssl_cache_node_t, queue);
+
+        ngx_ssl_cache_free(cache, cn);
+    }
+}
+
+
 static X509 *
 ngx_ssl_load_certificate(ngx_pool_t *pool, char **err, ngx_str_t *cert,
     STACK_OF(X509) **chain)
@@ -1592,8 +2017,11 @@ ngx_ssl_set_session(ngx_connection_t *c, ngx_ssl_session_t *session)
 ngx_int_t
 ngx_ssl_handshake(ngx_connection_t *c)
 {
-    int        n, sslerr;
-    ngx_err_t  err;
+    int                       n, sslerr;
+    ngx_err_t                 err;
+#if (NGX_THREADS)
+    ngx_ssl_handshake_ctx_t  *hc;
+#endif
 
 #ifdef SSL_READ_EARLY_DATA_SUCCESS
     if (c->ssl->try_early_data) {
@@ -1601,12 +2029,45 @@ ngx_ssl_handshake(ngx_connection_t *c)
     }
 #endif
 
+#if (NGX_THREADS)
+
+    hc = c->ssl->handshake_task ? c->ssl->handshake_task->ctx : NULL;
+
+    if (hc && hc->busy) {
+        return NGX_AGAIN;
+    }
+
+    if (hc && hc->done) {
+
+        /* the result of SSL_do_handshake() called in a thread */
+
+        hc->done = 0;
+        n = hc->n;
+
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                       "SSL_do_handshake: %d (thread)", n);
+
+    } else {
+        hc = NULL;
+
+        ngx_ssl_clear_error(c->log);
+
+        n = SSL_do_handshake(c->ssl->connection);
+
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                       "SSL_do_handshake: %d", n);
+    }
+
+#else
+
     ngx_ssl_clear_error(c->log);
 
     n = SSL_do_handshake(c->ssl->connection);
 
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0, "SSL_do_handshake: %d", n);
 
+#endif
+
     if (n == 1) {
 
         if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
@@ -1644,7 +2105,11 @@ ngx_ssl_handshake(ngx_connection_t *c)
         return NGX_OK;
     }
 
+#if (NGX_THREADS)
+    sslerr = hc ? hc->sslerr : SSL_get_error(c->ssl->connection, n);
+#else
     sslerr = SSL_get_error(c->ssl->connection, n);
+#endif
 
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0, "SSL_get_error: %d", sslerr);
 
@@ -1680,6 +2145,35 @@ ngx_ssl_handshake(ngx_connection_t *c)
         return NGX_AGAIN;
     }
 
+#if (NGX_THREADS)
+
+    if (sslerr == SSL_ERROR_WANT_X509_LOOKUP
+        && c->ssl->handshake_offloaded
+        && c->ssl->handshake_task == NULL)
+    {
+        return ngx_ssl_handshake_post(c);
+    }
+
+    if (hc) {
+        err = hc->err;
+
+        c->ssl->no_wait_shutdown = 1;
+        c->ssl->no_send_shutdown = 1;
+        c->read->eof = 1;
+
+        if (!hc->logged) {
+            ngx_connection_error(c, err,
+                                 "peer closed connection in SSL handshake");
+            return NGX_ERROR;
+        }
+
+        c->read->error = 1;
+
+        return NGX_ERROR;
+    }
+
+#endif
+
     err = (sslerr == SSL_ERROR_SYSCALL) ? ngx_errno : 0;
 
     c->ssl->no_wait_shutdown = 1;
@@ -1701,17 +2195,253 @@ ngx_ssl_handshake(ngx_connection_t *c)
 }
 
 
-#ifdef SSL_READ_EARLY_DATA_SUCCESS
+#if (NGX_THREADS)
 
-static ngx_int_t
-ngx_ssl_try_early_data(ngx_connection_t *c)
+/*
+ * Private key operations of a full handshake are done when the server
+ * sends its first flight, after the certificate callback.  If handshake
+ * offload is enabled, the certificate callback returns -1 once, and
+ * the rest of this SSL_do_handshake() call, including the signature,
+ * is done in a thread pool.  The connection is not touched by the event
+ * loop until the thread completes, timeouts and events occurred in the
+ * meantime are handled after that.  Closing the connection is deferred
+ * as well: the thread uses the connection, its pool and the SSL object,
+ * so ngx_ssl_shutdown() returns NGX_AGAIN until the thread completes.
+ */
+
+ngx_int_t
+ngx_ssl_handshake_threads(ngx_conf_t *cf, ngx_ssl_t *ssl,
+    ngx_thread_pool_t *tp, ngx_uint_t cert_cb)
 {
-    int        n, sslerr;
-    u_char     buf;
-    size_t     readbytes;
-    ngx_err_t  err;
+    if (SSL_CTX_set_ex_data(ssl->ctx, ngx_ssl_handshake_pool_index, tp) == 0) {
+        ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "SSL_CTX_set_ex_data() failed");
+        return NGX_ERROR;
+    }
 
-    ngx_ssl_clear_error(c->log);
+    if (!cert_cb) {
+
+#ifdef SSL_R_CERT_CB_ERROR
+        SSL_CTX_set_cert_cb(ssl->ctx, ngx_ssl_handshake_certificate_callback,
+                            NULL);
+#else
+        ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "handshake offload is not supported on this platform");
+        return NGX_ERROR;
+#endif
+    }
+
+    return NGX_OK;
+}
+
+
+int
+ngx_ssl_handshake_offload(ngx_connection_t *c)
+{
+    ngx_ssl_conn_t  *ssl_conn;
+
+    if (c->ssl->handshake_offloaded || c->ssl->try_early_data) {
+        return 1;
+    }
+
+    ssl_conn = c->ssl->connection;
+
+    if (!SSL_is_server(ssl_conn) || SSL_session_reused(ssl_conn)) {
+        return 1;
+    }
+
+    if (SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl_conn),
+                            ngx_ssl_handshake_pool_index)
+        == NULL)
+    {
+        return 1;
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, 0, "ssl handshake offload");
+
+    c->ssl->handshake_offloaded = 1;
+
+    return -1;
+}
+
+
+static int
+ngx_ssl_handshake_certificate_callback(ngx_ssl_conn_t *ssl_conn, void *arg)
+{
+    ngx_connection_t  *c;
+
+    c = ngx_ssl_get_connection(ssl_conn);
+
+    if (c->ssl->handshaked) {
+        return 0;
+    }
+
+    return ngx_ssl_handshake_offload(c);
+}
+
+
+static ngx_int_t
+ngx_ssl_handshake_post(ngx_connection_t *c)
+{
+    ngx_thread_task_t        *task;
+    ngx_thread_pool_t        *tp;
+    ngx_ssl_handshake_ctx_t  *hc;
+
+    tp = SSL_CTX_get_ex_data(SSL_get_SSL_CTX(c->ssl->connection),
+                             ngx_ssl_handshake_pool_index);
+
+    task = ngx_thread_task_alloc(c->pool, sizeof(ngx_ssl_handshake_ctx_t));
+    if (task == NULL) {
+        return NGX_ERROR;
+    }
+
+    hc = task->ctx;
+
+    hc->connection = c;
+
+    task->handler = ngx_ssl_handshake_thread;
+    task->event.handler = ngx_ssl_handshake_thread_event_handler;
+    task->event.data = c;
+
+    if (ngx_thread_task_post(tp, task) != NGX_OK) {
+
+        /*
+         * the queue is full, the certificate callback is not called
+         * again for an offloaded handshake, so it continues here
+         */
+
+        return ngx_ssl_handshake(c);
+    }
+
+    hc->busy = 1;
+    c->ssl->handshake_task = task;
+
+    c->read->handler = ngx_ssl_handshake_handler;
+    c->write->handler = ngx_ssl_handshake_handler;
+
+    if (!(ngx_event_flags & NGX_USE_CLEAR_EVENT)) {
+
+        /* level-triggered events would fire until the thread completes */
+
+        if (c->read->active
+            && ngx_del_event(c->read, NGX_READ_EVENT, 0) != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        if (c->write->active
+            && ngx_del_event(c->write, NGX_WRITE_EVENT, 0) != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_AGAIN;
+}
+
+
+static void
+ngx_ssl_handshake_thread(void *data, ngx_log_t *log)
+{
+    ngx_ssl_handshake_ctx_t *hc = data;
+
+    ngx_connection_t  *c;
+
+    c = hc->connection;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, log, 0, "ssl handshake thread");
+
+    ngx_ssl_clear_error(c->log);
+
+    hc->n = SSL_do_handshake(c->ssl->connection);
+
+    if (hc->n == 1) {
+        return;
+    }
+
+    /* the error queue is per thread, so errors are logged here */
+
+    hc->sslerr = SSL_get_error(c->ssl->connection, hc->n);
+    hc->err = (hc->sslerr == SSL_ERROR_SYSCALL) ? ngx_errno : 0;
+
+    if (hc->sslerr == SSL_ERROR_WANT_READ
+        || hc->sslerr == SSL_ERROR_WANT_WRITE
+        || hc->sslerr == SSL_ERROR_ZERO_RETURN
+        || ERR_peek_error() == 0)
+    {
+        return;
+    }
+
+    ngx_ssl_connection_error(c, hc->sslerr, hc->err,
+                             "SSL_do_handshake() failed");
+
+    hc->logged = 1;
+}
+
+
+static void
+ngx_ssl_handshake_thread_event_handler(ngx_event_t *ev)
+{
+    ngx_int_t                 rc;
+    ngx_connection_t         *c;
+    ngx_ssl_handshake_ctx_t  *hc;
+
+    c = ev->data;
+    hc = c->ssl->handshake_task->ctx;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "ssl handshake thread handler");
+
+    hc->busy = 0;
+
+    if (hc->closed) {
+
+        /* the connection was closed while the thread was running */
+
+        c->ssl->handler(c);
+        return;
+    }
+
+#if (!defined OPENSSL_NO_OCSP && defined SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB)
+    ngx_ssl_stapling_handshake_update(c);
+#endif
+
+    if (hc->timedout) {
+        c->read->timedout = 1;
+        c->ssl->handler(c);
+        return;
+    }
+
+    hc->done = 1;
+
+    rc = ngx_ssl_handshake(c);
+
+    if (rc == NGX_AGAIN) {
+
+        if (hc->events) {
+            ngx_post_event(c->read, &ngx_posted_events);
+        }
+
+        return;
+    }
+
+    c->ssl->handler(c);
+}
+
+#endif
+
+
+#ifdef SSL_READ_EARLY_DATA_SUCCESS
+
+static ngx_int_t
+ngx_ssl_try_early_data(ngx_connection_t *c)
+{
+    int        n, sslerr;
+    u_char     buf;
+    size_t     readbytes;
+    ngx_err_t  err;
+
+    ngx_ssl_clear_error(c->log);
 
     readbytes = 0;
 
@@ -1878,6 +2608,31 @@ ngx_ssl_handshake_handler(ngx_event_t *ev)
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
                    "SSL handshake handler: %d", ev->write);
 
+#if (NGX_THREADS)
+
+    if (c->ssl->handshake_task) {
+        ngx_ssl_handshake_ctx_t  *hc;
+
+        hc = c->ssl->handshake_task->ctx;
+
+        if (hc->busy) {
+
+            /* handled when the thread completes */
+
+            if (ev->timedout) {
+                ev->timedout = 0;
+                hc->timedout = 1;
+
+            } else {
+                hc->events = 1;
+            }
+
+            return;
+        }
+    }
+
+#endif
+
     if (ev->timedout) {
         c->ssl->handler(c);
         return;
@@ -2735,6 +3490,24 @@ ngx_ssl_shutdown(ngx_connection_t *c)
     int        n, sslerr, mode;
     ngx_err_t  err;
 
+#if (NGX_THREADS)
+
+    if (c->ssl->handshake_task) {
+        ngx_ssl_handshake_ctx_t  *hc;
+
+        hc = c->ssl->handshake_task->ctx;
+
+        if (hc->busy) {
+
+            /* the caller's handler is called once the thread completes */
+
+            hc->closed = 1;
+            return NGX_AGAIN;
+        }
+    }
+
+#endif
+
     if (SSL_in_init(c->ssl->connection)) {
         /*
          * OpenSSL 1.0.2f complains if SSL_shutdown() is called during
@@ -3266,15 +4039,83 @@ failed:
 }
 
 
+/*
+ * A shared session cache may be split into several shards, each with
+ * its own slab pool, rbtree, expiration queue and mutex.  A session is
+ * placed into a shard by the hash of its id, so concurrent lookups and
+ * insertions of different sessions rarely contend for the same mutex.
+ * Expired sessions found by a lookup are left in place and are removed
+ * by the incremental expiration done on insertion into the same shard.
+ *
+ * The mutex of a shard is the one of its slab pool.  The pool is linked
+ * to the zone, so the master process unlocks the mutex if a worker dies
+ * holding it.  A single shard uses the slab pool of the zone and its
+ * mutex, as do all shards if atomic operations are not available.
+ */
+
+#define ngx_ssl_session_shard_lock(shard)    ngx_shmtx_lock((shard)->mutex)
+#define ngx_ssl_session_shard_unlock(shard)  ngx_shmtx_unlock((shard)->mutex)
+
+#define ngx_ssl_session_shard(cache, hash)                                    \
+    (&(cache)->shards[(hash) % (cache)->nshards])
+
+
+ngx_int_t
+ngx_ssl_session_cache_shards(ngx_conf_t *cf, ngx_shm_zone_t *shm_zone,
+    ngx_uint_t shards)
+{
+    ngx_ssl_session_cache_t  *cache;
+
+    cache = shm_zone->data;
+
+    if (cache == NULL) {
+        cache = ngx_pcalloc(cf->pool, sizeof(ngx_ssl_session_cache_t));
+        if (cache == NULL) {
+            return NGX_ERROR;
+        }
+
+        cache->nshards = shards;
+
+        shm_zone->data = cache;
+
+        return NGX_OK;
+    }
+
+    if (cache->nshards != shards) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "session cache \"%V\" is already declared "
+                           "with %ui shards",
+                           &shm_zone->shm.name, cache->nshards);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 {
+    ngx_ssl_session_cache_t  *ocache = data;
+
     size_t                    len;
+    ngx_uint_t                nshards;
     ngx_slab_pool_t          *shpool;
     ngx_ssl_session_cache_t  *cache;
 
-    if (data) {
-        shm_zone->data = data;
+    cache = shm_zone->data;
+    nshards = cache ? cache->nshards : 1;
+
+    if (ocache) {
+        if (ocache->nshards != nshards) {
+            ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                          "session cache \"%V\" uses %ui shards "
+                          "while previously it used %ui shards",
+                          &shm_zone->shm.name, nshards, ocache->nshards);
+            return NGX_ERROR;
+        }
+
+        shm_zone->data = ocache;
         return NGX_OK;
     }
 
@@ -3285,18 +4126,21 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
         return NGX_OK;
     }
 
-    cache = ngx_slab_alloc(shpool, sizeof(ngx_ssl_session_cache_t));
+    cache = ngx_slab_calloc(shpool, sizeof(ngx_ssl_session_cache_t));
     if (cache == NULL) {
         return NGX_ERROR;
     }
 
-    shpool->data = cache;
-    shm_zone->data = cache;
+    cache->nshards = nshards;
 
-    ngx_rbtree_init(&cache->session_rbtree, &cache->sentinel,
-                    ngx_ssl_session_rbtree_insert_value);
+    cache->shards = ngx_slab_calloc(shpool,
+                                    nshards * sizeof(ngx_ssl_session_shard_t));
+    if (cache->shards == NULL) {
+        return NGX_ERROR;
+    }
 
-    ngx_queue_init(&cache->expire_queue);
+    shpool->data = cache;
+    shm_zone->data = cache;
 
     len = sizeof(" in SSL session shared cache \"\"") + shm_zone->shm.name.len;
 
@@ -3310,6 +4154,91 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     shpool->log_nomem = 0;
 
+    return ngx_ssl_session_cache_init_shards(shm_zone, cache);
+}
+
+
+static ngx_int_t
+ngx_ssl_session_cache_init_shards(ngx_shm_zone_t *shm_zone,
+    ngx_ssl_session_cache_t *cache)
+{
+    size_t                    size;
+    ngx_uint_t                i;
+    ngx_slab_pool_t          *shpool, *sp;
+    ngx_ssl_session_shard_t  *shard;
+
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (cache->nshards > 1) {
+
+        /*
+         * free pages of the zone are divided evenly between shards,
+         * each shard gets a separate slab pool in its part of the zone
+         */
+
+        size = (shpool->pfree / cache->nshards) * ngx_pagesize;
+
+        if (size < 8 * ngx_pagesize) {
+            ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                          "session cache \"%V\" is too small for %ui shards",
+                          &shm_zone->shm.name, cache->nshards);
+            return NGX_ERROR;
+        }
+
+    } else {
+        size = 0;
+    }
+
+    for (i = 0; i < cache->nshards; i++) {
+        shard = &cache->shards[i];
+
+        if (size) {
+            sp = ngx_slab_alloc(shpool, size);
+            if (sp == NULL) {
+                return NGX_ERROR;
+            }
+
+            ngx_memzero(sp, sizeof(ngx_slab_pool_t));
+
+            sp->end = (u_char *) sp + size;
+            sp->min_shift = 3;
+            sp->addr = sp;
+
+            ngx_slab_init(sp);
+
+            sp->log_ctx = shpool->log_ctx;
+            sp->log_nomem = 0;
+
+        } else {
+            sp = shpool;
+        }
+
+        ngx_slab_init_magazine(sp);
+
+        shard->shpool = sp;
+        shard->mutex = &shpool->mutex;
+
+#if (NGX_HAVE_ATOMIC_OPS)
+
+        if (sp != shpool) {
+            if (ngx_shmtx_create(&sp->mutex, &sp->lock, NULL) != NGX_OK) {
+                return NGX_ERROR;
+            }
+
+            sp->next = shpool->next;
+            shpool->next = sp;
+
+            shard->mutex = &sp->mutex;
+        }
+
+#endif
+
+        ngx_rbtree_init(&shard->session_rbtree, &shard->sentinel,
+                        ngx_ssl_session_rbtree_insert_value);
+
+        ngx_queue_init(&shard->expire_queue);
+    }
+
     return NGX_OK;
 }
 
@@ -3328,7 +4257,7 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
  * and an ASN1 representation, they take accordingly 128 and 128 bytes.
  *
  * OpenSSL's i2d_SSL_SESSION() and d2i_SSL_SESSION are slow,
- * so they are outside the code locked by shared pool mutex
+ * so they are outside the code locked by the shard mutex
  */
 
 static int
@@ -3344,6 +4273,7 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
     ngx_slab_pool_t          *shpool;
     ngx_ssl_sess_id_t        *sess_id;
     ngx_ssl_session_cache_t  *cache;
+    ngx_ssl_session_shard_t  *shard;
     u_char                    buf[NGX_SSL_MAX_SESSION_SIZE];
 
     len = i2d_SSL_SESSION(sess, NULL);
@@ -3357,18 +4287,23 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
     p = buf;
     i2d_SSL_SESSION(sess, &p);
 
-    c = ngx_ssl_get_connection(ssl_conn);
+    session_id = (u_char *) SSL_SESSION_get_id(sess, &session_id_length);
+
+    hash = ngx_crc32_short(session_id, session_id_length);
+
+    c = ngx_ssl_get_connection(ssl_conn);
 
     ssl_ctx = c->ssl->session_ctx;
     shm_zone = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_session_cache_index);
 
     cache = shm_zone->data;
-    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+    shard = ngx_ssl_session_shard(cache, hash);
+    shpool = shard->shpool;
 
-    ngx_shmtx_lock(&shpool->mutex);
+    ngx_ssl_session_shard_lock(shard);
 
     /* drop one or two expired sessions */
-    ngx_ssl_expire_sessions(cache, shpool, 1);
+    ngx_ssl_expire_sessions(shard, 1);
 
     cached_sess = ngx_slab_alloc_locked(shpool, len);
 
@@ -3376,7 +4311,7 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
         /* drop the oldest non-expired session and try once more */
 
-        ngx_ssl_expire_sessions(cache, shpool, 0);
+        ngx_ssl_expire_sessions(shard, 0);
 
         cached_sess = ngx_slab_alloc_locked(shpool, len);
 
@@ -3392,7 +4327,7 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
         /* drop the oldest non-expired session and try once more */
 
-        ngx_ssl_expire_sessions(cache, shpool, 0);
+        ngx_ssl_expire_sessions(shard, 0);
 
         sess_id = ngx_slab_alloc_locked(shpool, sizeof(ngx_ssl_sess_id_t));
 
@@ -3401,8 +4336,6 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
         }
     }
 
-    session_id = (u_char *) SSL_SESSION_get_id(sess, &session_id_length);
-
 #if (NGX_PTR_SIZE == 8)
 
     id = sess_id->sess_id;
@@ -3415,7 +4348,7 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
         /* drop the oldest non-expired session and try once more */
 
-        ngx_ssl_expire_sessions(cache, shpool, 0);
+        ngx_ssl_expire_sessions(shard, 0);
 
         id = ngx_slab_alloc_locked(shpool, session_id_length);
 
@@ -3430,11 +4363,9 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
     ngx_memcpy(id, session_id, session_id_length);
 
-    hash = ngx_crc32_short(session_id, session_id_length);
-
-    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
-                   "ssl new session: %08XD:%ud:%d",
-                   hash, session_id_length, len);
+    ngx_log_debug4(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "ssl new session: %08XD:%ud:%d shard:%ui",
+                   hash, session_id_length, len, hash % cache->nshards);
 
     sess_id->node.key = hash;
     sess_id->node.data = (u_char) session_id_length;
@@ -3444,11 +4375,11 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
     sess_id->expire = ngx_time() + SSL_CTX_get_timeout(ssl_ctx);
 
-    ngx_queue_insert_head(&cache->expire_queue, &sess_id->queue);
+    ngx_queue_insert_head(&shard->expire_queue, &sess_id->queue);
 
-    ngx_rbtree_insert(&cache->session_rbtree, &sess_id->node);
+    ngx_rbtree_insert(&shard->session_rbtree, &sess_id->node);
 
-    ngx_shmtx_unlock(&shpool->mutex);
+    ngx_ssl_session_shard_unlock(shard);
 
     return 0;
 
@@ -3462,7 +4393,7 @@ failed:
         ngx_slab_free_locked(shpool, sess_id);
     }
 
-    ngx_shmtx_unlock(&shpool->mutex);
+    ngx_ssl_session_shard_unlock(shard);
 
     ngx_log_error(NGX_LOG_ALERT, c->log, 0,
                   "could not allocate new session%s", shpool->log_ctx);
@@ -3483,11 +4414,11 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
     ngx_int_t                 rc;
     const u_char             *p;
     ngx_shm_zone_t           *shm_zone;
-    ngx_slab_pool_t          *shpool;
     ngx_rbtree_node_t        *node, *sentinel;
     ngx_ssl_session_t        *sess;
     ngx_ssl_sess_id_t        *sess_id;
     ngx_ssl_session_cache_t  *cache;
+    ngx_ssl_session_shard_t  *shard;
     u_char                    buf[NGX_SSL_MAX_SESSION_SIZE];
     ngx_connection_t         *c;
 
@@ -3503,15 +4434,12 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
                                    ngx_ssl_session_cache_index);
 
     cache = shm_zone->data;
+    shard = ngx_ssl_session_shard(cache, hash);
 
-    sess = NULL;
-
-    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
-
-    ngx_shmtx_lock(&shpool->mutex);
+    ngx_ssl_session_shard_lock(shard);
 
-    node = cache->session_rbtree.root;
-    sentinel = cache->session_rbtree.sentinel;
+    node = shard->session_rbtree.root;
+    sentinel = shard->session_rbtree.sentinel;
 
     while (node != sentinel) {
 
@@ -3534,32 +4462,23 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
 
         if (rc == 0) {
 
-            if (sess_id->expire > ngx_time()) {
-                slen = sess_id->len;
+            if (sess_id->expire <= ngx_time()) {
 
-                ngx_memcpy(buf, sess_id->session, slen);
+                /* left for ngx_ssl_expire_sessions() */
 
-                ngx_shmtx_unlock(&shpool->mutex);
-
-                p = buf;
-                sess = d2i_SSL_SESSION(NULL, &p, slen);
-
-                return sess;
+                goto done;
             }
 
-            ngx_queue_remove(&sess_id->queue);
+            slen = sess_id->len;
 
-            ngx_rbtree_delete(&cache->session_rbtree, node);
+            ngx_memcpy(buf, sess_id->session, slen);
 
-            ngx_slab_free_locked(shpool, sess_id->session);
-#if (NGX_PTR_SIZE == 4)
-            ngx_slab_free_locked(shpool, sess_id->id);
-#endif
-            ngx_slab_free_locked(shpool, sess_id);
+            ngx_ssl_session_shard_unlock(shard);
 
-            sess = NULL;
+            p = buf;
+            sess = d2i_SSL_SESSION(NULL, &p, slen);
 
-            goto done;
+            return sess;
         }
 
         node = (rc < 0) ? node->left : node->right;
@@ -3567,9 +4486,9 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
 
 done:
 
-    ngx_shmtx_unlock(&shpool->mutex);
+    ngx_ssl_session_shard_unlock(shard);
 
-    return sess;
+    return NULL;
 }
 
 
@@ -3590,10 +4509,10 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
     ngx_int_t                 rc;
     unsigned int              len;
     ngx_shm_zone_t           *shm_zone;
-    ngx_slab_pool_t          *shpool;
     ngx_rbtree_node_t        *node, *sentinel;
     ngx_ssl_sess_id_t        *sess_id;
     ngx_ssl_session_cache_t  *cache;
+    ngx_ssl_session_shard_t  *shard;
 
     shm_zone = SSL_CTX_get_ex_data(ssl, ngx_ssl_session_cache_index);
 
@@ -3610,12 +4529,12 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ngx_cycle->log, 0,
                    "ssl remove session: %08XD:%ud", hash, len);
 
-    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+    shard = ngx_ssl_session_shard(cache, hash);
 
-    ngx_shmtx_lock(&shpool->mutex);
+    ngx_ssl_session_shard_lock(shard);
 
-    node = cache->session_rbtree.root;
-    sentinel = cache->session_rbtree.sentinel;
+    node = shard->session_rbtree.root;
+    sentinel = shard->session_rbtree.sentinel;
 
     while (node != sentinel) {
 
@@ -3636,17 +4555,7 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
         rc = ngx_memn2cmp(id, sess_id->id, len, (size_t) node->data);
 
         if (rc == 0) {
-
-            ngx_queue_remove(&sess_id->queue);
-
-            ngx_rbtree_delete(&cache->session_rbtree, node);
-
-            ngx_slab_free_locked(shpool, sess_id->session);
-#if (NGX_PTR_SIZE == 4)
-            ngx_slab_free_locked(shpool, sess_id->id);
-#endif
-            ngx_slab_free_locked(shpool, sess_id);
-
+            ngx_ssl_free_sess_id(shard, sess_id);
             goto done;
         }
 
@@ -3655,13 +4564,12 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
 
 done:
 
-    ngx_shmtx_unlock(&shpool->mutex);
+    ngx_ssl_session_shard_unlock(shard);
 }
 
 
 static void
-ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
-    ngx_slab_pool_t *shpool, ngx_uint_t n)
+ngx_ssl_expire_sessions(ngx_ssl_session_shard_t *shard, ngx_uint_t n)
 {
     time_t              now;
     ngx_queue_t        *q;
@@ -3669,13 +4577,18 @@ ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
 
     now = ngx_time();
 
+    /*
+     * n == 1 deletes one or two expired sessions,
+     * n == 0 deletes the oldest session and one or two expired sessions
+     */
+
     while (n < 3) {
 
-        if (ngx_queue_empty(&cache->expire_queue)) {
+        if (ngx_queue_empty(&shard->expire_queue)) {
             return;
         }
 
-        q = ngx_queue_last(&cache->expire_queue);
+        q = ngx_queue_last(&shard->expire_queue);
 
         sess_id = ngx_queue_data(q, ngx_ssl_sess_id_t, queue);
 
@@ -3683,19 +4596,26 @@ ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
             return;
         }
 
-        ngx_queue_remove(q);
-
         ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ngx_cycle->log, 0,
                        "expire session: %08Xi", sess_id->node.key);
 
-        ngx_rbtree_delete(&cache->session_rbtree, &sess_id->node);
+        ngx_ssl_free_sess_id(shard, sess_id);
+    }
+}
+
 
-        ngx_slab_free_locked(shpool, sess_id->session);
+static void
+ngx_ssl_free_sess_id(ngx_ssl_session_shard_t *shard, ngx_ssl_sess_id_t *sess_id)
+{
+    ngx_queue_remove(&sess_id->queue);
+
+    ngx_rbtree_delete(&shard->session_rbtree, &sess_id->node);
+
+    ngx_slab_free_locked(shard->shpool, sess_id->session);
 #if (NGX_PTR_SIZE == 4)
-        ngx_slab_free_locked(shpool, sess_id->id);
+    ngx_slab_free_locked(shard->shpool, sess_id->id);
 #endif
-        ngx_slab_free_locked(shpool, sess_id);
-    }
+    ngx_slab_free_locked(shard->shpool, sess_id);
 }
 
 
@@ -3744,29 +4664,70 @@ ngx_ssl_session_rbtree_insert_value(ngx_rbtree_node_t *temp,
 #ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
 
 ngx_int_t
-ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
+ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths,
+    time_t check)
 {
-    u_char                         buf[80];
-    size_t                         size;
-    ssize_t                        n;
-    ngx_str_t                     *path;
-    ngx_file_t                     file;
-    ngx_uint_t                     i;
-    ngx_array_t                   *keys;
-    ngx_file_info_t                fi;
-    ngx_pool_cleanup_t            *cln;
-    ngx_ssl_session_ticket_key_t  *key;
+    time_t                          timeout;
+    ngx_str_t                      *path;
+    ngx_uint_t                      i;
+    ngx_array_t                    *keys;
+    ngx_shm_zone_t                 *shm_zone;
+    ngx_openssl_conf_t             *oscf;
+    ngx_pool_cleanup_t             *cln;
+    ngx_ssl_ticket_keys_t          *tk, **ptk;
+    ngx_ssl_ticket_key_file_t      *file;
+    ngx_ssl_session_ticket_key_t   *key;
+
+    oscf = (ngx_openssl_conf_t *) ngx_get_conf(cf->cycle->conf_ctx,
+                                               ngx_openssl_module);
 
     if (paths == NULL) {
-        return NGX_OK;
+
+        if (check) {
+            ngx_log_error(NGX_LOG_WARN, cf->log, 0,
+                          "\"ssl_session_ticket_key_check\" ignored, "
+                          "no \"ssl_session_ticket_key\" files");
+        }
+
+        /* keys are generated and rotated in the shared session cache */
+
+        shm_zone = SSL_CTX_get_ex_data(ssl->ctx, ngx_ssl_session_cache_index);
+        if (shm_zone == NULL) {
+            return NGX_OK;
+        }
+
+        timeout = SSL_CTX_get_timeout(ssl->ctx);
+
+        /*
+         * contexts using the same zone share the keys, so that a worker
+         * updates them from the zone with a single timer
+         */
+
+        ptk = oscf->ticket_keys ? oscf->ticket_keys->elts : NULL;
+
+        for (i = 0; ptk && i < oscf->ticket_keys->nelts; i++) {
+            tk = ptk[i];
+
+            if (tk->shm_zone == shm_zone) {
+                tk->timeout = ngx_max(tk->timeout, timeout);
+                goto set;
+            }
+        }
+    }
+
+    tk = ngx_pcalloc(cf->pool, sizeof(ngx_ssl_ticket_keys_t));
+    if (tk == NULL) {
+        return NGX_ERROR;
     }
 
-    keys = ngx_array_create(cf->pool, paths->nelts,
+    keys = ngx_array_create(cf->pool, paths ? paths->nelts : 3,
                             sizeof(ngx_ssl_session_ticket_key_t));
     if (keys == NULL) {
         return NGX_ERROR;
     }
 
+    tk->keys = keys;
+
     cln = ngx_pool_cleanup_add(cf->pool, 0);
     if (cln == NULL) {
         return NGX_ERROR;
@@ -3775,82 +4736,78 @@ ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
     cln->handler = ngx_ssl_session_ticket_keys_cleanup;
     cln->data = keys;
 
-    path = paths->elts;
-    for (i = 0; i < paths->nelts; i++) {
-
-        if (ngx_conf_full_name(cf->cycle, &path[i], 1) != NGX_OK) {
+    if (paths == NULL) {
+        key = ngx_array_push_n(keys, 3);
+        if (key == NULL) {
             return NGX_ERROR;
         }
 
-        ngx_memzero(&file, sizeof(ngx_file_t));
-        file.name = path[i];
-        file.log = cf->log;
+        ngx_memzero(key, 3 * sizeof(ngx_ssl_session_ticket_key_t));
 
-        file.fd = ngx_open_file(file.name.data, NGX_FILE_RDONLY,
-                                NGX_FILE_OPEN, 0);
+        tk->shm_zone = shm_zone;
+        tk->timeout = timeout;
+        tk->shared = 1;
 
-        if (file.fd == NGX_INVALID_FILE) {
-            ngx_conf_log_error(NGX_LOG_EMERG, cf, ngx_errno,
-                               ngx_open_file_n " \"%V\" failed", &file.name);
-            return NGX_ERROR;
-        }
-
-        if (ngx_fd_info(file.fd, &fi) == NGX_FILE_ERROR) {
-            ngx_conf_log_error(NGX_LOG_CRIT, cf, ngx_errno,
-                               ngx_fd_info_n " \"%V\" failed", &file.name);
-            goto failed;
-        }
+        goto done;
+    }
 
-        size = ngx_file_size(&fi);
+    tk->files = ngx_array_create(cf->pool, paths->nelts,
+                                 sizeof(ngx_ssl_ticket_key_file_t));
+    if (tk->files == NULL) {
+        return NGX_ERROR;
+    }
 
-        if (size != 48 && size != 80) {
-            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
-                               "\"%V\" must be 48 or 80 bytes", &file.name);
-            goto failed;
-        }
+    tk->check = check;
 
-        n = ngx_read_file(&file, buf, size, 0);
+    path = paths->elts;
+    for (i = 0; i < paths->nelts; i++) {
 
-        if (n == NGX_ERROR) {
-            ngx_conf_log_error(NGX_LOG_CRIT, cf, ngx_errno,
-                               ngx_read_file_n " \"%V\" failed", &file.name);
-            goto failed;
+        if (ngx_conf_full_name(cf->cycle, &path[i], 1) != NGX_OK) {
+            return NGX_ERROR;
         }
 
-        if ((size_t) n != size) {
-            ngx_conf_log_error(NGX_LOG_CRIT, cf, 0,
-                               ngx_read_file_n " \"%V\" returned only "
-                               "%z bytes instead of %uz", &file.name, n, size);
-            goto failed;
+        file = ngx_array_push(tk->files);
+        if (file == NULL) {
+            return NGX_ERROR;
         }
 
+        file->name = path[i];
+
         key = ngx_array_push(keys);
         if (key == NULL) {
-            goto failed;
+            return NGX_ERROR;
         }
 
-        if (size == 48) {
-            key->size = 48;
-            ngx_memcpy(key->name, buf, 16);
-            ngx_memcpy(key->aes_key, buf + 16, 16);
-            ngx_memcpy(key->hmac_key, buf + 32, 16);
+        if (ngx_ssl_session_ticket_key_read(file, key, cf->log) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
 
-        } else {
-            key->size = 80;
-            ngx_memcpy(key->name, buf, 16);
-            ngx_memcpy(key->hmac_key, buf + 16, 32);
-            ngx_memcpy(key->aes_key, buf + 48, 32);
+done:
+
+    if (tk->shared || tk->check) {
+
+        /* keys are updated by a timer in each worker */
+
+        if (oscf->ticket_keys == NULL) {
+            oscf->ticket_keys = ngx_array_create(cf->pool, 4,
+                                             sizeof(ngx_ssl_ticket_keys_t *));
+            if (oscf->ticket_keys == NULL) {
+                return NGX_ERROR;
+            }
         }
 
-        if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
-            ngx_log_error(NGX_LOG_ALERT, cf->log, ngx_errno,
-                          ngx_close_file_n " \"%V\" failed", &file.name);
+        ptk = ngx_array_push(oscf->ticket_keys);
+        if (ptk == NULL) {
+            return NGX_ERROR;
         }
 
-        ngx_explicit_memzero(&buf, 80);
+        *ptk = tk;
     }
 
-    if (SSL_CTX_set_ex_data(ssl->ctx, ngx_ssl_session_ticket_keys_index, keys)
+set:
+
+    if (SSL_CTX_set_ex_data(ssl->ctx, ngx_ssl_session_ticket_keys_index, tk)
         == 0)
     {
         ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
@@ -3870,17 +4827,424 @@ ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
     }
 
     return NGX_OK;
+}
+
+
+/*
+ * called on process initialization by the ssl modules, once the timers
+ * are available; keys of all modules are handled on the first call
+ */
+
+ngx_int_t
+ngx_ssl_session_ticket_keys_init_process(ngx_cycle_t *cycle)
+{
+    ngx_uint_t               i;
+    ngx_openssl_conf_t      *oscf;
+    ngx_ssl_ticket_keys_t  **tk;
+
+    if (ngx_process != NGX_PROCESS_WORKER
+        && ngx_process != NGX_PROCESS_SINGLE)
+    {
+        return NGX_OK;
+    }
+
+    oscf = (ngx_openssl_conf_t *) ngx_get_conf(cycle->conf_ctx,
+                                               ngx_openssl_module);
+
+    if (oscf->ticket_keys == NULL) {
+        return NGX_OK;
+    }
+
+    tk = oscf->ticket_keys->elts;
+
+    for (i = 0; i < oscf->ticket_keys->nelts; i++) {
+
+        if (tk[i]->event.handler) {
+            continue;
+        }
+
+        tk[i]->event.handler = ngx_ssl_session_ticket_keys_handler;
+        tk[i]->event.data = tk[i];
+        tk[i]->event.log = cycle->log;
+        tk[i]->event.cancelable = 1;
+
+        if (tk[i]->shared) {
+
+            /* shared keys are needed before the first handshake */
+
+            ngx_ssl_session_ticket_keys_handler(&tk[i]->event);
+
+        } else {
+            ngx_add_timer(&tk[i]->event, tk[i]->check * 1000);
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_ssl_session_ticket_key_read(ngx_ssl_ticket_key_file_t *kf,
+    ngx_ssl_session_ticket_key_t *key, ngx_log_t *log)
+{
+    u_char           buf[80];
+    size_t           size;
+    ssize_t          n;
+    ngx_int_t        rc;
+    ngx_file_t       file;
+    ngx_file_info_t  fi;
+
+    rc = NGX_ERROR;
+
+    ngx_memzero(&file, sizeof(ngx_file_t));
+    file.name = kf->name;
+    file.log = log;
+
+    file.fd = ngx_open_file(file.name.data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (file.fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno,
+                      ngx_open_file_n " \"%V\" failed", &file.name);
+        return NGX_ERROR;
+    }
+
+    if (ngx_fd_info(file.fd, &fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_fd_info_n " \"%V\" failed", &file.name);
+        goto failed;
+    }
+
+    size = ngx_file_size(&fi);
+
+    if (size != 48 && size != 80) {
+        ngx_log_error(NGX_LOG_EMERG, log, 0,
+                      "\"%V\" must be 48 or 80 bytes", &file.name);
+        goto failed;
+    }
+
+    n = ngx_read_file(&file, buf, size, 0);
+
+    if (n == NGX_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_read_file_n " \"%V\" failed", &file.name);
+        goto failed;
+    }
+
+    if ((size_t) n != size) {
+        ngx_log_error(NGX_LOG_CRIT, log, 0,
+                      ngx_read_file_n " \"%V\" returned only "
+                      "%z bytes instead of %uz", &file.name, n, size);
+        goto failed;
+    }
+
+    ngx_memzero(key, sizeof(ngx_ssl_session_ticket_key_t));
+
+    if (size == 48) {
+        key->size = 48;
+        ngx_memcpy(key->name, buf, 16);
+        ngx_memcpy(key->aes_key, buf + 16, 16);
+        ngx_memcpy(key->hmac_key, buf + 32, 16);
+
+    } else {
+        key->size = 80;
+        ngx_memcpy(key->name, buf, 16);
+        ngx_memcpy(key->hmac_key, buf + 16, 32);
+        ngx_memcpy(key->aes_key, buf + 48, 32);
+    }
+
+    kf->uniq = ngx_file_uniq(&fi);
+    kf->mtime = ngx_file_mtime(&fi);
+
+    rc = NGX_OK;
 
 failed:
 
     if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
-        ngx_log_error(NGX_LOG_ALERT, cf->log, ngx_errno,
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
                       ngx_close_file_n " \"%V\" failed", &file.name);
     }
 
     ngx_explicit_memzero(&buf, 80);
 
-    return NGX_ERROR;
+    return rc;
+}
+
+
+static void
+ngx_ssl_session_ticket_keys_handler(ngx_event_t *ev)
+{
+    ngx_ssl_ticket_keys_t  *tk = ev->data;
+
+    /*
+     * keys are updated by a timer rather than on handshakes, so neither
+     * the zone mutex nor stat() calls are on the handshake path
+     */
+
+    if (tk->shared) {
+        (void) ngx_ssl_rotate_ticket_keys(tk, ev->log);
+        ngx_add_timer(ev, 1000);
+
+    } else {
+        ngx_ssl_session_ticket_keys_check(tk, ev->log);
+        ngx_add_timer(ev, tk->check * 1000);
+    }
+}
+
+
+static void
+ngx_ssl_session_ticket_keys_check(ngx_ssl_ticket_keys_t *tk, ngx_log_t *log)
+{
+    ngx_uint_t                      i, changed;
+    ngx_file_info_t                 fi;
+    ngx_ssl_ticket_key_file_t      *file, *files;
+    ngx_ssl_session_ticket_key_t   *keys;
+
+    /*
+     * on any change all keys are reread, so the order of keys
+     * (and thus the encryption key) follows the files
+     */
+
+    file = tk->files->elts;
+    changed = 0;
+
+    for (i = 0; i < tk->files->nelts; i++) {
+
+        if (ngx_file_info(file[i].name.data, &fi) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                          ngx_file_info_n " \"%V\" failed", &file[i].name);
+            return;
+        }
+
+        if (file[i].uniq != ngx_file_uniq(&fi)
+            || file[i].mtime != ngx_file_mtime(&fi))
+        {
+            changed = 1;
+        }
+    }
+
+    if (!changed) {
+        return;
+    }
+
+    keys = ngx_alloc(tk->keys->nelts * sizeof(ngx_ssl_session_ticket_key_t),
+                     log);
+    if (keys == NULL) {
+        return;
+    }
+
+    files = ngx_alloc(tk->files->nelts * sizeof(ngx_ssl_ticket_key_file_t),
+                      log);
+    if (files == NULL) {
+        ngx_free(keys);
+        return;
+    }
+
+    ngx_memcpy(files, file,
+               tk->files->nelts * sizeof(ngx_ssl_ticket_key_file_t));
+
+    for (i = 0; i < tk->files->nelts; i++) {
+        if (ngx_ssl_session_ticket_key_read(&files[i], &keys[i], log)
+            != NGX_OK)
+        {
+            ngx_log_error(NGX_LOG_ERR, log, 0,
+                          "session ticket keys not reloaded, "
+                          "keeping previous keys");
+            goto done;
+        }
+    }
+
+    ngx_ssl_session_ticket_keys_update(tk, keys);
+
+    ngx_memcpy(file, files,
+               tk->files->nelts * sizeof(ngx_ssl_ticket_key_file_t));
+
+    ngx_log_error(NGX_LOG_NOTICE, log, 0,
+                  "session ticket keys reloaded from \"%V\"", &file[0].name);
+
+done:
+
+    ngx_explicit_memzero(keys,
+                         tk->keys->nelts * sizeof(ngx_ssl_session_ticket_key_t));
+    ngx_free(keys);
+    ngx_free(files);
+}
+
+
+static ngx_int_t
+ngx_ssl_rotate_ticket_keys(ngx_ssl_ticket_keys_t *tk, ngx_log_t *log)
+{
+    time_t                          now, expire;
+    ngx_int_t                       rc;
+    ngx_shm_zone_t                 *shm_zone;
+    ngx_slab_pool_t                *shpool;
+    ngx_ssl_session_cache_t        *cache;
+    ngx_ssl_session_ticket_key_t   *key, keys[3];
+
+    /*
+     * key[0] encrypts new tickets, key[1] is the previous key kept
+     * for decryption only, and key[2] is the next key, known in advance
+     * so that tickets from a process which has already rotated can be
+     * decrypted; keys are rotated once the previous key is expired,
+     * that is, each key encrypts tickets for about a session timeout
+     * and remains valid for decryption for another one
+     */
+
+    now = ngx_time();
+
+    /* a ticket may be issued up to a timer interval after the update */
+
+    expire = now + tk->timeout + 1;
+
+    shm_zone = tk->shm_zone;
+
+    cache = shm_zone->data;
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    rc = NGX_OK;
+
+    ngx_shmtx_lock(&shpool->mutex);
+
+    key = cache->ticket_keys;
+
+    if (key[0].size == 0) {
+
+        /*
+         * first use: generate the current and the next keys; there is
+         * no previous key yet, so its empty slot expires after a timeout
+         * for the current key to be used as long as the following ones
+         */
+
+        if (ngx_ssl_generate_ticket_key(&key[0], log) != NGX_OK
+            || ngx_ssl_generate_ticket_key(&key[2], log) != NGX_OK)
+        {
+            ngx_memzero(key, 3 * sizeof(ngx_ssl_session_ticket_key_t));
+            ngx_shmtx_unlock(&shpool->mutex);
+            return NGX_ERROR;
+        }
+
+        key[1].size = 0;
+        key[1].expire = expire;
+    }
+
+    if (key[0].expire < expire) {
+        key[0].expire = expire;
+    }
+
+    if (key[1].expire < now) {
+
+        /* the previous key is no longer needed, rotate */
+
+        ngx_memcpy(&key[1], &key[0], sizeof(ngx_ssl_session_ticket_key_t));
+        ngx_memcpy(&key[0], &key[2], sizeof(ngx_ssl_session_ticket_key_t));
+
+        key[0].expire = expire;
+
+        if (ngx_ssl_generate_ticket_key(&key[2], log) != NGX_OK) {
+
+            /* the current key is used as the next one until a retry */
+
+            ngx_memcpy(&key[2], &key[0], sizeof(ngx_ssl_session_ticket_key_t));
+            rc = NGX_ERROR;
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
+                       "ssl session ticket key rotated, expire: %T",
+                       key[1].expire);
+    }
+
+    ngx_memcpy(keys, key, 3 * sizeof(ngx_ssl_session_ticket_key_t));
+
+    ngx_shmtx_unlock(&shpool->mutex);
+
+    ngx_ssl_session_ticket_keys_update(tk, keys);
+
+    ngx_explicit_memzero(keys, 3 * sizeof(ngx_ssl_session_ticket_key_t));
+
+    return rc;
+}
+
+
+static ngx_int_t
+ngx_ssl_generate_ticket_key(ngx_ssl_session_ticket_key_t *key,
+    ngx_log_t *log)
+{
+    u_char  buf[80];
+
+    if (RAND_bytes(buf, 80) != 1) {
+        ngx_ssl_error(NGX_LOG_ALERT, log, 0, "RAND_bytes() failed");
+        return NGX_ERROR;
+    }
+
+    key->size = 80;
+    key->expire = 0;
+    ngx_memcpy(key->name, buf, 16);
+    ngx_memcpy(key->hmac_key, buf + 16, 32);
+    ngx_memcpy(key->aes_key, buf + 48, 32);
+
+    ngx_explicit_memzero(&buf, 80);
+
+    return NGX_OK;
+}
+
+
+/*
+ * keys are read by the ticket key callback, which may run in handshake
+ * threads, while they are updated in the worker; the generation is odd
+ * during an update, and readers retry if it was odd or has changed
+ */
+
+static void
+ngx_ssl_session_ticket_keys_update(ngx_ssl_ticket_keys_t *tk,
+    ngx_ssl_session_ticket_key_t *keys)
+{
+    tk->generation++;
+    ngx_memory_barrier();
+
+    ngx_memcpy(tk->keys->elts, keys,
+               tk->keys->nelts * sizeof(ngx_ssl_session_ticket_key_t));
+
+    ngx_memory_barrier();
+    tk->generation++;
+}
+
+
+static ngx_uint_t
+ngx_ssl_session_ticket_key_get(ngx_ssl_ticket_keys_t *tk, u_char *name,
+    ngx_ssl_session_ticket_key_t *key)
+{
+    ngx_uint_t                      i, n;
+    ngx_atomic_uint_t               generation;
+    ngx_ssl_session_ticket_key_t   *keys;
+
+    /* returns the index of the key found, or the number of keys */
+
+    keys = tk->keys->elts;
+    n = tk->keys->nelts;
+
+    do {
+        generation = tk->generation;
+        ngx_memory_barrier();
+
+        if (name == NULL) {
+            i = 0;
+
+        } else {
+            for (i = 0; i < n; i++) {
+                if (keys[i].size && ngx_memcmp(name, keys[i].name, 16) == 0) {
+                    break;
+                }
+            }
+        }
+
+        if (i < n) {
+            ngx_memcpy(key, &keys[i], sizeof(ngx_ssl_session_ticket_key_t));
+        }
+
+        ngx_memory_barrier();
+
+    } while ((generation & 1) || generation != tk->generation);
+
+    return i;
 }
 
 
@@ -3892,9 +5256,9 @@ ngx_ssl_session_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
     size_t                         size;
     SSL_CTX                       *ssl_ctx;
     ngx_uint_t                     i;
-    ngx_array_t                   *keys;
     ngx_connection_t              *c;
-    ngx_ssl_session_ticket_key_t  *key;
+    ngx_ssl_ticket_keys_t         *tk;
+    ngx_ssl_session_ticket_key_t   key;
     const EVP_MD                  *digest;
     const EVP_CIPHER              *cipher;
 #if (NGX_DEBUG)
@@ -3910,22 +5274,30 @@ ngx_ssl_session_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
     digest = EVP_sha256();
 #endif
 
-    keys = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_session_ticket_keys_index);
-    if (keys == NULL) {
+    tk = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_session_ticket_keys_index);
+    if (tk == NULL) {
         return -1;
     }
 
-    key = keys->elts;
-
     if (enc == 1) {
         /* encrypt session ticket */
 
+        (void) ngx_ssl_session_ticket_key_get(tk, NULL, &key);
+
+        if (key.size == 0) {
+
+            /* shared keys are not generated yet */
+
+            ngx_explicit_memzero(&key, sizeof(ngx_ssl_session_ticket_key_t));
+            return 0;
+        }
+
         ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
                        "ssl session ticket encrypt, key: \"%*s\" (%s session)",
-                       ngx_hex_dump(buf, key[0].name, 16) - buf, buf,
+                       ngx_hex_dump(buf, key.name, 16) - buf, buf,
                        SSL_session_reused(ssl_conn) ? "reused" : "new");
 
-        if (key[0].size == 48) {
+        if (key.size == 48) {
             cipher = EVP_aes_128_cbc();
             size = 16;
 
@@ -3936,51 +5308,50 @@ ngx_ssl_session_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
 
         if (RAND_bytes(iv, EVP_CIPHER_iv_length(cipher)) != 1) {
             ngx_ssl_error(NGX_LOG_ALERT, c->log, 0, "RAND_bytes() failed");
-            return -1;
+            goto failed;
         }
 
-        if (EVP_EncryptInit_ex(ectx, cipher, NULL, key[0].aes_key, iv) != 1) {
+        if (EVP_EncryptInit_ex(ectx, cipher, NULL, key.aes_key, iv) != 1) {
             ngx_ssl_error(NGX_LOG_ALERT, c->log, 0,
                           "EVP_EncryptInit_ex() failed");
-            return -1;
+            goto failed;
         }
 
 #if OPENSSL_VERSION_NUMBER >= 0x10000000L
-        if (HMAC_Init_ex(hctx, key[0].hmac_key, size, digest, NULL) != 1) {
+        if (HMAC_Init_ex(hctx, key.hmac_key, size, digest, NULL) != 1) {
             ngx_ssl_error(NGX_LOG_ALERT, c->log, 0, "HMAC_Init_ex() failed");
-            return -1;
+            goto failed;
         }
 #else
-        HMAC_Init_ex(hctx, key[0].hmac_key, size, digest, NULL);
+        HMAC_Init_ex(hctx, key.hmac_key, size, digest, NULL);
 #endif
 
-        ngx_memcpy(name, key[0].name, 16);
+        ngx_memcpy(name, key.name, 16);
+
+        ngx_explicit_memzero(&key, sizeof(ngx_ssl_session_ticket_key_t));
 
         return 1;
 
     } else {
         /* decrypt session ticket */
 
-        for (i = 0; i < keys->nelts; i++) {
-            if (ngx_memcmp(name, key[i].name, 16) == 0) {
-                goto found;
-            }
-        }
+        i = ngx_ssl_session_ticket_key_get(tk, name, &key);
 
-        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
-                       "ssl session ticket decrypt, key: \"%*s\" not found",
-                       ngx_hex_dump(buf, name, 16) - buf, buf);
-
-        return 0;
+        if (i == tk->keys->nelts) {
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                           "ssl session ticket decrypt, key: \"%*s\" "
+                           "not found",
+                           ngx_hex_dump(buf, name, 16) - buf, buf);
 
-    found:
+            return 0;
+        }
 
         ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
                        "ssl session ticket decrypt, key: \"%*s\"%s",
-                       ngx_hex_dump(buf, key[i].name, 16) - buf, buf,
+                       ngx_hex_dump(buf, key.name, 16) - buf, buf,
                        (i == 0) ? " (default)" : "");
 
-        if (key[i].size == 48) {
+        if (key.size == 48) {
             cipher = EVP_aes_128_cbc();
             size = 16;
 
@@ -3990,22 +5361,30 @@ ngx_ssl_session_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
         }
 
 #if OPENSSL_VERSION_NUMBER >= 0x10000000L
-        if (HMAC_Init_ex(hctx, key[i].hmac_key, size, digest, NULL) != 1) {
+        if (HMAC_Init_ex(hctx, key.hmac_key, size, digest, NULL) != 1) {
             ngx_ssl_error(NGX_LOG_ALERT, c->log, 0, "HMAC_Init_ex() failed");
-            return -1;
+            goto failed;
         }
 #else
-        HMAC_Init_ex(hctx, key[i].hmac_key, size, digest, NULL);
+        HMAC_Init_ex(hctx, key.hmac_key, size, digest, NULL);
 #endif
 
-        if (EVP_DecryptInit_ex(ectx, cipher, NULL, key[i].aes_key, iv) != 1) {
+        if (EVP_DecryptInit_ex(ectx, cipher, NULL, key.aes_key, iv) != 1) {
             ngx_ssl_error(NGX_LOG_ALERT, c->log, 0,
                           "EVP_DecryptInit_ex() failed");
-            return -1;
+            goto failed;
         }
 
+        ngx_explicit_memzero(&key, sizeof(ngx_ssl_session_ticket_key_t));
+
         return (i == 0) ? 1 : 2 /* renew */;
     }
+
+failed:
+
+    ngx_explicit_memzero(&key, sizeof(ngx_ssl_session_ticket_key_t));
+
+    return -1;
 }
 
 
@@ -4021,7 +5400,8 @@ ngx_ssl_session_ticket_keys_cleanup(void *data)
 #else
 
 ngx_int_t
-ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
+ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths,
+    time_t check)
 {
     if (paths) {
         ngx_log_error(NGX_LOG_WARN, ssl->log, 0,
@@ -4031,6 +5411,13 @@ ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
     return NGX_OK;
 }
 
+
+ngx_int_t
+ngx_ssl_session_ticket_keys_init_process(ngx_cycle_t *cycle)
+{
+    return NGX_OK;
+}
+
 #endif
 
 
@@ -5097,6 +6484,7 @@ ngx_openssl_create_conf(ngx_cycle_t *cycle)
      * set by ngx_pcalloc():
      *
      *     oscf->engine = 0;
+     *     oscf->ticket_keys = NULL;
      */
 
     return oscf;
@@ -87,6 +87,10 @@ struct ngx_ssl_connection_s {
     ngx_event_handler_pt        saved_read_handler;
     ngx_event_handler_pt        saved_write_handler;
 
+#if (NGX_THREADS)
+    ngx_thread_task_t          *handshake_task;
+#endif
+
     u_char                      early_buf;
 
     unsigned                    handshaked:1;
@@ -99,9 +103,13 @@ struct ngx_ssl_connection_s {
     unsigned                    in_early:1;
     unsigned                    early_preread:1;
     unsigned                    write_blocked:1;
+    unsigned                    handshake_offloaded:1;
 };
 
 
+typedef struct ngx_ssl_cache_s  ngx_ssl_cache_t;
+
+
 #define NGX_SSL_NO_SCACHE            -2
 #define NGX_SSL_NONE_SCACHE          -3
 #define NGX_SSL_NO_BUILTIN_SCACHE    -4
@@ -126,23 +134,31 @@ struct ngx_ssl_sess_id_s {
 };
 
 
+#define NGX_SSL_MAX_SCACHE_SHARDS  64
+
 typedef struct {
     ngx_rbtree_t                session_rbtree;
     ngx_rbtree_node_t           sentinel;
     ngx_queue_t                 expire_queue;
-} ngx_ssl_session_cache_t;
+    ngx_slab_pool_t            *shpool;
+    ngx_shmtx_t                *mutex;
+} ngx_ssl_session_shard_t;
 
 
-#ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
-
 typedef struct {
     size_t                      size;
     u_char                      name[16];
     u_char                      hmac_key[32];
     u_char                      aes_key[32];
+    time_t                      expire;
 } ngx_ssl_session_ticket_key_t;
 
-#endif
+
+typedef struct {
+    ngx_uint_t                     nshards;
+    ngx_ssl_session_shard_t       *shards;
+    ngx_ssl_session_ticket_key_t   ticket_keys[3];
+} ngx_ssl_session_cache_t;
 
 
 #define NGX_SSL_SSLv2    0x0002
@@ -167,7 +183,10 @@ ngx_int_t ngx_ssl_certificates(ngx_conf_t *cf, ngx_ssl_t *ssl,
 ngx_int_t ngx_ssl_certificate(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_str_t *cert, ngx_str_t *key, ngx_array_t *passwords);
 ngx_int_t ngx_ssl_connection_certificate(ngx_connection_t *c, ngx_pool_t *pool,
-    ngx_str_t *cert, ngx_str_t *key, ngx_array_t *passwords);
+    ngx_str_t *cert, ngx_str_t *key, ngx_array_t *passwords,
+    ngx_ssl_cache_t *cache);
+ngx_ssl_cache_t *ngx_ssl_cache_create(ngx_pool_t *pool, ngx_uint_t max,
+    time_t valid, time_t inactive);
 
 ngx_int_t ngx_ssl_ciphers(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *ciphers,
     ngx_uint_t prefer_server_ciphers);
@@ -177,9 +196,13 @@ ngx_int_t ngx_ssl_trusted_certificate(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_str_t *cert, ngx_int_t depth);
 ngx_int_t ngx_ssl_crl(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *crl);
 ngx_int_t ngx_ssl_stapling(ngx_conf_t *cf, ngx_ssl_t *ssl,
-    ngx_str_t *file, ngx_str_t *responder, ngx_uint_t verify);
+    ngx_str_t *file, ngx_str_t *responder, ngx_uint_t verify,
+    ngx_shm_zone_t *shm_zone);
 ngx_int_t ngx_ssl_stapling_resolver(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_resolver_t *resolver, ngx_msec_t resolver_timeout);
+ngx_shm_zone_t *ngx_ssl_stapling_cache(ngx_conf_t *cf, ngx_str_t *name,
+    size_t size, ngx_str_t *path);
+ngx_int_t ngx_ssl_stapling_init_process(ngx_cycle_t *cycle);
 RSA *ngx_ssl_rsa512_key_callback(ngx_ssl_conn_t *ssl_conn, int is_export,
     int key_length);
 ngx_array_t *ngx_ssl_read_password_file(ngx_conf_t *cf, ngx_str_t *file);
@@ -195,7 +218,10 @@ ngx_int_t ngx_ssl_session_cache(ngx_ssl_t *ssl, ngx_str_t *sess_ctx,
     ngx_array_t *certificates, ssize_t builtin_session_cache,
     ngx_shm_zone_t *shm_zone, time_t timeout);
 ngx_int_t ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl,
-    ngx_array_t *paths);
+    ngx_array_t *paths, time_t check);
+ngx_int_t ngx_ssl_session_ticket_keys_init_process(ngx_cycle_t *cycle);
+ngx_int_t ngx_ssl_session_cache_shards(ngx_conf_t *cf,
+    ngx_shm_zone_t *shm_zone, ngx_uint_t shards);
 ngx_int_t ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data);
 ngx_int_t ngx_ssl_create_connection(ngx_ssl_t *ssl, ngx_connection_t *c,
     ngx_uint_t flags);
@@ -265,6 +291,13 @@ ngx_int_t ngx_ssl_get_client_v_remain(ngx_connection_t *c, ngx_pool_t *pool,
 
 
 ngx_int_t ngx_ssl_handshake(ngx_connection_t *c);
+#if (NGX_THREADS)
+struct ngx_thread_pool_s;
+ngx_int_t ngx_ssl_handshake_threads(ngx_conf_t *cf, ngx_ssl_t *ssl,
+    struct ngx_thread_pool_s *tp, ngx_uint_t cert_cb);
+int ngx_ssl_handshake_offload(ngx_connection_t *c);
+void ngx_ssl_stapling_handshake_update(ngx_connection_t *c);
+#endif
 ssize_t ngx_ssl_recv(ngx_connection_t *c, u_char *buf, size_t size);
 ssize_t ngx_ssl_write(ngx_connection_t *c, u_char *data, size_t size);
 ssize_t ngx_ssl_recv_chain(ngx_connection_t *c, ngx_chain_t *cl, off_t limit);
@@ -285,6 +318,9 @@ extern int  ngx_ssl_certificate_index;
 extern int  ngx_ssl_next_certificate_index;
 extern int  ngx_ssl_certificate_name_index;
 extern int  ngx_ssl_stapling_index;
+#if (NGX_THREADS)
+extern int  ngx_ssl_handshake_pool_index;
+#endif
 
 
 #endif /* _NGX_EVENT_OPENSSL_H_INCLUDED_ */
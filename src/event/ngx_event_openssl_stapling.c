@@ -14,6 +14,37 @@
 #if (!defined OPENSSL_NO_OCSP && defined SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB)
 
 
+#define NGX_SSL_STAPLING_ID_LEN        20
+#define NGX_SSL_STAPLING_MAX_SIZE      65536
+#define NGX_SSL_STAPLING_CACHE_CHECK   10000
+
+
+typedef struct {
+    ngx_rbtree_t                 rbtree;
+    ngx_rbtree_node_t            sentinel;
+} ngx_ssl_stapling_cache_sh_t;
+
+
+typedef struct {
+    ngx_rbtree_node_t            node;
+    u_char                       id[NGX_SSL_STAPLING_ID_LEN];
+    time_t                       valid;
+    time_t                       refresh;
+    ngx_uint_t                   version;
+    size_t                       len;
+    u_char                      *data;
+} ngx_ssl_stapling_node_t;
+
+
+typedef struct {
+    ngx_ssl_stapling_cache_sh_t *sh;
+    ngx_slab_pool_t             *shpool;
+    ngx_path_t                  *path;
+    ngx_array_t                  staples;   /* ngx_ssl_stapling_t * */
+    ngx_event_t                  event;
+} ngx_ssl_stapling_cache_t;
+
+
 typedef struct {
     ngx_str_t                    staple;
     ngx_msec_t                   timeout;
@@ -36,6 +67,17 @@ typedef struct {
     time_t                       valid;
     time_t                       refresh;
 
+    ngx_ssl_stapling_cache_t    *cache;
+    u_char                       id[NGX_SSL_STAPLING_ID_LEN];
+    ngx_uint_t                   version;
+    time_t                       synced;
+    ngx_str_t                    file;
+    ngx_str_t                    temp;
+
+#if (NGX_THREADS)
+    ngx_atomic_t                 lock;
+#endif
+
     unsigned                     verify:1;
     unsigned                     loading:1;
 } ngx_ssl_stapling_t;
@@ -88,7 +130,8 @@ struct ngx_ssl_ocsp_ctx_s {
 
 
 static ngx_int_t ngx_ssl_stapling_certificate(ngx_conf_t *cf, ngx_ssl_t *ssl,
-    X509 *cert, ngx_str_t *file, ngx_str_t *responder, ngx_uint_t verify);
+    X509 *cert, ngx_str_t *file, ngx_str_t *responder, ngx_uint_t verify,
+    ngx_shm_zone_t *shm_zone);
 static ngx_int_t ngx_ssl_stapling_file(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_ssl_stapling_t *staple, ngx_str_t *file);
 static ngx_int_t ngx_ssl_stapling_issuer(ngx_conf_t *cf, ngx_ssl_t *ssl,
@@ -99,7 +142,28 @@ static ngx_int_t ngx_ssl_stapling_responder(ngx_conf_t *cf, ngx_ssl_t *ssl,
 static int ngx_ssl_certificate_status_callback(ngx_ssl_conn_t *ssl_conn,
     void *data);
 static void ngx_ssl_stapling_update(ngx_ssl_stapling_t *staple);
+static void ngx_ssl_stapling_request(ngx_ssl_stapling_t *staple);
 static void ngx_ssl_stapling_ocsp_handler(ngx_ssl_ocsp_ctx_t *ctx);
+static ngx_int_t ngx_ssl_stapling_check(ngx_ssl_stapling_t *staple,
+    u_char *data, size_t len, time_t *valid, ngx_log_t *log);
+
+static ngx_int_t ngx_ssl_stapling_cache_init(ngx_shm_zone_t *shm_zone,
+    void *data);
+static ngx_int_t ngx_ssl_stapling_cache_add(ngx_conf_t *cf,
+    ngx_ssl_stapling_t *staple, ngx_shm_zone_t *shm_zone);
+static ngx_ssl_stapling_node_t *ngx_ssl_stapling_cache_lookup(
+    ngx_ssl_stapling_cache_t *cache, u_char *id);
+static void ngx_ssl_stapling_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
+static ngx_int_t ngx_ssl_stapling_cache_store(ngx_ssl_stapling_t *staple,
+    ngx_str_t *response, time_t valid, time_t refresh);
+static void ngx_ssl_stapling_cache_sync(ngx_ssl_stapling_t *staple,
+    ngx_log_t *log);
+static void ngx_ssl_stapling_cache_read(ngx_ssl_stapling_t *staple,
+    ngx_log_t *log);
+static void ngx_ssl_stapling_cache_write(ngx_ssl_stapling_t *staple,
+    ngx_str_t *response, ngx_log_t *log);
+static void ngx_ssl_stapling_cache_handler(ngx_event_t *ev);
 
 static time_t ngx_ssl_stapling_time(ASN1_GENERALIZEDTIME *asn1time);
 
@@ -124,9 +188,12 @@ static ngx_int_t ngx_ssl_ocsp_process_body(ngx_ssl_ocsp_ctx_t *ctx);
 static u_char *ngx_ssl_ocsp_log_error(ngx_log_t *log, u_char *buf, size_t len);
 
 
+static ngx_uint_t  ngx_ssl_stapling_cache_tag;
+
+
 ngx_int_t
 ngx_ssl_stapling(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *file,
-    ngx_str_t *responder, ngx_uint_t verify)
+    ngx_str_t *responder, ngx_uint_t verify, ngx_shm_zone_t *shm_zone)
 {
     X509  *cert;
 
@@ -134,7 +201,8 @@ ngx_ssl_stapling(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *file,
          cert;
          cert = X509_get_ex_data(cert, ngx_ssl_next_certificate_index))
     {
-        if (ngx_ssl_stapling_certificate(cf, ssl, cert, file, responder, verify)
+        if (ngx_ssl_stapling_certificate(cf, ssl, cert, file, responder, verify,
+                                         shm_zone)
             != NGX_OK)
         {
             return NGX_ERROR;
@@ -149,7 +217,8 @@ ngx_ssl_stapling(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *file,
 
 static ngx_int_t
 ngx_ssl_stapling_certificate(ngx_conf_t *cf, ngx_ssl_t *ssl, X509 *cert,
-    ngx_str_t *file, ngx_str_t *responder, ngx_uint_t verify)
+    ngx_str_t *file, ngx_str_t *responder, ngx_uint_t verify,
+    ngx_shm_zone_t *shm_zone)
 {
     ngx_int_t            rc;
     ngx_pool_cleanup_t  *cln;
@@ -210,6 +279,10 @@ ngx_ssl_stapling_certificate(ngx_conf_t *cf, ngx_ssl_t *ssl, X509 *cert,
         return NGX_ERROR;
     }
 
+    if (shm_zone) {
+        return ngx_ssl_stapling_cache_add(cf, staple, shm_zone);
+    }
+
     return NGX_OK;
 }
 
@@ -516,307 +589,1079 @@ ngx_ssl_certificate_status_callback(ngx_ssl_conn_t *ssl_conn, void *data)
         return rc;
     }
 
-    staple = X509_get_ex_data(cert, ngx_ssl_stapling_index);
+    staple = X509_get_ex_data(cert, ngx_ssl_stapling_index);
+
+    if (staple == NULL) {
+        return rc;
+    }
+
+#if (NGX_THREADS)
+    /* the callback may be called by an offloaded handshake in a thread */
+    ngx_spinlock(&staple->lock, 1, 2048);
+#endif
+
+    if (staple->cache) {
+        ngx_ssl_stapling_cache_sync(staple, c->log);
+    }
+
+    if (staple->staple.len
+        && staple->valid >= ngx_time())
+    {
+        /* we have to copy ocsp response as OpenSSL will free it by itself */
+
+        p = OPENSSL_malloc(staple->staple.len);
+        if (p == NULL) {
+#if (NGX_THREADS)
+            ngx_unlock(&staple->lock);
+#endif
+            ngx_ssl_error(NGX_LOG_ALERT, c->log, 0, "OPENSSL_malloc() failed");
+            return SSL_TLSEXT_ERR_NOACK;
+        }
+
+        ngx_memcpy(p, staple->staple.data, staple->staple.len);
+
+        SSL_set_tlsext_status_ocsp_resp(ssl_conn, p, staple->staple.len);
+
+        rc = SSL_TLSEXT_ERR_OK;
+    }
+
+#if (NGX_THREADS)
+    ngx_unlock(&staple->lock);
+
+    if (c->ssl->handshake_task) {
+
+        /* see ngx_ssl_stapling_handshake_update() */
+
+        return rc;
+    }
+#endif
+
+    ngx_ssl_stapling_update(staple);
+
+    return rc;
+}
+
+
+#if (NGX_THREADS)
+
+void
+ngx_ssl_stapling_handshake_update(ngx_connection_t *c)
+{
+    X509                *cert;
+    ngx_ssl_stapling_t  *staple;
+
+    /*
+     * an update cannot be started from the status callback called
+     * in a thread, so it is done after an offloaded handshake
+     */
+
+    cert = SSL_get_certificate(c->ssl->connection);
+
+    if (cert == NULL) {
+        return;
+    }
+
+    staple = X509_get_ex_data(cert, ngx_ssl_stapling_index);
+
+    if (staple == NULL) {
+        return;
+    }
+
+    ngx_ssl_stapling_update(staple);
+}
+
+#endif
+
+
+static void
+ngx_ssl_stapling_update(ngx_ssl_stapling_t *staple)
+{
+    /* responses in a shared cache are updated by a timer */
+
+    if (staple->host.len == 0 || staple->cache
+        || staple->loading || staple->refresh >= ngx_time())
+    {
+        return;
+    }
+
+    ngx_ssl_stapling_request(staple);
+}
+
+
+static void
+ngx_ssl_stapling_request(ngx_ssl_stapling_t *staple)
+{
+    ngx_ssl_ocsp_ctx_t  *ctx;
+
+    staple->loading = 1;
+
+    ctx = ngx_ssl_ocsp_start();
+    if (ctx == NULL) {
+        staple->loading = 0;
+        return;
+    }
+
+    ctx->cert = staple->cert;
+    ctx->issuer = staple->issuer;
+    ctx->name = staple->name;
+
+    ctx->addrs = staple->addrs;
+    ctx->host = staple->host;
+    ctx->uri = staple->uri;
+    ctx->port = staple->port;
+    ctx->timeout = staple->timeout;
+
+    ctx->resolver = staple->resolver;
+    ctx->resolver_timeout = staple->resolver_timeout;
+
+    ctx->handler = ngx_ssl_stapling_ocsp_handler;
+    ctx->data = staple;
+
+    ngx_ssl_ocsp_request(ctx);
+
+    return;
+}
+
+
+static void
+ngx_ssl_stapling_ocsp_handler(ngx_ssl_ocsp_ctx_t *ctx)
+{
+    time_t               now, valid, refresh;
+    ngx_str_t            response;
+    ngx_ssl_stapling_t  *staple;
+
+    staple = ctx->data;
+    now = ngx_time();
+
+    if (ctx->code != 200) {
+        goto error;
+    }
+
+    response.len = ctx->response->last - ctx->response->pos;
+
+    if (ngx_ssl_stapling_check(staple, ctx->response->pos, response.len,
+                               &valid, ctx->log)
+        != NGX_OK)
+    {
+        goto error;
+    }
+
+    /* copy the response to memory not in ctx->pool */
+
+    response.data = ngx_alloc(response.len, ctx->log);
+
+    if (response.data == NULL) {
+        goto error;
+    }
+
+    ngx_memcpy(response.data, ctx->response->pos, response.len);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ctx->log, 0,
+                   "ssl ocsp response, good, %uz", response.len);
+
+    /*
+     * refresh before the response expires,
+     * but not earlier than in 5 minutes, and at least in an hour
+     */
+
+    refresh = ngx_max(ngx_min(valid - 300, now + 3600), now + 300);
+
+    if (staple->cache) {
+        if (ngx_ssl_stapling_cache_store(staple, &response, valid, refresh)
+            == NGX_OK)
+        {
+            ngx_ssl_stapling_cache_write(staple, &response, ctx->log);
+        }
+    }
+
+#if (NGX_THREADS)
+    ngx_spinlock(&staple->lock, 1, 2048);
+#endif
+
+    if (staple->staple.data) {
+        ngx_free(staple->staple.data);
+    }
+
+    staple->staple = response;
+    staple->valid = valid;
+
+#if (NGX_THREADS)
+    ngx_unlock(&staple->lock);
+#endif
+
+    staple->loading = 0;
+    staple->refresh = refresh;
+
+    ngx_ssl_ocsp_done(ctx);
+    return;
+
+error:
+
+    staple->loading = 0;
+    staple->refresh = now + 300;
+
+    if (staple->cache) {
+        (void) ngx_ssl_stapling_cache_store(staple, NULL, 0, staple->refresh);
+    }
+
+    ngx_ssl_ocsp_done(ctx);
+}
+
+
+static ngx_int_t
+ngx_ssl_stapling_check(ngx_ssl_stapling_t *staple, u_char *data, size_t len,
+    time_t *valid, ngx_log_t *log)
+{
+    int                    n;
+    X509_STORE            *store;
+    const u_char          *p;
+    STACK_OF(X509)        *chain;
+    OCSP_CERTID           *id;
+    OCSP_RESPONSE         *ocsp;
+    OCSP_BASICRESP        *basic;
+    ASN1_GENERALIZEDTIME  *thisupdate, *nextupdate;
+
+    ocsp = NULL;
+    basic = NULL;
+    id = NULL;
+
+    /* check the response */
+
+    p = data;
+
+    ocsp = d2i_OCSP_RESPONSE(NULL, &p, len);
+    if (ocsp == NULL) {
+        ngx_ssl_error(NGX_LOG_ERR, log, 0,
+                      "d2i_OCSP_RESPONSE() failed");
+        goto error;
+    }
+
+    n = OCSP_response_status(ocsp);
+
+    if (n != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+        ngx_log_error(NGX_LOG_ERR, log, 0,
+                      "OCSP response not successful (%d: %s)",
+                      n, OCSP_response_status_str(n));
+        goto error;
+    }
+
+    basic = OCSP_response_get1_basic(ocsp);
+    if (basic == NULL) {
+        ngx_ssl_error(NGX_LOG_ERR, log, 0,
+                      "OCSP_response_get1_basic() failed");
+        goto error;
+    }
+
+    store = SSL_CTX_get_cert_store(staple->ssl_ctx);
+    if (store == NULL) {
+        ngx_ssl_error(NGX_LOG_CRIT, log, 0,
+                      "SSL_CTX_get_cert_store() failed");
+        goto error;
+    }
+
+#ifdef SSL_CTRL_SELECT_CURRENT_CERT
+    /* OpenSSL 1.0.2+ */
+    SSL_CTX_select_current_cert(staple->ssl_ctx, staple->cert);
+#endif
+
+#ifdef SSL_CTRL_GET_EXTRA_CHAIN_CERTS
+    /* OpenSSL 1.0.1+ */
+    SSL_CTX_get_extra_chain_certs(staple->ssl_ctx, &chain);
+#else
+    chain = staple->ssl_ctx->extra_certs;
+#endif
+
+    if (OCSP_basic_verify(basic, chain, store,
+                          staple->verify ? OCSP_TRUSTOTHER : OCSP_NOVERIFY)
+        != 1)
+    {
+        ngx_ssl_error(NGX_LOG_ERR, log, 0,
+                      "OCSP_basic_verify() failed");
+        goto error;
+    }
+
+    id = OCSP_cert_to_id(NULL, staple->cert, staple->issuer);
+    if (id == NULL) {
+        ngx_ssl_error(NGX_LOG_CRIT, log, 0,
+                      "OCSP_cert_to_id() failed");
+        goto error;
+    }
+
+    if (OCSP_resp_find_status(basic, id, &n, NULL, NULL,
+                              &thisupdate, &nextupdate)
+        != 1)
+    {
+        ngx_log_error(NGX_LOG_ERR, log, 0,
+                      "certificate status not found in the OCSP response");
+        goto error;
+    }
+
+    if (n != V_OCSP_CERTSTATUS_GOOD) {
+        ngx_log_error(NGX_LOG_ERR, log, 0,
+                      "certificate status \"%s\" in the OCSP response",
+                      OCSP_cert_status_str(n));
+        goto error;
+    }
+
+    if (OCSP_check_validity(thisupdate, nextupdate, 300, -1) != 1) {
+        ngx_ssl_error(NGX_LOG_ERR, log, 0,
+                      "OCSP_check_validity() failed");
+        goto error;
+    }
+
+    if (nextupdate) {
+        *valid = ngx_ssl_stapling_time(nextupdate);
+        if (*valid == (time_t) NGX_ERROR) {
+            ngx_log_error(NGX_LOG_ERR, log, 0,
+                          "invalid nextUpdate time in certificate status");
+            goto error;
+        }
+
+    } else {
+        *valid = NGX_MAX_TIME_T_VALUE;
+    }
+
+    OCSP_CERTID_free(id);
+    OCSP_BASICRESP_free(basic);
+    OCSP_RESPONSE_free(ocsp);
+
+    return NGX_OK;
+
+error:
+
+    if (id) {
+        OCSP_CERTID_free(id);
+    }
+
+    if (basic) {
+        OCSP_BASICRESP_free(basic);
+    }
+
+    if (ocsp) {
+        OCSP_RESPONSE_free(ocsp);
+    }
+
+    return NGX_ERROR;
+}
+
+
+static time_t
+ngx_ssl_stapling_time(ASN1_GENERALIZEDTIME *asn1time)
+{
+    BIO     *bio;
+    char    *value;
+    size_t   len;
+    time_t   time;
+
+    /*
+     * OpenSSL doesn't provide a way to convert ASN1_GENERALIZEDTIME
+     * into time_t.  To do this, we use ASN1_GENERALIZEDTIME_print(),
+     * which uses the "MMM DD HH:MM:SS YYYY [GMT]" format (e.g.,
+     * "Feb  3 00:55:52 2015 GMT"), and parse the result.
+     */
+
+    bio = BIO_new(BIO_s_mem());
+    if (bio == NULL) {
+        return NGX_ERROR;
+    }
+
+    /* fake weekday prepended to match C asctime() format */
+
+    BIO_write(bio, "Tue ", sizeof("Tue ") - 1);
+    ASN1_GENERALIZEDTIME_print(bio, asn1time);
+    len = BIO_get_mem_data(bio, &value);
+
+    time = ngx_parse_http_time((u_char *) value, len);
+
+    BIO_free(bio);
+
+    return time;
+}
+
+
+static void
+ngx_ssl_stapling_cleanup(void *data)
+{
+    ngx_ssl_stapling_t  *staple = data;
+
+    if (staple->issuer) {
+        X509_free(staple->issuer);
+    }
+
+    if (staple->staple.data) {
+        ngx_free(staple->staple.data);
+    }
+}
+
+
+ngx_shm_zone_t *
+ngx_ssl_stapling_cache(ngx_conf_t *cf, ngx_str_t *name, size_t size,
+    ngx_str_t *path)
+{
+    ngx_shm_zone_t            *shm_zone;
+    ngx_ssl_stapling_cache_t  *cache;
+
+    shm_zone = ngx_shared_memory_add(cf, name, size,
+                                     &ngx_ssl_stapling_cache_tag);
+    if (shm_zone == NULL) {
+        return NULL;
+    }
+
+    if (shm_zone->data) {
+        cache = shm_zone->data;
+
+        if (path->len == 0 && cache->path == NULL) {
+            return shm_zone;
+        }
+
+        if (path->len && cache->path) {
+            if (ngx_conf_full_name(cf->cycle, path, 0) != NGX_OK) {
+                return NULL;
+            }
+
+            if (path->len == cache->path->name.len
+                && ngx_strncmp(path->data, cache->path->name.data, path->len)
+                   == 0)
+            {
+                return shm_zone;
+            }
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "stapling cache \"%V\" is already used "
+                           "with a different path", name);
+        return NULL;
+    }
+
+    cache = ngx_pcalloc(cf->pool, sizeof(ngx_ssl_stapling_cache_t));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    if (ngx_array_init(&cache->staples, cf->pool, 4,
+                       sizeof(ngx_ssl_stapling_t *))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    if (path->len) {
+        cache->path = ngx_pcalloc(cf->pool, sizeof(ngx_path_t));
+        if (cache->path == NULL) {
+            return NULL;
+        }
+
+        cache->path->name = *path;
+
+        if (ngx_conf_full_name(cf->cycle, &cache->path->name, 0) != NGX_OK) {
+            return NULL;
+        }
+
+        if (cache->path->name.data[cache->path->name.len - 1] == '/') {
+            cache->path->name.len--;
+        }
+
+        cache->path->conf_file = cf->conf_file->file.name.data;
+        cache->path->line = cf->conf_file->line;
+
+        if (ngx_add_path(cf, &cache->path) != NGX_OK) {
+            return NULL;
+        }
+    }
+
+    shm_zone->init = ngx_ssl_stapling_cache_init;
+    shm_zone->data = cache;
+
+    return shm_zone;
+}
+
+
+ngx_int_t
+ngx_ssl_stapling_init_process(ngx_cycle_t *cycle)
+{
+    ngx_uint_t                 i;
+    ngx_shm_zone_t            *shm_zone;
+    ngx_list_part_t           *part;
+    ngx_ssl_stapling_cache_t  *cache;
+
+    /* responses in shared caches are updated by the first worker only */
+
+    if ((ngx_process != NGX_PROCESS_WORKER
+         && ngx_process != NGX_PROCESS_SINGLE)
+        || ngx_worker != 0)
+    {
+        return NGX_OK;
+    }
+
+    part = &cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        if (shm_zone[i].tag != &ngx_ssl_stapling_cache_tag) {
+            continue;
+        }
+
+        cache = shm_zone[i].data;
+
+        if (cache->staples.nelts == 0) {
+            continue;
+        }
+
+        cache->event.handler = ngx_ssl_stapling_cache_handler;
+        cache->event.data = cache;
+        cache->event.log = cycle->log;
+        cache->event.cancelable = 1;
+
+        ngx_add_timer(&cache->event, 1);
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_ssl_stapling_cache_init(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_ssl_stapling_cache_t  *ocache = data;
+
+    size_t                      len;
+    ngx_uint_t                  i;
+    ngx_ssl_stapling_t        **staple;
+    ngx_ssl_stapling_cache_t   *cache;
+
+    cache = shm_zone->data;
+
+    if (ocache) {
+        cache->sh = ocache->sh;
+        cache->shpool = ocache->shpool;
+        goto read;
+    }
+
+    cache->shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (shm_zone->shm.exists) {
+        cache->sh = cache->shpool->data;
+        return NGX_OK;
+    }
+
+    cache->sh = ngx_slab_alloc(cache->shpool,
+                               sizeof(ngx_ssl_stapling_cache_sh_t));
+    if (cache->sh == NULL) {
+        return NGX_ERROR;
+    }
+
+    cache->shpool->data = cache->sh;
+
+    ngx_rbtree_init(&cache->sh->rbtree, &cache->sh->sentinel,
+                    ngx_ssl_stapling_rbtree_insert_value);
+
+    len = sizeof(" in OCSP stapling cache \"\"") + shm_zone->shm.name.len;
+
+    cache->shpool->log_ctx = ngx_slab_alloc(cache->shpool, len);
+    if (cache->shpool->log_ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_sprintf(cache->shpool->log_ctx, " in OCSP stapling cache \"%V\"%Z",
+                &shm_zone->shm.name);
+
+read:
+
+    /* responses saved by previous instances, if not yet in the cache */
+
+    staple = cache->staples.elts;
+
+    for (i = 0; i < cache->staples.nelts; i++) {
+        ngx_ssl_stapling_cache_read(staple[i], shm_zone->shm.log);
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_ssl_stapling_cache_add(ngx_conf_t *cf, ngx_ssl_stapling_t *staple,
+    ngx_shm_zone_t *shm_zone)
+{
+    u_char                     *p;
+    size_t                      len;
+    ngx_uint_t                  i;
+    unsigned int                n;
+    ngx_ssl_stapling_t        **s;
+    ngx_ssl_stapling_cache_t   *cache;
+
+    cache = shm_zone->data;
+
+    if (X509_digest(staple->cert, EVP_sha1(), staple->id, &n) == 0
+        || n != NGX_SSL_STAPLING_ID_LEN)
+    {
+        ngx_ssl_error(NGX_LOG_EMERG, cf->log, 0, "X509_digest() failed");
+        return NGX_ERROR;
+    }
+
+    staple->cache = cache;
+
+    /* the same certificate is requested once for all servers */
+
+    s = cache->staples.elts;
+
+    for (i = 0; i < cache->staples.nelts; i++) {
+        if (ngx_memcmp(s[i]->id, staple->id, NGX_SSL_STAPLING_ID_LEN) == 0) {
+            return NGX_OK;
+        }
+    }
+
+    s = ngx_array_push(&cache->staples);
+    if (s == NULL) {
+        return NGX_ERROR;
+    }
+
+    *s = staple;
+
+    if (cache->path == NULL) {
+        return NGX_OK;
+    }
+
+    /* "<path>/<sha1 of the certificate>.der" and a temporary file name */
+
+    len = cache->path->name.len + 1 + 2 * NGX_SSL_STAPLING_ID_LEN
+          + sizeof(".der") - 1;
+
+    p = ngx_pnalloc(cf->pool, 2 * len + sizeof(".tmp") + 1);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    staple->file.data = p;
+    staple->file.len = len;
+
+    p = ngx_cpymem(p, cache->path->name.data, cache->path->name.len);
+    *p++ = '/';
+    p = ngx_hex_dump(p, staple->id, NGX_SSL_STAPLING_ID_LEN);
+    p = ngx_cpymem(p, ".der", sizeof(".der"));
+
+    staple->temp.data = p;
+    staple->temp.len = len + sizeof(".tmp") - 1;
+
+    ngx_sprintf(p, "%V.tmp%Z", &staple->file);
+
+    return NGX_OK;
+}
+
+
+static ngx_ssl_stapling_node_t *
+ngx_ssl_stapling_cache_lookup(ngx_ssl_stapling_cache_t *cache, u_char *id)
+{
+    ngx_int_t                 rc;
+    uint32_t                  hash;
+    ngx_rbtree_node_t        *node, *sentinel;
+    ngx_ssl_stapling_node_t  *sn;
+
+    hash = ngx_crc32_short(id, NGX_SSL_STAPLING_ID_LEN);
+
+    node = cache->sh->rbtree.root;
+    sentinel = cache->sh->rbtree.sentinel;
+
+    while (node != sentinel) {
+
+        if (hash < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (hash > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* hash == node->key */
+
+        sn = (ngx_ssl_stapling_node_t *) node;
+
+        rc = ngx_memcmp(id, sn->id, NGX_SSL_STAPLING_ID_LEN);
+
+        if (rc == 0) {
+            return sn;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
+
+    return NULL;
+}
+
+
+static void
+ngx_ssl_stapling_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t        **p;
+    ngx_ssl_stapling_node_t   *n, *t;
+
+    for ( ;; ) {
+
+        if (node->key < temp->key) {
+
+            p = &temp->left;
+
+        } else if (node->key > temp->key) {
+
+            p = &temp->right;
+
+        } else { /* node->key == temp->key */
+
+            n = (ngx_ssl_stapling_node_t *) node;
+            t = (ngx_ssl_stapling_node_t *) temp;
+
+            p = (ngx_memcmp(n->id, t->id, NGX_SSL_STAPLING_ID_LEN) < 0)
+                ? &temp->left : &temp->right;
+        }
+
+        if (*p == sentinel) {
+            break;
+        }
+
+        temp = *p;
+    }
+
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
+}
+
+
+static ngx_int_t
+ngx_ssl_stapling_cache_store(ngx_ssl_stapling_t *staple, ngx_str_t *response,
+    time_t valid, time_t refresh)
+{
+    u_char                   *data;
+    ngx_slab_pool_t          *shpool;
+    ngx_ssl_stapling_node_t  *sn;
+
+    /* a NULL response only postpones the next update */
+
+    shpool = staple->cache->shpool;
+
+    ngx_shmtx_lock(&shpool->mutex);
+
+    sn = ngx_ssl_stapling_cache_lookup(staple->cache, staple->id);
+
+    if (sn == NULL) {
+        sn = ngx_slab_calloc_locked(shpool, sizeof(ngx_ssl_stapling_node_t));
+        if (sn == NULL) {
+            goto failed;
+        }
+
+        sn->node.key = ngx_crc32_short(staple->id, NGX_SSL_STAPLING_ID_LEN);
+        ngx_memcpy(sn->id, staple->id, NGX_SSL_STAPLING_ID_LEN);
 
-    if (staple == NULL) {
-        return rc;
+        ngx_rbtree_insert(&staple->cache->sh->rbtree, &sn->node);
     }
 
-    if (staple->staple.len
-        && staple->valid >= ngx_time())
-    {
-        /* we have to copy ocsp response as OpenSSL will free it by itself */
+    sn->refresh = refresh;
 
-        p = OPENSSL_malloc(staple->staple.len);
-        if (p == NULL) {
-            ngx_ssl_error(NGX_LOG_ALERT, c->log, 0, "OPENSSL_malloc() failed");
-            return SSL_TLSEXT_ERR_NOACK;
+    if (response) {
+        data = ngx_slab_alloc_locked(shpool, response->len);
+        if (data == NULL) {
+            goto failed;
         }
 
-        ngx_memcpy(p, staple->staple.data, staple->staple.len);
+        ngx_memcpy(data, response->data, response->len);
 
-        SSL_set_tlsext_status_ocsp_resp(ssl_conn, p, staple->staple.len);
+        if (sn->data) {
+            ngx_slab_free_locked(shpool, sn->data);
+        }
 
-        rc = SSL_TLSEXT_ERR_OK;
+        sn->data = data;
+        sn->len = response->len;
+        sn->valid = valid;
+        sn->version++;
     }
 
-    ngx_ssl_stapling_update(staple);
+    ngx_shmtx_unlock(&shpool->mutex);
 
-    return rc;
+    return NGX_OK;
+
+failed:
+
+    ngx_shmtx_unlock(&shpool->mutex);
+
+    return NGX_ERROR;
 }
 
 
 static void
-ngx_ssl_stapling_update(ngx_ssl_stapling_t *staple)
+ngx_ssl_stapling_cache_sync(ngx_ssl_stapling_t *staple, ngx_log_t *log)
 {
-    ngx_ssl_ocsp_ctx_t  *ctx;
+    u_char                   *data;
+    time_t                    now;
+    ngx_slab_pool_t          *shpool;
+    ngx_ssl_stapling_node_t  *sn;
 
-    if (staple->host.len == 0
-        || staple->loading || staple->refresh >= ngx_time())
-    {
+    /*
+     * called with the staple locked; the local copy is checked
+     * against the shared cache at most once per second
+     */
+
+    now = ngx_time();
+
+    if (staple->synced == now) {
         return;
     }
 
-    staple->loading = 1;
+    staple->synced = now;
 
-    ctx = ngx_ssl_ocsp_start();
-    if (ctx == NULL) {
-        return;
+    shpool = staple->cache->shpool;
+
+    ngx_shmtx_lock(&shpool->mutex);
+
+    sn = ngx_ssl_stapling_cache_lookup(staple->cache, staple->id);
+
+    if (sn == NULL || sn->data == NULL || sn->version == staple->version) {
+        goto done;
     }
 
-    ctx->cert = staple->cert;
-    ctx->issuer = staple->issuer;
-    ctx->name = staple->name;
+    data = ngx_alloc(sn->len, log);
+    if (data == NULL) {
+        goto done;
+    }
 
-    ctx->addrs = staple->addrs;
-    ctx->host = staple->host;
-    ctx->uri = staple->uri;
-    ctx->port = staple->port;
-    ctx->timeout = staple->timeout;
+    ngx_memcpy(data, sn->data, sn->len);
 
-    ctx->resolver = staple->resolver;
-    ctx->resolver_timeout = staple->resolver_timeout;
+    if (staple->staple.data) {
+        ngx_free(staple->staple.data);
+    }
 
-    ctx->handler = ngx_ssl_stapling_ocsp_handler;
-    ctx->data = staple;
+    staple->staple.data = data;
+    staple->staple.len = sn->len;
+    staple->valid = sn->valid;
+    staple->version = sn->version;
 
-    ngx_ssl_ocsp_request(ctx);
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "ssl stapling cache sync, %uz", sn->len);
 
-    return;
+done:
+
+    ngx_shmtx_unlock(&shpool->mutex);
 }
 
 
 static void
-ngx_ssl_stapling_ocsp_handler(ngx_ssl_ocsp_ctx_t *ctx)
+ngx_ssl_stapling_cache_read(ngx_ssl_stapling_t *staple, ngx_log_t *log)
 {
-    int                    n;
-    size_t                 len;
-    time_t                 now, valid;
-    ngx_str_t              response;
-    X509_STORE            *store;
-    const u_char          *p;
-    STACK_OF(X509)        *chain;
-    OCSP_CERTID           *id;
-    OCSP_RESPONSE         *ocsp;
-    OCSP_BASICRESP        *basic;
-    ngx_ssl_stapling_t    *staple;
-    ASN1_GENERALIZEDTIME  *thisupdate, *nextupdate;
-
-    staple = ctx->data;
-    now = ngx_time();
-    ocsp = NULL;
-    basic = NULL;
-    id = NULL;
-
-    if (ctx->code != 200) {
-        goto error;
+    time_t                    now, valid;
+    ssize_t                   n;
+    ngx_str_t                 response;
+    ngx_file_t                file;
+    ngx_file_info_t           fi;
+    ngx_slab_pool_t          *shpool;
+    ngx_ssl_stapling_node_t  *sn;
+
+    if (staple->file.len == 0) {
+        return;
     }
 
-    /* check the response */
+    shpool = staple->cache->shpool;
 
-    len = ctx->response->last - ctx->response->pos;
-    p = ctx->response->pos;
+    ngx_shmtx_lock(&shpool->mutex);
+    sn = ngx_ssl_stapling_cache_lookup(staple->cache, staple->id);
+    ngx_shmtx_unlock(&shpool->mutex);
 
-    ocsp = d2i_OCSP_RESPONSE(NULL, &p, len);
-    if (ocsp == NULL) {
-        ngx_ssl_error(NGX_LOG_ERR, ctx->log, 0,
-                      "d2i_OCSP_RESPONSE() failed");
-        goto error;
+    if (sn && sn->data) {
+        return;
     }
 
-    n = OCSP_response_status(ocsp);
+    ngx_memzero(&file, sizeof(ngx_file_t));
+    file.name = staple->file;
+    file.log = log;
 
-    if (n != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
-        ngx_log_error(NGX_LOG_ERR, ctx->log, 0,
-                      "OCSP response not successful (%d: %s)",
-                      n, OCSP_response_status_str(n));
-        goto error;
-    }
+    file.fd = ngx_open_file(file.name.data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
 
-    basic = OCSP_response_get1_basic(ocsp);
-    if (basic == NULL) {
-        ngx_ssl_error(NGX_LOG_ERR, ctx->log, 0,
-                      "OCSP_response_get1_basic() failed");
-        goto error;
-    }
+    if (file.fd == NGX_INVALID_FILE) {
+        if (ngx_errno != NGX_ENOENT) {
+            ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                          ngx_open_file_n " \"%V\" failed", &file.name);
+        }
 
-    store = SSL_CTX_get_cert_store(staple->ssl_ctx);
-    if (store == NULL) {
-        ngx_ssl_error(NGX_LOG_CRIT, ctx->log, 0,
-                      "SSL_CTX_get_cert_store() failed");
-        goto error;
+        return;
     }
 
-#ifdef SSL_CTRL_SELECT_CURRENT_CERT
-    /* OpenSSL 1.0.2+ */
-    SSL_CTX_select_current_cert(staple->ssl_ctx, ctx->cert);
-#endif
+    response.data = NULL;
 
-#ifdef SSL_CTRL_GET_EXTRA_CHAIN_CERTS
-    /* OpenSSL 1.0.1+ */
-    SSL_CTX_get_extra_chain_certs(staple->ssl_ctx, &chain);
-#else
-    chain = staple->ssl_ctx->extra_certs;
-#endif
+    if (ngx_fd_info(file.fd, &fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_fd_info_n " \"%V\" failed", &file.name);
+        goto done;
+    }
 
-    if (OCSP_basic_verify(basic, chain, store,
-                          staple->verify ? OCSP_TRUSTOTHER : OCSP_NOVERIFY)
-        != 1)
-    {
-        ngx_ssl_error(NGX_LOG_ERR, ctx->log, 0,
-                      "OCSP_basic_verify() failed");
-        goto error;
+    response.len = ngx_file_size(&fi);
+
+    if (response.len == 0 || response.len > NGX_SSL_STAPLING_MAX_SIZE) {
+        ngx_log_error(NGX_LOG_WARN, log, 0,
+                      "invalid size of saved OCSP response \"%V\"",
+                      &file.name);
+        goto done;
     }
 
-    id = OCSP_cert_to_id(NULL, ctx->cert, ctx->issuer);
-    if (id == NULL) {
-        ngx_ssl_error(NGX_LOG_CRIT, ctx->log, 0,
-                      "OCSP_cert_to_id() failed");
-        goto error;
+    response.data = ngx_alloc(response.len, log);
+    if (response.data == NULL) {
+        goto done;
     }
 
-    if (OCSP_resp_find_status(basic, id, &n, NULL, NULL,
-                              &thisupdate, &nextupdate)
-        != 1)
-    {
-        ngx_log_error(NGX_LOG_ERR, ctx->log, 0,
-                      "certificate status not found in the OCSP response");
-        goto error;
+    n = ngx_read_file(&file, response.data, response.len, 0);
+
+    if (n == NGX_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_read_file_n " \"%V\" failed", &file.name);
+        goto done;
     }
 
-    if (n != V_OCSP_CERTSTATUS_GOOD) {
-        ngx_log_error(NGX_LOG_ERR, ctx->log, 0,
-                      "certificate status \"%s\" in the OCSP response",
-                      OCSP_cert_status_str(n));
-        goto error;
+    if ((size_t) n != response.len) {
+        ngx_log_error(NGX_LOG_CRIT, log, 0,
+                      ngx_read_file_n " \"%V\" returned only "
+                      "%z bytes instead of %uz", &file.name, n, response.len);
+        goto done;
     }
 
-    if (OCSP_check_validity(thisupdate, nextupdate, 300, -1) != 1) {
-        ngx_ssl_error(NGX_LOG_ERR, ctx->log, 0,
-                      "OCSP_check_validity() failed");
-        goto error;
+    if (ngx_ssl_stapling_check(staple, response.data, response.len, &valid,
+                               log)
+        != NGX_OK)
+    {
+        ngx_log_error(NGX_LOG_WARN, log, 0,
+                      "saved OCSP response \"%V\" ignored", &file.name);
+        goto done;
     }
 
-    if (nextupdate) {
-        valid = ngx_ssl_stapling_time(nextupdate);
-        if (valid == (time_t) NGX_ERROR) {
-            ngx_log_error(NGX_LOG_ERR, ctx->log, 0,
-                          "invalid nextUpdate time in certificate status");
-            goto error;
-        }
+    now = ngx_time();
 
-    } else {
-        valid = NGX_MAX_TIME_T_VALUE;
+    if (valid <= now) {
+        goto done;
     }
 
-    OCSP_CERTID_free(id);
-    OCSP_BASICRESP_free(basic);
-    OCSP_RESPONSE_free(ocsp);
+    /* unlike on updates, a response close to expiration is refreshed now */
 
-    id = NULL;
-    basic = NULL;
-    ocsp = NULL;
+    (void) ngx_ssl_stapling_cache_store(staple, &response, valid,
+                                        ngx_min(valid - 300, now + 3600));
 
-    /* copy the response to memory not in ctx->pool */
+done:
 
-    response.len = len;
-    response.data = ngx_alloc(response.len, ctx->log);
+    if (response.data) {
+        ngx_free(response.data);
+    }
 
-    if (response.data == NULL) {
-        goto error;
+    if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_close_file_n " \"%V\" failed", &file.name);
     }
+}
 
-    ngx_memcpy(response.data, ctx->response->pos, response.len);
 
-    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ctx->log, 0,
-                   "ssl ocsp response, %s, %uz",
-                   OCSP_cert_status_str(n), response.len);
+static void
+ngx_ssl_stapling_cache_write(ngx_ssl_stapling_t *staple, ngx_str_t *response,
+    ngx_log_t *log)
+{
+    ssize_t   n;
+    ngx_fd_t  fd;
 
-    if (staple->staple.data) {
-        ngx_free(staple->staple.data);
+    if (staple->file.len == 0) {
+        return;
     }
 
-    staple->staple = response;
-    staple->valid = valid;
-
-    /*
-     * refresh before the response expires,
-     * but not earlier than in 5 minutes, and at least in an hour
-     */
+    fd = ngx_open_file(staple->temp.data, NGX_FILE_WRONLY, NGX_FILE_TRUNCATE,
+                       NGX_FILE_DEFAULT_ACCESS);
 
-    staple->loading = 0;
-    staple->refresh = ngx_max(ngx_min(valid - 300, now + 3600), now + 300);
-
-    ngx_ssl_ocsp_done(ctx);
-    return;
+    if (fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_open_file_n " \"%V\" failed", &staple->temp);
+        return;
+    }
 
-error:
+    n = ngx_write_fd(fd, response->data, response->len);
 
-    staple->loading = 0;
-    staple->refresh = now + 300;
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_write_fd_n " \"%V\" failed", &staple->temp);
+    }
 
-    if (id) {
-        OCSP_CERTID_free(id);
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_close_file_n " \"%V\" failed", &staple->temp);
     }
 
-    if (basic) {
-        OCSP_BASICRESP_free(basic);
+    if ((size_t) n != response->len) {
+        goto failed;
     }
 
-    if (ocsp) {
-        OCSP_RESPONSE_free(ocsp);
+    if (ngx_rename_file(staple->temp.data, staple->file.data)
+        == NGX_FILE_ERROR)
+    {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_rename_file_n " \"%V\" to \"%V\" failed",
+                      &staple->temp, &staple->file);
+        goto failed;
     }
 
-    ngx_ssl_ocsp_done(ctx);
+    return;
+
+failed:
+
+    if (ngx_delete_file(staple->temp.data) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_delete_file_n " \"%V\" failed", &staple->temp);
+    }
 }
 
 
-static time_t
-ngx_ssl_stapling_time(ASN1_GENERALIZEDTIME *asn1time)
+static void
+ngx_ssl_stapling_cache_handler(ngx_event_t *ev)
 {
-    BIO     *bio;
-    char    *value;
-    size_t   len;
-    time_t   time;
+    time_t                     now, refresh;
+    ngx_uint_t                 i;
+    ngx_ssl_stapling_t       **staple;
+    ngx_ssl_stapling_node_t   *sn;
+    ngx_ssl_stapling_cache_t  *cache;
 
-    /*
-     * OpenSSL doesn't provide a way to convert ASN1_GENERALIZEDTIME
-     * into time_t.  To do this, we use ASN1_GENERALIZEDTIME_print(),
-     * which uses the "MMM DD HH:MM:SS YYYY [GMT]" format (e.g.,
-     * "Feb  3 00:55:52 2015 GMT"), and parse the result.
-     */
+    cache = ev->data;
+    now = ngx_time();
 
-    bio = BIO_new(BIO_s_mem());
-    if (bio == NULL) {
-        return NGX_ERROR;
-    }
+    staple = cache->staples.elts;
 
-    /* fake weekday prepended to match C asctime() format */
+    for (i = 0; i < cache->staples.nelts; i++) {
 
-    BIO_write(bio, "Tue ", sizeof("Tue ") - 1);
-    ASN1_GENERALIZEDTIME_print(bio, asn1time);
-    len = BIO_get_mem_data(bio, &value);
+        if (staple[i]->loading) {
+            continue;
+        }
 
-    time = ngx_parse_http_time((u_char *) value, len);
+        ngx_shmtx_lock(&cache->shpool->mutex);
 
-    BIO_free(bio);
+        sn = ngx_ssl_stapling_cache_lookup(cache, staple[i]->id);
+        refresh = sn ? sn->refresh : 0;
 
-    return time;
-}
+        ngx_shmtx_unlock(&cache->shpool->mutex);
 
+        if (refresh > now) {
+            continue;
+        }
 
-static void
-ngx_ssl_stapling_cleanup(void *data)
-{
-    ngx_ssl_stapling_t  *staple = data;
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "ssl stapling cache update: \"%s\"", staple[i]->name);
 
-    if (staple->issuer) {
-        X509_free(staple->issuer);
+        ngx_ssl_stapling_request(staple[i]);
     }
 
-    if (staple->staple.data) {
-        ngx_free(staple->staple.data);
-    }
+    ngx_add_timer(ev, NGX_SSL_STAPLING_CACHE_CHECK);
 }
 
 
@@ -1874,7 +2719,7 @@ ngx_ssl_ocsp_log_error(ngx_log_t *log, u_char *buf, size_t len)
 
 ngx_int_t
 ngx_ssl_stapling(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *file,
-    ngx_str_t *responder, ngx_uint_t verify)
+    ngx_str_t *responder, ngx_uint_t verify, ngx_shm_zone_t *shm_zone)
 {
     ngx_log_error(NGX_LOG_WARN, ssl->log, 0,
                   "\"ssl_stapling\" ignored, not supported");
@@ -1883,6 +2728,26 @@ ngx_ssl_stapling(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_str_t *file,
 }
 
 
+ngx_shm_zone_t *
+ngx_ssl_stapling_cache(ngx_conf_t *cf, ngx_str_t *name, size_t size,
+    ngx_str_t *path)
+{
+    static ngx_uint_t  tag;
+
+    ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                       "\"ssl_stapling_cache\" ignored, not supported");
+
+    return ngx_shared_memory_add(cf, name, size, &tag);
+}
+
+
+ngx_int_t
+ngx_ssl_stapling_init_process(ngx_cycle_t *cycle)
+{
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_ssl_stapling_resolver(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_resolver_t *resolver, ngx_msec_t resolver_timeout)
@@ -10,6 +10,342 @@
 #include <ngx_event.h>
 
 
+#if (NGX_EVENT_TIMER_WHEEL)
+
+/*
+ * hierarchical timer wheel: level 0 has 1ms slots, each next level
+ * has NGX_TIMER_WHEEL_SLOTS times coarser slots; a timer is placed
+ * on the lowest level where its key shares the upper bits with the
+ * current wheel time, and is cascaded to lower levels when the wheel
+ * time reaches its slot; timers too far away are kept in the overflow
+ * list which is redistributed once per top level rotation
+ */
+
+static void ngx_event_timer_wheel_link(ngx_rbtree_node_t *node);
+static void ngx_event_timer_wheel_cascade(ngx_rbtree_node_t *slot);
+static ngx_msec_t ngx_event_timer_wheel_next(void);
+static ngx_uint_t ngx_event_timer_wheel_ffs(uint64_t mask);
+
+
+ngx_event_timer_wheel_t  ngx_event_timer_wheel;
+
+
+ngx_int_t
+ngx_event_timer_init(ngx_log_t *log)
+{
+    ngx_uint_t          i, n;
+    ngx_rbtree_node_t  *slot;
+
+    ngx_event_timer_wheel.current = ngx_current_msec;
+    ngx_event_timer_wheel.count = 0;
+
+    for (i = 0; i < NGX_TIMER_WHEEL_LEVELS; i++) {
+        ngx_event_timer_wheel.occupied[i] = 0;
+
+        for (n = 0; n < NGX_TIMER_WHEEL_SLOTS; n++) {
+            slot = &ngx_event_timer_wheel.slots[i][n];
+            slot->left = slot;
+            slot->right = slot;
+        }
+    }
+
+    slot = &ngx_event_timer_wheel.overflow;
+    slot->left = slot;
+    slot->right = slot;
+
+    return NGX_OK;
+}
+
+
+void
+ngx_event_timer_wheel_insert(ngx_rbtree_node_t *node)
+{
+    if (ngx_event_timer_wheel.count == 0
+        && (ngx_msec_int_t) (ngx_current_msec - ngx_event_timer_wheel.current)
+           > 0)
+    {
+        /* the wheel is empty, skip the idle time at once */
+        ngx_event_timer_wheel.current = ngx_current_msec;
+    }
+
+    ngx_event_timer_wheel_link(node);
+
+    ngx_event_timer_wheel.count++;
+}
+
+
+static void
+ngx_event_timer_wheel_link(ngx_rbtree_node_t *node)
+{
+    ngx_msec_t          key, current, diff;
+    ngx_uint_t          level, n;
+    ngx_rbtree_node_t  *slot;
+
+    current = ngx_event_timer_wheel.current;
+    key = node->key;
+
+    if ((ngx_msec_int_t) (key - current) < 0) {
+        key = current;
+    }
+
+    diff = key ^ current;
+    slot = &ngx_event_timer_wheel.overflow;
+
+    for (level = 0; level < NGX_TIMER_WHEEL_LEVELS; level++) {
+
+        if (diff >> (NGX_TIMER_WHEEL_BITS * (level + 1))) {
+            continue;
+        }
+
+        n = (key >> (NGX_TIMER_WHEEL_BITS * level))
+            & (NGX_TIMER_WHEEL_SLOTS - 1);
+
+        slot = &ngx_event_timer_wheel.slots[level][n];
+        ngx_event_timer_wheel.occupied[level] |= (uint64_t) 1 << n;
+
+        break;
+    }
+
+    node->parent = slot;
+    node->left = slot;
+    node->right = slot->right;
+    slot->right->left = node;
+    slot->right = node;
+}
+
+
+static void
+ngx_event_timer_wheel_cascade(ngx_rbtree_node_t *slot)
+{
+    ngx_uint_t          n;
+    ngx_rbtree_node_t  *node, *next;
+
+    if (slot->left == slot) {
+        return;
+    }
+
+    node = slot->left;
+    slot->right->left = NULL;
+
+    slot->left = slot;
+    slot->right = slot;
+
+    if (slot != &ngx_event_timer_wheel.overflow) {
+        n = slot - &ngx_event_timer_wheel.slots[0][0];
+
+        ngx_event_timer_wheel.occupied[n / NGX_TIMER_WHEEL_SLOTS] &=
+                            ~((uint64_t) 1 << (n % NGX_TIMER_WHEEL_SLOTS));
+    }
+
+    while (node) {
+        next = node->left;
+        ngx_event_timer_wheel_link(node);
+        node = next;
+    }
+}
+
+
+/*
+ * returns the wheel time when the nearest non-empty slot is due:
+ * either the nearest timer expiration on level 0 or the time when
+ * a slot of an upper level should be cascaded, the latter may be
+ * earlier than the actual expiration of its timers
+ */
+
+static ngx_msec_t
+ngx_event_timer_wheel_next(void)
+{
+    uint64_t     mask;
+    ngx_uint_t   level, n, shift;
+    ngx_msec_t   current;
+
+    current = ngx_event_timer_wheel.current;
+
+    for (level = 0; level < NGX_TIMER_WHEEL_LEVELS; level++) {
+        shift = NGX_TIMER_WHEEL_BITS * level;
+        n = (current >> shift) & (NGX_TIMER_WHEEL_SLOTS - 1);
+
+        mask = ngx_event_timer_wheel.occupied[level] & ((uint64_t) -1 << n);
+
+        if (mask) {
+            n = ngx_event_timer_wheel_ffs(mask);
+            shift += NGX_TIMER_WHEEL_BITS;
+
+            return ((current >> shift) << shift)
+                   | ((ngx_msec_t) n << (shift - NGX_TIMER_WHEEL_BITS));
+        }
+    }
+
+    /* the overflow list */
+
+    shift = NGX_TIMER_WHEEL_BITS * NGX_TIMER_WHEEL_LEVELS;
+
+    return (current | (((ngx_msec_t) 1 << shift) - 1)) + 1;
+}
+
+
+static ngx_uint_t
+ngx_event_timer_wheel_ffs(uint64_t mask)
+{
+    ngx_uint_t  n;
+
+    n = 0;
+
+    if ((mask & 0xffffffff) == 0) {
+        n += 32;
+        mask >>= 32;
+    }
+
+    if ((mask & 0xffff) == 0) {
+        n += 16;
+        mask >>= 16;
+    }
+
+    if ((mask & 0xff) == 0) {
+        n += 8;
+        mask >>= 8;
+    }
+
+    if ((mask & 0xf) == 0) {
+        n += 4;
+        mask >>= 4;
+    }
+
+    if ((mask & 0x3) == 0) {
+        n += 2;
+        mask >>= 2;
+    }
+
+    if ((mask & 0x1) == 0) {
+        n += 1;
+    }
+
+    return n;
+}
+
+
+ngx_msec_t
+ngx_event_find_timer(void)
+{
+    ngx_msec_int_t  timer;
+
+    if (ngx_event_timer_wheel.count == 0) {
+        return NGX_TIMER_INFINITE;
+    }
+
+    timer = (ngx_msec_int_t) (ngx_event_timer_wheel_next() - ngx_current_msec);
+
+    return (ngx_msec_t) (timer > 0 ? timer : 0);
+}
+
+
+void
+ngx_event_expire_timers(void)
+{
+    ngx_msec_t          next;
+    ngx_uint_t          level, n;
+    ngx_event_t        *ev;
+    ngx_rbtree_node_t  *node, *slot;
+
+    for ( ;; ) {
+
+        if (ngx_event_timer_wheel.count == 0) {
+            return;
+        }
+
+        next = ngx_event_timer_wheel_next();
+
+        if ((ngx_msec_int_t) (next - ngx_current_msec) > 0) {
+            ngx_event_timer_wheel.current = ngx_current_msec;
+            return;
+        }
+
+        ngx_event_timer_wheel.current = next;
+
+        n = NGX_TIMER_WHEEL_BITS * NGX_TIMER_WHEEL_LEVELS;
+
+        if ((next & (((ngx_msec_t) 1 << n) - 1)) == 0) {
+            ngx_event_timer_wheel_cascade(&ngx_event_timer_wheel.overflow);
+        }
+
+        for (level = NGX_TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            n = NGX_TIMER_WHEEL_BITS * level;
+
+            if (next & (((ngx_msec_t) 1 << n) - 1)) {
+                continue;
+            }
+
+            n = (next >> n) & (NGX_TIMER_WHEEL_SLOTS - 1);
+
+            ngx_event_timer_wheel_cascade(
+                                      &ngx_event_timer_wheel.slots[level][n]);
+        }
+
+        /* all timers in the level 0 slot are expired */
+
+        n = next & (NGX_TIMER_WHEEL_SLOTS - 1);
+        slot = &ngx_event_timer_wheel.slots[0][n];
+
+        while (slot->left != slot) {
+            node = slot->left;
+
+            ev = (ngx_event_t *) ((char *) node - offsetof(ngx_event_t, timer));
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                           "event timer del: %d: %M",
+                           ngx_event_ident(ev->data), ev->timer.key);
+
+            ngx_event_timer_wheel_delete(node);
+
+#if (NGX_DEBUG)
+            ev->timer.left = NULL;
+            ev->timer.right = NULL;
+            ev->timer.parent = NULL;
+#endif
+
+            ev->timer_set = 0;
+
+            ev->timedout = 1;
+
+            ev->handler(ev);
+        }
+    }
+}
+
+
+ngx_int_t
+ngx_event_no_timers_left(void)
+{
+    ngx_uint_t          i;
+    ngx_event_t        *ev;
+    ngx_rbtree_node_t  *node, *slot;
+
+    for (i = 0; i <= NGX_TIMER_WHEEL_LEVELS * NGX_TIMER_WHEEL_SLOTS; i++) {
+
+        if (i == NGX_TIMER_WHEEL_LEVELS * NGX_TIMER_WHEEL_SLOTS) {
+            slot = &ngx_event_timer_wheel.overflow;
+
+        } else {
+            slot = &ngx_event_timer_wheel.slots[i / NGX_TIMER_WHEEL_SLOTS]
+                                              [i % NGX_TIMER_WHEEL_SLOTS];
+        }
+
+        for (node = slot->left; node != slot; node = node->left) {
+            ev = (ngx_event_t *) ((char *) node - offsetof(ngx_event_t, timer));
+
+            if (!ev->cancelable) {
+                return NGX_AGAIN;
+            }
+        }
+    }
+
+    /* only cancelable timers left */
+
+    return NGX_OK;
+}
+
+#else
+
 ngx_rbtree_t              ngx_event_timer_rbtree;
 static ngx_rbtree_node_t  ngx_event_timer_sentinel;
 
@@ -124,3 +460,5 @@ ngx_event_no_timers_left(void)
 
     return NGX_OK;
 }
+
+#endif
@@ -298,6 +298,8 @@ ngx_event_recvmsg(ngx_event_t *ev)
             return;
         }
 
+        ngx_pool_set_type(c->pool, NGX_POOL_CONNECTION);
+
         c->sockaddr = ngx_palloc(c->pool, socklen);
         if (c->sockaddr == NULL) {
             ngx_close_accepted_udp_connection(c);
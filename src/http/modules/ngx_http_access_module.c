@@ -34,10 +34,17 @@ typedef struct {
 
 #endif
 
+/* long rule lists are looked up in a compiled radix tree */
+
+#define NGX_HTTP_ACCESS_TREE_RULES  16
+
+
 typedef struct {
     ngx_array_t      *rules;     /* array of ngx_http_access_rule_t */
+    ngx_radix_tree_t *tree;
 #if (NGX_HAVE_INET6)
     ngx_array_t      *rules6;    /* array of ngx_http_access_rule6_t */
+    ngx_radix_tree_t *tree6;
 #endif
 #if (NGX_HAVE_UNIX_DOMAIN)
     ngx_array_t      *rules_un;  /* array of ngx_http_access_rule_un_t */
@@ -57,6 +64,8 @@ static ngx_int_t ngx_http_access_unix(ngx_http_request_t *r,
     ngx_http_access_loc_conf_t *alcf);
 #endif
 static ngx_int_t ngx_http_access_found(ngx_http_request_t *r, ngx_uint_t deny);
+static ngx_int_t ngx_http_access_tree(ngx_conf_t *cf,
+    ngx_http_access_loc_conf_t *alcf);
 static char *ngx_http_access_rule(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static void *ngx_http_access_create_loc_conf(ngx_conf_t *cf);
@@ -186,6 +195,20 @@ ngx_http_access_inet(ngx_http_request_t *r, ngx_http_access_loc_conf_t *alcf,
     ngx_uint_t               i;
     ngx_http_access_rule_t  *rule;
 
+    if (alcf->tree) {
+        rule = (ngx_http_access_rule_t *)
+                   ngx_radix32tree_find(alcf->tree, ntohl(addr));
+
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "access: %08XD tree %p", addr, rule);
+
+        if (rule == (ngx_http_access_rule_t *) NGX_RADIX_NO_VALUE) {
+            return NGX_DECLINED;
+        }
+
+        return ngx_http_access_found(r, rule->deny);
+    }
+
     rule = alcf->rules->elts;
     for (i = 0; i < alcf->rules->nelts; i++) {
 
@@ -212,6 +235,20 @@ ngx_http_access_inet6(ngx_http_request_t *r, ngx_http_access_loc_conf_t *alcf,
     ngx_uint_t                i;
     ngx_http_access_rule6_t  *rule6;
 
+    if (alcf->tree6) {
+        rule6 = (ngx_http_access_rule6_t *)
+                    ngx_radix128tree_find(alcf->tree6, p);
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "access: tree %p", rule6);
+
+        if (rule6 == (ngx_http_access_rule6_t *) NGX_RADIX_NO_VALUE) {
+            return NGX_DECLINED;
+        }
+
+        return ngx_http_access_found(r, rule6->deny);
+    }
+
     rule6 = alcf->rules6->elts;
     for (i = 0; i < alcf->rules6->nelts; i++) {
 
@@ -431,19 +468,118 @@ ngx_http_access_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         && conf->rules_un == NULL
 #endif
     ) {
+        if (ngx_http_access_tree(cf, prev) != NGX_OK) {
+            return NGX_CONF_ERROR;
+        }
+
         conf->rules = prev->rules;
+        conf->tree = prev->tree;
 #if (NGX_HAVE_INET6)
         conf->rules6 = prev->rules6;
+        conf->tree6 = prev->tree6;
 #endif
 #if (NGX_HAVE_UNIX_DOMAIN)
         conf->rules_un = prev->rules_un;
 #endif
+
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_http_access_tree(cf, conf) != NGX_OK) {
+        return NGX_CONF_ERROR;
     }
 
     return NGX_CONF_OK;
 }
 
 
+/*
+ * a rule covered by an earlier rule with a shorter or the same prefix
+ * never matches, the longest prefix match among the rest is the first
+ * matching rule
+ */
+
+static ngx_int_t
+ngx_http_access_tree(ngx_conf_t *cf, ngx_http_access_loc_conf_t *alcf)
+{
+    ngx_int_t                 rc;
+    ngx_uint_t                i;
+    ngx_http_access_rule_t   *rule;
+#if (NGX_HAVE_INET6)
+    ngx_http_access_rule6_t  *rule6;
+#endif
+
+    if (alcf->rules && alcf->tree == NULL
+        && alcf->rules->nelts >= NGX_HTTP_ACCESS_TREE_RULES)
+    {
+        alcf->tree = ngx_radix_tree_create(cf->pool, -1);
+        if (alcf->tree == NULL) {
+            return NGX_ERROR;
+        }
+
+        rule = alcf->rules->elts;
+        for (i = 0; i < alcf->rules->nelts; i++) {
+
+            if (ngx_radix32tree_find_prefix(alcf->tree, ntohl(rule[i].addr),
+                                            ntohl(rule[i].mask))
+                != NGX_RADIX_NO_VALUE)
+            {
+                continue;
+            }
+
+            rc = ngx_radix32tree_insert(alcf->tree, ntohl(rule[i].addr),
+                                        ntohl(rule[i].mask),
+                                        (uintptr_t) &rule[i]);
+            if (rc == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+        }
+
+        if (ngx_radix32tree_compile(alcf->tree) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+#if (NGX_HAVE_INET6)
+
+    if (alcf->rules6 && alcf->tree6 == NULL
+        && alcf->rules6->nelts >= NGX_HTTP_ACCESS_TREE_RULES)
+    {
+        alcf->tree6 = ngx_radix_tree_create(cf->pool, -1);
+        if (alcf->tree6 == NULL) {
+            return NGX_ERROR;
+        }
+
+        rule6 = alcf->rules6->elts;
+        for (i = 0; i < alcf->rules6->nelts; i++) {
+
+            if (ngx_radix128tree_find_prefix(alcf->tree6,
+                                             rule6[i].addr.s6_addr,
+                                             rule6[i].mask.s6_addr)
+                != NGX_RADIX_NO_VALUE)
+            {
+                continue;
+            }
+
+            rc = ngx_radix128tree_insert(alcf->tree6, rule6[i].addr.s6_addr,
+                                         rule6[i].mask.s6_addr,
+                                         (uintptr_t) &rule6[i]);
+            if (rc == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+        }
+
+        if (ngx_radix128tree_compile(alcf->tree6) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+#endif
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_http_access_init(ngx_conf_t *cf)
 {
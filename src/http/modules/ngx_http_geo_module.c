@@ -25,8 +25,14 @@ typedef struct {
 } ngx_http_geo_trees_t;
 
 
+/* longer lists of ranges within a /16 are searched by bisection */
+
+#define NGX_HTTP_GEO_RANGES_LINEAR  8
+
+
 typedef struct {
     ngx_http_geo_range_t           **low;
+    uint32_t                        *nranges;
     ngx_http_variable_value_t       *default_value;
 } ngx_http_geo_high_ranges_t;
 
@@ -49,6 +55,7 @@ typedef struct {
     ngx_rbtree_t                     rbtree;
     ngx_rbtree_node_t                sentinel;
     ngx_array_t                     *proxies;
+    ngx_db_t                        *db;
     ngx_pool_t                      *pool;
     ngx_pool_t                      *temp_pool;
 
@@ -75,10 +82,14 @@ typedef struct {
     ngx_array_t                     *proxies;
     unsigned                         proxy_recursive:1;
 
+    ngx_db_t                        *db;
+
     ngx_int_t                        index;
 } ngx_http_geo_ctx_t;
 
 
+static ngx_int_t ngx_http_geo_db_variable(ngx_http_request_t *r,
+    ngx_http_geo_ctx_t *ctx, in_addr_t inaddr, ngx_http_variable_value_t *v);
 static ngx_int_t ngx_http_geo_addr(ngx_http_request_t *r,
     ngx_http_geo_ctx_t *ctx, ngx_addr_t *addr);
 static ngx_int_t ngx_http_geo_real_addr(ngx_http_request_t *r,
@@ -106,6 +117,8 @@ static char *ngx_http_geo_include(ngx_conf_t *cf, ngx_http_geo_conf_ctx_t *ctx,
 static ngx_int_t ngx_http_geo_include_binary_base(ngx_conf_t *cf,
     ngx_http_geo_conf_ctx_t *ctx, ngx_str_t *name);
 static void ngx_http_geo_create_binary_base(ngx_http_geo_conf_ctx_t *ctx);
+static ngx_int_t ngx_http_geo_index_ranges(ngx_conf_t *cf,
+    ngx_http_geo_high_ranges_t *high);
 static u_char *ngx_http_geo_copy_values(u_char *base, u_char *p,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
 
@@ -177,6 +190,7 @@ ngx_http_geo_cidr_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v,
     ngx_http_geo_ctx_t *ctx = (ngx_http_geo_ctx_t *) data;
 
     in_addr_t                   inaddr;
+    ngx_int_t                   rc;
     ngx_addr_t                  addr;
     struct sockaddr_in         *sin;
     ngx_http_variable_value_t  *vv;
@@ -204,6 +218,14 @@ ngx_http_geo_cidr_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v,
             inaddr += p[14] << 8;
             inaddr += p[15];
 
+            if (ctx->db) {
+                rc = ngx_http_geo_db_variable(r, ctx, inaddr, v);
+
+                if (rc != NGX_DECLINED) {
+                    return rc;
+                }
+            }
+
             vv = (ngx_http_variable_value_t *)
                       ngx_radix32tree_find(ctx->u.trees.tree, inaddr);
 
@@ -226,6 +248,14 @@ ngx_http_geo_cidr_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v,
         sin = (struct sockaddr_in *) addr.sockaddr;
         inaddr = ntohl(sin->sin_addr.s_addr);
 
+        if (ctx->db) {
+            rc = ngx_http_geo_db_variable(r, ctx, inaddr, v);
+
+            if (rc != NGX_DECLINED) {
+                return rc;
+            }
+        }
+
         vv = (ngx_http_variable_value_t *)
                   ngx_radix32tree_find(ctx->u.trees.tree, inaddr);
 
@@ -250,8 +280,9 @@ ngx_http_geo_range_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v,
     ngx_http_geo_ctx_t *ctx = (ngx_http_geo_ctx_t *) data;
 
     in_addr_t              inaddr;
+    ngx_int_t              rc;
     ngx_addr_t             addr;
-    ngx_uint_t             n;
+    ngx_uint_t             n, m, lo, hi;
     struct sockaddr_in    *sin;
     ngx_http_geo_range_t  *range;
 #if (NGX_HAVE_INET6)
@@ -300,10 +331,38 @@ ngx_http_geo_range_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v,
         inaddr = INADDR_NONE;
     }
 
+    if (ctx->db) {
+        rc = ngx_http_geo_db_variable(r, ctx, inaddr, v);
+
+        if (rc != NGX_DECLINED) {
+            return rc;
+        }
+    }
+
     if (ctx->u.high.low) {
         range = ctx->u.high.low[inaddr >> 16];
 
-        if (range) {
+        if (range && ctx->u.high.nranges) {
+            n = inaddr & 0xffff;
+            lo = 0;
+            hi = ctx->u.high.nranges[inaddr >> 16];
+
+            while (lo < hi) {
+                m = (lo + hi) / 2;
+
+                if (n < (ngx_uint_t) range[m].start) {
+                    hi = m;
+
+                } else {
+                    lo = m + 1;
+                }
+            }
+
+            if (lo && n <= (ngx_uint_t) range[lo - 1].end) {
+                *v = *range[lo - 1].value;
+            }
+
+        } else if (range) {
             n = inaddr & 0xffff;
             do {
                 if (n >= (ngx_uint_t) range->start
@@ -323,6 +382,40 @@ ngx_http_geo_range_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v,
 }
 
 
+/*
+ * database values are copied as the database may be replaced
+ * while the request is still using the variable
+ */
+
+static ngx_int_t
+ngx_http_geo_db_variable(ngx_http_request_t *r, ngx_http_geo_ctx_t *ctx,
+    in_addr_t inaddr, ngx_http_variable_value_t *v)
+{
+    ngx_str_t  value;
+
+    if (ngx_db_find_range(ctx->db, inaddr, &value) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    v->data = ngx_pnalloc(r->pool, value.len);
+    if (v->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(v->data, value.data, value.len);
+
+    v->len = value.len;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http geo database: %v", v);
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_http_geo_addr(ngx_http_request_t *r, ngx_http_geo_ctx_t *ctx,
     ngx_addr_t *addr)
@@ -480,6 +573,7 @@ ngx_http_geo_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     geo->proxies = ctx.proxies;
     geo->proxy_recursive = ctx.proxy_recursive;
+    geo->db = ctx.db;
 
     if (ctx.ranges) {
 
@@ -521,6 +615,12 @@ ngx_http_geo_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             ctx.high.default_value = &ngx_http_variable_null_value;
         }
 
+        if (ctx.high.low
+            && ngx_http_geo_index_ranges(cf, &ctx.high) != NGX_OK)
+        {
+            goto failed;
+        }
+
         geo->u.high = ctx.high;
 
         var->get_handler = ngx_http_geo_range_variable;
@@ -559,6 +659,10 @@ ngx_http_geo_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
         /* NGX_BUSY is okay (default was set explicitly) */
 
+        if (ngx_radix32tree_compile(ctx.tree) != NGX_OK) {
+            goto failed;
+        }
+
 #if (NGX_HAVE_INET6)
         if (ngx_radix128tree_insert(ctx.tree6, zero.s6_addr, zero.s6_addr,
                                     (uintptr_t) &ngx_http_variable_null_value)
@@ -566,6 +670,10 @@ ngx_http_geo_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         {
             goto failed;
         }
+
+        if (ngx_radix128tree_compile(ctx.tree6) != NGX_OK) {
+            goto failed;
+        }
 #endif
     }
 
@@ -625,6 +733,14 @@ ngx_http_geo(ngx_conf_t *cf, ngx_command_t *dummy, void *conf)
         }
     }
 
+    if (ngx_strcmp(value[0].data, "database") == 0
+        && (cf->args->nelts == 2 || cf->args->nelts == 3))
+    {
+        rv = ngx_db_conf(cf, NGX_DB_RANGES, &ctx->db);
+
+        goto done;
+    }
+
     if (cf->args->nelts != 2) {
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid number of the geo parameters");
@@ -1652,6 +1768,53 @@ ngx_http_geo_create_binary_base(ngx_http_geo_conf_ctx_t *ctx)
 }
 
 
+static ngx_int_t
+ngx_http_geo_index_ranges(ngx_conf_t *cf, ngx_http_geo_high_ranges_t *high)
+{
+    ngx_uint_t             i, n, max;
+    ngx_http_geo_range_t  *range;
+
+    max = 0;
+
+    for (i = 0; i < 0x10000; i++) {
+        range = high->low[i];
+
+        if (range == NULL) {
+            continue;
+        }
+
+        for (n = 0; range[n].value; n++) { /* void */ }
+
+        if (n > max) {
+            max = n;
+        }
+    }
+
+    if (max <= NGX_HTTP_GEO_RANGES_LINEAR) {
+        return NGX_OK;
+    }
+
+    high->nranges = ngx_pcalloc(cf->pool, 0x10000 * sizeof(uint32_t));
+    if (high->nranges == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < 0x10000; i++) {
+        range = high->low[i];
+
+        if (range == NULL) {
+            continue;
+        }
+
+        for (n = 0; range[n].value; n++) { /* void */ }
+
+        high->nranges[i] = (uint32_t) n;
+    }
+
+    return NGX_OK;
+}
+
+
 static u_char *
 ngx_http_geo_copy_values(u_char *base, u_char *p, ngx_rbtree_node_t *node,
     ngx_rbtree_node_t *sentinel)
@@ -26,6 +26,11 @@ typedef struct {
     size_t               memlevel;
     ssize_t              min_length;
 
+#if (NGX_THREADS)
+    ngx_thread_pool_t   *thread_pool;
+    size_t               threads_min_length;
+#endif
+
     ngx_array_t         *types_keys;
 } ngx_http_gzip_conf_t;
 
@@ -57,6 +62,16 @@ typedef struct {
     unsigned             nomem:1;
     unsigned             buffering:1;
     unsigned             intel:1;
+    unsigned             zlib_ng:1;
+
+#if (NGX_THREADS)
+    unsigned             offload:1;
+    unsigned             aio:1;
+    unsigned             deflated:1;
+
+    int                  thread_rc;
+    ngx_thread_task_t   *thread_task;
+#endif
 
     size_t               zin;
     size_t               zout;
@@ -66,6 +81,15 @@ typedef struct {
 } ngx_http_gzip_ctx_t;
 
 
+#if (NGX_THREADS)
+
+typedef struct {
+    ngx_http_gzip_ctx_t *ctx;
+} ngx_http_gzip_thread_ctx_t;
+
+#endif
+
+
 static void ngx_http_gzip_filter_memory(ngx_http_request_t *r,
     ngx_http_gzip_ctx_t *ctx);
 static ngx_int_t ngx_http_gzip_filter_buffer(ngx_http_gzip_ctx_t *ctx,
@@ -81,6 +105,13 @@ static ngx_int_t ngx_http_gzip_filter_deflate(ngx_http_request_t *r,
 static ngx_int_t ngx_http_gzip_filter_deflate_end(ngx_http_request_t *r,
     ngx_http_gzip_ctx_t *ctx);
 
+#if (NGX_THREADS)
+static ngx_int_t ngx_http_gzip_filter_deflate_thread(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx);
+static void ngx_http_gzip_thread_handler(void *data, ngx_log_t *log);
+static void ngx_http_gzip_thread_event_handler(ngx_event_t *ev);
+#endif
+
 static void *ngx_http_gzip_filter_alloc(void *opaque, u_int items,
     u_int size);
 static void ngx_http_gzip_filter_free(void *opaque, void *address);
@@ -97,6 +128,10 @@ static char *ngx_http_gzip_merge_conf(ngx_conf_t *cf,
     void *parent, void *child);
 static char *ngx_http_gzip_window(ngx_conf_t *cf, void *post, void *data);
 static char *ngx_http_gzip_hash(ngx_conf_t *cf, void *post, void *data);
+#if (NGX_THREADS)
+static char *ngx_http_gzip_threads(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+#endif
 
 
 static ngx_conf_num_bounds_t  ngx_http_gzip_comp_level_bounds = {
@@ -173,6 +208,17 @@ static ngx_command_t  ngx_http_gzip_filter_commands[] = {
       offsetof(ngx_http_gzip_conf_t, min_length),
       NULL },
 
+#if (NGX_THREADS)
+
+    { ngx_string("gzip_threads"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE12,
+      ngx_http_gzip_threads,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+#endif
+
       ngx_null_command
 };
 
@@ -311,6 +357,21 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http gzip filter");
 
+#if (NGX_THREADS)
+
+    if (ctx->aio) {
+
+        /* deflate() is running in a thread */
+
+        if (in && ngx_chain_add_copy(r->pool, &ctx->in, in) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
     if (ctx->buffering) {
 
         /*
@@ -408,7 +469,7 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 
             rc = ngx_http_gzip_filter_deflate(r, ctx);
 
-            if (rc == NGX_OK) {
+            if (rc == NGX_OK || rc == NGX_BUSY) {
                 break;
             }
 
@@ -443,6 +504,12 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         if (ctx->done) {
             return rc;
         }
+
+#if (NGX_THREADS)
+        if (ctx->aio) {
+            return NGX_AGAIN;
+        }
+#endif
     }
 
     /* unreachable */
@@ -503,6 +570,21 @@ ngx_http_gzip_filter_memory(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
      *  *) 5920 bytes on amd64 and sparc64
      */
 
+#ifdef ZLIBNG_VERSION
+
+    /*
+     * zlib-ng, https://github.com/zlib-ng/zlib-ng, built with zlib
+     * compatible API.  It allocates all deflate memory at once with
+     * 64-byte alignment, uses 128K hash, and up to 5 literal buffers.
+     */
+
+    ctx->allocated = 8192 + 16 + (1 << (wbits + 2))
+                     + 131072 + (5 << (memlevel + 6))
+                     + 4 * (64 + sizeof(void *));
+    ctx->zlib_ng = 1;
+
+#else
+
     if (!ngx_http_gzip_assume_intel) {
         ctx->allocated = 8192 + (1 << (wbits + 2)) + (1 << (memlevel + 9));
 
@@ -524,6 +606,8 @@ ngx_http_gzip_filter_memory(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
                          + (1 << (memlevel + 8));
         ctx->intel = 1;
     }
+
+#endif
 }
 
 
@@ -640,6 +724,12 @@ ngx_http_gzip_filter_add_data(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
         return NGX_OK;
     }
 
+#if (NGX_THREADS)
+    if (ctx->deflated) {
+        return NGX_OK;
+    }
+#endif
+
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "gzip in: %p", ctx->in);
 
@@ -678,6 +768,17 @@ ngx_http_gzip_filter_add_data(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
                    ctx->in_buf,
                    ctx->zstream.next_in, ctx->zstream.avail_in);
 
+#if (NGX_THREADS)
+    {
+    ngx_http_gzip_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
+
+    ctx->offload = (conf->thread_pool
+                    && ctx->zstream.avail_in >= conf->threads_min_length);
+    }
+#endif
+
     if (ctx->in_buf->last_buf) {
         ctx->flush = Z_FINISH;
 
@@ -703,6 +804,12 @@ ngx_http_gzip_filter_get_buf(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
         return NGX_OK;
     }
 
+#if (NGX_THREADS)
+    if (ctx->deflated) {
+        return NGX_OK;
+    }
+#endif
+
     conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
 
     if (ctx->free) {
@@ -750,8 +857,30 @@ ngx_http_gzip_filter_deflate(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
                  ctx->zstream.avail_in, ctx->zstream.avail_out,
                  ctx->flush, ctx->redo);
 
+#if (NGX_THREADS)
+
+    if (ctx->deflated) {
+        ctx->deflated = 0;
+        rc = ctx->thread_rc;
+        goto deflated;
+    }
+
+    if (ctx->offload) {
+        if (ngx_http_gzip_filter_deflate_thread(r, ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        return NGX_BUSY;
+    }
+
+#endif
+
     rc = deflate(&ctx->zstream, ctx->flush);
 
+#if (NGX_THREADS)
+deflated:
+#endif
+
     if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
         ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
                       "deflate() failed: %d, %d", ctx->flush, rc);
@@ -913,6 +1042,107 @@ ngx_http_gzip_filter_deflate_end(ngx_http_request_t *r,
 }
 
 
+#if (NGX_THREADS)
+
+static ngx_int_t
+ngx_http_gzip_filter_deflate_thread(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx)
+{
+    ngx_thread_task_t           *task;
+    ngx_http_gzip_conf_t        *conf;
+    ngx_http_gzip_thread_ctx_t  *tctx;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
+
+    task = ctx->thread_task;
+
+    if (task == NULL) {
+        task = ngx_thread_task_alloc(r->pool,
+                                     sizeof(ngx_http_gzip_thread_ctx_t));
+        if (task == NULL) {
+            return NGX_ERROR;
+        }
+
+        task->handler = ngx_http_gzip_thread_handler;
+
+        tctx = task->ctx;
+        tctx->ctx = ctx;
+
+        ctx->thread_task = task;
+    }
+
+    task->event.data = r;
+    task->event.handler = ngx_http_gzip_thread_event_handler;
+
+    if (ngx_thread_task_post(conf->thread_pool, task) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    r->main->blocked++;
+    r->aio = 1;
+    ctx->aio = 1;
+
+    r->connection->buffered |= NGX_HTTP_GZIP_BUFFERED;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_gzip_thread_handler(void *data, ngx_log_t *log)
+{
+    ngx_http_gzip_thread_ctx_t *tctx = data;
+
+    ngx_http_gzip_ctx_t  *ctx;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, log, 0, "gzip thread handler");
+
+    ctx = tctx->ctx;
+
+    ctx->thread_rc = deflate(&ctx->zstream, ctx->flush);
+}
+
+
+static void
+ngx_http_gzip_thread_event_handler(ngx_event_t *ev)
+{
+    ngx_connection_t     *c;
+    ngx_http_request_t   *r;
+    ngx_http_gzip_ctx_t  *ctx;
+
+    r = ev->data;
+    c = r->connection;
+
+    ngx_http_set_log_request(c->log, r);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http gzip thread: \"%V?%V\"", &r->uri, &r->args);
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_gzip_filter_module);
+
+    ctx->aio = 0;
+    ctx->deflated = 1;
+
+    r->main->blocked--;
+    r->aio = 0;
+
+    if (r->done) {
+        /*
+         * trigger connection event handler if the subrequest was
+         * already finalized
+         */
+
+        c->write->handler(c->write);
+
+    } else {
+        r->write_event_handler(r);
+        ngx_http_run_posted_requests(c);
+    }
+}
+
+#endif
+
+
 static void *
 ngx_http_gzip_filter_alloc(void *opaque, u_int items, u_int size)
 {
@@ -945,7 +1175,7 @@ ngx_http_gzip_filter_alloc(void *opaque, u_int items, u_int size)
         return p;
     }
 
-    if (ctx->intel) {
+    if (ctx->intel || ctx->zlib_ng) {
         ngx_log_error(NGX_LOG_ALERT, ctx->request->connection->log, 0,
                       "gzip filter failed to use preallocated memory: "
                       "%ud of %ui", items * size, ctx->allocated);
@@ -1073,6 +1303,11 @@ ngx_http_gzip_create_conf(ngx_conf_t *cf)
     conf->memlevel = NGX_CONF_UNSET_SIZE;
     conf->min_length = NGX_CONF_UNSET;
 
+#if (NGX_THREADS)
+    conf->thread_pool = NGX_CONF_UNSET_PTR;
+    conf->threads_min_length = NGX_CONF_UNSET_SIZE;
+#endif
+
     return conf;
 }
 
@@ -1083,6 +1318,8 @@ ngx_http_gzip_merge_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_http_gzip_conf_t *prev = parent;
     ngx_http_gzip_conf_t *conf = child;
 
+    ngx_http_core_loc_conf_t  *clcf;
+
     ngx_conf_merge_value(conf->enable, prev->enable, 0);
     ngx_conf_merge_value(conf->no_buffer, prev->no_buffer, 0);
 
@@ -1097,6 +1334,12 @@ ngx_http_gzip_merge_conf(ngx_conf_t *cf, void *parent, void *child)
                               MAX_MEM_LEVEL - 1);
     ngx_conf_merge_value(conf->min_length, prev->min_length, 20);
 
+#if (NGX_THREADS)
+    ngx_conf_merge_ptr_value(conf->thread_pool, prev->thread_pool, NULL);
+    ngx_conf_merge_size_value(conf->threads_min_length,
+                              prev->threads_min_length, 32768);
+#endif
+
     if (ngx_http_merge_types(cf, &conf->types_keys, &conf->types,
                              &prev->types_keys, &prev->types,
                              ngx_http_html_default_types)
@@ -1105,6 +1348,11 @@ ngx_http_gzip_merge_conf(ngx_conf_t *cf, void *parent, void *child)
         return NGX_CONF_ERROR;
     }
 
+    if (conf->enable) {
+        clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+        clcf->encodings |= NGX_HTTP_ENCODING_GZIP;
+    }
+
     return NGX_CONF_OK;
 }
 
@@ -1168,3 +1416,82 @@ ngx_http_gzip_hash(ngx_conf_t *cf, void *post, void *data)
 
     return "must be 512, 1k, 2k, 4k, 8k, 16k, 32k, 64k, or 128k";
 }
+
+
+#if (NGX_THREADS)
+
+static char *
+ngx_http_gzip_threads(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_gzip_conf_t *gcf = conf;
+
+    ngx_str_t   *value, name, s;
+    ngx_uint_t   i;
+
+    if (gcf->thread_pool != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+
+        if (cf->args->nelts > 2) {
+            return "has invalid parameters";
+        }
+
+        gcf->thread_pool = NULL;
+        return NGX_CONF_OK;
+    }
+
+    ngx_str_null(&name);
+
+    for (i = 1; i < cf->args->nelts; i++) {
+
+        if (i == 1 && ngx_strcmp(value[i].data, "on") == 0) {
+            continue;
+        }
+
+        if (i == 1 && ngx_strncmp(value[i].data, "pool=", 5) == 0) {
+            name.len = value[i].len - 5;
+            name.data = value[i].data + 5;
+
+            if (name.len == 0) {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "min_length=", 11) == 0) {
+            s.len = value[i].len - 11;
+            s.data = value[i].data + 11;
+
+            gcf->threads_min_length = ngx_parse_size(&s);
+
+            if (gcf->threads_min_length == (size_t) NGX_ERROR) {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        goto invalid;
+    }
+
+    gcf->thread_pool = ngx_thread_pool_add(cf, name.len ? &name : NULL);
+    if (gcf->thread_pool == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid parameter \"%V\"", &value[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+#endif
@@ -17,10 +17,23 @@
 
 typedef struct {
     ngx_uint_t  enable;
+    ngx_uint_t  brotli;
+    ngx_uint_t  zstd;
 } ngx_http_gzip_static_conf_t;
 
 
+typedef struct {
+    ngx_str_t   suffix;
+    ngx_str_t   encoding;
+    ngx_uint_t  bit;
+    ngx_uint_t  offset;
+} ngx_http_gzip_static_variant_t;
+
+
 static ngx_int_t ngx_http_gzip_static_handler(ngx_http_request_t *r);
+static ngx_int_t ngx_http_gzip_static_send(ngx_http_request_t *r,
+    ngx_str_t *path, ngx_http_gzip_static_variant_t *variant,
+    ngx_uint_t enable, ngx_int_t ok);
 static void *ngx_http_gzip_static_create_conf(ngx_conf_t *cf);
 static char *ngx_http_gzip_static_merge_conf(ngx_conf_t *cf, void *parent,
     void *child);
@@ -44,10 +57,41 @@ static ngx_command_t  ngx_http_gzip_static_commands[] = {
       offsetof(ngx_http_gzip_static_conf_t, enable),
       &ngx_http_gzip_static },
 
+    { ngx_string("brotli_static"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_enum_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_gzip_static_conf_t, brotli),
+      &ngx_http_gzip_static },
+
+    { ngx_string("zstd_static"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_enum_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_gzip_static_conf_t, zstd),
+      &ngx_http_gzip_static },
+
       ngx_null_command
 };
 
 
+/* in the order of preference */
+
+static ngx_http_gzip_static_variant_t  ngx_http_gzip_static_variants[] = {
+
+    { ngx_string(".zst"), ngx_string("zstd"), NGX_HTTP_ENCODING_ZSTD,
+      offsetof(ngx_http_gzip_static_conf_t, zstd) },
+
+    { ngx_string(".br"), ngx_string("br"), NGX_HTTP_ENCODING_BR,
+      offsetof(ngx_http_gzip_static_conf_t, brotli) },
+
+    { ngx_string(".gz"), ngx_string("gzip"), NGX_HTTP_ENCODING_GZIP,
+      offsetof(ngx_http_gzip_static_conf_t, enable) },
+
+    { ngx_null_string, ngx_null_string, 0, 0 }
+};
+
+
 static ngx_http_module_t  ngx_http_gzip_static_module_ctx = {
     NULL,                                  /* preconfiguration */
     ngx_http_gzip_static_init,             /* postconfiguration */
@@ -82,18 +126,14 @@ ngx_module_t  ngx_http_gzip_static_module = {
 static ngx_int_t
 ngx_http_gzip_static_handler(ngx_http_request_t *r)
 {
-    u_char                       *p;
-    size_t                        root;
-    ngx_str_t                     path;
-    ngx_int_t                     rc;
-    ngx_uint_t                    level;
-    ngx_log_t                    *log;
-    ngx_buf_t                    *b;
-    ngx_chain_t                   out;
-    ngx_table_elt_t              *h;
-    ngx_open_file_info_t          of;
-    ngx_http_core_loc_conf_t     *clcf;
-    ngx_http_gzip_static_conf_t  *gzcf;
+    u_char                          *p, *last;
+    size_t                           root;
+    ngx_str_t                        path;
+    ngx_int_t                        rc;
+    ngx_uint_t                       enable, encodings;
+    ngx_http_core_loc_conf_t        *clcf;
+    ngx_http_gzip_static_conf_t     *gzcf;
+    ngx_http_gzip_static_variant_t  *v;
 
     if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
         return NGX_DECLINED;
@@ -105,40 +145,91 @@ ngx_http_gzip_static_handler(ngx_http_request_t *r)
 
     gzcf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_static_module);
 
-    if (gzcf->enable == NGX_HTTP_GZIP_STATIC_OFF) {
+    if (gzcf->enable == NGX_HTTP_GZIP_STATIC_OFF
+        && gzcf->brotli == NGX_HTTP_GZIP_STATIC_OFF
+        && gzcf->zstd == NGX_HTTP_GZIP_STATIC_OFF)
+    {
         return NGX_DECLINED;
     }
 
-    if (gzcf->enable == NGX_HTTP_GZIP_STATIC_ON) {
-        rc = ngx_http_gzip_ok(r);
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
-    } else {
-        /* always */
-        rc = NGX_OK;
-    }
+    encodings = 0;
 
-    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+    for (v = ngx_http_gzip_static_variants; v->suffix.len; v++) {
+        enable = *(ngx_uint_t *) ((char *) gzcf + v->offset);
 
-    if (!clcf->gzip_vary && rc != NGX_OK) {
-        return NGX_DECLINED;
+        if (enable == NGX_HTTP_GZIP_STATIC_ON) {
+            encodings |= v->bit;
+        }
     }
 
-    log = r->connection->log;
+    p = NULL;
 
-    p = ngx_http_map_uri_to_path(r, &path, &root, sizeof(".gz") - 1);
-    if (p == NULL) {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    for (v = ngx_http_gzip_static_variants; v->suffix.len; v++) {
+        enable = *(ngx_uint_t *) ((char *) gzcf + v->offset);
+
+        if (enable == NGX_HTTP_GZIP_STATIC_OFF) {
+            continue;
+        }
+
+        if (enable == NGX_HTTP_GZIP_STATIC_ALWAYS) {
+            rc = NGX_OK;
+
+        } else if (v->bit == NGX_HTTP_ENCODING_GZIP) {
+            rc = ngx_http_gzip_ok(r);
+
+        } else {
+            rc = ngx_http_encoding_ok(r, v->bit, encodings);
+        }
+
+        if (!clcf->gzip_vary && rc != NGX_OK) {
+            continue;
+        }
+
+        if (p == NULL) {
+            p = ngx_http_map_uri_to_path(r, &path, &root,
+                                         sizeof(".zst") - 1);
+            if (p == NULL) {
+                return NGX_HTTP_INTERNAL_SERVER_ERROR;
+            }
+        }
+
+        last = ngx_cpymem(p, v->suffix.data, v->suffix.len);
+        *last = '\0';
+
+        path.len = last - path.data;
+
+        rc = ngx_http_gzip_static_send(r, &path, v, enable, rc);
+
+        if (rc != NGX_DECLINED) {
+            return rc;
+        }
     }
 
-    *p++ = '.';
-    *p++ = 'g';
-    *p++ = 'z';
-    *p = '\0';
+    return NGX_DECLINED;
+}
 
-    path.len = p - path.data;
+
+static ngx_int_t
+ngx_http_gzip_static_send(ngx_http_request_t *r, ngx_str_t *path,
+    ngx_http_gzip_static_variant_t *variant, ngx_uint_t enable, ngx_int_t ok)
+{
+    ngx_int_t                  rc;
+    ngx_uint_t                 level;
+    ngx_log_t                 *log;
+    ngx_buf_t                 *b;
+    ngx_chain_t                out;
+    ngx_table_elt_t           *h;
+    ngx_open_file_info_t       of;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    log = r->connection->log;
 
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
-                   "http filename: \"%s\"", path.data);
+                   "http filename: \"%s\"", path->data);
 
     ngx_memzero(&of, sizeof(ngx_open_file_info_t));
 
@@ -149,11 +240,11 @@ ngx_http_gzip_static_handler(ngx_http_request_t *r)
     of.errors = clcf->open_file_cache_errors;
     of.events = clcf->open_file_cache_events;
 
-    if (ngx_http_set_disable_symlinks(r, clcf, &path, &of) != NGX_OK) {
+    if (ngx_http_set_disable_symlinks(r, clcf, path, &of) != NGX_OK) {
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    if (ngx_open_cached_file(clcf->open_file_cache, &path, &of, r->pool)
+    if (ngx_open_cached_file(clcf->open_file_cache, path, &of, r->pool)
         != NGX_OK)
     {
         switch (of.err) {
@@ -183,15 +274,15 @@ ngx_http_gzip_static_handler(ngx_http_request_t *r)
         }
 
         ngx_log_error(level, log, of.err,
-                      "%s \"%s\" failed", of.failed, path.data);
+                      "%s \"%s\" failed", of.failed, path->data);
 
         return NGX_DECLINED;
     }
 
-    if (gzcf->enable == NGX_HTTP_GZIP_STATIC_ON) {
+    if (enable == NGX_HTTP_GZIP_STATIC_ON) {
         r->gzip_vary = 1;
 
-        if (rc != NGX_OK) {
+        if (ok != NGX_OK) {
             return NGX_DECLINED;
         }
     }
@@ -207,7 +298,7 @@ ngx_http_gzip_static_handler(ngx_http_request_t *r)
 
     if (!of.is_file) {
         ngx_log_error(NGX_LOG_CRIT, log, 0,
-                      "\"%s\" is not a regular file", path.data);
+                      "\"%s\" is not a regular file", path->data);
 
         return NGX_HTTP_NOT_FOUND;
     }
@@ -243,7 +334,7 @@ ngx_http_gzip_static_handler(ngx_http_request_t *r)
 
     h->hash = 1;
     ngx_str_set(&h->key, "Content-Encoding");
-    ngx_str_set(&h->value, "gzip");
+    h->value = variant->encoding;
     r->headers_out.content_encoding = h;
 
     /* we need to allocate all before the header would be sent */
@@ -272,7 +363,7 @@ ngx_http_gzip_static_handler(ngx_http_request_t *r)
     b->last_in_chain = 1;
 
     b->file->fd = of.fd;
-    b->file->name = path;
+    b->file->name = *path;
     b->file->log = log;
     b->file->directio = of.is_directio;
 
@@ -294,6 +385,8 @@ ngx_http_gzip_static_create_conf(ngx_conf_t *cf)
     }
 
     conf->enable = NGX_CONF_UNSET_UINT;
+    conf->brotli = NGX_CONF_UNSET_UINT;
+    conf->zstd = NGX_CONF_UNSET_UINT;
 
     return conf;
 }
@@ -307,6 +400,10 @@ ngx_http_gzip_static_merge_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_conf_merge_uint_value(conf->enable, prev->enable,
                               NGX_HTTP_GZIP_STATIC_OFF);
+    ngx_conf_merge_uint_value(conf->brotli, prev->brotli,
+                              NGX_HTTP_GZIP_STATIC_OFF);
+    ngx_conf_merge_uint_value(conf->zstd, prev->zstd,
+                              NGX_HTTP_GZIP_STATIC_OFF);
 
     return NGX_CONF_OK;
 }
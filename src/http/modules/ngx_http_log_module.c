@@ -35,6 +35,7 @@ typedef struct {
     ngx_str_t                   name;
     ngx_array_t                *flushes;
     ngx_array_t                *ops;        /* array of ngx_http_log_op_t */
+    ngx_uint_t                  binary;     /* unsigned  binary:1; */
 } ngx_http_log_fmt_t;
 
 
@@ -44,6 +45,54 @@ typedef struct {
 } ngx_http_log_main_conf_t;
 
 
+#if (NGX_THREADS)
+
+#define NGX_HTTP_LOG_THREAD_BUFS  4
+
+
+typedef struct {
+    u_char                     *start;
+    size_t                      len;
+} ngx_http_log_chunk_t;
+
+
+typedef struct {
+    ngx_fd_t                    fd;
+    ngx_int_t                   gzip;
+    ngx_http_log_chunk_t       *chunks;
+    ngx_uint_t                  nchunks;
+
+    u_char                     *out;
+    size_t                      size;
+
+    ngx_err_t                   err;
+    ssize_t                     n;
+    size_t                      len;
+    ngx_uint_t                  failed;     /* unsigned  failed:1; */
+
+    ngx_thread_mutex_t          mtx;
+    ngx_thread_cond_t           cond;
+    ngx_uint_t                  done;
+} ngx_http_log_thread_ctx_t;
+
+
+typedef struct {
+    ngx_thread_pool_t          *thread_pool;
+    ngx_thread_task_t          *task;
+
+    u_char                     *free[NGX_HTTP_LOG_THREAD_BUFS];
+    ngx_uint_t                  nfree;
+
+    ngx_http_log_chunk_t        queue[NGX_HTTP_LOG_THREAD_BUFS];
+    ngx_uint_t                  nqueued;
+    ngx_uint_t                  nbusy;
+
+    time_t                      error_log_time;
+} ngx_http_log_thread_t;
+
+#endif
+
+
 typedef struct {
     u_char                     *start;
     u_char                     *pos;
@@ -52,6 +101,10 @@ typedef struct {
     ngx_event_t                *event;
     ngx_msec_t                  flush;
     ngx_int_t                   gzip;
+
+#if (NGX_THREADS)
+    ngx_http_log_thread_t      *thread;
+#endif
 } ngx_http_log_buf_t;
 
 
@@ -93,6 +146,37 @@ typedef struct {
 #define NGX_HTTP_LOG_ESCAPE_DEFAULT  0
 #define NGX_HTTP_LOG_ESCAPE_JSON     1
 #define NGX_HTTP_LOG_ESCAPE_NONE     2
+#define NGX_HTTP_LOG_BINARY          3
+
+
+/*
+ * a binary record is a 32-bit length of the rest of the record followed
+ * by fields, each field is a type byte and a value; integers are 64-bit,
+ * and all numbers are little-endian
+ */
+
+#define NGX_HTTP_LOG_BINARY_NULL      0
+#define NGX_HTTP_LOG_BINARY_UINT      1    /* 8 bytes */
+#define NGX_HTTP_LOG_BINARY_STRING    2    /* 4 bytes length and data */
+#define NGX_HTTP_LOG_BINARY_MSEC      3    /* 8 bytes, since the Epoch */
+#define NGX_HTTP_LOG_BINARY_DURATION  4    /* 8 bytes, milliseconds */
+#define NGX_HTTP_LOG_BINARY_INET      5    /* 4 bytes */
+#define NGX_HTTP_LOG_BINARY_INET6     6    /* 16 bytes */
+
+#define NGX_HTTP_LOG_BINARY_INT_LEN   (1 + 8)
+
+
+#if (NGX_ZLIB)
+
+/*
+ * This is a formula from deflateBound() for conservative upper bound of
+ * compressed data plus 18 bytes of gzip wrapper.
+ */
+
+#define ngx_http_log_gzip_bound(len)                                         \
+    ((len) + (((len) + 7) >> 3) + (((len) + 63) >> 6) + 5 + 18)
+
+#endif
 
 
 static void ngx_http_log_write(ngx_http_request_t *r, ngx_http_log_t *log,
@@ -103,14 +187,31 @@ static ssize_t ngx_http_log_script_write(ngx_http_request_t *r,
 #if (NGX_ZLIB)
 static ssize_t ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len,
     ngx_int_t level, ngx_log_t *log);
+static ssize_t ngx_http_log_deflate(z_stream *zstream, u_char *buf,
+    size_t len, ngx_int_t level, u_char *out, size_t size, ngx_log_t *log);
 
 static void *ngx_http_log_gzip_alloc(void *opaque, u_int items, u_int size);
 static void ngx_http_log_gzip_free(void *opaque, void *address);
 #endif
 
 static void ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log);
+static void ngx_http_log_flush_buf(ngx_open_file_t *file, u_char *buf,
+    size_t len, ngx_log_t *log);
 static void ngx_http_log_flush_handler(ngx_event_t *ev);
 
+#if (NGX_THREADS)
+static ngx_int_t ngx_http_log_thread_write(ngx_open_file_t *file,
+    ngx_log_t *log);
+static void ngx_http_log_thread_post(ngx_open_file_t *file, ngx_log_t *log);
+static void ngx_http_log_thread_handler(void *data, ngx_log_t *log);
+static void ngx_http_log_thread_event_handler(ngx_event_t *ev);
+static void ngx_http_log_thread_done(ngx_open_file_t *file, ngx_log_t *log);
+static void ngx_http_log_thread_flush(ngx_open_file_t *file, ngx_log_t *log);
+static void ngx_http_log_thread_cleanup(void *data);
+static ngx_int_t ngx_http_log_thread_init(ngx_conf_t *cf,
+    ngx_open_file_t *file, ngx_thread_pool_t *tp);
+#endif
+
 static u_char *ngx_http_log_pipe(ngx_http_request_t *r, u_char *buf,
     ngx_http_log_op_t *op);
 static u_char *ngx_http_log_time(ngx_http_request_t *r, u_char *buf,
@@ -129,6 +230,28 @@ static u_char *ngx_http_log_body_bytes_sent(ngx_http_request_t *r,
     u_char *buf, ngx_http_log_op_t *op);
 static u_char *ngx_http_log_request_length(ngx_http_request_t *r, u_char *buf,
     ngx_http_log_op_t *op);
+static ngx_uint_t ngx_http_log_get_status(ngx_http_request_t *r);
+
+static u_char *ngx_http_log_binary_record(ngx_http_request_t *r,
+    ngx_http_log_fmt_t *fmt, u_char *buf);
+static u_char *ngx_http_log_binary_int(u_char *buf, ngx_uint_t type,
+    uint64_t n);
+static u_char *ngx_http_log_binary_pipe(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op);
+static u_char *ngx_http_log_binary_msec(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op);
+static u_char *ngx_http_log_binary_request_time(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
+static u_char *ngx_http_log_binary_status(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op);
+static u_char *ngx_http_log_binary_bytes_sent(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
+static u_char *ngx_http_log_binary_body_bytes_sent(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
+static u_char *ngx_http_log_binary_request_length(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
+static u_char *ngx_http_log_binary_remote_addr(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
 
 static ngx_int_t ngx_http_log_variable_compile(ngx_conf_t *cf,
     ngx_http_log_op_t *op, ngx_str_t *value, ngx_uint_t escape);
@@ -145,6 +268,10 @@ static size_t ngx_http_log_unescaped_variable_getlen(ngx_http_request_t *r,
     uintptr_t data);
 static u_char *ngx_http_log_unescaped_variable(ngx_http_request_t *r,
     u_char *buf, ngx_http_log_op_t *op);
+static size_t ngx_http_log_binary_variable_getlen(ngx_http_request_t *r,
+    uintptr_t data);
+static u_char *ngx_http_log_binary_variable(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
 
 
 static void *ngx_http_log_create_main_conf(ngx_conf_t *cf);
@@ -250,6 +377,32 @@ static ngx_http_log_var_t  ngx_http_log_vars[] = {
 };
 
 
+static ngx_http_log_var_t  ngx_http_log_binary_vars[] = {
+    { ngx_string("pipe"), NGX_HTTP_LOG_BINARY_INT_LEN,
+                          ngx_http_log_binary_pipe },
+    { ngx_string("time_local"), NGX_HTTP_LOG_BINARY_INT_LEN,
+                          ngx_http_log_binary_msec },
+    { ngx_string("time_iso8601"), NGX_HTTP_LOG_BINARY_INT_LEN,
+                          ngx_http_log_binary_msec },
+    { ngx_string("msec"), NGX_HTTP_LOG_BINARY_INT_LEN,
+                          ngx_http_log_binary_msec },
+    { ngx_string("request_time"), NGX_HTTP_LOG_BINARY_INT_LEN,
+                          ngx_http_log_binary_request_time },
+    { ngx_string("status"), NGX_HTTP_LOG_BINARY_INT_LEN,
+                          ngx_http_log_binary_status },
+    { ngx_string("bytes_sent"), NGX_HTTP_LOG_BINARY_INT_LEN,
+                          ngx_http_log_binary_bytes_sent },
+    { ngx_string("body_bytes_sent"), NGX_HTTP_LOG_BINARY_INT_LEN,
+                          ngx_http_log_binary_body_bytes_sent },
+    { ngx_string("request_length"), NGX_HTTP_LOG_BINARY_INT_LEN,
+                          ngx_http_log_binary_request_length },
+    { ngx_string("remote_addr"), 1 + 16,
+                          ngx_http_log_binary_remote_addr },
+
+    { ngx_null_string, 0, NULL }
+};
+
+
 static ngx_int_t
 ngx_http_log_handler(ngx_http_request_t *r)
 {
@@ -319,7 +472,12 @@ ngx_http_log_handler(ngx_http_request_t *r)
             goto alloc_line;
         }
 
-        len += NGX_LINEFEED_SIZE;
+        if (log[l].format->binary) {
+            len += 4;
+
+        } else {
+            len += NGX_LINEFEED_SIZE;
+        }
 
         buffer = log[l].file ? log[l].file->data : NULL;
 
@@ -327,10 +485,30 @@ ngx_http_log_handler(ngx_http_request_t *r)
 
             if (len > (size_t) (buffer->last - buffer->pos)) {
 
+#if (NGX_THREADS)
+                if (buffer->thread) {
+
+                    if (ngx_http_log_thread_write(log[l].file,
+                                                  r->connection->log)
+                        != NGX_OK)
+                    {
+                        /* all buffers are busy, write in the worker */
+
+                        ngx_http_log_flush(log[l].file, r->connection->log);
+                    }
+
+                } else {
+                    ngx_http_log_write(r, &log[l], buffer->start,
+                                       buffer->pos - buffer->start);
+
+                    buffer->pos = buffer->start;
+                }
+#else
                 ngx_http_log_write(r, &log[l], buffer->start,
                                    buffer->pos - buffer->start);
 
                 buffer->pos = buffer->start;
+#endif
             }
 
             if (len <= (size_t) (buffer->last - buffer->pos)) {
@@ -341,6 +519,12 @@ ngx_http_log_handler(ngx_http_request_t *r)
                     ngx_add_timer(buffer->event, buffer->flush);
                 }
 
+                if (log[l].format->binary) {
+                    buffer->pos = ngx_http_log_binary_record(r, log[l].format,
+                                                             p);
+                    continue;
+                }
+
                 for (i = 0; i < log[l].format->ops->nelts; i++) {
                     p = op[i].run(r, p, &op[i]);
                 }
@@ -364,6 +548,12 @@ ngx_http_log_handler(ngx_http_request_t *r)
             return NGX_ERROR;
         }
 
+        if (log[l].format->binary) {
+            p = ngx_http_log_binary_record(r, log[l].format, line);
+            ngx_http_log_write(r, &log[l], line, p - line);
+            continue;
+        }
+
         p = line;
 
         if (log[l].syslog_peer) {
@@ -587,7 +777,6 @@ static ssize_t
 ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len, ngx_int_t level,
     ngx_log_t *log)
 {
-    int          rc, wbits, memlevel;
     u_char      *out;
     size_t       size;
     ssize_t      n;
@@ -595,20 +784,7 @@ ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len, ngx_int_t level,
     ngx_err_t    err;
     ngx_pool_t  *pool;
 
-    wbits = MAX_WBITS;
-    memlevel = MAX_MEM_LEVEL - 1;
-
-    while ((ssize_t) len < ((1 << (wbits - 1)) - 262)) {
-        wbits--;
-        memlevel--;
-    }
-
-    /*
-     * This is a formula from deflateBound() for conservative upper bound of
-     * compressed data plus 18 bytes of gzip wrapper.
-     */
-
-    size = len + ((len + 7) >> 3) + ((len + 63) >> 6) + 5 + 18;
+    size = ngx_http_log_gzip_bound(len);
 
     ngx_memzero(&zstream, sizeof(z_stream));
 
@@ -629,145 +805,566 @@ ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len, ngx_int_t level,
         goto done;
     }
 
-    zstream.next_in = buf;
-    zstream.avail_in = len;
-    zstream.next_out = out;
-    zstream.avail_out = size;
+    n = ngx_http_log_deflate(&zstream, buf, len, level, out, size, log);
+
+    if (n == NGX_ERROR) {
+        goto done;
+    }
+
+    size = n;
+
+    n = ngx_write_fd(fd, out, size);
 
-    rc = deflateInit2(&zstream, (int) level, Z_DEFLATED, wbits + 16, memlevel,
+    if (n != (ssize_t) size) {
+        err = (n == -1) ? ngx_errno : 0;
+
+        ngx_destroy_pool(pool);
+
+        ngx_set_errno(err);
+        return -1;
+    }
+
+done:
+
+    ngx_destroy_pool(pool);
+
+    /* simulate successful logging */
+    return len;
+}
+
+
+static ssize_t
+ngx_http_log_deflate(z_stream *zstream, u_char *buf, size_t len,
+    ngx_int_t level, u_char *out, size_t size, ngx_log_t *log)
+{
+    int  rc, wbits, memlevel;
+
+    wbits = MAX_WBITS;
+    memlevel = MAX_MEM_LEVEL - 1;
+
+    while ((ssize_t) len < ((1 << (wbits - 1)) - 262)) {
+        wbits--;
+        memlevel--;
+    }
+
+    zstream->next_in = buf;
+    zstream->avail_in = len;
+    zstream->next_out = out;
+    zstream->avail_out = size;
+
+    rc = deflateInit2(zstream, (int) level, Z_DEFLATED, wbits + 16, memlevel,
                       Z_DEFAULT_STRATEGY);
 
     if (rc != Z_OK) {
         ngx_log_error(NGX_LOG_ALERT, log, 0, "deflateInit2() failed: %d", rc);
-        goto done;
+        return NGX_ERROR;
     }
 
     ngx_log_debug4(NGX_LOG_DEBUG_HTTP, log, 0,
                    "deflate in: ni:%p no:%p ai:%ud ao:%ud",
-                   zstream.next_in, zstream.next_out,
-                   zstream.avail_in, zstream.avail_out);
+                   zstream->next_in, zstream->next_out,
+                   zstream->avail_in, zstream->avail_out);
 
-    rc = deflate(&zstream, Z_FINISH);
+    rc = deflate(zstream, Z_FINISH);
 
     if (rc != Z_STREAM_END) {
         ngx_log_error(NGX_LOG_ALERT, log, 0,
                       "deflate(Z_FINISH) failed: %d", rc);
-        goto done;
+        (void) deflateEnd(zstream);
+        return NGX_ERROR;
     }
 
     ngx_log_debug5(NGX_LOG_DEBUG_HTTP, log, 0,
                    "deflate out: ni:%p no:%p ai:%ud ao:%ud rc:%d",
-                   zstream.next_in, zstream.next_out,
-                   zstream.avail_in, zstream.avail_out,
+                   zstream->next_in, zstream->next_out,
+                   zstream->avail_in, zstream->avail_out,
                    rc);
 
-    size -= zstream.avail_out;
+    size -= zstream->avail_out;
 
-    rc = deflateEnd(&zstream);
+    rc = deflateEnd(zstream);
 
     if (rc != Z_OK) {
         ngx_log_error(NGX_LOG_ALERT, log, 0, "deflateEnd() failed: %d", rc);
-        goto done;
+        return NGX_ERROR;
     }
 
-    n = ngx_write_fd(fd, out, size);
+    return size;
+}
 
-    if (n != (ssize_t) size) {
-        err = (n == -1) ? ngx_errno : 0;
 
-        ngx_destroy_pool(pool);
+static void *
+ngx_http_log_gzip_alloc(void *opaque, u_int items, u_int size)
+{
+    ngx_pool_t *pool = opaque;
 
-        ngx_set_errno(err);
-        return -1;
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, pool->log, 0,
+                   "gzip alloc: n:%ud s:%ud", items, size);
+
+    return ngx_palloc(pool, items * size);
+}
+
+
+static void
+ngx_http_log_gzip_free(void *opaque, void *address)
+{
+#if 0
+    ngx_pool_t *pool = opaque;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, pool->log, 0, "gzip free: %p", address);
+#endif
+}
+
+#endif
+
+
+static void
+ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log)
+{
+    ngx_http_log_buf_t  *buffer;
+
+    buffer = file->data;
+
+#if (NGX_THREADS)
+    if (buffer->thread) {
+        ngx_http_log_thread_flush(file, log);
     }
+#endif
 
-done:
+    ngx_http_log_flush_buf(file, buffer->start, buffer->pos - buffer->start,
+                           log);
 
-    ngx_destroy_pool(pool);
+    buffer->pos = buffer->start;
 
-    /* simulate successful logging */
-    return len;
+    if (buffer->event && buffer->event->timer_set) {
+        ngx_del_timer(buffer->event);
+    }
 }
 
 
-static void *
-ngx_http_log_gzip_alloc(void *opaque, u_int items, u_int size)
+static void
+ngx_http_log_flush_buf(ngx_open_file_t *file, u_char *buf, size_t len,
+    ngx_log_t *log)
 {
-    ngx_pool_t *pool = opaque;
+    ssize_t              n;
+#if (NGX_ZLIB)
+    ngx_http_log_buf_t  *buffer;
+#endif
 
-    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, pool->log, 0,
-                   "gzip alloc: n:%ud s:%ud", items, size);
+    if (len == 0) {
+        return;
+    }
 
-    return ngx_palloc(pool, items * size);
+#if (NGX_ZLIB)
+    buffer = file->data;
+
+    if (buffer->gzip) {
+        n = ngx_http_log_gzip(file->fd, buf, len, buffer->gzip, log);
+    } else {
+        n = ngx_write_fd(file->fd, buf, len);
+    }
+#else
+    n = ngx_write_fd(file->fd, buf, len);
+#endif
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_write_fd_n " to \"%s\" failed",
+                      file->name.data);
+
+    } else if ((size_t) n != len) {
+        ngx_log_error(NGX_LOG_ALERT, log, 0,
+                      ngx_write_fd_n " to \"%s\" was incomplete: %z of %uz",
+                      file->name.data, n, len);
+    }
+}
+
+
+static void
+ngx_http_log_flush_handler(ngx_event_t *ev)
+{
+#if (NGX_THREADS)
+    ngx_open_file_t     *file;
+    ngx_http_log_buf_t  *buffer;
+#endif
+
+    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "http log buffer flush handler");
+
+#if (NGX_THREADS)
+
+    file = ev->data;
+    buffer = file->data;
+
+    if (buffer->thread) {
+
+        if (ngx_http_log_thread_write(file, ev->log) != NGX_OK) {
+            ngx_add_timer(ev, buffer->flush);
+        }
+
+        return;
+    }
+
+#endif
+
+    ngx_http_log_flush(ev->data, ev->log);
+}
+
+
+#if (NGX_THREADS)
+
+/*
+ * a filled buffer is queued and written by a thread pool task, while
+ * the worker continues with a free buffer; the task writes queued buffers
+ * in order, and a new task is posted as the previous one completes
+ */
+
+static ngx_int_t
+ngx_http_log_thread_write(ngx_open_file_t *file, ngx_log_t *log)
+{
+    size_t                  size;
+    ngx_http_log_buf_t     *buffer;
+    ngx_http_log_chunk_t   *chunk;
+    ngx_http_log_thread_t  *thr;
+
+    buffer = file->data;
+    thr = buffer->thread;
+
+    if (buffer->pos == buffer->start) {
+        return NGX_OK;
+    }
+
+    if (thr->nfree == 0) {
+        return NGX_DECLINED;
+    }
+
+    chunk = &thr->queue[thr->nqueued++];
+
+    chunk->start = buffer->start;
+    chunk->len = buffer->pos - buffer->start;
+
+    size = buffer->last - buffer->start;
+
+    buffer->start = thr->free[--thr->nfree];
+    buffer->pos = buffer->start;
+    buffer->last = buffer->start + size;
+
+    if (buffer->event && buffer->event->timer_set) {
+        ngx_del_timer(buffer->event);
+    }
+
+    if (!thr->task->event.active) {
+        ngx_http_log_thread_post(file, log);
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_log_thread_post(ngx_open_file_t *file, ngx_log_t *log)
+{
+    ngx_thread_task_t          *task;
+    ngx_http_log_buf_t         *buffer;
+    ngx_http_log_thread_t      *thr;
+    ngx_http_log_thread_ctx_t  *ctx;
+
+    buffer = file->data;
+    thr = buffer->thread;
+    task = thr->task;
+    ctx = task->ctx;
+
+    ctx->fd = file->fd;
+    ctx->nchunks = thr->nqueued;
+    ctx->failed = 0;
+    ctx->done = 0;
+
+    thr->nbusy = thr->nqueued;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, log, 0,
+                   "http log thread post: \"%s\" %ui",
+                   file->name.data, thr->nbusy);
+
+    if (ngx_thread_task_post(thr->thread_pool, task) != NGX_OK) {
+
+        /* write the buffers in the worker */
+
+        thr->nbusy = 0;
+        ngx_http_log_thread_flush(file, log);
+    }
+}
+
+
+static void
+ngx_http_log_thread_handler(void *data, ngx_log_t *log)
+{
+    ngx_http_log_thread_ctx_t *ctx = data;
+
+    u_char      *buf;
+    size_t       len;
+    ssize_t      n;
+    ngx_uint_t   i;
+#if (NGX_ZLIB)
+    z_stream     zstream;
+#endif
+
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, log, 0, "http log thread handler");
+
+    for (i = 0; i < ctx->nchunks; i++) {
+
+        buf = ctx->chunks[i].start;
+        len = ctx->chunks[i].len;
+
+#if (NGX_ZLIB)
+        if (ctx->gzip) {
+
+            /* zlib allocates with malloc(), pools are not used in threads */
+
+            ngx_memzero(&zstream, sizeof(z_stream));
+
+            n = ngx_http_log_deflate(&zstream, buf, len, ctx->gzip,
+                                     ctx->out, ctx->size, log);
+
+            if (n == NGX_ERROR) {
+                continue;
+            }
+
+            buf = ctx->out;
+            len = n;
+        }
+#endif
+
+        n = ngx_write_fd(ctx->fd, buf, len);
+
+        if (n != (ssize_t) len && !ctx->failed) {
+            ctx->err = (n == -1) ? ngx_errno : 0;
+            ctx->n = n;
+            ctx->len = len;
+            ctx->failed = 1;
+        }
+    }
+
+    (void) ngx_thread_mutex_lock(&ctx->mtx, log);
+
+    ctx->done = 1;
+
+    (void) ngx_thread_cond_signal(&ctx->cond, log);
+    (void) ngx_thread_mutex_unlock(&ctx->mtx, log);
+}
+
+
+static void
+ngx_http_log_thread_event_handler(ngx_event_t *ev)
+{
+    ngx_open_file_t        *file;
+    ngx_http_log_buf_t     *buffer;
+    ngx_http_log_thread_t  *thr;
+
+    file = ev->data;
+    buffer = file->data;
+    thr = buffer->thread;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                   "http log thread done: \"%s\"", file->name.data);
+
+    if (thr->nbusy) {
+        ngx_http_log_thread_done(file, ev->log);
+    }
+
+    if (thr->nqueued) {
+        ngx_http_log_thread_post(file, ev->log);
+    }
+}
+
+
+static void
+ngx_http_log_thread_done(ngx_open_file_t *file, ngx_log_t *log)
+{
+    time_t                      now;
+    ngx_uint_t                  i;
+    ngx_http_log_buf_t         *buffer;
+    ngx_http_log_thread_t      *thr;
+    ngx_http_log_thread_ctx_t  *ctx;
+
+    buffer = file->data;
+    thr = buffer->thread;
+    ctx = thr->task->ctx;
+
+    for (i = 0; i < thr->nbusy; i++) {
+        thr->free[thr->nfree++] = thr->queue[i].start;
+    }
+
+    thr->nqueued -= thr->nbusy;
+
+    ngx_memmove(thr->queue, &thr->queue[thr->nbusy],
+                thr->nqueued * sizeof(ngx_http_log_chunk_t));
+
+    thr->nbusy = 0;
+
+    if (!ctx->failed) {
+        return;
+    }
+
+    now = ngx_time();
+
+    if (now - thr->error_log_time < 60) {
+        return;
+    }
+
+    thr->error_log_time = now;
+
+    if (ctx->n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ctx->err,
+                      ngx_write_fd_n " to \"%s\" failed", file->name.data);
+
+    } else {
+        ngx_log_error(NGX_LOG_ALERT, log, 0,
+                      ngx_write_fd_n " to \"%s\" was incomplete: %z of %uz",
+                      file->name.data, ctx->n, ctx->len);
+    }
+}
+
+
+static void
+ngx_http_log_thread_flush(ngx_open_file_t *file, ngx_log_t *log)
+{
+    ngx_uint_t                  i;
+    ngx_http_log_buf_t         *buffer;
+    ngx_http_log_chunk_t       *chunk;
+    ngx_http_log_thread_t      *thr;
+    ngx_http_log_thread_ctx_t  *ctx;
+
+    buffer = file->data;
+    thr = buffer->thread;
+    ctx = thr->task->ctx;
+
+    if (thr->nbusy) {
+
+        /*
+         * the descriptor is closed after a flush on reopen and
+         * on exit, so the task is waited for
+         */
+
+        if (ngx_thread_mutex_lock(&ctx->mtx, log) != NGX_OK) {
+            return;
+        }
+
+        while (!ctx->done) {
+            if (ngx_thread_cond_wait(&ctx->cond, &ctx->mtx, log) != NGX_OK) {
+                (void) ngx_thread_mutex_unlock(&ctx->mtx, log);
+                return;
+            }
+        }
+
+        (void) ngx_thread_mutex_unlock(&ctx->mtx, log);
+
+        ngx_http_log_thread_done(file, log);
+    }
+
+    for (i = 0; i < thr->nqueued; i++) {
+        chunk = &thr->queue[i];
+
+        ngx_http_log_flush_buf(file, chunk->start, chunk->len, log);
+
+        thr->free[thr->nfree++] = chunk->start;
+    }
+
+    thr->nqueued = 0;
 }
 
 
-static void
-ngx_http_log_gzip_free(void *opaque, void *address)
+static ngx_int_t
+ngx_http_log_thread_init(ngx_conf_t *cf, ngx_open_file_t *file,
+    ngx_thread_pool_t *tp)
 {
-#if 0
-    ngx_pool_t *pool = opaque;
+    size_t                      size;
+    ngx_uint_t                  i;
+    ngx_pool_cleanup_t         *cln;
+    ngx_thread_task_t          *task;
+    ngx_http_log_buf_t         *buffer;
+    ngx_http_log_thread_t      *thr;
+    ngx_http_log_thread_ctx_t  *ctx;
 
-    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, pool->log, 0, "gzip free: %p", address);
-#endif
-}
+    buffer = file->data;
+    size = buffer->last - buffer->start;
 
-#endif
+    thr = ngx_pcalloc(cf->pool, sizeof(ngx_http_log_thread_t));
+    if (thr == NULL) {
+        return NGX_ERROR;
+    }
 
+    for (i = 0; i < NGX_HTTP_LOG_THREAD_BUFS - 1; i++) {
+        thr->free[i] = ngx_pnalloc(cf->pool, size);
+        if (thr->free[i] == NULL) {
+            return NGX_ERROR;
+        }
+    }
 
-static void
-ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log)
-{
-    size_t               len;
-    ssize_t              n;
-    ngx_http_log_buf_t  *buffer;
+    thr->nfree = NGX_HTTP_LOG_THREAD_BUFS - 1;
 
-    buffer = file->data;
+    task = ngx_thread_task_alloc(cf->pool, sizeof(ngx_http_log_thread_ctx_t));
+    if (task == NULL) {
+        return NGX_ERROR;
+    }
 
-    len = buffer->pos - buffer->start;
+    task->handler = ngx_http_log_thread_handler;
+    task->event.handler = ngx_http_log_thread_event_handler;
+    task->event.data = file;
+    task->event.log = &cf->cycle->new_log;
 
-    if (len == 0) {
-        return;
+    ctx = task->ctx;
+
+    ctx->chunks = thr->queue;
+    ctx->gzip = buffer->gzip;
+
+    cln = ngx_pool_cleanup_add(cf->pool, 0);
+    if (cln == NULL) {
+        return NGX_ERROR;
+    }
+
+    if (ngx_thread_mutex_create(&ctx->mtx, cf->log) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (ngx_thread_cond_create(&ctx->cond, cf->log) != NGX_OK) {
+        (void) ngx_thread_mutex_destroy(&ctx->mtx, cf->log);
+        return NGX_ERROR;
     }
 
+    cln->handler = ngx_http_log_thread_cleanup;
+    cln->data = ctx;
+
 #if (NGX_ZLIB)
     if (buffer->gzip) {
-        n = ngx_http_log_gzip(file->fd, buffer->start, len, buffer->gzip, log);
-    } else {
-        n = ngx_write_fd(file->fd, buffer->start, len);
+        ctx->size = ngx_http_log_gzip_bound(size);
+
+        ctx->out = ngx_pnalloc(cf->pool, ctx->size);
+        if (ctx->out == NULL) {
+            return NGX_ERROR;
+        }
     }
-#else
-    n = ngx_write_fd(file->fd, buffer->start, len);
 #endif
 
-    if (n == -1) {
-        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
-                      ngx_write_fd_n " to \"%s\" failed",
-                      file->name.data);
-
-    } else if ((size_t) n != len) {
-        ngx_log_error(NGX_LOG_ALERT, log, 0,
-                      ngx_write_fd_n " to \"%s\" was incomplete: %z of %uz",
-                      file->name.data, n, len);
-    }
+    thr->thread_pool = tp;
+    thr->task = task;
 
-    buffer->pos = buffer->start;
+    buffer->thread = thr;
 
-    if (buffer->event && buffer->event->timer_set) {
-        ngx_del_timer(buffer->event);
-    }
+    return NGX_OK;
 }
 
 
 static void
-ngx_http_log_flush_handler(ngx_event_t *ev)
+ngx_http_log_thread_cleanup(void *data)
 {
-    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, 0,
-                   "http log buffer flush handler");
+    ngx_http_log_thread_ctx_t *ctx = data;
 
-    ngx_http_log_flush(ev->data, ev->log);
+    (void) ngx_thread_cond_destroy(&ctx->cond, ngx_cycle->log);
+    (void) ngx_thread_mutex_destroy(&ctx->mtx, ngx_cycle->log);
 }
 
+#endif
+
 
 static u_char *
 ngx_http_log_copy_short(ngx_http_request_t *r, u_char *buf,
@@ -854,22 +1451,26 @@ ngx_http_log_request_time(ngx_http_request_t *r, u_char *buf,
 static u_char *
 ngx_http_log_status(ngx_http_request_t *r, u_char *buf, ngx_http_log_op_t *op)
 {
-    ngx_uint_t  status;
+    return ngx_sprintf(buf, "%03ui", ngx_http_log_get_status(r));
+}
 
-    if (r->err_status) {
-        status = r->err_status;
 
-    } else if (r->headers_out.status) {
-        status = r->headers_out.status;
+static ngx_uint_t
+ngx_http_log_get_status(ngx_http_request_t *r)
+{
+    if (r->err_status) {
+        return r->err_status;
+    }
 
-    } else if (r->http_version == NGX_HTTP_VERSION_9) {
-        status = 9;
+    if (r->headers_out.status) {
+        return r->headers_out.status;
+    }
 
-    } else {
-        status = 0;
+    if (r->http_version == NGX_HTTP_VERSION_9) {
+        return 9;
     }
 
-    return ngx_sprintf(buf, "%03ui", status);
+    return 0;
 }
 
 
@@ -912,6 +1513,160 @@ ngx_http_log_request_length(ngx_http_request_t *r, u_char *buf,
 }
 
 
+static u_char *
+ngx_http_log_binary_record(ngx_http_request_t *r, ngx_http_log_fmt_t *fmt,
+    u_char *buf)
+{
+    u_char             *p;
+    uint32_t            len;
+    ngx_uint_t          i;
+    ngx_http_log_op_t  *op;
+
+    p = buf + 4;
+
+    op = fmt->ops->elts;
+    for (i = 0; i < fmt->ops->nelts; i++) {
+        p = op[i].run(r, p, &op[i]);
+    }
+
+    len = p - buf - 4;
+
+    buf[0] = (u_char) len;
+    buf[1] = (u_char) (len >> 8);
+    buf[2] = (u_char) (len >> 16);
+    buf[3] = (u_char) (len >> 24);
+
+    return p;
+}
+
+
+static u_char *
+ngx_http_log_binary_int(u_char *buf, ngx_uint_t type, uint64_t n)
+{
+    ngx_uint_t  i;
+
+    *buf++ = (u_char) type;
+
+    for (i = 0; i < 8; i++) {
+        *buf++ = (u_char) n;
+        n >>= 8;
+    }
+
+    return buf;
+}
+
+
+static u_char *
+ngx_http_log_binary_pipe(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    return ngx_http_log_binary_int(buf, NGX_HTTP_LOG_BINARY_UINT,
+                                   r->pipeline);
+}
+
+
+static u_char *
+ngx_http_log_binary_msec(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    ngx_time_t  *tp;
+
+    tp = ngx_timeofday();
+
+    return ngx_http_log_binary_int(buf, NGX_HTTP_LOG_BINARY_MSEC,
+                                   (uint64_t) tp->sec * 1000 + tp->msec);
+}
+
+
+static u_char *
+ngx_http_log_binary_request_time(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    ngx_time_t      *tp;
+    ngx_msec_int_t   ms;
+
+    tp = ngx_timeofday();
+
+    ms = (ngx_msec_int_t)
+             ((tp->sec - r->start_sec) * 1000 + (tp->msec - r->start_msec));
+    ms = ngx_max(ms, 0);
+
+    return ngx_http_log_binary_int(buf, NGX_HTTP_LOG_BINARY_DURATION, ms);
+}
+
+
+static u_char *
+ngx_http_log_binary_status(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    return ngx_http_log_binary_int(buf, NGX_HTTP_LOG_BINARY_UINT,
+                                   ngx_http_log_get_status(r));
+}
+
+
+static u_char *
+ngx_http_log_binary_bytes_sent(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    return ngx_http_log_binary_int(buf, NGX_HTTP_LOG_BINARY_UINT,
+                                   r->connection->sent);
+}
+
+
+static u_char *
+ngx_http_log_binary_body_bytes_sent(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    off_t  length;
+
+    length = r->connection->sent - r->header_size;
+
+    return ngx_http_log_binary_int(buf, NGX_HTTP_LOG_BINARY_UINT,
+                                   length > 0 ? length : 0);
+}
+
+
+static u_char *
+ngx_http_log_binary_request_length(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    return ngx_http_log_binary_int(buf, NGX_HTTP_LOG_BINARY_UINT,
+                                   r->request_length);
+}
+
+
+static u_char *
+ngx_http_log_binary_remote_addr(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    struct sockaddr_in   *sin;
+#if (NGX_HAVE_INET6)
+    struct sockaddr_in6  *sin6;
+#endif
+
+    switch (r->connection->sockaddr->sa_family) {
+
+#if (NGX_HAVE_INET6)
+    case AF_INET6:
+        sin6 = (struct sockaddr_in6 *) r->connection->sockaddr;
+
+        *buf++ = NGX_HTTP_LOG_BINARY_INET6;
+        return ngx_cpymem(buf, sin6->sin6_addr.s6_addr, 16);
+#endif
+
+    case AF_INET:
+        sin = (struct sockaddr_in *) r->connection->sockaddr;
+
+        *buf++ = NGX_HTTP_LOG_BINARY_INET;
+        return ngx_cpymem(buf, &sin->sin_addr.s_addr, 4);
+
+    default: /* AF_UNIX */
+        *buf = NGX_HTTP_LOG_BINARY_NULL;
+        return buf + 1;
+    }
+}
+
+
 static ngx_int_t
 ngx_http_log_variable_compile(ngx_conf_t *cf, ngx_http_log_op_t *op,
     ngx_str_t *value, ngx_uint_t escape)
@@ -936,6 +1691,11 @@ ngx_http_log_variable_compile(ngx_conf_t *cf, ngx_http_log_op_t *op,
         op->run = ngx_http_log_unescaped_variable;
         break;
 
+    case NGX_HTTP_LOG_BINARY:
+        op->getlen = ngx_http_log_binary_variable_getlen;
+        op->run = ngx_http_log_binary_variable;
+        break;
+
     default: /* NGX_HTTP_LOG_ESCAPE_DEFAULT */
         op->getlen = ngx_http_log_variable_getlen;
         op->run = ngx_http_log_variable;
@@ -988,9 +1748,18 @@ ngx_http_log_variable(ngx_http_request_t *r, u_char *buf, ngx_http_log_op_t *op)
 }
 
 
+/* the bytes escaped are less than 0x20, '"', '\\', and 0x7f and above */
+
+#define ngx_http_log_escape_word(w)                                          \
+    (((w) & 0x8080808080808080ULL) | ngx_swar_hasless(w, 0x20)               \
+     | ngx_swar_hasbyte(w, '"') | ngx_swar_hasbyte(w, '\\')                  \
+     | ngx_swar_hasbyte(w, 0x7f))
+
+
 static uintptr_t
 ngx_http_log_escape(u_char *dst, u_char *src, size_t size)
 {
+    uint64_t        w;
     ngx_uint_t      n;
     static u_char   hex[] = "0123456789ABCDEF";
 
@@ -1020,6 +1789,17 @@ ngx_http_log_escape(u_char *dst, u_char *src, size_t size)
         n = 0;
 
         while (size) {
+
+            if (size >= 8) {
+                w = ngx_swar_load(src);
+
+                if (ngx_http_log_escape_word(w) == 0) {
+                    src += 8;
+                    size -= 8;
+                    continue;
+                }
+            }
+
             if (escape[*src >> 5] & (1U << (*src & 0x1f))) {
                 n++;
             }
@@ -1031,6 +1811,19 @@ ngx_http_log_escape(u_char *dst, u_char *src, size_t size)
     }
 
     while (size) {
+
+        if (size >= 8) {
+            w = ngx_swar_load(src);
+
+            if (ngx_http_log_escape_word(w) == 0) {
+                ngx_memcpy(dst, src, 8);
+                dst += 8;
+                src += 8;
+                size -= 8;
+                continue;
+            }
+        }
+
         if (escape[*src >> 5] & (1U << (*src & 0x1f))) {
             *dst++ = '\\';
             *dst++ = 'x';
@@ -1122,6 +1915,45 @@ ngx_http_log_unescaped_variable(ngx_http_request_t *r, u_char *buf,
 }
 
 
+static size_t
+ngx_http_log_binary_variable_getlen(ngx_http_request_t *r, uintptr_t data)
+{
+    ngx_http_variable_value_t  *value;
+
+    value = ngx_http_get_indexed_variable(r, data);
+
+    if (value == NULL || value->not_found) {
+        return 1;
+    }
+
+    return 1 + 4 + value->len;
+}
+
+
+static u_char *
+ngx_http_log_binary_variable(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    ngx_http_variable_value_t  *value;
+
+    value = ngx_http_get_indexed_variable(r, op->data);
+
+    if (value == NULL || value->not_found) {
+        *buf = NGX_HTTP_LOG_BINARY_NULL;
+        return buf + 1;
+    }
+
+    *buf++ = NGX_HTTP_LOG_BINARY_STRING;
+
+    *buf++ = (u_char) value->len;
+    *buf++ = (u_char) (value->len >> 8);
+    *buf++ = (u_char) (value->len >> 16);
+    *buf++ = (u_char) (value->len >> 24);
+
+    return ngx_cpymem(buf, value->data, value->len);
+}
+
+
 static void *
 ngx_http_log_create_main_conf(ngx_conf_t *cf)
 {
@@ -1251,6 +2083,9 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_http_log_main_conf_t          *lmcf;
     ngx_http_script_compile_t          sc;
     ngx_http_compile_complex_value_t   ccv;
+#if (NGX_THREADS)
+    ngx_thread_pool_t                 *tp;
+#endif
 
     value = cf->args->elts;
 
@@ -1361,9 +2196,19 @@ process_formats:
         return NGX_CONF_ERROR;
     }
 
+    if (log->format->binary && log->syslog_peer) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "binary log format \"%V\" cannot be used "
+                           "with syslog", &name);
+        return NGX_CONF_ERROR;
+    }
+
     size = 0;
     flush = 0;
     gzip = 0;
+#if (NGX_THREADS)
+    tp = NULL;
+#endif
 
     for (i = 3; i < cf->args->nelts; i++) {
 
@@ -1430,6 +2275,45 @@ process_formats:
 #endif
         }
 
+        if (ngx_strncmp(value[i].data, "threads", 7) == 0
+            && (value[i].len == 7 || value[i].data[7] == '='))
+        {
+#if (NGX_THREADS)
+            if (size == 0) {
+                size = 64 * 1024;
+            }
+
+            if (value[i].len == 7) {
+                tp = ngx_thread_pool_add(cf, NULL);
+
+            } else {
+                s.len = value[i].len - 8;
+                s.data = value[i].data + 8;
+
+                if (s.len == 0) {
+                    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                       "invalid parameter \"%V\"",
+                                       &value[i]);
+                    return NGX_CONF_ERROR;
+                }
+
+                tp = ngx_thread_pool_add(cf, &s);
+            }
+
+            if (tp == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "\"threads\" parameter "
+                               "is unsupported on this platform");
+            return NGX_CONF_ERROR;
+#endif
+        }
+
         if (ngx_strncmp(value[i].data, "if=", 3) == 0) {
             s.len = value[i].len - 3;
             s.data = value[i].data + 3;
@@ -1484,7 +2368,11 @@ process_formats:
 
             if (buffer->last - buffer->start != size
                 || buffer->flush != flush
-                || buffer->gzip != gzip)
+                || buffer->gzip != gzip
+#if (NGX_THREADS)
+                || (buffer->thread ? buffer->thread->thread_pool : NULL) != tp
+#endif
+                )
             {
                 ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                                    "access_log \"%V\" already defined "
@@ -1527,6 +2415,12 @@ process_formats:
 
         log->file->flush = ngx_http_log_flush;
         log->file->data = buffer;
+
+#if (NGX_THREADS)
+        if (tp && ngx_http_log_thread_init(cf, log->file, tp) != NGX_OK) {
+            return NGX_CONF_ERROR;
+        }
+#endif
     }
 
     return NGX_CONF_OK;
@@ -1573,6 +2467,9 @@ ngx_http_log_set_format(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
+    fmt->binary = (cf->args->nelts > 2
+                   && ngx_strcmp(value[2].data, "binary") == 0);
+
     return ngx_http_log_compile_format(cf, fmt->flushes, fmt->ops, cf->args, 2);
 }
 
@@ -1592,7 +2489,13 @@ ngx_http_log_compile_format(ngx_conf_t *cf, ngx_array_t *flushes,
     escape = NGX_HTTP_LOG_ESCAPE_DEFAULT;
     value = args->elts;
 
-    if (s < args->nelts && ngx_strncmp(value[s].data, "escape=", 7) == 0) {
+    if (s < args->nelts && ngx_strcmp(value[s].data, "binary") == 0) {
+        escape = NGX_HTTP_LOG_BINARY;
+        s++;
+
+    } else if (s < args->nelts
+               && ngx_strncmp(value[s].data, "escape=", 7) == 0)
+    {
         data = value[s].data + 7;
 
         if (ngx_strcmp(data, "json") == 0) {
@@ -1674,7 +2577,10 @@ ngx_http_log_compile_format(ngx_conf_t *cf, ngx_array_t *flushes,
                     goto invalid;
                 }
 
-                for (v = ngx_http_log_vars; v->name.len; v++) {
+                v = (escape == NGX_HTTP_LOG_BINARY) ? ngx_http_log_binary_vars
+                                                    : ngx_http_log_vars;
+
+                for ( /* void */ ; v->name.len; v++) {
 
                     if (v->name.len == var.len
                         && ngx_strncmp(v->name.data, var.data, var.len) == 0)
@@ -1717,6 +2623,14 @@ ngx_http_log_compile_format(ngx_conf_t *cf, ngx_array_t *flushes,
 
             len = &value[s].data[i] - data;
 
+            if (escape == NGX_HTTP_LOG_BINARY) {
+
+                /* text only separates fields of binary records */
+
+                ops->nelts--;
+                continue;
+            }
+
             if (len) {
 
                 op->len = len;
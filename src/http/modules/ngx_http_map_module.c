@@ -13,6 +13,7 @@
 typedef struct {
     ngx_uint_t                  hash_max_size;
     ngx_uint_t                  hash_bucket_size;
+    ngx_flag_t                  hash_perfect;
 } ngx_http_map_conf_t;
 
 
@@ -25,6 +26,7 @@ typedef struct {
 #endif
 
     ngx_http_variable_value_t  *default_value;
+    ngx_db_t                   *db;
     ngx_conf_t                 *cf;
     unsigned                    hostnames:1;
     unsigned                    no_cacheable:1;
@@ -35,6 +37,7 @@ typedef struct {
     ngx_http_map_t              map;
     ngx_http_complex_value_t    value;
     ngx_http_variable_value_t  *default_value;
+    ngx_db_t                   *db;
     ngx_uint_t                  hostnames;      /* unsigned  hostnames:1 */
 } ngx_http_map_ctx_t;
 
@@ -44,6 +47,8 @@ static int ngx_libc_cdecl ngx_http_map_cmp_dns_wildcards(const void *one,
 static void *ngx_http_map_create_conf(ngx_conf_t *cf);
 static char *ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static char *ngx_http_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf);
+static ngx_int_t ngx_http_map_db_variable(ngx_http_request_t *r,
+    ngx_http_map_ctx_t *map, ngx_str_t *val, ngx_http_variable_value_t *v);
 
 
 static ngx_command_t  ngx_http_map_commands[] = {
@@ -69,6 +74,13 @@ static ngx_command_t  ngx_http_map_commands[] = {
       offsetof(ngx_http_map_conf_t, hash_bucket_size),
       NULL },
 
+    { ngx_string("map_hash_perfect"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_map_conf_t, hash_perfect),
+      NULL },
+
       ngx_null_command
 };
 
@@ -110,6 +122,7 @@ ngx_http_map_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v,
 {
     ngx_http_map_ctx_t  *map = (ngx_http_map_ctx_t *) data;
 
+    ngx_int_t                   rc;
     ngx_str_t                   val, str;
     ngx_http_complex_value_t   *cv;
     ngx_http_variable_value_t  *value;
@@ -125,6 +138,14 @@ ngx_http_map_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v,
         val.len--;
     }
 
+    if (map->db) {
+        rc = ngx_http_map_db_variable(r, map, &val, v);
+
+        if (rc != NGX_DECLINED) {
+            return rc;
+        }
+    }
+
     value = ngx_http_map_find(r, &map->map, &val);
 
     if (value == NULL) {
@@ -155,6 +176,48 @@ ngx_http_map_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v,
 }
 
 
+/*
+ * database keys are lowercase, values are copied as the database
+ * may be replaced while the request is still using the variable
+ */
+
+static ngx_int_t
+ngx_http_map_db_variable(ngx_http_request_t *r, ngx_http_map_ctx_t *map,
+    ngx_str_t *val, ngx_http_variable_value_t *v)
+{
+    ngx_str_t  key, value;
+
+    key.len = val->len;
+    key.data = ngx_pnalloc(r->pool, val->len);
+    if (key.data == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_strlow(key.data, val->data, val->len);
+
+    if (ngx_db_find_key(map->db, &key, &value) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    v->data = ngx_pnalloc(r->pool, value.len);
+    if (v->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(v->data, value.data, value.len);
+
+    v->len = value.len;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http map database: \"%V\" \"%v\"", val, v);
+
+    return NGX_OK;
+}
+
+
 static void *
 ngx_http_map_create_conf(ngx_conf_t *cf)
 {
@@ -167,6 +230,7 @@ ngx_http_map_create_conf(ngx_conf_t *cf)
 
     mcf->hash_max_size = NGX_CONF_UNSET_UINT;
     mcf->hash_bucket_size = NGX_CONF_UNSET_UINT;
+    mcf->hash_perfect = NGX_CONF_UNSET;
 
     return mcf;
 }
@@ -178,7 +242,12 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_http_map_conf_t  *mcf = conf;
 
     char                              *rv;
+    ngx_int_t                          rc;
     ngx_str_t                         *value, name;
+#if (NGX_PCRE)
+    ngx_uint_t                         i;
+    ngx_http_regex_t                  *re;
+#endif
     ngx_conf_t                         save;
     ngx_pool_t                        *pool;
     ngx_hash_init_t                    hash;
@@ -199,6 +268,10 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
                                           ngx_cacheline_size);
     }
 
+    if (mcf->hash_perfect == NGX_CONF_UNSET) {
+        mcf->hash_perfect = 0;
+    }
+
     map = ngx_pcalloc(cf->pool, sizeof(ngx_http_map_ctx_t));
     if (map == NULL) {
         return NGX_CONF_ERROR;
@@ -264,6 +337,7 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 #endif
 
     ctx.default_value = NULL;
+    ctx.db = NULL;
     ctx.cf = &save;
     ctx.hostnames = 0;
     ctx.no_cacheable = 0;
@@ -291,6 +365,7 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
                                              &ngx_http_variable_null_value;
 
     map->hostnames = ctx.hostnames;
+    map->db = ctx.db;
 
     hash.key = ngx_hash_key_lc;
     hash.max_size = mcf->hash_max_size;
@@ -302,9 +377,16 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         hash.hash = &map->map.hash.hash;
         hash.temp_pool = NULL;
 
-        if (ngx_hash_init(&hash, ctx.keys.keys.elts, ctx.keys.keys.nelts)
-            != NGX_OK)
-        {
+        if (mcf->hash_perfect) {
+            rc = ngx_hash_perfect_init(&hash, ctx.keys.keys.elts,
+                                       ctx.keys.keys.nelts);
+
+        } else {
+            rc = ngx_hash_init(&hash, ctx.keys.keys.elts,
+                               ctx.keys.keys.nelts);
+        }
+
+        if (rc != NGX_OK) {
             ngx_destroy_pool(pool);
             return NGX_CONF_ERROR;
         }
@@ -319,10 +401,17 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         hash.hash = NULL;
         hash.temp_pool = pool;
 
-        if (ngx_hash_wildcard_init(&hash, ctx.keys.dns_wc_head.elts,
-                                   ctx.keys.dns_wc_head.nelts)
-            != NGX_OK)
-        {
+        if (mcf->hash_perfect) {
+            rc = ngx_hash_wildcard_perfect_init(&hash,
+                                                ctx.keys.dns_wc_head.elts,
+                                                ctx.keys.dns_wc_head.nelts);
+
+        } else {
+            rc = ngx_hash_wildcard_init(&hash, ctx.keys.dns_wc_head.elts,
+                                        ctx.keys.dns_wc_head.nelts);
+        }
+
+        if (rc != NGX_OK) {
             ngx_destroy_pool(pool);
             return NGX_CONF_ERROR;
         }
@@ -339,10 +428,17 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         hash.hash = NULL;
         hash.temp_pool = pool;
 
-        if (ngx_hash_wildcard_init(&hash, ctx.keys.dns_wc_tail.elts,
-                                   ctx.keys.dns_wc_tail.nelts)
-            != NGX_OK)
-        {
+        if (mcf->hash_perfect) {
+            rc = ngx_hash_wildcard_perfect_init(&hash,
+                                                ctx.keys.dns_wc_tail.elts,
+                                                ctx.keys.dns_wc_tail.nelts);
+
+        } else {
+            rc = ngx_hash_wildcard_init(&hash, ctx.keys.dns_wc_tail.elts,
+                                        ctx.keys.dns_wc_tail.nelts);
+        }
+
+        if (rc != NGX_OK) {
             ngx_destroy_pool(pool);
             return NGX_CONF_ERROR;
         }
@@ -355,6 +451,29 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     if (ctx.regexes.nelts) {
         map->map.regex = ctx.regexes.elts;
         map->map.nregex = ctx.regexes.nelts;
+
+        map->map.regex_set = ngx_regex_set_create(cf->pool,
+                                                  map->map.nregex);
+        if (map->map.regex_set == NULL) {
+            ngx_destroy_pool(pool);
+            return NGX_CONF_ERROR;
+        }
+
+        for (i = 0; i < map->map.nregex; i++) {
+            re = map->map.regex[i].regex;
+
+            if (ngx_regex_set_add(map->map.regex_set, re->regex, &re->name)
+                != NGX_OK)
+            {
+                ngx_destroy_pool(pool);
+                return NGX_CONF_ERROR;
+            }
+        }
+
+        if (ngx_regex_set_compile(map->map.regex_set) != NGX_OK) {
+            ngx_destroy_pool(pool);
+            return NGX_CONF_ERROR;
+        }
     }
 
 #endif
@@ -408,6 +527,12 @@ ngx_http_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf)
         return NGX_CONF_OK;
     }
 
+    if (ngx_strcmp(value[0].data, "database") == 0
+        && (cf->args->nelts == 2 || cf->args->nelts == 3))
+    {
+        return ngx_db_conf(cf, NGX_DB_KEYS, &ctx->db);
+    }
+
     if (cf->args->nelts != 2) {
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid number of the map parameters");
@@ -0,0 +1,2080 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_HTTP_METRICS_SERVER      0
+#define NGX_HTTP_METRICS_LOCATION    1
+#define NGX_HTTP_METRICS_UPSTREAM    2
+
+#define NGX_HTTP_METRICS_PROMETHEUS  0
+#define NGX_HTTP_METRICS_JSON        1
+
+#define NGX_HTTP_METRICS_COUNTER     0
+#define NGX_HTTP_METRICS_RESPONSES   1
+#define NGX_HTTP_METRICS_HISTOGRAM   2
+
+#define NGX_HTTP_METRICS_OWNERS      8
+
+
+typedef struct {
+    ngx_atomic_uint_t            requests;
+    ngx_atomic_uint_t            responses[5];
+    ngx_atomic_uint_t            received;
+    ngx_atomic_uint_t            sent;
+
+    /* request time, or upstream connect, header and response times */
+    ngx_stat_histogram_t         times[3];
+} ngx_http_metrics_stats_t;
+
+
+/*
+ * status zones of a worker slot, shared by an old and a new worker
+ * after a reload which did not change them; pids of the workers using
+ * them are kept, so that zones are freed once no live worker uses them,
+ * even if some of the workers crashed
+ */
+
+typedef struct {
+    ngx_queue_t                  queue;
+    ngx_uint_t                   worker;
+    ngx_pid_t                    owners[NGX_HTTP_METRICS_OWNERS];
+    uint32_t                     layout;
+    ngx_http_metrics_stats_t    *stats;
+} ngx_http_metrics_slots_t;
+
+
+typedef struct {
+    ngx_event_metrics_t          event;
+    ngx_stat_histogram_t         phases[NGX_HTTP_LOG_PHASE];
+
+    ngx_http_metrics_slots_t    *slots;
+} ngx_http_metrics_worker_t;
+
+
+typedef struct {
+    ngx_http_metrics_worker_t   *workers[NGX_MAX_PROCESSES];
+    ngx_queue_t                  slots;
+} ngx_http_metrics_shctx_t;
+
+
+typedef struct {
+    ngx_http_metrics_shctx_t    *sh;
+    ngx_slab_pool_t             *shpool;
+} ngx_http_metrics_ctx_t;
+
+
+typedef struct {
+    ngx_str_t                       name;
+    ngx_uint_t                      type;
+    ngx_uint_t                      slot;
+    ngx_uint_t                      npeers;
+    ngx_str_t                      *peers;
+    ngx_http_upstream_srv_conf_t   *upstream;
+} ngx_http_metrics_zone_t;
+
+
+typedef struct {
+    ngx_shm_zone_t              *shm_zone;
+    ngx_array_t                  zones;      /* ngx_http_metrics_zone_t */
+    ngx_uint_t                   nstats;
+    uint32_t                     layout;
+} ngx_http_metrics_main_conf_t;
+
+
+typedef struct {
+    ngx_uint_t                   zone;
+} ngx_http_metrics_srv_conf_t;
+
+
+typedef struct {
+    ngx_uint_t                   zone;
+    ngx_uint_t                   format;
+} ngx_http_metrics_loc_conf_t;
+
+
+typedef struct {
+    ngx_str_t                    name;
+    ngx_str_t                    help;
+    size_t                       offset;
+} ngx_http_metrics_event_t;
+
+
+typedef struct {
+    ngx_str_t                    name;
+    ngx_str_t                    help;
+    ngx_uint_t                   type;
+    ngx_uint_t                   upstream;
+    size_t                       offset;
+} ngx_http_metrics_family_t;
+
+
+typedef struct {
+    ngx_str_t                    name;
+    ngx_str_t                    help;
+    char                        *type;
+    size_t                       offset;
+} ngx_http_metrics_slab_t;
+
+
+static ngx_int_t ngx_http_metrics_handler(ngx_http_request_t *r);
+static ngx_int_t ngx_http_metrics_events(ngx_http_request_t *r,
+    ngx_http_metrics_ctx_t *ctx, ngx_uint_t workers, ngx_chain_t ***ll);
+static ngx_int_t ngx_http_metrics_zones(ngx_http_request_t *r,
+    ngx_http_metrics_main_conf_t *mmcf, ngx_http_metrics_stats_t *stats,
+    ngx_chain_t ***ll);
+static ngx_int_t ngx_http_metrics_json(ngx_http_request_t *r,
+    ngx_http_metrics_main_conf_t *mmcf, ngx_http_metrics_stats_t *stats,
+    ngx_chain_t ***ll);
+static ngx_int_t ngx_http_metrics_slabs(ngx_http_request_t *r,
+    ngx_chain_t ***ll);
+static ngx_int_t ngx_http_metrics_json_slabs(ngx_http_request_t *r,
+    ngx_chain_t ***ll);
+static u_char *ngx_http_metrics_json_stats(u_char *p,
+    ngx_http_metrics_stats_t *st, ngx_uint_t upstream);
+static ngx_http_metrics_stats_t *ngx_http_metrics_collect(
+    ngx_http_request_t *r, ngx_http_metrics_main_conf_t *mmcf,
+    ngx_uint_t workers);
+static void ngx_http_metrics_merge(ngx_stat_histogram_t *dst,
+    ngx_stat_histogram_t *src);
+static uintptr_t ngx_http_metrics_escape(u_char *dst, u_char *src,
+    size_t size);
+static ngx_buf_t *ngx_http_metrics_buf(ngx_http_request_t *r, size_t size,
+    ngx_chain_t ***ll);
+static u_char *ngx_http_metrics_header(u_char *p, ngx_str_t *name,
+    ngx_str_t *help, char *type);
+static u_char *ngx_http_metrics_histogram(u_char *p, ngx_str_t *name,
+    ngx_str_t *labels, ngx_stat_histogram_t *h);
+static ngx_int_t ngx_http_metrics_log_handler(ngx_http_request_t *r);
+static void ngx_http_metrics_account(ngx_http_metrics_stats_t *st,
+    ngx_uint_t status, off_t received, off_t sent);
+static ngx_int_t ngx_http_metrics_init_zone(ngx_shm_zone_t *shm_zone,
+    void *data);
+static ngx_int_t ngx_http_metrics_init(ngx_conf_t *cf);
+static void *ngx_http_metrics_create_main_conf(ngx_conf_t *cf);
+static void *ngx_http_metrics_create_srv_conf(ngx_conf_t *cf);
+static void *ngx_http_metrics_create_loc_conf(ngx_conf_t *cf);
+static char *ngx_http_metrics_merge_loc_conf(ngx_conf_t *cf, void *parent,
+    void *child);
+static char *ngx_http_metrics_zone(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_metrics(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_metrics_status_zone(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static ngx_int_t ngx_http_metrics_init_process(ngx_cycle_t *cycle);
+static void ngx_http_metrics_exit_process(ngx_cycle_t *cycle);
+static void ngx_http_metrics_free_slots(ngx_http_metrics_ctx_t *ctx);
+
+
+static ngx_command_t  ngx_http_metrics_commands[] = {
+
+    { ngx_string("metrics_zone"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE12,
+      ngx_http_metrics_zone,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("metrics"),
+      NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_NOARGS|NGX_CONF_TAKE1,
+      ngx_http_metrics,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("status_zone"),
+      NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_HTTP_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_http_metrics_status_zone,
+      0,
+      0,
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_metrics_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    ngx_http_metrics_init,                 /* postconfiguration */
+
+    ngx_http_metrics_create_main_conf,     /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    ngx_http_metrics_create_srv_conf,      /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    ngx_http_metrics_create_loc_conf,      /* create location configuration */
+    ngx_http_metrics_merge_loc_conf        /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_metrics_module = {
+    NGX_MODULE_V1,
+    &ngx_http_metrics_module_ctx,          /* module context */
+    ngx_http_metrics_commands,             /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    ngx_http_metrics_init_process,         /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    ngx_http_metrics_exit_process,         /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_http_metrics_slots_t  *ngx_http_metrics_slots;
+static ngx_http_metrics_stats_t  *ngx_http_metrics_stats;
+
+
+static ngx_http_metrics_event_t  ngx_http_metrics_event_names[] = {
+
+    { ngx_string("nginx_event_loop_duration_seconds"),
+      ngx_string("Event loop iteration time, excluding waiting for events."),
+      offsetof(ngx_event_metrics_t, loop) },
+
+    { ngx_string("nginx_event_process_duration_seconds"),
+      ngx_string("Time spent handling I/O events."),
+      offsetof(ngx_event_metrics_t, events) },
+
+    { ngx_string("nginx_event_timers_duration_seconds"),
+      ngx_string("Time spent handling expired timers."),
+      offsetof(ngx_event_metrics_t, timers) },
+
+    { ngx_string("nginx_event_posted_duration_seconds"),
+      ngx_string("Time spent handling posted events."),
+      offsetof(ngx_event_metrics_t, posted) }
+};
+
+
+static ngx_str_t  ngx_http_metrics_phase_name =
+    ngx_string("nginx_http_phase_duration_seconds");
+
+static ngx_str_t  ngx_http_metrics_phase_help =
+    ngx_string("Time spent in request processing phase handlers.");
+
+static char  *ngx_http_metrics_phase_names[] = {
+    "post_read",
+    "server_rewrite",
+    "find_config",
+    "rewrite",
+    "post_rewrite",
+    "preaccess",
+    "access",
+    "post_access",
+    "precontent",
+    "content"
+};
+
+
+static ngx_http_metrics_family_t  ngx_http_metrics_families[] = {
+
+    { ngx_string("nginx_http_zone_requests_total"),
+      ngx_string("Requests processed in the status zone."),
+      NGX_HTTP_METRICS_COUNTER, 0,
+      offsetof(ngx_http_metrics_stats_t, requests) },
+
+    { ngx_string("nginx_http_zone_responses_total"),
+      ngx_string("Responses sent in the status zone."),
+      NGX_HTTP_METRICS_RESPONSES, 0,
+      offsetof(ngx_http_metrics_stats_t, responses) },
+
+    { ngx_string("nginx_http_zone_received_bytes_total"),
+      ngx_string("Bytes received from clients."),
+      NGX_HTTP_METRICS_COUNTER, 0,
+      offsetof(ngx_http_metrics_stats_t, received) },
+
+    { ngx_string("nginx_http_zone_sent_bytes_total"),
+      ngx_string("Bytes sent to clients."),
+      NGX_HTTP_METRICS_COUNTER, 0,
+      offsetof(ngx_http_metrics_stats_t, sent) },
+
+    { ngx_string("nginx_http_zone_request_duration_seconds"),
+      ngx_string("Request processing time."),
+      NGX_HTTP_METRICS_HISTOGRAM, 0,
+      offsetof(ngx_http_metrics_stats_t, times[0]) },
+
+    { ngx_string("nginx_upstream_peer_requests_total"),
+      ngx_string("Requests passed to the upstream server."),
+      NGX_HTTP_METRICS_COUNTER, 1,
+      offsetof(ngx_http_metrics_stats_t, requests) },
+
+    { ngx_string("nginx_upstream_peer_responses_total"),
+      ngx_string("Responses received from the upstream server."),
+      NGX_HTTP_METRICS_RESPONSES, 1,
+      offsetof(ngx_http_metrics_stats_t, responses) },
+
+    { ngx_string("nginx_upstream_peer_received_bytes_total"),
+      ngx_string("Bytes received from the upstream server."),
+      NGX_HTTP_METRICS_COUNTER, 1,
+      offsetof(ngx_http_metrics_stats_t, received) },
+
+    { ngx_string("nginx_upstream_peer_sent_bytes_total"),
+      ngx_string("Bytes sent to the upstream server."),
+      NGX_HTTP_METRICS_COUNTER, 1,
+      offsetof(ngx_http_metrics_stats_t, sent) },
+
+    { ngx_string("nginx_upstream_peer_connect_duration_seconds"),
+      ngx_string("Time to establish a connection with the upstream server."),
+      NGX_HTTP_METRICS_HISTOGRAM, 1,
+      offsetof(ngx_http_metrics_stats_t, times[0]) },
+
+    { ngx_string("nginx_upstream_peer_header_duration_seconds"),
+      ngx_string("Time to receive the response header from the upstream."),
+      NGX_HTTP_METRICS_HISTOGRAM, 1,
+      offsetof(ngx_http_metrics_stats_t, times[1]) },
+
+    { ngx_string("nginx_upstream_peer_response_duration_seconds"),
+      ngx_string("Time to receive the response from the upstream server."),
+      NGX_HTTP_METRICS_HISTOGRAM, 1,
+      offsetof(ngx_http_metrics_stats_t, times[2]) }
+};
+
+
+static char  *ngx_http_metrics_zone_types[] = {
+    "server",
+    "location"
+};
+
+
+static ngx_str_t  ngx_http_metrics_slab_help[] = {
+    ngx_string("Pages in the shared memory zone."),
+    ngx_string("Free pages in the shared memory zone."),
+    ngx_string("Free space in pages split into chunks.")
+};
+
+
+static ngx_http_metrics_slab_t  ngx_http_metrics_slab_names[] = {
+
+    { ngx_string("nginx_slab_chunks"),
+      ngx_string("Chunks in pages of the size class."),
+      "gauge", offsetof(ngx_slab_stat_t, total) },
+
+    { ngx_string("nginx_slab_chunks_used"),
+      ngx_string("Chunks in use, including chunks cached by workers."),
+      "gauge", offsetof(ngx_slab_stat_t, used) },
+
+    { ngx_string("nginx_slab_requests_total"),
+      ngx_string("Chunk allocations from the slab."),
+      "counter", offsetof(ngx_slab_stat_t, reqs) },
+
+    { ngx_string("nginx_slab_failures_total"),
+      ngx_string("Failed chunk allocations."),
+      "counter", offsetof(ngx_slab_stat_t, fails) }
+};
+
+
+/* a bucket line with a phase label is the longest one */
+
+#define NGX_HTTP_METRICS_LINE_LEN                                             \
+    (sizeof("nginx_upstream_peer_response_duration_seconds_bucket"            \
+            "{phase=\"server_rewrite\",le=\".000000\"} \n")                  \
+     + 2 * NGX_ATOMIC_T_LEN)
+
+#define NGX_HTTP_METRICS_LABELS_LEN                                           \
+    sizeof("upstream=\"\",peer=\"\",code=\"1xx\"")
+
+#define NGX_HTTP_METRICS_HEADER_LEN  256
+
+#define NGX_HTTP_METRICS_JSON_LEN                                             \
+    (sizeof("{\"server\":\"\",\"requests\":,\"responses\":{\"1xx\":,"       \
+            "\"2xx\":,\"3xx\":,\"4xx\":,\"5xx\":},\"received\":,"          \
+            "\"sent\":,\"connect_time\":{\"count\":,\"sum\":.000000},"     \
+            "\"header_time\":{\"count\":,\"sum\":.000000},"                \
+            "\"response_time\":{\"count\":,\"sum\":.000000}},")            \
+     + 14 * NGX_ATOMIC_T_LEN)
+
+
+static ngx_int_t
+ngx_http_metrics_handler(ngx_http_request_t *r)
+{
+    off_t                          len;
+    ngx_int_t                      rc;
+    ngx_uint_t                     workers;
+    ngx_chain_t                   *out, *cl, **ll;
+    ngx_core_conf_t               *ccf;
+    ngx_http_metrics_ctx_t        *ctx;
+    ngx_http_metrics_stats_t      *stats;
+    ngx_http_metrics_loc_conf_t   *mlcf;
+    ngx_http_metrics_main_conf_t  *mmcf;
+
+    if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+
+    rc = ngx_http_discard_request_body(r);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    mlcf = ngx_http_get_module_loc_conf(r, ngx_http_metrics_module);
+
+    if (mlcf->format == NGX_HTTP_METRICS_JSON) {
+        r->headers_out.content_type_len = sizeof("application/json") - 1;
+        ngx_str_set(&r->headers_out.content_type, "application/json");
+
+    } else {
+        r->headers_out.content_type_len = sizeof("text/plain") - 1;
+        ngx_str_set(&r->headers_out.content_type,
+                    "text/plain; version=0.0.4");
+    }
+
+    r->headers_out.content_type_lowcase = NULL;
+
+    if (r->method == NGX_HTTP_HEAD) {
+        r->headers_out.status = NGX_HTTP_OK;
+
+        rc = ngx_http_send_header(r);
+
+        if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+            return rc;
+        }
+    }
+
+    mmcf = ngx_http_get_module_main_conf(r, ngx_http_metrics_module);
+    ctx = mmcf->shm_zone->data;
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(ngx_cycle->conf_ctx,
+                                           ngx_core_module);
+
+    workers = ccf->master ? (ngx_uint_t) ccf->worker_processes : 1;
+
+    stats = ngx_http_metrics_collect(r, mmcf, workers);
+    if (stats == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    out = NULL;
+    ll = &out;
+
+    if (mlcf->format == NGX_HTTP_METRICS_JSON) {
+        rc = ngx_http_metrics_json(r, mmcf, stats, &ll);
+
+        if (rc == NGX_OK) {
+            rc = ngx_http_metrics_json_slabs(r, &ll);
+        }
+
+    } else {
+        rc = ngx_http_metrics_events(r, ctx, workers, &ll);
+
+        if (rc == NGX_OK) {
+            rc = ngx_http_metrics_zones(r, mmcf, stats, &ll);
+        }
+
+        if (rc == NGX_OK) {
+            rc = ngx_http_metrics_slabs(r, &ll);
+        }
+    }
+
+    if (rc != NGX_OK) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    len = 0;
+
+    for (cl = out; cl; cl = cl->next) {
+        len += cl->buf->last - cl->buf->pos;
+
+        if (cl->next == NULL) {
+            cl->buf->last_buf = (r == r->main) ? 1 : 0;
+            cl->buf->last_in_chain = 1;
+        }
+    }
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = len;
+
+    rc = ngx_http_send_header(r);
+
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    return ngx_http_output_filter(r, out);
+}
+
+
+static ngx_int_t
+ngx_http_metrics_events(ngx_http_request_t *r, ngx_http_metrics_ctx_t *ctx,
+    ngx_uint_t workers, ngx_chain_t ***ll)
+{
+    size_t                      size;
+    u_char                     *p, buf[64];
+    ngx_str_t                   labels;
+    ngx_buf_t                  *b;
+    ngx_uint_t                  i, k, n;
+    ngx_stat_histogram_t        h, *wh;
+    ngx_http_metrics_worker_t  *w;
+
+    n = sizeof(ngx_http_metrics_event_names)
+        / sizeof(ngx_http_metrics_event_t);
+
+    size = (n * workers + NGX_HTTP_LOG_PHASE)
+           * (NGX_STAT_HISTOGRAM_BUCKETS + 2) * NGX_HTTP_METRICS_LINE_LEN
+           + (n + 1) * NGX_HTTP_METRICS_HEADER_LEN;
+
+    b = ngx_http_metrics_buf(r, size, ll);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = b->last;
+
+    labels.data = buf;
+
+    for (k = 0; k < n; k++) {
+        p = ngx_http_metrics_header(p, &ngx_http_metrics_event_names[k].name,
+                                    &ngx_http_metrics_event_names[k].help,
+                                    "histogram");
+
+        for (i = 0; i < workers; i++) {
+            w = ctx->sh->workers[i];
+
+            if (w == NULL) {
+                continue;
+            }
+
+            wh = (ngx_stat_histogram_t *)
+                     ((u_char *) &w->event
+                      + ngx_http_metrics_event_names[k].offset);
+
+            labels.len = ngx_sprintf(buf, "worker=\"%ui\"", i) - buf;
+
+            p = ngx_http_metrics_histogram(p,
+                                          &ngx_http_metrics_event_names[k].name,
+                                          &labels, wh);
+        }
+    }
+
+    /* phase handler times are summed over all workers */
+
+    p = ngx_http_metrics_header(p, &ngx_http_metrics_phase_name,
+                                &ngx_http_metrics_phase_help, "histogram");
+
+    for (k = 0; k < NGX_HTTP_LOG_PHASE; k++) {
+
+        ngx_memzero(&h, sizeof(ngx_stat_histogram_t));
+
+        for (i = 0; i < workers; i++) {
+            w = ctx->sh->workers[i];
+
+            if (w == NULL) {
+                continue;
+            }
+
+            ngx_http_metrics_merge(&h, &w->phases[k]);
+        }
+
+        labels.len = ngx_sprintf(buf, "phase=\"%s\"",
+                                 ngx_http_metrics_phase_names[k])
+                     - buf;
+
+        p = ngx_http_metrics_histogram(p, &ngx_http_metrics_phase_name,
+                                       &labels, &h);
+    }
+
+    b->last = p;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_metrics_zones(ngx_http_request_t *r,
+    ngx_http_metrics_main_conf_t *mmcf, ngx_http_metrics_stats_t *stats,
+    ngx_chain_t ***ll)
+{
+    char                       *type;
+    size_t                      size, len;
+    u_char                     *p, *last;
+    ngx_str_t                   labels;
+    ngx_buf_t                  *b;
+    ngx_uint_t                  i, j, k, f, n, lines, upstream;
+    ngx_atomic_uint_t          *counter;
+    ngx_http_metrics_zone_t    *zone;
+    ngx_http_metrics_stats_t   *st;
+    ngx_http_metrics_family_t  *family;
+
+    zone = mmcf->zones.elts;
+
+    len = 0;
+
+    for (i = 0; i < mmcf->zones.nelts; i++) {
+        n = zone[i].name.len
+            + ngx_http_metrics_escape(NULL, zone[i].name.data,
+                                      zone[i].name.len);
+        len = ngx_max(len, n);
+
+        for (k = 0; k < zone[i].npeers; k++) {
+            len = ngx_max(len, n + zone[i].peers[k].len
+                               + ngx_http_metrics_escape(NULL,
+                                                     zone[i].peers[k].data,
+                                                     zone[i].peers[k].len));
+        }
+    }
+
+    labels.data = ngx_pnalloc(r->pool, len + NGX_HTTP_METRICS_LABELS_LEN);
+    if (labels.data == NULL) {
+        return NGX_ERROR;
+    }
+
+    n = sizeof(ngx_http_metrics_families) / sizeof(ngx_http_metrics_family_t);
+
+    for (f = 0; f < n; f++) {
+        family = &ngx_http_metrics_families[f];
+
+        switch (family->type) {
+
+        case NGX_HTTP_METRICS_COUNTER:
+            lines = 1;
+            break;
+
+        case NGX_HTTP_METRICS_RESPONSES:
+            lines = 5;
+            break;
+
+        default: /* NGX_HTTP_METRICS_HISTOGRAM */
+            lines = NGX_STAT_HISTOGRAM_BUCKETS + 2;
+            break;
+        }
+
+        size = 0;
+
+        for (i = 0; i < mmcf->zones.nelts; i++) {
+            upstream = (zone[i].type == NGX_HTTP_METRICS_UPSTREAM);
+
+            if (upstream != family->upstream) {
+                continue;
+            }
+
+            size += (upstream ? zone[i].npeers : 1) * lines
+                    * (NGX_HTTP_METRICS_LINE_LEN + len
+                       + NGX_HTTP_METRICS_LABELS_LEN);
+        }
+
+        if (size == 0) {
+            continue;
+        }
+
+        b = ngx_http_metrics_buf(r, size + NGX_HTTP_METRICS_HEADER_LEN, ll);
+        if (b == NULL) {
+            return NGX_ERROR;
+        }
+
+        p = ngx_http_metrics_header(b->last, &family->name, &family->help,
+                                    family->type == NGX_HTTP_METRICS_HISTOGRAM
+                                    ? "histogram" : "counter");
+
+        for (i = 0; i < mmcf->zones.nelts; i++) {
+            upstream = (zone[i].type == NGX_HTTP_METRICS_UPSTREAM);
+
+            if (upstream != family->upstream) {
+                continue;
+            }
+
+            for (j = 0; j < (upstream ? zone[i].npeers : 1); j++) {
+                st = &stats[zone[i].slot + j];
+
+                if (upstream) {
+                    last = ngx_cpymem(labels.data, "upstream=\"",
+                                      sizeof("upstream=\"") - 1);
+                    last = (u_char *) ngx_http_metrics_escape(last,
+                                                       zone[i].name.data,
+                                                       zone[i].name.len);
+                    last = ngx_cpymem(last, "\",peer=\"",
+                                      sizeof("\",peer=\"") - 1);
+                    last = (u_char *) ngx_http_metrics_escape(last,
+                                                       zone[i].peers[j].data,
+                                                       zone[i].peers[j].len);
+                    *last++ = '"';
+
+                } else {
+                    type = ngx_http_metrics_zone_types[zone[i].type];
+
+                    last = ngx_cpymem(labels.data, "zone=\"",
+                                      sizeof("zone=\"") - 1);
+                    last = (u_char *) ngx_http_metrics_escape(last,
+                                                       zone[i].name.data,
+                                                       zone[i].name.len);
+                    last = ngx_sprintf(last, "\",type=\"%s\"", type);
+                }
+
+                labels.len = last - labels.data;
+
+                counter = (ngx_atomic_uint_t *)
+                              ((u_char *) st + family->offset);
+
+                switch (family->type) {
+
+                case NGX_HTTP_METRICS_COUNTER:
+                    p = ngx_sprintf(p, "%V{%V} %uA\n",
+                                    &family->name, &labels, *counter);
+                    break;
+
+                case NGX_HTTP_METRICS_RESPONSES:
+                    for (k = 0; k < 5; k++) {
+                        p = ngx_sprintf(p, "%V{%V,code=\"%uixx\"} %uA\n",
+                                        &family->name, &labels, k + 1,
+                                        counter[k]);
+                    }
+                    break;
+
+                default: /* NGX_HTTP_METRICS_HISTOGRAM */
+                    p = ngx_http_metrics_histogram(p, &family->name, &labels,
+                                                   (ngx_stat_histogram_t *)
+                                                   counter);
+                    break;
+                }
+            }
+        }
+
+        b->last = p;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_metrics_json(ngx_http_request_t *r,
+    ngx_http_metrics_main_conf_t *mmcf, ngx_http_metrics_stats_t *stats,
+    ngx_chain_t ***ll)
+{
+    size_t                    size;
+    u_char                   *p;
+    ngx_buf_t                *b;
+    ngx_uint_t                i, k, type, first;
+    ngx_http_metrics_zone_t  *zone;
+
+    static char  *sections[] = {
+        "\"server_zones\":{",
+        "\"location_zones\":{",
+        "\"upstreams\":{"
+    };
+
+    zone = mmcf->zones.elts;
+
+    size = sizeof("{\"server_zones\":{},\"location_zones\":{},"
+                  "\"upstreams\":{}}\n");
+
+    for (i = 0; i < mmcf->zones.nelts; i++) {
+        size += sizeof("\"\":{\"peers\":[]},") + zone[i].name.len
+                + ngx_escape_json(NULL, zone[i].name.data, zone[i].name.len)
+                + NGX_HTTP_METRICS_JSON_LEN;
+
+        for (k = 0; k < zone[i].npeers; k++) {
+            size += zone[i].peers[k].len
+                    + ngx_escape_json(NULL, zone[i].peers[k].data,
+                                      zone[i].peers[k].len)
+                    + NGX_HTTP_METRICS_JSON_LEN;
+        }
+    }
+
+    b = ngx_http_metrics_buf(r, size, ll);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = b->last;
+
+    *p++ = '{';
+
+    for (type = 0; type < 3; type++) {
+
+        if (type) {
+            *p++ = ',';
+        }
+
+        p = ngx_cpymem(p, sections[type], ngx_strlen(sections[type]));
+
+        first = 1;
+
+        for (i = 0; i < mmcf->zones.nelts; i++) {
+
+            if (zone[i].type != type) {
+                continue;
+            }
+
+            if (!first) {
+                *p++ = ',';
+            }
+
+            first = 0;
+
+            *p++ = '"';
+            p = (u_char *) ngx_escape_json(p, zone[i].name.data,
+                                           zone[i].name.len);
+            *p++ = '"';
+            *p++ = ':';
+
+            if (type != NGX_HTTP_METRICS_UPSTREAM) {
+                p = ngx_http_metrics_json_stats(p, &stats[zone[i].slot], 0);
+                continue;
+            }
+
+            p = ngx_cpymem(p, "{\"peers\":[", sizeof("{\"peers\":[") - 1);
+
+            for (k = 0; k < zone[i].npeers; k++) {
+
+                if (k) {
+                    *p++ = ',';
+                }
+
+                p = ngx_cpymem(p, "{\"server\":\"",
+                               sizeof("{\"server\":\"") - 1);
+                p = (u_char *) ngx_escape_json(p, zone[i].peers[k].data,
+                                               zone[i].peers[k].len);
+                *p++ = '"';
+                *p++ = ',';
+
+                p = ngx_http_metrics_json_stats(p, &stats[zone[i].slot + k],
+                                                1);
+            }
+
+            *p++ = ']';
+            *p++ = '}';
+        }
+
+        *p++ = '}';
+    }
+
+    /* the object is closed by ngx_http_metrics_json_slabs() */
+
+    b->last = p;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_metrics_slabs(ngx_http_request_t *r, ngx_chain_t ***ll)
+{
+    size_t                    size, len;
+    u_char                   *p;
+    ngx_buf_t                *b;
+    ngx_str_t                 name;
+    ngx_uint_t                i, k, f, n, bytes;
+    ngx_list_part_t          *part;
+    ngx_shm_zone_t           *shm_zone;
+    ngx_slab_pool_t          *pool;
+    ngx_slab_stat_t          *stat;
+    ngx_http_metrics_slab_t  *slab;
+
+    static ngx_str_t  slab_pages = ngx_string("nginx_slab_pages");
+    static ngx_str_t  slab_free_pages = ngx_string("nginx_slab_free_pages");
+    static ngx_str_t  slab_fragmented =
+                                    ngx_string("nginx_slab_fragmented_bytes");
+
+    size = 0;
+    len = 0;
+
+    part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        pool = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+
+        n = shm_zone[i].shm.name.len
+            + ngx_http_metrics_escape(NULL, shm_zone[i].shm.name.data,
+                                      shm_zone[i].shm.name.len);
+        len = ngx_max(len, n);
+
+        size += (3 + 4 * (ngx_pagesize_shift - pool->min_shift))
+                * (NGX_HTTP_METRICS_LINE_LEN + n
+                   + NGX_HTTP_METRICS_LABELS_LEN);
+    }
+
+    if (size == 0) {
+        return NGX_OK;
+    }
+
+    name.data = ngx_pnalloc(r->pool, len);
+    if (name.data == NULL) {
+        return NGX_ERROR;
+    }
+
+    b = ngx_http_metrics_buf(r, size + 7 * NGX_HTTP_METRICS_HEADER_LEN, ll);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = b->last;
+
+    n = sizeof(ngx_http_metrics_slab_names) / sizeof(ngx_http_metrics_slab_t);
+
+    /* zone-wide gauges come first, then per size class ones */
+
+    for (f = 0; f < 3 + n; f++) {
+
+        switch (f) {
+
+        case 0:
+            p = ngx_http_metrics_header(p, &slab_pages,
+                                   &ngx_http_metrics_slab_help[0], "gauge");
+            break;
+
+        case 1:
+            p = ngx_http_metrics_header(p, &slab_free_pages,
+                                   &ngx_http_metrics_slab_help[1], "gauge");
+            break;
+
+        case 2:
+            p = ngx_http_metrics_header(p, &slab_fragmented,
+                                   &ngx_http_metrics_slab_help[2], "gauge");
+            break;
+
+        default:
+            slab = &ngx_http_metrics_slab_names[f - 3];
+
+            p = ngx_http_metrics_header(p, &slab->name, &slab->help,
+                                        slab->type);
+        }
+
+        part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+        shm_zone = part->elts;
+
+        for (i = 0; /* void */ ; i++) {
+
+            if (i >= part->nelts) {
+                if (part->next == NULL) {
+                    break;
+                }
+
+                part = part->next;
+                shm_zone = part->elts;
+                i = 0;
+            }
+
+            name.len = (u_char *) ngx_http_metrics_escape(name.data,
+                                                   shm_zone[i].shm.name.data,
+                                                   shm_zone[i].shm.name.len)
+                       - name.data;
+
+            pool = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+            stat = pool->stats;
+
+            switch (f) {
+
+            case 0:
+                p = ngx_sprintf(p, "%V{zone=\"%V\"} %ui\n", &slab_pages,
+                                &name,
+                                (ngx_uint_t) ((pool->end - pool->start)
+                                              >> ngx_pagesize_shift));
+                continue;
+
+            case 1:
+                p = ngx_sprintf(p, "%V{zone=\"%V\"} %ui\n", &slab_free_pages,
+                                &name, pool->pfree);
+                continue;
+
+            case 2:
+                bytes = 0;
+
+                for (k = 0; k < ngx_pagesize_shift - pool->min_shift; k++) {
+                    bytes += (stat[k].total - stat[k].used)
+                             << (k + pool->min_shift);
+                }
+
+                p = ngx_sprintf(p, "%V{zone=\"%V\"} %ui\n", &slab_fragmented,
+                                &name, bytes);
+                continue;
+            }
+
+            for (k = 0; k < ngx_pagesize_shift - pool->min_shift; k++) {
+                p = ngx_sprintf(p, "%V{zone=\"%V\",size=\"%ui\"} %ui\n",
+                                &slab->name, &name,
+                                (ngx_uint_t) 1 << (k + pool->min_shift),
+                                *(ngx_uint_t *) ((u_char *) &stat[k]
+                                                 + slab->offset));
+            }
+        }
+    }
+
+    b->last = p;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_metrics_json_slabs(ngx_http_request_t *r, ngx_chain_t ***ll)
+{
+    size_t            size;
+    u_char           *p;
+    ngx_buf_t        *b;
+    ngx_uint_t        i, k, first;
+    ngx_list_part_t  *part;
+    ngx_shm_zone_t   *shm_zone;
+    ngx_slab_pool_t  *pool;
+    ngx_slab_stat_t  *stat;
+
+    size = sizeof(",\"slabs\":{}}\n");
+
+    part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        pool = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+
+        size += sizeof("\"\":{\"pages\":,\"free_pages\":,\"slots\":{}},")
+                + shm_zone[i].shm.name.len
+                + ngx_escape_json(NULL, shm_zone[i].shm.name.data,
+                                  shm_zone[i].shm.name.len)
+                + 2 * NGX_INT_T_LEN
+                + (ngx_pagesize_shift - pool->min_shift)
+                  * (sizeof("\"\":{\"total\":,\"used\":,\"reqs\":,"
+                            "\"fails\":},")
+                     + 5 * NGX_INT_T_LEN);
+    }
+
+    b = ngx_http_metrics_buf(r, size, ll);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = ngx_cpymem(b->last, ",\"slabs\":{", sizeof(",\"slabs\":{") - 1);
+
+    first = 1;
+
+    part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        if (!first) {
+            *p++ = ',';
+        }
+
+        first = 0;
+
+        pool = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+        stat = pool->stats;
+
+        *p++ = '"';
+        p = (u_char *) ngx_escape_json(p, shm_zone[i].shm.name.data,
+                                       shm_zone[i].shm.name.len);
+
+        p = ngx_sprintf(p, "\":{\"pages\":%ui,\"free_pages\":%ui,\"slots\":{",
+                        (ngx_uint_t) ((pool->end - pool->start)
+                                      >> ngx_pagesize_shift),
+                        pool->pfree);
+
+        for (k = 0; k < ngx_pagesize_shift - pool->min_shift; k++) {
+
+            if (k) {
+                *p++ = ',';
+            }
+
+            p = ngx_sprintf(p, "\"%ui\":{\"total\":%ui,\"used\":%ui,"
+                            "\"reqs\":%ui,\"fails\":%ui}",
+                            (ngx_uint_t) 1 << (k + pool->min_shift),
+                            stat[k].total, stat[k].used,
+                            stat[k].reqs, stat[k].fails);
+        }
+
+        *p++ = '}';
+        *p++ = '}';
+    }
+
+    *p++ = '}';
+    *p++ = '}';
+    *p++ = LF;
+
+    b->last = p;
+
+    return NGX_OK;
+}
+
+
+static u_char *
+ngx_http_metrics_json_stats(u_char *p, ngx_http_metrics_stats_t *st,
+    ngx_uint_t upstream)
+{
+    ngx_uint_t             i, k, n, count;
+    ngx_stat_histogram_t  *h;
+
+    static char  *times[] = {
+        "request_time",
+        "connect_time",
+        "header_time",
+        "response_time"
+    };
+
+    if (!upstream) {
+        *p++ = '{';
+    }
+
+    p = ngx_sprintf(p, "\"requests\":%uA,\"responses\":{\"1xx\":%uA,"
+                    "\"2xx\":%uA,\"3xx\":%uA,\"4xx\":%uA,\"5xx\":%uA},"
+                    "\"received\":%uA,\"sent\":%uA",
+                    st->requests, st->responses[0], st->responses[1],
+                    st->responses[2], st->responses[3], st->responses[4],
+                    st->received, st->sent);
+
+    n = upstream ? 3 : 1;
+
+    for (i = 0; i < n; i++) {
+        h = &st->times[i];
+
+        count = 0;
+
+        for (k = 0; k < NGX_STAT_HISTOGRAM_BUCKETS; k++) {
+            count += h->buckets[k];
+        }
+
+        p = ngx_sprintf(p, ",\"%s\":{\"count\":%ui,\"sum\":%ui.%06ui}",
+                        times[upstream ? i + 1 : 0], count,
+                        (ngx_uint_t) h->sum / 1000000,
+                        (ngx_uint_t) h->sum % 1000000);
+    }
+
+    *p++ = '}';
+
+    return p;
+}
+
+
+static ngx_http_metrics_stats_t *
+ngx_http_metrics_collect(ngx_http_request_t *r,
+    ngx_http_metrics_main_conf_t *mmcf, ngx_uint_t workers)
+{
+    ngx_uint_t                  i, k, n;
+    ngx_http_metrics_ctx_t     *ctx;
+    ngx_http_metrics_stats_t   *stats, *st, *ws;
+    ngx_http_metrics_worker_t  *w;
+
+    stats = ngx_pcalloc(r->pool,
+                        (mmcf->nstats + 1) * sizeof(ngx_http_metrics_stats_t));
+    if (stats == NULL) {
+        return NULL;
+    }
+
+    ctx = mmcf->shm_zone->data;
+
+    for (i = 0; i < workers; i++) {
+        w = ctx->sh->workers[i];
+
+        /* skip slots left by workers running another configuration */
+
+        if (w == NULL || w->slots == NULL || w->slots->layout != mmcf->layout)
+        {
+            continue;
+        }
+
+        for (n = 0; n < mmcf->nstats; n++) {
+            st = &stats[n];
+            ws = &w->slots->stats[n];
+
+            st->requests += ws->requests;
+
+            for (k = 0; k < 5; k++) {
+                st->responses[k] += ws->responses[k];
+            }
+
+            st->received += ws->received;
+            st->sent += ws->sent;
+
+            for (k = 0; k < 3; k++) {
+                ngx_http_metrics_merge(&st->times[k], &ws->times[k]);
+            }
+        }
+    }
+
+    return stats;
+}
+
+
+static void
+ngx_http_metrics_merge(ngx_stat_histogram_t *dst, ngx_stat_histogram_t *src)
+{
+    ngx_uint_t  i;
+
+    dst->sum += src->sum;
+
+    for (i = 0; i < NGX_STAT_HISTOGRAM_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
+
+
+static uintptr_t
+ngx_http_metrics_escape(u_char *dst, u_char *src, size_t size)
+{
+    u_char      ch;
+    ngx_uint_t  n;
+
+    /* backslashes, double quotes and line feeds are escaped in labels */
+
+    if (dst == NULL) {
+        n = 0;
+
+        while (size) {
+            ch = *src++;
+
+            if (ch == '\\' || ch == '"' || ch == LF) {
+                n++;
+            }
+
+            size--;
+        }
+
+        return (uintptr_t) n;
+    }
+
+    while (size) {
+        ch = *src++;
+
+        switch (ch) {
+
+        case '\\':
+        case '"':
+            *dst++ = '\\';
+            *dst++ = ch;
+            break;
+
+        case LF:
+            *dst++ = '\\';
+            *dst++ = 'n';
+            break;
+
+        default:
+            *dst++ = ch;
+        }
+
+        size--;
+    }
+
+    return (uintptr_t) dst;
+}
+
+
+static ngx_buf_t *
+ngx_http_metrics_buf(ngx_http_request_t *r, size_t size, ngx_chain_t ***ll)
+{
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    b = ngx_create_temp_buf(r->pool, size);
+    if (b == NULL) {
+        return NULL;
+    }
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return NULL;
+    }
+
+    cl->buf = b;
+    cl->next = NULL;
+
+    **ll = cl;
+    *ll = &cl->next;
+
+    return b;
+}
+
+
+static u_char *
+ngx_http_metrics_header(u_char *p, ngx_str_t *name, ngx_str_t *help,
+    char *type)
+{
+    return ngx_sprintf(p, "# HELP %V %V\n# TYPE %V %s\n",
+                       name, help, name, type);
+}
+
+
+static u_char *
+ngx_http_metrics_histogram(u_char *p, ngx_str_t *name, ngx_str_t *labels,
+    ngx_stat_histogram_t *h)
+{
+    ngx_uint_t  i, bound, count;
+
+    count = 0;
+
+    for (i = 0; i < NGX_STAT_HISTOGRAM_BUCKETS - 1; i++) {
+        count += h->buckets[i];
+        bound = ngx_stat_histogram_bound(i);
+
+        p = ngx_sprintf(p, "%V_bucket{%V,le=\"%ui.%06ui\"} %ui\n",
+                        name, labels, bound / 1000000, bound % 1000000, count);
+    }
+
+    /* the counters are updated without locks, make them consistent */
+
+    count += h->buckets[i];
+
+    p = ngx_sprintf(p, "%V_bucket{%V,le=\"+Inf\"} %ui\n",
+                    name, labels, count);
+
+    p = ngx_sprintf(p, "%V_sum{%V} %ui.%06ui\n", name, labels,
+                    (ngx_uint_t) h->sum / 1000000,
+                    (ngx_uint_t) h->sum % 1000000);
+
+    return ngx_sprintf(p, "%V_count{%V} %ui\n", name, labels, count);
+}
+
+
+static ngx_int_t
+ngx_http_metrics_log_handler(ngx_http_request_t *r)
+{
+    ngx_uint_t                      i, k, status;
+    ngx_time_t                     *tp;
+    ngx_msec_int_t                  ms;
+    ngx_http_metrics_zone_t        *zone, *z;
+    ngx_http_metrics_stats_t       *st;
+    ngx_http_upstream_state_t      *state;
+    ngx_http_metrics_srv_conf_t    *mscf;
+    ngx_http_metrics_loc_conf_t    *mlcf;
+    ngx_http_upstream_srv_conf_t   *uscf;
+    ngx_http_metrics_main_conf_t   *mmcf;
+
+    if (ngx_http_metrics_stats == NULL) {
+        return NGX_OK;
+    }
+
+    mmcf = ngx_http_get_module_main_conf(r, ngx_http_metrics_module);
+    mscf = ngx_http_get_module_srv_conf(r, ngx_http_metrics_module);
+    mlcf = ngx_http_get_module_loc_conf(r, ngx_http_metrics_module);
+
+    zone = mmcf->zones.elts;
+
+    if (mscf->zone != NGX_CONF_UNSET_UINT
+        || mlcf->zone != NGX_CONF_UNSET_UINT)
+    {
+        status = r->err_status ? r->err_status : r->headers_out.status;
+
+        tp = ngx_timeofday();
+
+        ms = (ngx_msec_int_t)
+                 ((tp->sec - r->start_sec) * 1000 + (tp->msec - r->start_msec));
+        ms = ngx_max(ms, 0);
+
+        for (i = 0; i < 2; i++) {
+            k = i ? mlcf->zone : mscf->zone;
+
+            if (k == NGX_CONF_UNSET_UINT) {
+                continue;
+            }
+
+            st = &ngx_http_metrics_stats[zone[k].slot];
+
+            ngx_http_metrics_account(st, status, r->request_length,
+                                     r->connection->sent);
+
+            ngx_stat_histogram_add(&st->times[0], ms * 1000);
+        }
+    }
+
+    if (r->upstream == NULL || r->upstream_states == NULL) {
+        return NGX_OK;
+    }
+
+    uscf = r->upstream->upstream;
+
+    /* implicit upstreams have no configuration of their own */
+
+    if (uscf == NULL || uscf->srv_conf == NULL) {
+        return NGX_OK;
+    }
+
+    mscf = ngx_http_conf_upstream_srv_conf(uscf, ngx_http_metrics_module);
+
+    if (mscf->zone == NGX_CONF_UNSET_UINT) {
+        return NGX_OK;
+    }
+
+    z = &zone[mscf->zone];
+
+    state = r->upstream_states->elts;
+
+    for (i = 0; i < r->upstream_states->nelts; i++) {
+
+        if (state[i].peer == NULL) {
+            continue;
+        }
+
+        for (k = 0; k < z->npeers; k++) {
+            if (z->peers[k].len == state[i].peer->len
+                && ngx_strncmp(z->peers[k].data, state[i].peer->data,
+                               z->peers[k].len)
+                   == 0)
+            {
+                break;
+            }
+        }
+
+        if (k == z->npeers) {
+            continue;
+        }
+
+        st = &ngx_http_metrics_stats[z->slot + k];
+
+        ngx_http_metrics_account(st, state[i].status,
+                                 state[i].bytes_received,
+                                 state[i].bytes_sent);
+
+        if (state[i].connect_time != (ngx_msec_t) -1) {
+            ngx_stat_histogram_add(&st->times[0],
+                                   state[i].connect_time * 1000);
+        }
+
+        if (state[i].header_time != (ngx_msec_t) -1) {
+            ngx_stat_histogram_add(&st->times[1],
+                                   state[i].header_time * 1000);
+        }
+
+        if (state[i].response_time != (ngx_msec_t) -1) {
+            ngx_stat_histogram_add(&st->times[2],
+                                   state[i].response_time * 1000);
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_metrics_account(ngx_http_metrics_stats_t *st, ngx_uint_t status,
+    off_t received, off_t sent)
+{
+    /* an old worker may still update the same slot after a reload */
+
+    (void) ngx_atomic_fetch_add(&st->requests, 1);
+
+    if (status >= 100 && status < 600) {
+        (void) ngx_atomic_fetch_add(&st->responses[status / 100 - 1], 1);
+    }
+
+    (void) ngx_atomic_fetch_add(&st->received, (ngx_atomic_int_t) received);
+    (void) ngx_atomic_fetch_add(&st->sent, (ngx_atomic_int_t) sent);
+}
+
+
+static ngx_int_t
+ngx_http_metrics_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_http_metrics_ctx_t  *octx = data;
+
+    size_t                   len;
+    ngx_http_metrics_ctx_t  *ctx;
+
+    ctx = shm_zone->data;
+
+    if (octx) {
+        ctx->sh = octx->sh;
+        ctx->shpool = octx->shpool;
+
+        return NGX_OK;
+    }
+
+    ctx->shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (shm_zone->shm.exists) {
+        ctx->sh = ctx->shpool->data;
+
+        return NGX_OK;
+    }
+
+    ctx->sh = ngx_slab_calloc(ctx->shpool, sizeof(ngx_http_metrics_shctx_t));
+    if (ctx->sh == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->shpool->data = ctx->sh;
+
+    ngx_queue_init(&ctx->sh->slots);
+
+    len = sizeof(" in metrics zone \"\"") + shm_zone->shm.name.len;
+
+    ctx->shpool->log_ctx = ngx_slab_alloc(ctx->shpool, len);
+    if (ctx->shpool->log_ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_sprintf(ctx->shpool->log_ctx, " in metrics zone \"%V\"%Z",
+                &shm_zone->shm.name);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_metrics_init(ngx_conf_t *cf)
+{
+    u_char                         type;
+    ngx_uint_t                     i, j, k;
+    ngx_http_handler_pt           *h;
+    ngx_http_metrics_zone_t       *zone;
+    ngx_http_core_main_conf_t     *cmcf;
+    ngx_http_upstream_server_t    *server;
+    ngx_http_metrics_main_conf_t  *mmcf;
+
+    mmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_metrics_module);
+
+    if (mmcf->zones.nelts == 0) {
+        return NGX_OK;
+    }
+
+    if (mmcf->shm_zone == NULL) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"status_zone\" requires "
+                           "the \"metrics_zone\" directive");
+        return NGX_ERROR;
+    }
+
+    /*
+     * upstream peers are known after the upstream module initialized
+     * its main configuration; the layout checksum lets readers skip
+     * worker slots filled according to another configuration
+     */
+
+    ngx_crc32_init(mmcf->layout);
+
+    zone = mmcf->zones.elts;
+
+    for (i = 0; i < mmcf->zones.nelts; i++) {
+        zone[i].slot = mmcf->nstats;
+
+        type = (u_char) zone[i].type;
+
+        ngx_crc32_update(&mmcf->layout, &type, 1);
+        ngx_crc32_update(&mmcf->layout, zone[i].name.data, zone[i].name.len);
+
+        if (zone[i].type != NGX_HTTP_METRICS_UPSTREAM) {
+            mmcf->nstats++;
+            continue;
+        }
+
+        server = zone[i].upstream->servers->elts;
+
+        for (j = 0; j < zone[i].upstream->servers->nelts; j++) {
+            zone[i].npeers += server[j].naddrs;
+        }
+
+        zone[i].peers = ngx_palloc(cf->pool,
+                                   zone[i].npeers * sizeof(ngx_str_t));
+        if (zone[i].peers == NULL) {
+            return NGX_ERROR;
+        }
+
+        zone[i].npeers = 0;
+
+        for (j = 0; j < zone[i].upstream->servers->nelts; j++) {
+            for (k = 0; k < server[j].naddrs; k++) {
+                zone[i].peers[zone[i].npeers++] = server[j].addrs[k].name;
+
+                ngx_crc32_update(&mmcf->layout, server[j].addrs[k].name.data,
+                                 server[j].addrs[k].name.len);
+            }
+        }
+
+        mmcf->nstats += zone[i].npeers;
+    }
+
+    ngx_crc32_final(mmcf->layout);
+
+    cmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_core_module);
+
+    h = ngx_array_push(&cmcf->phases[NGX_HTTP_LOG_PHASE].handlers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    *h = ngx_http_metrics_log_handler;
+
+    return NGX_OK;
+}
+
+
+static void *
+ngx_http_metrics_create_main_conf(ngx_conf_t *cf)
+{
+    ngx_http_metrics_main_conf_t  *mmcf;
+
+    mmcf = ngx_pcalloc(cf->pool, sizeof(ngx_http_metrics_main_conf_t));
+    if (mmcf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     mmcf->shm_zone = NULL;
+     *     mmcf->nstats = 0;
+     *     mmcf->layout = 0;
+     */
+
+    if (ngx_array_init(&mmcf->zones, cf->pool, 4,
+                       sizeof(ngx_http_metrics_zone_t))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    return mmcf;
+}
+
+
+static void *
+ngx_http_metrics_create_srv_conf(ngx_conf_t *cf)
+{
+    ngx_http_metrics_srv_conf_t  *mscf;
+
+    mscf = ngx_palloc(cf->pool, sizeof(ngx_http_metrics_srv_conf_t));
+    if (mscf == NULL) {
+        return NULL;
+    }
+
+    mscf->zone = NGX_CONF_UNSET_UINT;
+
+    return mscf;
+}
+
+
+static void *
+ngx_http_metrics_create_loc_conf(ngx_conf_t *cf)
+{
+    ngx_http_metrics_loc_conf_t  *mlcf;
+
+    mlcf = ngx_palloc(cf->pool, sizeof(ngx_http_metrics_loc_conf_t));
+    if (mlcf == NULL) {
+        return NULL;
+    }
+
+    mlcf->zone = NGX_CONF_UNSET_UINT;
+    mlcf->format = NGX_CONF_UNSET_UINT;
+
+    return mlcf;
+}
+
+
+static char *
+ngx_http_metrics_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_http_metrics_loc_conf_t *prev = parent;
+    ngx_http_metrics_loc_conf_t *conf = child;
+
+    ngx_conf_merge_uint_value(conf->zone, prev->zone, NGX_CONF_UNSET_UINT);
+    ngx_conf_merge_uint_value(conf->format, prev->format,
+                              NGX_HTTP_METRICS_PROMETHEUS);
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_metrics_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_metrics_main_conf_t *mmcf = conf;
+
+    ssize_t                  size;
+    ngx_str_t               *value, name;
+    ngx_http_metrics_ctx_t  *ctx;
+
+    if (mmcf->shm_zone) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    size = ngx_parse_size(&value[1]);
+
+    if (size == NGX_ERROR) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid zone size \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    if (size < (ssize_t) (8 * ngx_pagesize)) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "zone \"%V\" is too small", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    ctx = ngx_pcalloc(cf->pool, sizeof(ngx_http_metrics_ctx_t));
+    if (ctx == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_str_set(&name, "metrics");
+
+    mmcf->shm_zone = ngx_shared_memory_add(cf, &name, size,
+                                           &ngx_http_metrics_module);
+    if (mmcf->shm_zone == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    mmcf->shm_zone->init = ngx_http_metrics_init_zone;
+    mmcf->shm_zone->data = ctx;
+
+    if (cf->args->nelts == 3) {
+        if (ngx_strcmp(value[2].data, "hugepages") != 0) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid parameter \"%V\"", &value[2]);
+            return NGX_CONF_ERROR;
+        }
+
+        mmcf->shm_zone->shm.hugepages = 1;
+    }
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_metrics(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_metrics_loc_conf_t *mlcf = conf;
+
+    ngx_str_t                     *value;
+    ngx_http_core_loc_conf_t      *clcf;
+    ngx_http_metrics_main_conf_t  *mmcf;
+
+    mmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_metrics_module);
+
+    if (mmcf->shm_zone == NULL) {
+        return "requires the \"metrics_zone\" directive";
+    }
+
+    if (cf->args->nelts == 2) {
+        value = cf->args->elts;
+
+        if (ngx_strcmp(value[1].data, "json") == 0) {
+            mlcf->format = NGX_HTTP_METRICS_JSON;
+
+        } else if (ngx_strcmp(value[1].data, "prometheus") == 0) {
+            mlcf->format = NGX_HTTP_METRICS_PROMETHEUS;
+
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid parameter \"%V\"", &value[1]);
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+    clcf->handler = ngx_http_metrics_handler;
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_metrics_status_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_str_t                     *value;
+    ngx_uint_t                     i, type, *index;
+    ngx_http_metrics_zone_t       *zone;
+    ngx_http_metrics_srv_conf_t   *mscf;
+    ngx_http_metrics_loc_conf_t   *mlcf;
+    ngx_http_metrics_main_conf_t  *mmcf;
+
+    if (cf->cmd_type == NGX_HTTP_LOC_CONF) {
+        mlcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_metrics_module);
+
+        type = NGX_HTTP_METRICS_LOCATION;
+        index = &mlcf->zone;
+
+    } else {
+        mscf = ngx_http_conf_get_module_srv_conf(cf, ngx_http_metrics_module);
+
+        type = (cf->cmd_type == NGX_HTTP_UPS_CONF) ? NGX_HTTP_METRICS_UPSTREAM
+                                                   : NGX_HTTP_METRICS_SERVER;
+        index = &mscf->zone;
+    }
+
+    if (*index != NGX_CONF_UNSET_UINT) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    mmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_metrics_module);
+
+    zone = mmcf->zones.elts;
+
+    for (i = 0; i < mmcf->zones.nelts; i++) {
+
+        if (zone[i].type != type
+            || zone[i].name.len != value[1].len
+            || ngx_strncmp(zone[i].name.data, value[1].data, value[1].len)
+               != 0)
+        {
+            continue;
+        }
+
+        if (type == NGX_HTTP_METRICS_UPSTREAM) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "status zone \"%V\" is already used "
+                               "by another upstream", &value[1]);
+            return NGX_CONF_ERROR;
+        }
+
+        *index = i;
+
+        return NGX_CONF_OK;
+    }
+
+    zone = ngx_array_push(&mmcf->zones);
+    if (zone == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_memzero(zone, sizeof(ngx_http_metrics_zone_t));
+
+    zone->name = value[1];
+    zone->type = type;
+
+    if (type == NGX_HTTP_METRICS_UPSTREAM) {
+        zone->upstream = ngx_http_conf_get_module_srv_conf(cf,
+                                                     ngx_http_upstream_module);
+    }
+
+    *index = i;
+
+    return NGX_CONF_OK;
+}
+
+
+static ngx_int_t
+ngx_http_metrics_init_process(ngx_cycle_t *cycle)
+{
+    size_t                         size;
+    ngx_uint_t                     i;
+    ngx_http_metrics_ctx_t        *ctx;
+    ngx_http_metrics_slots_t      *slots;
+    ngx_http_metrics_worker_t     *w;
+    ngx_http_metrics_main_conf_t  *mmcf;
+
+    if (ngx_process != NGX_PROCESS_WORKER
+        && ngx_process != NGX_PROCESS_SINGLE)
+    {
+        return NGX_OK;
+    }
+
+    mmcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_metrics_module);
+
+    if (mmcf == NULL || mmcf->shm_zone == NULL) {
+        return NGX_OK;
+    }
+
+    ctx = mmcf->shm_zone->data;
+
+    /* the worker slot is kept across reloads */
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+
+    w = ctx->sh->workers[ngx_worker];
+
+    if (w == NULL) {
+        w = ngx_slab_calloc_locked(ctx->shpool,
+                                   sizeof(ngx_http_metrics_worker_t));
+        ctx->sh->workers[ngx_worker] = w;
+    }
+
+    slots = NULL;
+
+    if (w && mmcf->nstats) {
+        slots = w->slots;
+
+        /*
+         * status zones are kept if the configuration did not change them,
+         * otherwise the old ones are freed here or, if an old worker still
+         * uses them, when it exits
+         */
+
+        if (slots && slots->layout != mmcf->layout) {
+            w->slots = NULL;
+            slots = NULL;
+        }
+
+        ngx_http_metrics_free_slots(ctx);
+
+        i = 0;
+
+        if (slots) {
+            while (i < NGX_HTTP_METRICS_OWNERS && slots->owners[i]) {
+                i++;
+            }
+
+            if (i == NGX_HTTP_METRICS_OWNERS) {
+
+                /* too many old workers are still running */
+
+                w->slots = NULL;
+                slots = NULL;
+                i = 0;
+            }
+        }
+
+        if (slots == NULL) {
+            size = sizeof(ngx_http_metrics_slots_t)
+                   + mmcf->nstats * sizeof(ngx_http_metrics_stats_t);
+
+            slots = ngx_slab_calloc_locked(ctx->shpool, size);
+
+            if (slots) {
+                slots->worker = ngx_worker;
+                slots->layout = mmcf->layout;
+                slots->stats = (ngx_http_metrics_stats_t *) &slots[1];
+                ngx_queue_insert_tail(&ctx->sh->slots, &slots->queue);
+                w->slots = slots;
+            }
+        }
+
+        if (slots) {
+            slots->owners[i] = ngx_pid;
+        }
+    }
+
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+
+    if (w == NULL) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                      "could not allocate metrics of worker %ui, "
+                      "metrics_zone is too small", ngx_worker);
+        return NGX_OK;
+    }
+
+    ngx_event_metrics = &w->event;
+    ngx_http_metrics_phases = w->phases;
+
+    if (mmcf->nstats == 0) {
+        return NGX_OK;
+    }
+
+    if (slots == NULL) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                      "could not allocate status zones of worker %ui, "
+                      "metrics_zone is too small", ngx_worker);
+        return NGX_OK;
+    }
+
+    ngx_http_metrics_slots = slots;
+    ngx_http_metrics_stats = slots->stats;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_metrics_exit_process(ngx_cycle_t *cycle)
+{
+    ngx_uint_t                     i;
+    ngx_http_metrics_ctx_t        *ctx;
+    ngx_http_metrics_slots_t      *slots;
+    ngx_http_metrics_main_conf_t  *mmcf;
+
+    slots = ngx_http_metrics_slots;
+
+    if (slots == NULL) {
+        return;
+    }
+
+    ngx_http_metrics_slots = NULL;
+    ngx_http_metrics_stats = NULL;
+
+    mmcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_metrics_module);
+
+    ctx = mmcf->shm_zone->data;
+
+    ngx_shmtx_lock(&ctx->shpool->mutex);
+
+    for (i = 0; i < NGX_HTTP_METRICS_OWNERS; i++) {
+        if (slots->owners[i] == ngx_pid) {
+            slots->owners[i] = 0;
+        }
+    }
+
+    ngx_http_metrics_free_slots(ctx);
+
+    ngx_shmtx_unlock(&ctx->shpool->mutex);
+}
+
+
+/*
+ * called with the zone locked; status zones replaced by a new worker are
+ * freed once they have no live owners, and owners which exited without
+ * releasing the zones, that is, crashed, are dropped
+ */
+
+static void
+ngx_http_metrics_free_slots(ngx_http_metrics_ctx_t *ctx)
+{
+    ngx_uint_t                 i, n;
+    ngx_queue_t               *q, *next;
+    ngx_http_metrics_slots_t  *slots;
+
+    for (q = ngx_queue_head(&ctx->sh->slots);
+         q != ngx_queue_sentinel(&ctx->sh->slots);
+         q = next)
+    {
+        next = ngx_queue_next(q);
+        slots = ngx_queue_data(q, ngx_http_metrics_slots_t, queue);
+
+        n = 0;
+
+        for (i = 0; i < NGX_HTTP_METRICS_OWNERS; i++) {
+
+            if (slots->owners[i] == 0) {
+                continue;
+            }
+
+#if !(NGX_WIN32)
+            if (kill(slots->owners[i], 0) == -1 && ngx_errno == NGX_ESRCH) {
+                slots->owners[i] = 0;
+                continue;
+            }
+#endif
+
+            n++;
+        }
+
+        if (n == 0 && ctx->sh->workers[slots->worker]->slots != slots) {
+            ngx_queue_remove(q);
+            ngx_slab_free_locked(ctx->shpool, slots);
+        }
+    }
+}
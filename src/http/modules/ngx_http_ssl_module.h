@@ -48,16 +48,23 @@ typedef struct {
     ngx_str_t                       ciphers;
 
     ngx_array_t                    *passwords;
+    ngx_ssl_cache_t                *certificate_cache;
 
     ngx_shm_zone_t                 *shm_zone;
 
     ngx_flag_t                      session_tickets;
     ngx_array_t                    *session_ticket_keys;
+    time_t                          session_ticket_key_check;
 
     ngx_flag_t                      stapling;
     ngx_flag_t                      stapling_verify;
     ngx_str_t                       stapling_file;
     ngx_str_t                       stapling_responder;
+    ngx_shm_zone_t                 *stapling_cache;
+
+#if (NGX_THREADS)
+    ngx_thread_pool_t              *handshake_pool;
+#endif
 
     u_char                         *file;
     ngx_uint_t                      line;
@@ -10,6 +10,9 @@
 #include <ngx_http.h>
 
 
+#define NGX_HTTP_SUB_AC_PATTERNS  4
+
+
 typedef struct {
     ngx_http_complex_value_t   match;
     ngx_http_complex_value_t   value;
@@ -28,6 +31,8 @@ typedef struct {
 
     u_char                     index[257];
     u_char                     shift[256];
+
+    ngx_ac_t                  *ac;
 } ngx_http_sub_tables_t;
 
 
@@ -72,6 +77,10 @@ typedef struct {
     ngx_int_t                  offset;
     ngx_uint_t                 index;
 
+    uint32_t                   state;
+    ngx_int_t                  start;
+    ngx_uint_t                 pending;   /* unsigned  pending:1 */
+
     ngx_http_sub_tables_t     *tables;
     ngx_array_t               *matches;
 } ngx_http_sub_ctx_t;
@@ -84,6 +93,8 @@ static ngx_int_t ngx_http_sub_output(ngx_http_request_t *r,
     ngx_http_sub_ctx_t *ctx);
 static ngx_int_t ngx_http_sub_parse(ngx_http_request_t *r,
     ngx_http_sub_ctx_t *ctx, ngx_uint_t flush);
+static ngx_int_t ngx_http_sub_ac_parse(ngx_http_request_t *r,
+    ngx_http_sub_ctx_t *ctx);
 static ngx_int_t ngx_http_sub_match(ngx_http_sub_ctx_t *ctx, ngx_int_t start,
     ngx_str_t *m);
 
@@ -92,8 +103,8 @@ static char * ngx_http_sub_filter(ngx_conf_t *cf, ngx_command_t *cmd,
 static void *ngx_http_sub_create_conf(ngx_conf_t *cf);
 static char *ngx_http_sub_merge_conf(ngx_conf_t *cf,
     void *parent, void *child);
-static void ngx_http_sub_init_tables(ngx_http_sub_tables_t *tables,
-    ngx_http_sub_match_t *match, ngx_uint_t n);
+static ngx_int_t ngx_http_sub_init_tables(ngx_pool_t *pool,
+    ngx_http_sub_tables_t *tables, ngx_http_sub_match_t *match, ngx_uint_t n);
 static ngx_int_t ngx_http_sub_cmp_matches(const void *one, const void *two);
 static ngx_int_t ngx_http_sub_filter_init(ngx_conf_t *cf);
 
@@ -244,23 +255,30 @@ ngx_http_sub_header_filter(ngx_http_request_t *r)
             return NGX_ERROR;
         }
 
-        ngx_http_sub_init_tables(ctx->tables, ctx->matches->elts,
-                                 ctx->matches->nelts);
+        if (ngx_http_sub_init_tables(r->pool, ctx->tables, ctx->matches->elts,
+                                     ctx->matches->nelts)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
     }
 
-    ctx->saved.data = ngx_pnalloc(r->pool, ctx->tables->max_match_len - 1);
+    ctx->saved.data = ngx_pnalloc(r->pool, ctx->tables->max_match_len);
     if (ctx->saved.data == NULL) {
         return NGX_ERROR;
     }
 
-    ctx->looked.data = ngx_pnalloc(r->pool, ctx->tables->max_match_len - 1);
+    ctx->looked.data = ngx_pnalloc(r->pool, ctx->tables->max_match_len);
     if (ctx->looked.data == NULL) {
         return NGX_ERROR;
     }
 
     ngx_http_set_ctx(r, ctx, ngx_http_sub_filter_module);
 
-    ctx->offset = ctx->tables->min_match_len - 1;
+    if (ctx->tables->ac == NULL) {
+        ctx->offset = ctx->tables->min_match_len - 1;
+    }
+
     ctx->last_out = &ctx->out;
 
     r->filter_need_in_memory = 1;
@@ -350,8 +368,13 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 
         b = NULL;
 
-        while (ctx->pos < ctx->buf->last) {
+        /* a pending match is completed at the end of data */
 
+        while (ctx->pos < ctx->buf->last
+               || ((ctx->buf->last_buf || ctx->buf->last_in_chain)
+                   && (ctx->pending || ctx->offset < 0)
+                   && ctx->tables->ac))
+        {
             rc = ngx_http_sub_parse(r, ctx, last);
 
             ngx_log_debug4(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -494,6 +517,7 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             ctx->last_out = &cl->next;
 
             ctx->looked.len = 0;
+            ctx->state = 0;
         }
 
         if (ctx->buf->last_buf || ctx->buf->flush || ctx->buf->sync
@@ -615,6 +639,10 @@ ngx_http_sub_parse(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx,
     ngx_http_sub_tables_t    *tables;
     ngx_http_sub_loc_conf_t  *slcf;
 
+    if (ctx->tables->ac) {
+        return ngx_http_sub_ac_parse(r, ctx);
+    }
+
     slcf = ngx_http_get_module_loc_conf(r, ngx_http_sub_filter_module);
     tables = ctx->tables;
     match = ctx->matches->elts;
@@ -740,6 +768,160 @@ done:
 }
 
 
+/*
+ * all patterns are matched in one pass; of matches the leftmost one wins,
+ * and of matches at the same position the first configured one, so a match
+ * found is kept pending while a match starting earlier is still possible
+ */
+
+static ngx_int_t
+ngx_http_sub_ac_parse(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx)
+{
+    u_char                   *p, c;
+    uint32_t                  state, m;
+    ngx_int_t                 offset, start, next, end, len, k, rc;
+    ngx_uint_t                i, shift;
+    ngx_ac_t                 *ac;
+    ngx_http_sub_match_t     *match;
+    ngx_http_sub_tables_t    *tables;
+    ngx_http_sub_loc_conf_t  *slcf;
+
+    slcf = ngx_http_get_module_loc_conf(r, ngx_http_sub_filter_module);
+    tables = ctx->tables;
+    ac = tables->ac;
+    match = ctx->matches->elts;
+
+    offset = ctx->offset;
+    end = ctx->buf->last - ctx->pos;
+    state = ctx->state;
+
+    if (ctx->once) {
+        offset = end;
+        state = 0;
+    }
+
+    while (offset < end) {
+
+        if (state == 0) {
+
+            /* skip positions where no match may start */
+
+            while (offset + (ngx_int_t) tables->min_match_len <= end) {
+                k = offset + (ngx_int_t) tables->min_match_len - 1;
+
+                c = k < 0 ? ctx->looked.data[ctx->looked.len + k]
+                          : ctx->pos[k];
+
+                shift = tables->shift[ngx_tolower(c)];
+                if (shift == 0) {
+                    break;
+                }
+
+                offset += shift;
+            }
+
+            if (offset == end) {
+                break;
+            }
+        }
+
+        c = offset < 0 ? ctx->looked.data[ctx->looked.len + offset]
+                       : ctx->pos[offset];
+
+        state = ngx_ac_next(ac, state, c);
+        offset++;
+
+        for (m = ngx_ac_output(ac, state); m; m = ac->dict[m]) {
+
+            for (k = ac->match[m]; k != NGX_AC_NONE;
+                 k = ngx_ac_pattern(ac, k)->next)
+            {
+                i = ngx_ac_pattern(ac, k)->id;
+
+                if (slcf->once && ctx->sub && ctx->sub[i].data) {
+                    continue;
+                }
+
+                start = offset - (ngx_int_t) match[i].match.len;
+
+                if (!ctx->pending
+                    || start < ctx->start
+                    || (start == ctx->start && i < ctx->index))
+                {
+                    ctx->pending = 1;
+                    ctx->start = start;
+                    ctx->index = i;
+                }
+            }
+        }
+
+        if (ctx->pending
+            && ctx->start < offset - (ngx_int_t) ac->depth[state])
+        {
+            goto found;
+        }
+    }
+
+    if (ctx->pending && (ctx->buf->last_buf || ctx->buf->last_in_chain)) {
+        goto found;
+    }
+
+    /* keep the longest suffix which may start a match */
+
+    ctx->offset = offset;
+    ctx->state = state;
+    start = offset - (ngx_int_t) ac->depth[state];
+    next = start;
+    rc = NGX_AGAIN;
+
+    goto done;
+
+found:
+
+    /* the rest after the match is scanned again */
+
+    start = ctx->start;
+    next = start + (ngx_int_t) match[ctx->index].match.len;
+    end = ngx_max(next, 0);
+
+    ctx->offset = next;
+    ctx->state = 0;
+    ctx->pending = 0;
+    rc = NGX_OK;
+
+done:
+
+    /* send [ - looked.len, start ] to client */
+
+    ctx->saved.len = ctx->looked.len + ngx_min(start, 0);
+    ngx_memcpy(ctx->saved.data, ctx->looked.data, ctx->saved.len);
+
+    ctx->copy_start = ctx->pos;
+    ctx->copy_end = ctx->pos + ngx_max(start, 0);
+
+    /* save [ next, end ] in looked */
+
+    len = ngx_min(next, 0);
+    p = ctx->looked.data;
+    p = ngx_movemem(p, p + ctx->looked.len + len, - len);
+
+    len = ngx_max(next, 0);
+    p = ngx_cpymem(p, ctx->pos + len, end - len);
+    ctx->looked.len = p - ctx->looked.data;
+
+    /* update position */
+
+    ctx->pos += end;
+    ctx->offset -= end;
+
+    if (ctx->pending) {
+        ctx->start -= end;
+    }
+
+    return rc;
+}
+
+
 static ngx_int_t
 ngx_http_sub_match(ngx_http_sub_ctx_t *ctx, ngx_int_t start, ngx_str_t *m)
 {
@@ -936,16 +1118,20 @@ ngx_http_sub_merge_conf(ngx_conf_t *cf, void *parent, void *child)
             return NGX_CONF_ERROR;
         }
 
-        ngx_http_sub_init_tables(conf->tables, conf->matches->elts,
-                                 conf->matches->nelts);
+        if (ngx_http_sub_init_tables(cf->pool, conf->tables,
+                                     conf->matches->elts, conf->matches->nelts)
+            != NGX_OK)
+        {
+            return NGX_CONF_ERROR;
+        }
     }
 
     return NGX_CONF_OK;
 }
 
 
-static void
-ngx_http_sub_init_tables(ngx_http_sub_tables_t *tables,
+static ngx_int_t
+ngx_http_sub_init_tables(ngx_pool_t *pool, ngx_http_sub_tables_t *tables,
     ngx_http_sub_match_t *match, ngx_uint_t n)
 {
     u_char      c;
@@ -986,6 +1172,31 @@ ngx_http_sub_init_tables(ngx_http_sub_tables_t *tables,
     while (ch < 257) {
         tables->index[ch++] = (u_char) n;
     }
+
+    tables->ac = NULL;
+
+    if (n < NGX_HTTP_SUB_AC_PATTERNS) {
+        return NGX_OK;
+    }
+
+    /*
+     * the sort above is stable and patterns which may match at the same
+     * position have the same character at min_match_len - 1, so for them
+     * the index still follows the configuration order
+     */
+
+    tables->ac = ngx_ac_create(pool, n, 1);
+    if (tables->ac == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (ngx_ac_add(tables->ac, &match[i].match, i) == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+    }
+
+    return ngx_ac_compile(tables->ac);
 }
 
 
@@ -0,0 +1,1068 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include <zstd.h>
+
+
+typedef struct {
+    ngx_str_t               name;
+    ngx_str_t               data;
+    u_char                  hash[32];
+    ngx_str_t               available;
+} ngx_http_zstd_dict_t;
+
+
+typedef struct {
+    ngx_flag_t              enable;
+
+    ngx_hash_t              types;
+
+    ngx_bufs_t              bufs;
+
+    ngx_int_t               level;
+    ssize_t                 min_length;
+
+    ngx_http_zstd_dict_t   *dict;
+    ZSTD_CDict             *cdict;
+
+    ngx_array_t            *types_keys;
+} ngx_http_zstd_conf_t;
+
+
+typedef struct {
+    ngx_chain_t            *in;
+    ngx_chain_t            *free;
+    ngx_chain_t            *busy;
+    ngx_chain_t            *out;
+    ngx_chain_t           **last_out;
+
+    ngx_buf_t              *in_buf;
+    ngx_buf_t              *out_buf;
+    ngx_int_t               bufs;
+
+    ZSTD_CCtx              *cctx;
+    ZSTD_EndDirective       directive;
+
+    ZSTD_inBuffer           input;
+    ZSTD_outBuffer          output;
+
+    unsigned                dictionary:1;
+    unsigned                started:1;
+    unsigned                redo:1;
+    unsigned                done:1;
+    unsigned                nomem:1;
+
+    ngx_http_request_t     *request;
+} ngx_http_zstd_ctx_t;
+
+
+static ngx_int_t ngx_http_zstd_dictionary_ok(ngx_http_request_t *r,
+    ngx_http_zstd_conf_t *conf);
+static ngx_int_t ngx_http_zstd_filter_start(ngx_http_request_t *r,
+    ngx_http_zstd_ctx_t *ctx);
+static ngx_int_t ngx_http_zstd_filter_add_data(ngx_http_request_t *r,
+    ngx_http_zstd_ctx_t *ctx);
+static ngx_int_t ngx_http_zstd_filter_get_buf(ngx_http_request_t *r,
+    ngx_http_zstd_ctx_t *ctx);
+static ngx_int_t ngx_http_zstd_filter_compress(ngx_http_request_t *r,
+    ngx_http_zstd_ctx_t *ctx);
+static ngx_int_t ngx_http_zstd_filter_end(ngx_http_request_t *r,
+    ngx_http_zstd_ctx_t *ctx);
+static void ngx_http_zstd_cleanup_cctx(void *data);
+
+static ngx_int_t ngx_http_zstd_filter_init(ngx_conf_t *cf);
+static void *ngx_http_zstd_create_conf(ngx_conf_t *cf);
+static char *ngx_http_zstd_merge_conf(ngx_conf_t *cf,
+    void *parent, void *child);
+#if (NGX_OPENSSL)
+static char *ngx_http_zstd_dictionary(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static ngx_int_t ngx_http_zstd_dictionary_read(ngx_conf_t *cf,
+    ngx_http_zstd_dict_t *dict);
+static void ngx_http_zstd_cleanup_cdict(void *data);
+#endif
+
+
+static ngx_conf_num_bounds_t  ngx_http_zstd_comp_level_bounds = {
+    ngx_conf_check_num_bounds, 1, 19
+};
+
+
+static ngx_command_t  ngx_http_zstd_filter_commands[] = {
+
+    { ngx_string("zstd"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_HTTP_LIF_CONF
+                        |NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_zstd_conf_t, enable),
+      NULL },
+
+    { ngx_string("zstd_buffers"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE2,
+      ngx_conf_set_bufs_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_zstd_conf_t, bufs),
+      NULL },
+
+    { ngx_string("zstd_types"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+      ngx_http_types_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_zstd_conf_t, types_keys),
+      &ngx_http_html_default_types[0] },
+
+    { ngx_string("zstd_comp_level"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_zstd_conf_t, level),
+      &ngx_http_zstd_comp_level_bounds },
+
+    { ngx_string("zstd_min_length"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_zstd_conf_t, min_length),
+      NULL },
+
+#if (NGX_OPENSSL)
+
+    { ngx_string("zstd_dictionary"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_zstd_dictionary,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+#endif
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_zstd_filter_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    ngx_http_zstd_filter_init,             /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    NULL,                                  /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    ngx_http_zstd_create_conf,             /* create location configuration */
+    ngx_http_zstd_merge_conf               /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_zstd_filter_module = {
+    NGX_MODULE_V1,
+    &ngx_http_zstd_filter_module_ctx,      /* module context */
+    ngx_http_zstd_filter_commands,         /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+/*
+ * the "dcz" stream starts with a skippable frame of 32 bytes,
+ * which holds the SHA-256 hash of the dictionary
+ */
+
+static u_char  ngx_http_zstd_dcz_header[] = {
+    0x5e, 0x2a, 0x4d, 0x18, 0x20, 0x00, 0x00, 0x00
+};
+
+
+static ngx_http_output_header_filter_pt  ngx_http_next_header_filter;
+static ngx_http_output_body_filter_pt    ngx_http_next_body_filter;
+
+
+static ngx_int_t
+ngx_http_zstd_header_filter(ngx_http_request_t *r)
+{
+    ngx_uint_t                 dictionary;
+    ngx_table_elt_t           *h;
+    ngx_http_zstd_ctx_t       *ctx;
+    ngx_http_zstd_conf_t      *conf;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_zstd_filter_module);
+
+    if (!conf->enable
+        || (r->headers_out.status != NGX_HTTP_OK
+            && r->headers_out.status != NGX_HTTP_FORBIDDEN
+            && r->headers_out.status != NGX_HTTP_NOT_FOUND)
+        || (r->headers_out.content_encoding
+            && r->headers_out.content_encoding->value.len)
+        || (r->headers_out.content_length_n != -1
+            && r->headers_out.content_length_n < conf->min_length)
+        || ngx_http_test_content_type(r, &conf->types) == NULL
+        || r->header_only)
+    {
+        return ngx_http_next_header_filter(r);
+    }
+
+    r->gzip_vary = 1;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    if (conf->dict && clcf->gzip_vary) {
+        h = ngx_list_push(&r->headers_out.headers);
+        if (h == NULL) {
+            return NGX_ERROR;
+        }
+
+        h->hash = 1;
+        ngx_str_set(&h->key, "Vary");
+        ngx_str_set(&h->value, "Available-Dictionary");
+    }
+
+#if (NGX_HTTP_DEGRADATION)
+
+    if (clcf->gzip_disable_degradation && ngx_http_degraded(r)) {
+        return ngx_http_next_header_filter(r);
+    }
+
+#endif
+
+    dictionary = 0;
+
+    if (conf->dict
+        && ngx_http_zstd_dictionary_ok(r, conf) == NGX_OK
+        && ngx_http_encoding_ok(r, NGX_HTTP_ENCODING_DCZ,
+                                clcf->encodings|NGX_HTTP_ENCODING_DCZ)
+           == NGX_OK)
+    {
+        dictionary = 1;
+
+    } else if (ngx_http_encoding_ok(r, NGX_HTTP_ENCODING_ZSTD,
+                                    clcf->encodings)
+               != NGX_OK)
+    {
+        return ngx_http_next_header_filter(r);
+    }
+
+    ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_zstd_ctx_t));
+    if (ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_http_set_ctx(r, ctx, ngx_http_zstd_filter_module);
+
+    ctx->request = r;
+    ctx->dictionary = dictionary;
+
+    h = ngx_list_push(&r->headers_out.headers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    h->hash = 1;
+    ngx_str_set(&h->key, "Content-Encoding");
+
+    if (dictionary) {
+        ngx_str_set(&h->value, "dcz");
+
+    } else {
+        ngx_str_set(&h->value, "zstd");
+    }
+
+    r->headers_out.content_encoding = h;
+
+    r->main_filter_need_in_memory = 1;
+
+    ngx_http_clear_content_length(r);
+    ngx_http_clear_accept_ranges(r);
+    ngx_http_weak_etag(r);
+
+    return ngx_http_next_header_filter(r);
+}
+
+
+static ngx_int_t
+ngx_http_zstd_dictionary_ok(ngx_http_request_t *r, ngx_http_zstd_conf_t *conf)
+{
+    u_char           *p, *last;
+    ngx_uint_t        i;
+    ngx_list_part_t  *part;
+    ngx_table_elt_t  *header;
+
+    part = &r->headers_in.headers.part;
+    header = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            header = part->elts;
+            i = 0;
+        }
+
+        if (header[i].key.len != sizeof("Available-Dictionary") - 1
+            || ngx_strncasecmp(header[i].key.data,
+                               (u_char *) "Available-Dictionary",
+                               sizeof("Available-Dictionary") - 1)
+               != 0)
+        {
+            continue;
+        }
+
+        p = header[i].value.data;
+        last = p + header[i].value.len;
+
+        while (last > p && (last[-1] == ' ' || last[-1] == '\t')) {
+            last--;
+        }
+
+        if ((size_t) (last - p) == conf->dict->available.len
+            && ngx_strncmp(p, conf->dict->available.data,
+                           conf->dict->available.len)
+               == 0)
+        {
+            return NGX_OK;
+        }
+
+        return NGX_DECLINED;
+    }
+
+    return NGX_DECLINED;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
+{
+    ngx_int_t              rc;
+    ngx_uint_t             flush;
+    ngx_chain_t           *cl;
+    ngx_http_zstd_ctx_t   *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_zstd_filter_module);
+
+    if (ctx == NULL || ctx->done || r->header_only) {
+        return ngx_http_next_body_filter(r, in);
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http zstd filter");
+
+    if (!ctx->started) {
+        if (ngx_http_zstd_filter_start(r, ctx) != NGX_OK) {
+            goto failed;
+        }
+    }
+
+    if (in) {
+        if (ngx_chain_add_copy(r->pool, &ctx->in, in) != NGX_OK) {
+            goto failed;
+        }
+
+        r->connection->buffered |= NGX_HTTP_GZIP_BUFFERED;
+    }
+
+    if (ctx->nomem) {
+
+        /* flush busy buffers */
+
+        if (ngx_http_next_body_filter(r, NULL) == NGX_ERROR) {
+            goto failed;
+        }
+
+        cl = NULL;
+
+        ngx_chain_update_chains(r->pool, &ctx->free, &ctx->busy, &cl,
+                                (ngx_buf_tag_t) &ngx_http_zstd_filter_module);
+        ctx->nomem = 0;
+        flush = 0;
+
+    } else {
+        flush = ctx->busy ? 1 : 0;
+    }
+
+    for ( ;; ) {
+
+        /* cycle while we can write to a client */
+
+        for ( ;; ) {
+
+            /* cycle while there is data to feed zstd and ... */
+
+            rc = ngx_http_zstd_filter_add_data(r, ctx);
+
+            if (rc == NGX_DECLINED) {
+                break;
+            }
+
+            if (rc == NGX_AGAIN) {
+                continue;
+            }
+
+
+            /* ... there are buffers to write zstd output */
+
+            rc = ngx_http_zstd_filter_get_buf(r, ctx);
+
+            if (rc == NGX_DECLINED) {
+                break;
+            }
+
+            if (rc == NGX_ERROR) {
+                goto failed;
+            }
+
+
+            rc = ngx_http_zstd_filter_compress(r, ctx);
+
+            if (rc == NGX_OK) {
+                break;
+            }
+
+            if (rc == NGX_ERROR) {
+                goto failed;
+            }
+
+            /* rc == NGX_AGAIN */
+        }
+
+        if (ctx->out == NULL && !flush) {
+            return ctx->busy ? NGX_AGAIN : NGX_OK;
+        }
+
+        rc = ngx_http_next_body_filter(r, ctx->out);
+
+        if (rc == NGX_ERROR) {
+            goto failed;
+        }
+
+        ngx_chain_update_chains(r->pool, &ctx->free, &ctx->busy, &ctx->out,
+                                (ngx_buf_tag_t) &ngx_http_zstd_filter_module);
+        ctx->last_out = &ctx->out;
+
+        ctx->nomem = 0;
+        flush = 0;
+
+        if (ctx->done) {
+            return rc;
+        }
+    }
+
+    /* unreachable */
+
+failed:
+
+    ctx->done = 1;
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_start(ngx_http_request_t *r, ngx_http_zstd_ctx_t *ctx)
+{
+    size_t                 rc;
+    ngx_buf_t             *b;
+    ngx_chain_t           *cl;
+    ngx_pool_cleanup_t    *cln;
+    ngx_http_zstd_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_zstd_filter_module);
+
+    cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (cln == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->cctx = ZSTD_createCCtx();
+    if (ctx->cctx == NULL) {
+        ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                      "ZSTD_createCCtx() failed");
+        return NGX_ERROR;
+    }
+
+    cln->handler = ngx_http_zstd_cleanup_cctx;
+    cln->data = ctx->cctx;
+
+    ctx->started = 1;
+
+    if (ctx->dictionary) {
+        rc = ZSTD_CCtx_refCDict(ctx->cctx, conf->cdict);
+
+    } else {
+        rc = ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_compressionLevel,
+                                    (int) conf->level);
+    }
+
+    if (ZSTD_isError(rc)) {
+        ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                      "zstd setup failed: %s", ZSTD_getErrorName(rc));
+        return NGX_ERROR;
+    }
+
+    if (r->headers_out.content_length_n > 0) {
+
+        /* tables are sized after the known response length */
+
+        rc = ZSTD_CCtx_setPledgedSrcSize(ctx->cctx,
+                          (unsigned long long) r->headers_out.content_length_n);
+
+        if (ZSTD_isError(rc)) {
+            ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                          "ZSTD_CCtx_setPledgedSrcSize() failed: %s",
+                          ZSTD_getErrorName(rc));
+            return NGX_ERROR;
+        }
+    }
+
+    ctx->last_out = &ctx->out;
+    ctx->directive = ZSTD_e_continue;
+
+    if (!ctx->dictionary) {
+        return NGX_OK;
+    }
+
+    b = ngx_create_temp_buf(r->pool, sizeof(ngx_http_zstd_dcz_header) + 32);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    b->last = ngx_cpymem(b->last, ngx_http_zstd_dcz_header,
+                         sizeof(ngx_http_zstd_dcz_header));
+    b->last = ngx_cpymem(b->last, conf->dict->hash, 32);
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return NGX_ERROR;
+    }
+
+    cl->buf = b;
+    cl->next = NULL;
+    ctx->out = cl;
+    ctx->last_out = &cl->next;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_add_data(ngx_http_request_t *r, ngx_http_zstd_ctx_t *ctx)
+{
+    ngx_chain_t  *cl;
+
+    if (ctx->input.pos < ctx->input.size
+        || ctx->directive != ZSTD_e_continue
+        || ctx->redo)
+    {
+        return NGX_OK;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "zstd in: %p", ctx->in);
+
+    if (ctx->in == NULL) {
+        return NGX_DECLINED;
+    }
+
+    cl = ctx->in;
+    ctx->in_buf = cl->buf;
+    ctx->in = cl->next;
+
+    ngx_free_chain(r->pool, cl);
+
+    ctx->input.src = ctx->in_buf->pos;
+    ctx->input.size = ctx->in_buf->last - ctx->in_buf->pos;
+    ctx->input.pos = 0;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "zstd in_buf:%p src:%p size:%uz",
+                   ctx->in_buf, ctx->input.src, ctx->input.size);
+
+    if (ctx->in_buf->last_buf) {
+        ctx->directive = ZSTD_e_end;
+
+    } else if (ctx->in_buf->flush) {
+        ctx->directive = ZSTD_e_flush;
+
+    } else if (ctx->input.size == 0) {
+        /* ctx->directive == ZSTD_e_continue */
+        return NGX_AGAIN;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_get_buf(ngx_http_request_t *r, ngx_http_zstd_ctx_t *ctx)
+{
+    ngx_chain_t           *cl;
+    ngx_http_zstd_conf_t  *conf;
+
+    if (ctx->output.pos < ctx->output.size) {
+        return NGX_OK;
+    }
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_zstd_filter_module);
+
+    if (ctx->free) {
+
+        cl = ctx->free;
+        ctx->out_buf = cl->buf;
+        ctx->free = cl->next;
+
+        ngx_free_chain(r->pool, cl);
+
+    } else if (ctx->bufs < conf->bufs.num) {
+
+        ctx->out_buf = ngx_create_temp_buf(r->pool, conf->bufs.size);
+        if (ctx->out_buf == NULL) {
+            return NGX_ERROR;
+        }
+
+        ctx->out_buf->tag = (ngx_buf_tag_t) &ngx_http_zstd_filter_module;
+        ctx->out_buf->recycled = 1;
+        ctx->bufs++;
+
+    } else {
+        ctx->nomem = 1;
+        return NGX_DECLINED;
+    }
+
+    ctx->output.dst = ctx->out_buf->pos;
+    ctx->output.size = conf->bufs.size;
+    ctx->output.pos = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_compress(ngx_http_request_t *r, ngx_http_zstd_ctx_t *ctx)
+{
+    size_t        rc;
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    ngx_log_debug6(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "zstd in: in:%uz/%uz out:%uz/%uz d:%d redo:%d",
+                   ctx->input.pos, ctx->input.size,
+                   ctx->output.pos, ctx->output.size,
+                   ctx->directive, ctx->redo);
+
+    rc = ZSTD_compressStream2(ctx->cctx, &ctx->output, &ctx->input,
+                              ctx->directive);
+
+    if (ZSTD_isError(rc)) {
+        ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                      "ZSTD_compressStream2() failed: %s",
+                      ZSTD_getErrorName(rc));
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug5(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "zstd out: in:%uz/%uz out:%uz/%uz rc:%uz",
+                   ctx->input.pos, ctx->input.size,
+                   ctx->output.pos, ctx->output.size, rc);
+
+    if (ctx->in_buf) {
+        ctx->in_buf->pos = (u_char *) ctx->input.src + ctx->input.pos;
+    }
+
+    ctx->out_buf->last = (u_char *) ctx->output.dst + ctx->output.pos;
+
+    if (ctx->output.pos == ctx->output.size
+        && (ctx->directive == ZSTD_e_continue || rc != 0))
+    {
+
+        /* zstd wants to output some more data */
+
+        cl = ngx_alloc_chain_link(r->pool);
+        if (cl == NULL) {
+            return NGX_ERROR;
+        }
+
+        cl->buf = ctx->out_buf;
+        cl->next = NULL;
+        *ctx->last_out = cl;
+        ctx->last_out = &cl->next;
+
+        ctx->redo = 1;
+
+        return NGX_AGAIN;
+    }
+
+    ctx->redo = 0;
+
+    if (ctx->directive == ZSTD_e_continue) {
+        return NGX_AGAIN;
+    }
+
+    if (rc != 0) {
+        return NGX_AGAIN;
+    }
+
+    if (ctx->directive == ZSTD_e_end) {
+        return ngx_http_zstd_filter_end(r, ctx);
+    }
+
+    /* ZSTD_e_flush */
+
+    ctx->directive = ZSTD_e_continue;
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return NGX_ERROR;
+    }
+
+    b = ctx->out_buf;
+
+    if (ngx_buf_size(b) == 0) {
+
+        b = ngx_calloc_buf(ctx->request->pool);
+        if (b == NULL) {
+            return NGX_ERROR;
+        }
+
+    } else {
+        ctx->output.pos = ctx->output.size;
+    }
+
+    b->flush = 1;
+
+    cl->buf = b;
+    cl->next = NULL;
+    *ctx->last_out = cl;
+    ctx->last_out = &cl->next;
+
+    r->connection->buffered &= ~NGX_HTTP_GZIP_BUFFERED;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_end(ngx_http_request_t *r, ngx_http_zstd_ctx_t *ctx)
+{
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return NGX_ERROR;
+    }
+
+    b = ctx->out_buf;
+
+    if (ngx_buf_size(b) == 0) {
+        b->temporary = 0;
+    }
+
+    b->last_buf = 1;
+
+    cl->buf = b;
+    cl->next = NULL;
+    *ctx->last_out = cl;
+    ctx->last_out = &cl->next;
+
+    ctx->output.pos = ctx->output.size;
+
+    ctx->done = 1;
+
+    r->connection->buffered &= ~NGX_HTTP_GZIP_BUFFERED;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_zstd_cleanup_cctx(void *data)
+{
+    ZSTD_CCtx  *cctx = data;
+
+    ZSTD_freeCCtx(cctx);
+}
+
+
+static void *
+ngx_http_zstd_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_zstd_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_http_zstd_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->bufs.num = 0;
+     *     conf->types = { NULL };
+     *     conf->types_keys = NULL;
+     *     conf->cdict = NULL;
+     */
+
+    conf->enable = NGX_CONF_UNSET;
+
+    conf->level = NGX_CONF_UNSET;
+    conf->min_length = NGX_CONF_UNSET;
+
+    conf->dict = NGX_CONF_UNSET_PTR;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_zstd_merge_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_http_zstd_conf_t *prev = parent;
+    ngx_http_zstd_conf_t *conf = child;
+
+    ngx_http_core_loc_conf_t  *clcf;
+#if (NGX_OPENSSL)
+    ngx_pool_cleanup_t        *cln;
+#endif
+
+    ngx_conf_merge_value(conf->enable, prev->enable, 0);
+
+    ngx_conf_merge_bufs_value(conf->bufs, prev->bufs,
+                              (128 * 1024) / ngx_pagesize, ngx_pagesize);
+
+    ngx_conf_merge_value(conf->level, prev->level, 3);
+    ngx_conf_merge_value(conf->min_length, prev->min_length, 20);
+
+    ngx_conf_merge_ptr_value(conf->dict, prev->dict, NULL);
+
+    if (ngx_http_merge_types(cf, &conf->types_keys, &conf->types,
+                             &prev->types_keys, &prev->types,
+                             ngx_http_html_default_types)
+        != NGX_OK)
+    {
+        return NGX_CONF_ERROR;
+    }
+
+    if (conf->enable) {
+        clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+        clcf->encodings |= NGX_HTTP_ENCODING_ZSTD;
+    }
+
+#if (NGX_OPENSSL)
+
+    if (conf->dict == NULL || !conf->enable) {
+        return NGX_CONF_OK;
+    }
+
+    if (conf->dict == prev->dict && conf->level == prev->level
+        && prev->cdict)
+    {
+        conf->cdict = prev->cdict;
+        return NGX_CONF_OK;
+    }
+
+    cln = ngx_pool_cleanup_add(cf->pool, 0);
+    if (cln == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    conf->cdict = ZSTD_createCDict(conf->dict->data.data, conf->dict->data.len,
+                                   (int) conf->level);
+    if (conf->cdict == NULL) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "ZSTD_createCDict(\"%V\") failed",
+                           &conf->dict->name);
+        return NGX_CONF_ERROR;
+    }
+
+    cln->handler = ngx_http_zstd_cleanup_cdict;
+    cln->data = conf->cdict;
+
+#endif
+
+    return NGX_CONF_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_filter_init(ngx_conf_t *cf)
+{
+    ngx_http_next_header_filter = ngx_http_top_header_filter;
+    ngx_http_top_header_filter = ngx_http_zstd_header_filter;
+
+    ngx_http_next_body_filter = ngx_http_top_body_filter;
+    ngx_http_top_body_filter = ngx_http_zstd_body_filter;
+
+    return NGX_OK;
+}
+
+
+#if (NGX_OPENSSL)
+
+static char *
+ngx_http_zstd_dictionary(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_zstd_conf_t *zcf = conf;
+
+    ngx_str_t             *value;
+    ngx_http_zstd_dict_t  *dict;
+
+    if (zcf->dict != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        zcf->dict = NULL;
+        return NGX_CONF_OK;
+    }
+
+    dict = ngx_pcalloc(cf->pool, sizeof(ngx_http_zstd_dict_t));
+    if (dict == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    dict->name = value[1];
+
+    if (ngx_conf_full_name(cf->cycle, &dict->name, 1) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (ngx_http_zstd_dictionary_read(cf, dict) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    zcf->dict = dict;
+
+    return NGX_CONF_OK;
+}
+
+
+static ngx_int_t
+ngx_http_zstd_dictionary_read(ngx_conf_t *cf, ngx_http_zstd_dict_t *dict)
+{
+    size_t           size;
+    ssize_t          n;
+    ngx_int_t        rc;
+    ngx_str_t        hash, encoded;
+    ngx_file_t       file;
+    ngx_file_info_t  fi;
+
+    rc = NGX_ERROR;
+
+    ngx_memzero(&file, sizeof(ngx_file_t));
+    file.name = dict->name;
+    file.log = cf->log;
+
+    file.fd = ngx_open_file(file.name.data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (file.fd == NGX_INVALID_FILE) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, ngx_errno,
+                           ngx_open_file_n " \"%V\" failed", &file.name);
+        return NGX_ERROR;
+    }
+
+    if (ngx_fd_info(file.fd, &fi) == NGX_FILE_ERROR) {
+        ngx_conf_log_error(NGX_LOG_CRIT, cf, ngx_errno,
+                           ngx_fd_info_n " \"%V\" failed", &file.name);
+        goto failed;
+    }
+
+    size = ngx_file_size(&fi);
+
+    if (size == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "dictionary \"%V\" is empty", &file.name);
+        goto failed;
+    }
+
+    dict->data.data = ngx_pnalloc(cf->pool, size);
+    if (dict->data.data == NULL) {
+        goto failed;
+    }
+
+    n = ngx_read_file(&file, dict->data.data, size, 0);
+
+    if (n == NGX_ERROR) {
+        ngx_conf_log_error(NGX_LOG_CRIT, cf, ngx_errno,
+                           ngx_read_file_n " \"%V\" failed", &file.name);
+        goto failed;
+    }
+
+    if ((size_t) n != size) {
+        ngx_conf_log_error(NGX_LOG_CRIT, cf, 0,
+                           ngx_read_file_n " \"%V\" returned only "
+                           "%z bytes instead of %uz", &file.name, n, size);
+        goto failed;
+    }
+
+    dict->data.len = size;
+
+    if (EVP_Digest(dict->data.data, size, dict->hash, NULL, EVP_sha256(),
+                   NULL)
+        != 1)
+    {
+        ngx_ssl_error(NGX_LOG_EMERG, cf->log, 0, "EVP_Digest() failed");
+        goto failed;
+    }
+
+    /* the structured field byte sequence, ":" base64 ":" */
+
+    dict->available.data = ngx_pnalloc(cf->pool,
+                                       ngx_base64_encoded_length(32) + 2);
+    if (dict->available.data == NULL) {
+        goto failed;
+    }
+
+    hash.len = 32;
+    hash.data = dict->hash;
+
+    encoded.data = dict->available.data + 1;
+    ngx_encode_base64(&encoded, &hash);
+
+    dict->available.data[0] = ':';
+    dict->available.data[encoded.len + 1] = ':';
+    dict->available.len = encoded.len + 2;
+
+    rc = NGX_OK;
+
+failed:
+
+    if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, cf->log, ngx_errno,
+                      ngx_close_file_n " \"%V\" failed", &file.name);
+    }
+
+    return rc;
+}
+
+
+static void
+ngx_http_zstd_cleanup_cdict(void *data)
+{
+    ZSTD_CDict  *cdict = data;
+
+    ZSTD_freeCDict(cdict);
+}
+
+#endif
@@ -498,6 +498,7 @@ ngx_http_init_phase_handlers(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf)
             find_config_index = n;
 
             ph->checker = ngx_http_core_find_config_phase;
+            ph->phase = i;
             n++;
             ph++;
 
@@ -515,6 +516,7 @@ ngx_http_init_phase_handlers(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf)
             if (use_rewrite) {
                 ph->checker = ngx_http_core_post_rewrite_phase;
                 ph->next = find_config_index;
+                ph->phase = i;
                 n++;
                 ph++;
             }
@@ -530,6 +532,7 @@ ngx_http_init_phase_handlers(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf)
             if (use_access) {
                 ph->checker = ngx_http_core_post_access_phase;
                 ph->next = n;
+                ph->phase = i;
                 ph++;
             }
 
@@ -549,6 +552,7 @@ ngx_http_init_phase_handlers(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf)
             ph->checker = checker;
             ph->handler = h[j];
             ph->next = n;
+            ph->phase = i;
             ph++;
         }
     }
@@ -773,17 +777,33 @@ ngx_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
 
         pclcf->regex_locations = clcfp;
 
+        pclcf->regex_set = ngx_regex_set_create(cf->pool, r);
+        if (pclcf->regex_set == NULL) {
+            return NGX_ERROR;
+        }
+
         for (q = regex;
              q != ngx_queue_sentinel(locations);
              q = ngx_queue_next(q))
         {
             lq = (ngx_http_location_queue_t *) q;
 
+            if (ngx_regex_set_add(pclcf->regex_set, lq->exact->regex->regex,
+                                  &lq->exact->name)
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+
             *(clcfp++) = lq->exact;
         }
 
         *clcfp = NULL;
 
+        if (ngx_regex_set_compile(pclcf->regex_set) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
         ngx_queue_split(locations, regex, &tail);
     }
 
@@ -1497,7 +1517,14 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
         hash.hash = &addr->hash;
         hash.temp_pool = NULL;
 
-        if (ngx_hash_init(&hash, ha.keys.elts, ha.keys.nelts) != NGX_OK) {
+        if (cmcf->server_names_hash_perfect) {
+            rc = ngx_hash_perfect_init(&hash, ha.keys.elts, ha.keys.nelts);
+
+        } else {
+            rc = ngx_hash_init(&hash, ha.keys.elts, ha.keys.nelts);
+        }
+
+        if (rc != NGX_OK) {
             goto failed;
         }
     }
@@ -1510,10 +1537,16 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
         hash.hash = NULL;
         hash.temp_pool = ha.temp_pool;
 
-        if (ngx_hash_wildcard_init(&hash, ha.dns_wc_head.elts,
-                                   ha.dns_wc_head.nelts)
-            != NGX_OK)
-        {
+        if (cmcf->server_names_hash_perfect) {
+            rc = ngx_hash_wildcard_perfect_init(&hash, ha.dns_wc_head.elts,
+                                                ha.dns_wc_head.nelts);
+
+        } else {
+            rc = ngx_hash_wildcard_init(&hash, ha.dns_wc_head.elts,
+                                        ha.dns_wc_head.nelts);
+        }
+
+        if (rc != NGX_OK) {
             goto failed;
         }
 
@@ -1528,10 +1561,16 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
         hash.hash = NULL;
         hash.temp_pool = ha.temp_pool;
 
-        if (ngx_hash_wildcard_init(&hash, ha.dns_wc_tail.elts,
-                                   ha.dns_wc_tail.nelts)
-            != NGX_OK)
-        {
+        if (cmcf->server_names_hash_perfect) {
+            rc = ngx_hash_wildcard_perfect_init(&hash, ha.dns_wc_tail.elts,
+                                                ha.dns_wc_tail.nelts);
+
+        } else {
+            rc = ngx_hash_wildcard_init(&hash, ha.dns_wc_tail.elts,
+                                        ha.dns_wc_tail.nelts);
+        }
+
+        if (rc != NGX_OK) {
             goto failed;
         }
 
@@ -1768,6 +1807,7 @@ ngx_http_add_listening(ngx_conf_t *cf, ngx_http_conf_addr_t *addr)
 
 #if (NGX_HAVE_REUSEPORT)
     ls->reuseport = addr->opt.reuseport;
+    ls->reuseport_cpu = addr->opt.reuseport_cpu;
 #endif
 
     return ls;
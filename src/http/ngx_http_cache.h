@@ -90,9 +90,12 @@ struct ngx_http_cache_s {
     ngx_uint_t                       valid_msec;
     ngx_uint_t                       vary_tag;
 
+    ngx_str_t                        encoding;
+
     ngx_buf_t                       *buf;
 
     ngx_http_file_cache_t           *file_cache;
+    ngx_http_cache_t                *parent;
     ngx_http_file_cache_node_t      *node;
 
 #if (NGX_THREADS || NGX_COMPAT)
@@ -117,6 +120,8 @@ struct ngx_http_cache_s {
     unsigned                         reading:1;
     unsigned                         secondary:1;
     unsigned                         background:1;
+    unsigned                         encoded:1;
+    unsigned                         reencode:1;
 
     unsigned                         stale_updating:1;
     unsigned                         stale_error:1;
@@ -191,6 +196,10 @@ ngx_int_t ngx_http_file_cache_open(ngx_http_request_t *r);
 ngx_int_t ngx_http_file_cache_set_header(ngx_http_request_t *r, u_char *buf);
 void ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf);
 void ngx_http_file_cache_update_header(ngx_http_request_t *r);
+ngx_int_t ngx_http_file_cache_create_encoded(ngx_http_request_t *r,
+    ngx_http_cache_t **ecp);
+void ngx_http_file_cache_update_encoded(ngx_http_request_t *r,
+    ngx_http_cache_t *c, ngx_temp_file_t *tf);
 ngx_int_t ngx_http_cache_send(ngx_http_request_t *);
 void ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf);
 time_t ngx_http_file_cache_valid(ngx_array_t *cache_valid, ngx_uint_t status);
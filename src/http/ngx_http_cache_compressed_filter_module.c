@@ -0,0 +1,267 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+typedef struct {
+    ngx_http_cache_t            *cache;
+    ngx_temp_file_t             *temp_file;
+    ngx_uint_t                   done;    /* unsigned  done:1; */
+} ngx_http_cache_compressed_ctx_t;
+
+
+static void ngx_http_cache_compressed_cleanup(void *data);
+static ngx_int_t ngx_http_cache_compressed_filter_init(ngx_conf_t *cf);
+
+
+static ngx_http_module_t  ngx_http_cache_compressed_filter_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    ngx_http_cache_compressed_filter_init, /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    NULL,                                  /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    NULL,                                  /* create location configuration */
+    NULL                                   /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_cache_compressed_filter_module = {
+    NGX_MODULE_V1,
+    &ngx_http_cache_compressed_filter_module_ctx, /* module context */
+    NULL,                                  /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_http_output_header_filter_pt  ngx_http_next_header_filter;
+static ngx_http_output_body_filter_pt    ngx_http_next_body_filter;
+
+
+static ngx_int_t
+ngx_http_cache_compressed_header_filter(ngx_http_request_t *r)
+{
+    ngx_int_t                         rc;
+    ngx_buf_t                         b;
+    ngx_chain_t                       out;
+    ngx_table_elt_t                  *h;
+    ngx_temp_file_t                  *tf;
+    ngx_http_cache_t                 *c, *ec;
+    ngx_pool_cleanup_t               *cln;
+    ngx_http_upstream_t              *u;
+    ngx_http_file_cache_header_t     *fh;
+    ngx_http_cache_compressed_ctx_t  *ctx;
+
+    c = r->cache;
+    u = r->upstream;
+    h = r->headers_out.content_encoding;
+
+    /*
+     * a fresh cached response was encoded on the fly
+     * as the cache lookup negotiated
+     */
+
+    if (r != r->main
+        || c == NULL
+        || u == NULL
+        || !r->cached
+        || c->encoded
+        || c->encoding.len == 0
+        || c->header_start == c->body_start
+        || u->cache_status != NGX_HTTP_CACHE_HIT
+        || r->headers_out.status != NGX_HTTP_OK
+        || r->header_only
+        || h == NULL
+        || h->value.len != c->encoding.len
+        || ngx_strncasecmp(h->value.data, c->encoding.data, c->encoding.len)
+           != 0
+#if (NGX_HTTP_GZIP)
+        || u->headers_in.content_encoding
+#endif
+        )
+    {
+        return ngx_http_next_header_filter(r);
+    }
+
+    rc = ngx_http_file_cache_create_encoded(r, &ec);
+
+    if (rc == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    if (rc == NGX_DECLINED) {
+        return ngx_http_next_header_filter(r);
+    }
+
+    ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_cache_compressed_ctx_t));
+    if (ctx == NULL) {
+        goto failed;
+    }
+
+    tf = ngx_pcalloc(r->pool, sizeof(ngx_temp_file_t));
+    if (tf == NULL) {
+        goto failed;
+    }
+
+    tf->file.fd = NGX_INVALID_FILE;
+    tf->file.log = r->connection->log;
+    tf->path = u->conf->temp_path;
+    tf->pool = r->pool;
+    tf->persistent = 1;
+
+    if (!c->file_cache->use_temp_path) {
+        tf->path = c->file_cache->path;
+        tf->file.name = ec->file.name;
+    }
+
+    cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (cln == NULL) {
+        goto failed;
+    }
+
+    cln->handler = ngx_http_cache_compressed_cleanup;
+    cln->data = ctx;
+
+    ctx->cache = ec;
+    ctx->temp_file = tf;
+
+    ngx_http_set_ctx(r, ctx, ngx_http_cache_compressed_filter_module);
+
+    /* the variant keeps the cache file header and the original header */
+
+    ngx_memzero(&b, sizeof(ngx_buf_t));
+
+    b.start = ngx_pnalloc(r->pool, c->body_start);
+    if (b.start == NULL) {
+        return NGX_ERROR;
+    }
+
+    b.pos = b.start;
+    b.last = ngx_cpymem(b.start, c->buf->pos, c->body_start);
+    b.memory = 1;
+
+    fh = (ngx_http_file_cache_header_t *) b.start;
+
+    fh->vary_len = 0;
+    ngx_memzero(fh->variant, NGX_HTTP_CACHE_KEY_LEN);
+
+    out.buf = &b;
+    out.next = NULL;
+
+    if (ngx_write_chain_to_temp_file(tf, &out) == NGX_ERROR) {
+        ngx_http_file_cache_free(ec, tf);
+        ctx->done = 1;
+
+    } else {
+        tf->offset = c->body_start;
+    }
+
+    return ngx_http_next_header_filter(r);
+
+failed:
+
+    ngx_http_file_cache_free(ec, NULL);
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_http_cache_compressed_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
+{
+    off_t                             size;
+    ngx_uint_t                        last;
+    ngx_chain_t                      *cl;
+    ngx_temp_file_t                  *tf;
+    ngx_http_cache_compressed_ctx_t  *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_cache_compressed_filter_module);
+
+    if (ctx == NULL || ctx->done || in == NULL) {
+        return ngx_http_next_body_filter(r, in);
+    }
+
+    tf = ctx->temp_file;
+
+    size = 0;
+    last = 0;
+
+    for (cl = in; cl; cl = cl->next) {
+
+        if (cl->buf->in_file) {
+            ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                          "unexpected file buf in encoded cache variant");
+            goto failed;
+        }
+
+        size += ngx_buf_size(cl->buf);
+
+        if (cl->buf->last_buf) {
+            last = 1;
+        }
+    }
+
+    if (size) {
+        if (ngx_write_chain_to_temp_file(tf, in) == NGX_ERROR) {
+            goto failed;
+        }
+
+        tf->offset += size;
+    }
+
+    if (last) {
+        ngx_http_file_cache_update_encoded(r, ctx->cache, tf);
+        ctx->done = 1;
+    }
+
+    return ngx_http_next_body_filter(r, in);
+
+failed:
+
+    ngx_http_file_cache_free(ctx->cache, tf);
+    ctx->done = 1;
+
+    return ngx_http_next_body_filter(r, in);
+}
+
+
+static void
+ngx_http_cache_compressed_cleanup(void *data)
+{
+    ngx_http_cache_compressed_ctx_t  *ctx = data;
+
+    if (!ctx->done) {
+        ngx_http_file_cache_free(ctx->cache, ctx->temp_file);
+    }
+}
+
+
+static ngx_int_t
+ngx_http_cache_compressed_filter_init(ngx_conf_t *cf)
+{
+    ngx_http_next_header_filter = ngx_http_top_header_filter;
+    ngx_http_top_header_filter = ngx_http_cache_compressed_header_filter;
+
+    ngx_http_next_body_filter = ngx_http_top_body_filter;
+    ngx_http_top_body_filter = ngx_http_cache_compressed_body_filter;
+
+    return NGX_OK;
+}
@@ -77,6 +77,9 @@ static char *ngx_http_core_resolver(ngx_conf_t *cf, ngx_command_t *cmd,
 #if (NGX_HTTP_GZIP)
 static ngx_int_t ngx_http_gzip_accept_encoding(ngx_str_t *ae);
 static ngx_uint_t ngx_http_gzip_quantity(u_char *p, u_char *last);
+static ngx_int_t ngx_http_gzip_allowed(ngx_http_request_t *r,
+    ngx_http_core_loc_conf_t *clcf);
+static ngx_uint_t ngx_http_encoding_quantity(ngx_str_t *ae, ngx_str_t *name);
 static char *ngx_http_gzip_disable(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 #endif
@@ -177,6 +180,17 @@ static ngx_str_t  ngx_http_gzip_no_cache = ngx_string("no-cache");
 static ngx_str_t  ngx_http_gzip_no_store = ngx_string("no-store");
 static ngx_str_t  ngx_http_gzip_private = ngx_string("private");
 
+
+/* in the order of NGX_HTTP_ENCODING_* bits */
+
+static ngx_str_t  ngx_http_encodings[] = {
+    ngx_string("gzip"),
+    ngx_string("br"),
+    ngx_string("zstd"),
+    ngx_string("dcz"),
+    ngx_null_string
+};
+
 #endif
 
 
@@ -210,6 +224,13 @@ static ngx_command_t  ngx_http_core_commands[] = {
       offsetof(ngx_http_core_main_conf_t, server_names_hash_bucket_size),
       NULL },
 
+    { ngx_string("server_names_hash_perfect"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_core_main_conf_t, server_names_hash_perfect),
+      NULL },
+
     { ngx_string("server"),
       NGX_HTTP_MAIN_CONF|NGX_CONF_BLOCK|NGX_CONF_NOARGS,
       ngx_http_core_server,
@@ -808,6 +829,10 @@ ngx_module_t  ngx_http_core_module = {
 
 ngx_str_t  ngx_http_core_get_method = { 3, (u_char *) "GET" };
 
+#if (NGX_STAT_METRICS)
+ngx_stat_histogram_t  *ngx_http_metrics_phases;
+#endif
+
 
 void
 ngx_http_handler(ngx_http_request_t *r)
@@ -858,6 +883,9 @@ ngx_http_core_run_phases(ngx_http_request_t *r)
     ngx_int_t                   rc;
     ngx_http_phase_handler_t   *ph;
     ngx_http_core_main_conf_t  *cmcf;
+#if (NGX_STAT_METRICS)
+    ngx_uint_t                  phase, start;
+#endif
 
     cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
 
@@ -865,6 +893,26 @@ ngx_http_core_run_phases(ngx_http_request_t *r)
 
     while (ph[r->phase_handler].checker) {
 
+#if (NGX_STAT_METRICS)
+        if (ngx_http_metrics_phases) {
+            phase = ph[r->phase_handler].phase;
+            start = ngx_stat_usec();
+
+            rc = ph[r->phase_handler].checker(r, &ph[r->phase_handler]);
+
+            /* the request may be already freed here */
+
+            ngx_stat_histogram_add(&ngx_http_metrics_phases[phase],
+                                   ngx_stat_usec() - start);
+
+            if (rc == NGX_OK) {
+                return;
+            }
+
+            continue;
+        }
+#endif
+
         rc = ph[r->phase_handler].checker(r, &ph[r->phase_handler]);
 
         if (rc == NGX_OK) {
@@ -1379,6 +1427,7 @@ ngx_http_core_find_location(ngx_http_request_t *r)
     ngx_int_t                  rc;
     ngx_http_core_loc_conf_t  *pclcf;
 #if (NGX_PCRE)
+    u_char                    *found;
     ngx_int_t                  n;
     ngx_uint_t                 noregex;
     ngx_http_core_loc_conf_t  *clcf, **clcfp;
@@ -1413,8 +1462,14 @@ ngx_http_core_find_location(ngx_http_request_t *r)
 
     if (noregex == 0 && pclcf->regex_locations) {
 
+        found = ngx_regex_set_scan(pclcf->regex_set, &r->uri);
+
         for (clcfp = pclcf->regex_locations; *clcfp; clcfp++) {
 
+            if (!found[clcfp - pclcf->regex_locations]) {
+                continue;
+            }
+
             ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                            "test location: ~ \"%V\"", &(*clcfp)->name);
 
@@ -2005,10 +2060,7 @@ ngx_http_auth_basic_user(ngx_http_request_t *r)
 ngx_int_t
 ngx_http_gzip_ok(ngx_http_request_t *r)
 {
-    time_t                     date, expires;
-    ngx_uint_t                 p;
-    ngx_array_t               *cc;
-    ngx_table_elt_t           *e, *d, *ae;
+    ngx_table_elt_t           *ae;
     ngx_http_core_loc_conf_t  *clcf;
 
     r->gzip_tested = 1;
@@ -2047,6 +2099,113 @@ ngx_http_gzip_ok(ngx_http_request_t *r)
         return NGX_DECLINED;
     }
 
+    if (ngx_http_gzip_allowed(r, clcf) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    r->gzip_ok = 1;
+
+    return NGX_OK;
+}
+
+
+/*
+ * an encoding is used if it is acceptable and no other encoding
+ * of "encodings" has a higher quantity, the gzip_http_version,
+ * gzip_proxied, and gzip_disable directives apply to all encodings
+ */
+
+ngx_int_t
+ngx_http_encoding_ok(ngx_http_request_t *r, ngx_uint_t encoding,
+    ngx_uint_t encodings)
+{
+    ngx_uint_t                 i, q;
+    ngx_table_elt_t           *ae;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    if (r != r->main) {
+        return NGX_DECLINED;
+    }
+
+    ae = r->headers_in.accept_encoding;
+    if (ae == NULL) {
+        return NGX_DECLINED;
+    }
+
+    for (i = 0; encoding != (ngx_uint_t) 1 << i; i++) { /* void */ }
+
+    q = ngx_http_encoding_quantity(&ae->value, &ngx_http_encodings[i]);
+
+    if (q == 0) {
+        return NGX_DECLINED;
+    }
+
+    for (i = 0; ngx_http_encodings[i].len; i++) {
+
+        if (!(encodings & ((ngx_uint_t) 1 << i))
+            || encoding == (ngx_uint_t) 1 << i)
+        {
+            continue;
+        }
+
+        if (ngx_http_encoding_quantity(&ae->value, &ngx_http_encodings[i])
+            > q)
+        {
+            return NGX_DECLINED;
+        }
+    }
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    return ngx_http_gzip_allowed(r, clcf);
+}
+
+
+/*
+ * returns the encoding the compression filters of "encodings" would
+ * choose for the request, regardless of the response; they are called
+ * in the reverse order of the bits, and "dcz" is not negotiated here
+ * as it depends on the dictionary
+ */
+
+ngx_str_t *
+ngx_http_encoding_negotiate(ngx_http_request_t *r, ngx_uint_t encodings)
+{
+    ngx_uint_t                 i, encoding;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    for (i = 3; i > 0; i--) {
+        encoding = (ngx_uint_t) 1 << (i - 1);
+
+        if (!(encodings & encoding)) {
+            continue;
+        }
+
+        if (encoding == NGX_HTTP_ENCODING_GZIP
+            && r->headers_in.msie6 && clcf->gzip_disable_msie6)
+        {
+            continue;
+        }
+
+        if (ngx_http_encoding_ok(r, encoding, encodings) == NGX_OK) {
+            return &ngx_http_encodings[i - 1];
+        }
+    }
+
+    return NULL;
+}
+
+
+static ngx_int_t
+ngx_http_gzip_allowed(ngx_http_request_t *r, ngx_http_core_loc_conf_t *clcf)
+{
+    time_t            date, expires;
+    ngx_uint_t        p;
+    ngx_array_t      *cc;
+    ngx_table_elt_t  *e, *d;
+
     if (r->http_version < clcf->gzip_http_version) {
         return NGX_DECLINED;
     }
@@ -2157,8 +2316,6 @@ ok:
 
 #endif
 
-    r->gzip_ok = 1;
-
     return NGX_OK;
 }
 
@@ -2291,6 +2448,98 @@ ngx_http_gzip_quantity(u_char *p, u_char *last)
     return q;
 }
 
+
+/*
+ * returns the quantity of the encoding multiplied by 1000, that is
+ * from 1 to 1000 if the encoding is acceptable, and 0 if it is not
+ * listed, is disabled with "q=0", or the quantity is invalid
+ */
+
+static ngx_uint_t
+ngx_http_encoding_quantity(ngx_str_t *ae, ngx_str_t *name)
+{
+    u_char      *p, *last, *start;
+    ngx_uint_t   q, n, found;
+
+    p = ae->data;
+    last = p + ae->len;
+
+    while (p < last) {
+
+        while (p < last && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+
+        start = p;
+
+        while (p < last
+               && *p != ' ' && *p != '\t' && *p != ',' && *p != ';')
+        {
+            p++;
+        }
+
+        found = ((size_t) (p - start) == name->len
+                 && ngx_strncasecmp(start, name->data, name->len) == 0);
+
+        q = 1000;
+
+        while (p < last && *p != ',') {
+
+            if (*p == ' ' || *p == '\t' || *p == ';') {
+                p++;
+                continue;
+            }
+
+            if (p + 2 < last && (*p == 'q' || *p == 'Q') && p[1] == '=') {
+                p += 2;
+
+                if (*p != '0' && *p != '1') {
+                    q = 0;
+                    break;
+                }
+
+                q = (*p++ - '0') * 1000;
+
+                if (p < last && *p == '.') {
+                    p++;
+
+                    for (n = 100; p < last && *p >= '0' && *p <= '9'; n /= 10)
+                    {
+                        if (n == 0) {
+                            q = 0;
+                            break;
+                        }
+
+                        q += (*p++ - '0') * n;
+                    }
+                }
+
+                if (q > 1000) {
+                    q = 0;
+                }
+
+                continue;
+            }
+
+            /* other parameters */
+
+            while (p < last && *p != ';' && *p != ',') {
+                p++;
+            }
+        }
+
+        if (found) {
+            return q;
+        }
+
+        while (p < last && *p != ',') {
+            p++;
+        }
+    }
+
+    return 0;
+}
+
 #endif
 
 
@@ -3291,6 +3540,7 @@ ngx_http_core_create_main_conf(ngx_conf_t *cf)
 
     cmcf->server_names_hash_max_size = NGX_CONF_UNSET_UINT;
     cmcf->server_names_hash_bucket_size = NGX_CONF_UNSET_UINT;
+    cmcf->server_names_hash_perfect = NGX_CONF_UNSET;
 
     cmcf->variables_hash_max_size = NGX_CONF_UNSET_UINT;
     cmcf->variables_hash_bucket_size = NGX_CONF_UNSET_UINT;
@@ -3311,6 +3561,8 @@ ngx_http_core_init_main_conf(ngx_conf_t *cf, void *conf)
     cmcf->server_names_hash_bucket_size =
             ngx_align(cmcf->server_names_hash_bucket_size, ngx_cacheline_size);
 
+    ngx_conf_init_value(cmcf->server_names_hash_perfect, 0);
+
 
     ngx_conf_init_uint_value(cmcf->variables_hash_max_size, 1024);
     ngx_conf_init_uint_value(cmcf->variables_hash_bucket_size, 64);
@@ -3465,6 +3717,7 @@ ngx_http_core_create_loc_conf(ngx_conf_t *cf)
      *     clcf->limit_rate = NULL;
      *     clcf->limit_rate_after = NULL;
      *     clcf->gzip_proxied = 0;
+     *     clcf->encodings = 0;
      *     clcf->keepalive_disable = 0;
      */
 
@@ -4054,6 +4307,21 @@ ngx_http_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strcmp(value[n].data, "reuseport=cpu") == 0) {
+#if (NGX_HAVE_REUSEPORT && NGX_HAVE_REUSEPORT_CBPF)
+            lsopt.reuseport = 1;
+            lsopt.reuseport_cpu = 1;
+            lsopt.set = 1;
+            lsopt.bind = 1;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "reuseport=cpu is not supported "
+                               "on this platform");
+            return NGX_CONF_ERROR;
+#endif
+            continue;
+        }
+
         if (ngx_strcmp(value[n].data, "ssl") == 0) {
 #if (NGX_HTTP_SSL)
             lsopt.ssl = 1;
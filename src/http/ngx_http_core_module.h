@@ -31,6 +31,12 @@ typedef struct ngx_thread_pool_s  ngx_thread_pool_t;
 #define NGX_HTTP_GZIP_PROXIED_ANY       0x0200
 
 
+#define NGX_HTTP_ENCODING_GZIP          0x0001
+#define NGX_HTTP_ENCODING_BR            0x0002
+#define NGX_HTTP_ENCODING_ZSTD          0x0004
+#define NGX_HTTP_ENCODING_DCZ           0x0008
+
+
 #define NGX_HTTP_AIO_OFF                0
 #define NGX_HTTP_AIO_ON                 1
 #define NGX_HTTP_AIO_THREADS            2
@@ -80,6 +86,7 @@ typedef struct {
 #endif
     unsigned                   deferred_accept:1;
     unsigned                   reuseport:1;
+    unsigned                   reuseport_cpu:1;
     unsigned                   so_keepalive:2;
     unsigned                   proxy_protocol:1;
 
@@ -134,6 +141,7 @@ struct ngx_http_phase_handler_s {
     ngx_http_phase_handler_pt  checker;
     ngx_http_handler_pt        handler;
     ngx_uint_t                 next;
+    ngx_uint_t                 phase;
 };
 
 
@@ -164,6 +172,7 @@ typedef struct {
 
     ngx_uint_t                 server_names_hash_max_size;
     ngx_uint_t                 server_names_hash_bucket_size;
+    ngx_flag_t                 server_names_hash_perfect;
 
     ngx_uint_t                 variables_hash_max_size;
     ngx_uint_t                 variables_hash_bucket_size;
@@ -320,6 +329,7 @@ struct ngx_http_core_loc_conf_s {
     ngx_http_location_tree_node_t   *static_locations;
 #if (NGX_PCRE)
     ngx_http_core_loc_conf_t       **regex_locations;
+    ngx_regex_set_t                 *regex_set;
 #endif
 
     /* pointer to the modules' loc_conf */
@@ -404,6 +414,8 @@ struct ngx_http_core_loc_conf_s {
     ngx_uint_t    gzip_http_version;       /* gzip_http_version */
     ngx_uint_t    gzip_proxied;            /* gzip_proxied */
 
+    ngx_uint_t    encodings;   /* content codings of compression filters */
+
 #if (NGX_PCRE)
     ngx_array_t  *gzip_disable;            /* gzip_disable */
 #endif
@@ -496,6 +508,10 @@ u_char *ngx_http_map_uri_to_path(ngx_http_request_t *r, ngx_str_t *name,
 ngx_int_t ngx_http_auth_basic_user(ngx_http_request_t *r);
 #if (NGX_HTTP_GZIP)
 ngx_int_t ngx_http_gzip_ok(ngx_http_request_t *r);
+ngx_int_t ngx_http_encoding_ok(ngx_http_request_t *r, ngx_uint_t encoding,
+    ngx_uint_t encodings);
+ngx_str_t *ngx_http_encoding_negotiate(ngx_http_request_t *r,
+    ngx_uint_t encodings);
 #endif
 
 
@@ -537,6 +553,10 @@ extern ngx_uint_t ngx_http_max_module;
 
 extern ngx_str_t  ngx_http_core_get_method;
 
+#if (NGX_STAT_METRICS)
+extern ngx_stat_histogram_t  *ngx_http_metrics_phases;
+#endif
+
 
 #define ngx_http_clear_content_length(r)                                      \
                                                                               \
@@ -31,7 +31,7 @@ static void ngx_http_cache_thread_event_handler(ngx_event_t *ev);
 static ngx_int_t ngx_http_file_cache_exists(ngx_http_file_cache_t *cache,
     ngx_http_cache_t *c);
 static ngx_int_t ngx_http_file_cache_name(ngx_http_request_t *r,
-    ngx_path_t *path);
+    ngx_http_cache_t *c, ngx_path_t *path);
 static ngx_http_file_cache_node_t *
     ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key);
 static void ngx_http_file_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
@@ -44,6 +44,16 @@ static ngx_int_t ngx_http_file_cache_reopen(ngx_http_request_t *r,
     ngx_http_cache_t *c);
 static ngx_int_t ngx_http_file_cache_update_variant(ngx_http_request_t *r,
     ngx_http_cache_t *c);
+static ngx_http_cache_t *ngx_http_file_cache_encoded(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
+static ngx_int_t ngx_http_file_cache_open_encoded(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
+static ngx_int_t ngx_http_file_cache_encoded_done(ngx_http_request_t *r,
+    ngx_http_cache_t *c, ngx_int_t rc);
+static void ngx_http_file_cache_update_file(ngx_http_request_t *r,
+    ngx_http_cache_t *c, ngx_temp_file_t *tf);
+static ngx_int_t ngx_http_file_cache_set_encoding(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
 static void ngx_http_file_cache_cleanup(void *data);
 static time_t ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache);
 static time_t ngx_http_file_cache_expire(ngx_http_file_cache_t *cache);
@@ -168,6 +178,8 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     cache->shpool->log_nomem = 0;
 
+    ngx_slab_init_magazine(cache->shpool);
+
     return NGX_OK;
 }
 
@@ -216,7 +228,7 @@ ngx_http_file_cache_create(ngx_http_request_t *r)
         return NGX_ERROR;
     }
 
-    if (ngx_http_file_cache_name(r, cache->path) != NGX_OK) {
+    if (ngx_http_file_cache_name(r, c, cache->path) != NGX_OK) {
         return NGX_ERROR;
     }
 
@@ -279,7 +291,13 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
     }
 
     if (c->reading) {
-        return ngx_http_file_cache_read(r, c);
+        rc = ngx_http_file_cache_read(r, c);
+
+        if (c->encoded) {
+            rc = ngx_http_file_cache_encoded_done(r, c, rc);
+        }
+
+        return rc;
     }
 
     cache = c->file_cache;
@@ -335,7 +353,7 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
         }
     }
 
-    if (ngx_http_file_cache_name(r, cache->path) != NGX_OK) {
+    if (ngx_http_file_cache_name(r, c, cache->path) != NGX_OK) {
         return NGX_ERROR;
     }
 
@@ -659,6 +677,10 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
         return rc;
     }
 
+    if (c->encoding.len && !c->encoded) {
+        return ngx_http_file_cache_open_encoded(r, c);
+    }
+
     return NGX_OK;
 }
 
@@ -930,12 +952,10 @@ failed:
 
 
 static ngx_int_t
-ngx_http_file_cache_name(ngx_http_request_t *r, ngx_path_t *path)
+ngx_http_file_cache_name(ngx_http_request_t *r, ngx_http_cache_t *c,
+    ngx_path_t *path)
 {
-    u_char            *p;
-    ngx_http_cache_t  *c;
-
-    c = r->cache;
+    u_char  *p;
 
     if (c->file.name.len) {
         return NGX_OK;
@@ -1344,27 +1364,210 @@ ngx_http_file_cache_update_variant(ngx_http_request_t *r, ngx_http_cache_t *c)
         return NGX_ERROR;
     }
 
-    if (ngx_http_file_cache_name(r, cache->path) != NGX_OK) {
+    if (ngx_http_file_cache_name(r, c, cache->path) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_http_cache_t *
+ngx_http_file_cache_encoded(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    ngx_md5_t          md5;
+    ngx_http_cache_t  *ec;
+
+    ec = ngx_pcalloc(r->pool, sizeof(ngx_http_cache_t));
+    if (ec == NULL) {
+        return NULL;
+    }
+
+    /*
+     * the variant key includes the identity of the cache file,
+     * so a variant is not used once the file is replaced or revalidated
+     */
+
+    ngx_md5_init(&md5);
+    ngx_md5_update(&md5, c->key, NGX_HTTP_CACHE_KEY_LEN);
+    ngx_md5_update(&md5, &c->uniq, sizeof(ngx_file_uniq_t));
+    ngx_md5_update(&md5, &c->length, sizeof(off_t));
+    ngx_md5_update(&md5, &c->date, sizeof(time_t));
+    ngx_md5_update(&md5, c->encoding.data, c->encoding.len);
+    ngx_md5_final(ec->key, &md5);
+
+    ngx_memcpy(ec->main, c->main, NGX_HTTP_CACHE_KEY_LEN);
+
+    ec->keys = c->keys;
+    ec->crc32 = c->crc32;
+    ec->header_start = c->header_start;
+    ec->body_start = c->buf->end - c->buf->start;
+    ec->min_uses = 1;
+    ec->lock_age = c->lock_age;
+    ec->encoding = c->encoding;
+    ec->file_cache = c->file_cache;
+    ec->parent = c;
+    ec->encoded = 1;
+
+    ec->file.log = r->connection->log;
+    ec->file.fd = NGX_INVALID_FILE;
+
+    return ec;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_open_encoded(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    ngx_int_t                    rc;
+    ngx_uint_t                   exists;
+    ngx_http_cache_t            *ec;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_node_t  *fcn;
+
+    ec = ngx_http_file_cache_encoded(r, c);
+    if (ec == NULL) {
+        return NGX_ERROR;
+    }
+
+    cache = c->file_cache;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    fcn = ngx_http_file_cache_lookup(cache, ec->key);
+    exists = (fcn && fcn->exists);
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache encoded \"%V\" e:%ui",
+                   &c->encoding, exists);
+
+    if (!exists) {
+        return NGX_OK;
+    }
+
+    r->cache = ec;
+
+    rc = ngx_http_file_cache_open(r);
+
+    return ngx_http_file_cache_encoded_done(r, ec, rc);
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_encoded_done(ngx_http_request_t *r, ngx_http_cache_t *c,
+    ngx_int_t rc)
+{
+    if (rc == NGX_OK || rc == NGX_AGAIN || rc == NGX_ERROR) {
+        return rc;
+    }
+
+    /* the variant is unusable, the main entry is still valid */
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache encoded failed: %i", rc);
+
+    ngx_http_file_cache_free(c, NULL);
+
+    r->cache = c->parent;
+    r->cache->reencode = 1;
+
+    return NGX_OK;
+}
+
+
+ngx_int_t
+ngx_http_file_cache_create_encoded(ngx_http_request_t *r,
+    ngx_http_cache_t **ecp)
+{
+    ngx_int_t               rc;
+    ngx_msec_t              now, timer;
+    ngx_http_cache_t       *c, *ec;
+    ngx_http_file_cache_t  *cache;
+
+    c = r->cache;
+
+    ec = ngx_http_file_cache_encoded(r, c);
+    if (ec == NULL) {
+        return NGX_ERROR;
+    }
+
+    ec->body_start = c->body_start;
+
+    cache = c->file_cache;
+
+    rc = ngx_http_file_cache_exists(cache, ec);
+
+    if (rc == NGX_ERROR) {
         return NGX_ERROR;
     }
 
+    now = ngx_current_msec;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    timer = ec->node->lock_time - now;
+
+    if ((!ec->node->exists || c->reencode)
+        && (!ec->node->updating || (ngx_msec_int_t) timer <= 0))
+    {
+        ec->node->updating = 1;
+        ec->node->lock_time = now + ec->lock_age;
+        ec->updating = 1;
+        ec->lock_time = ec->node->lock_time;
+    }
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache create encoded \"%V\" u:%d",
+                   &ec->encoding, ec->updating);
+
+    if (!ec->updating) {
+        ngx_http_file_cache_free(ec, NULL);
+        return NGX_DECLINED;
+    }
+
+    ec->temp_file = 1;
+
+    if (ngx_http_file_cache_name(r, ec, cache->path) != NGX_OK) {
+        ngx_http_file_cache_free(ec, NULL);
+        return NGX_ERROR;
+    }
+
+    *ecp = ec;
+
     return NGX_OK;
 }
 
 
+void
+ngx_http_file_cache_update_encoded(ngx_http_request_t *r, ngx_http_cache_t *c,
+    ngx_temp_file_t *tf)
+{
+    ngx_http_file_cache_update_file(r, c, tf);
+}
+
+
 void
 ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
+{
+    ngx_http_file_cache_update_file(r, r->cache, tf);
+}
+
+
+static void
+ngx_http_file_cache_update_file(ngx_http_request_t *r, ngx_http_cache_t *c,
+    ngx_temp_file_t *tf)
 {
     off_t                   fs_size;
     ngx_int_t               rc;
     ngx_file_uniq_t         uniq;
     ngx_file_info_t         fi;
-    ngx_http_cache_t        *c;
     ngx_ext_rename_file_t   ext;
     ngx_http_file_cache_t  *cache;
 
-    c = r->cache;
-
     if (c->updated) {
         return;
     }
@@ -1588,6 +1791,10 @@ ngx_http_cache_send(ngx_http_request_t *r)
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
+    if (c->encoded && ngx_http_file_cache_set_encoding(r, c) != NGX_OK) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
     rc = ngx_http_send_header(r);
 
     if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
@@ -1612,6 +1819,40 @@ ngx_http_cache_send(ngx_http_request_t *r)
 }
 
 
+static ngx_int_t
+ngx_http_file_cache_set_encoding(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    ngx_table_elt_t  *h;
+
+    h = ngx_list_push(&r->headers_out.headers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    h->hash = 1;
+    ngx_str_set(&h->key, "Content-Encoding");
+    h->value = c->encoding;
+
+    r->headers_out.content_encoding = h;
+
+    if (r->headers_out.content_length) {
+        r->headers_out.content_length->hash = 0;
+        r->headers_out.content_length = NULL;
+    }
+
+    r->headers_out.content_length_n = c->length - c->body_start;
+
+    ngx_http_clear_accept_ranges(r);
+    ngx_http_weak_etag(r);
+
+#if (NGX_HTTP_GZIP)
+    r->gzip_vary = 1;
+#endif
+
+    return NGX_OK;
+}
+
+
 void
 ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
 {
@@ -2312,7 +2553,7 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_int_t               loader_files, manager_files;
     ngx_msec_t              loader_sleep, manager_sleep, loader_threshold,
                             manager_threshold;
-    ngx_uint_t              i, n, use_temp_path;
+    ngx_uint_t              i, n, use_temp_path, hugepages;
     ngx_array_t            *caches;
     ngx_http_file_cache_t  *cache, **ce;
 
@@ -2327,6 +2568,7 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     }
 
     use_temp_path = 1;
+    hugepages = 0;
 
     inactive = 600;
 
@@ -2412,6 +2654,11 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strcmp(value[i].data, "hugepages") == 0) {
+            hugepages = 1;
+            continue;
+        }
+
         if (ngx_strncmp(value[i].data, "keys_zone=", 10) == 0) {
 
             name.data = value[i].data + 10;
@@ -2602,6 +2849,7 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     cache->shm_zone->init = ngx_http_file_cache_init;
     cache->shm_zone->data = cache;
+    cache->shm_zone->shm.hugepages = hugepages;
 
     cache->use_temp_path = use_temp_path;
 
@@ -11,6 +11,7 @@
 
 
 static void ngx_http_wait_request_handler(ngx_event_t *ev);
+static void ngx_http_overload_handler(ngx_event_t *rev);
 static ngx_http_request_t *ngx_http_alloc_request(ngx_connection_t *c);
 static void ngx_http_process_request_line(ngx_event_t *rev);
 static void ngx_http_process_request_headers(ngx_event_t *rev);
@@ -349,6 +350,33 @@ ngx_http_init_connection(ngx_connection_t *c)
         c->log->action = "reading PROXY protocol";
     }
 
+    if (ngx_event_overloaded) {
+
+        if (hc->ssl || rev->handler != ngx_http_wait_request_handler) {
+            ngx_log_error(NGX_LOG_INFO, c->log, 0,
+                          "worker process is overloaded, "
+                          "closing connection");
+            ngx_http_close_connection(c);
+            return;
+        }
+
+        c->log->action = "rejecting request";
+        rev->handler = ngx_http_overload_handler;
+
+        if (rev->ready) {
+            rev->handler(rev);
+            return;
+        }
+
+        ngx_add_timer(rev, c->listening->post_accept_timeout);
+
+        if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+            ngx_http_close_connection(c);
+        }
+
+        return;
+    }
+
     if (rev->ready) {
         /* the deferred accept(), iocp */
 
@@ -371,6 +399,52 @@ ngx_http_init_connection(ngx_connection_t *c)
 }
 
 
+static void
+ngx_http_overload_handler(ngx_event_t *rev)
+{
+    ssize_t            n;
+    ngx_connection_t  *c;
+    u_char             buffer[NGX_HTTP_DISCARD_BUFFER_SIZE];
+
+    static u_char      response[] =
+        "HTTP/1.1 503 Service Temporarily Unavailable" CRLF
+        "Connection: close" CRLF
+        "Content-Length: 0" CRLF
+        "Retry-After: 1" CRLF CRLF;
+
+    c = rev->data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0, "http overload handler");
+
+    if (rev->timedout) {
+        ngx_log_error(NGX_LOG_INFO, c->log, NGX_ETIMEDOUT, "client timed out");
+        ngx_http_close_connection(c);
+        return;
+    }
+
+    /* the request is read only to avoid reset on close and is discarded */
+
+    n = c->recv(c, buffer, NGX_HTTP_DISCARD_BUFFER_SIZE);
+
+    if (n == NGX_AGAIN) {
+        if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+            ngx_http_close_connection(c);
+        }
+
+        return;
+    }
+
+    if (n == NGX_ERROR || n == 0) {
+        ngx_http_close_connection(c);
+        return;
+    }
+
+    (void) c->send(c, response, sizeof(response) - 1);
+
+    ngx_http_close_connection(c);
+}
+
+
 static void
 ngx_http_wait_request_handler(ngx_event_t *rev)
 {
@@ -552,6 +626,8 @@ ngx_http_alloc_request(ngx_connection_t *c)
         return NULL;
     }
 
+    ngx_pool_set_type(pool, NGX_POOL_REQUEST);
+
     r = ngx_pcalloc(pool, sizeof(ngx_http_request_t));
     if (r == NULL) {
         ngx_destroy_pool(pool);
@@ -981,6 +1057,12 @@ ngx_http_ssl_certificate(ngx_ssl_conn_t *ssl_conn, void *arg)
         return 0;
     }
 
+#if (NGX_THREADS)
+    if (c->ssl->handshake_offloaded) {
+        return 1;
+    }
+#endif
+
     r = ngx_http_alloc_request(c);
     if (r == NULL) {
         return 0;
@@ -1011,7 +1093,8 @@ ngx_http_ssl_certificate(ngx_ssl_conn_t *ssl_conn, void *arg)
                        "ssl key: \"%s\"", key.data);
 
         if (ngx_ssl_connection_certificate(c, r->pool, &cert, &key,
-                                           sscf->passwords)
+                                           sscf->passwords,
+                                           sscf->certificate_cache)
             != NGX_OK)
         {
             goto failed;
@@ -1020,7 +1103,12 @@ ngx_http_ssl_certificate(ngx_ssl_conn_t *ssl_conn, void *arg)
 
     ngx_http_free_request(r, 0);
     c->destroyed = 0;
+
+#if (NGX_THREADS)
+    return ngx_ssl_handshake_offload(c);
+#else
     return 1;
+#endif
 
 failed:
 
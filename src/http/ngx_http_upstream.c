@@ -812,9 +812,13 @@ found:
 static ngx_int_t
 ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
 {
-    ngx_int_t               rc;
-    ngx_http_cache_t       *c;
-    ngx_http_file_cache_t  *cache;
+    ngx_int_t                  rc;
+    ngx_http_cache_t          *c;
+    ngx_http_file_cache_t     *cache;
+#if (NGX_HTTP_GZIP)
+    ngx_str_t                 *encoding;
+    ngx_http_core_loc_conf_t  *clcf;
+#endif
 
     c = r->cache;
 
@@ -882,6 +886,20 @@ ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
         c->lock_timeout = u->conf->cache_lock_timeout;
         c->lock_age = u->conf->cache_lock_age;
 
+#if (NGX_HTTP_GZIP)
+
+        if (u->conf->cache_compressed) {
+            clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+            encoding = ngx_http_encoding_negotiate(r, clcf->encodings);
+
+            if (encoding) {
+                c->encoding = *encoding;
+            }
+        }
+
+#endif
+
         u->cache_status = NGX_HTTP_CACHE_MISS;
     }
 
@@ -1580,6 +1598,8 @@ ngx_http_upstream_connect(ngx_http_request_t *r, ngx_http_upstream_t *u)
                                                NGX_HTTP_INTERNAL_SERVER_ERROR);
             return;
         }
+
+        ngx_pool_set_type(c->pool, NGX_POOL_CONNECTION);
     }
 
     c->log = r->connection->log;
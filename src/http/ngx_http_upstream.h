@@ -208,6 +208,7 @@ typedef struct {
     ngx_flag_t                       cache_revalidate;
     ngx_flag_t                       cache_convert_head;
     ngx_flag_t                       cache_background_update;
+    ngx_flag_t                       cache_compressed;
 
     ngx_array_t                     *cache_valid;
     ngx_array_t                     *cache_bypass;
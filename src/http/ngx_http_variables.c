@@ -2402,14 +2402,21 @@ ngx_http_map_find(ngx_http_request_t *r, ngx_http_map_t *map, ngx_str_t *match)
 #if (NGX_PCRE)
 
     if (len && map->nregex) {
+        u_char                *found;
         ngx_int_t              n;
         ngx_uint_t             i;
         ngx_http_map_regex_t  *reg;
 
         reg = map->regex;
 
+        found = ngx_regex_set_scan(map->regex_set, match);
+
         for (i = 0; i < map->nregex; i++) {
 
+            if (!found[i]) {
+                continue;
+            }
+
             n = ngx_http_regex_exec(r, reg[i].regex, match);
 
             if (n == NGX_OK) {
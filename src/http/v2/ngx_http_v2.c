@@ -282,6 +282,8 @@ ngx_http_v2_init(ngx_event_t *rev)
         return;
     }
 
+    ngx_pool_set_type(h2c->pool, NGX_POOL_CONNECTION);
+
     cln = ngx_pool_cleanup_add(c->pool, 0);
     if (cln == NULL) {
         ngx_http_close_connection(c);
@@ -1137,6 +1139,8 @@ ngx_http_v2_state_headers(ngx_http_v2_connection_t *h2c, u_char *pos,
         return ngx_http_v2_connection_error(h2c, NGX_HTTP_V2_INTERNAL_ERROR);
     }
 
+    ngx_pool_set_type(h2c->state.pool, NGX_POOL_REQUEST);
+
     h2scf = ngx_http_get_module_srv_conf(h2c->http_connection->conf_ctx,
                                          ngx_http_v2_module);
 
@@ -2556,6 +2560,8 @@ ngx_http_v2_push_stream(ngx_http_v2_stream_t *parent, ngx_str_t *path)
         goto rst_stream;
     }
 
+    ngx_pool_set_type(pool, NGX_POOL_REQUEST);
+
     node = ngx_http_v2_get_node_by_id(h2c, h2c->last_push, 1);
 
     if (node == NULL) {
@@ -4519,6 +4525,8 @@ ngx_http_v2_idle_handler(ngx_event_t *rev)
         return;
     }
 
+    ngx_pool_set_type(h2c->pool, NGX_POOL_CONNECTION);
+
     c->write->handler = ngx_http_v2_write_handler;
 
     rev->handler = ngx_http_v2_read_handler;
@@ -46,6 +46,49 @@ ngx_calloc(size_t size, ngx_log_t *log)
 }
 
 
+/*
+ * huge pages are taken from the reserved pool if possible,
+ * otherwise transparent huge pages are requested
+ */
+
+void *
+ngx_alloc_huge(size_t size, ngx_log_t *log)
+{
+    void  *p;
+
+    size = ngx_align(size, NGX_HUGE_PAGE_SIZE);
+
+#if (NGX_HAVE_MAP_HUGETLB)
+
+    p = mmap(NULL, size, PROT_READ|PROT_WRITE,
+             MAP_PRIVATE|MAP_ANON|NGX_MAP_HUGETLB, -1, 0);
+
+    if (p != MAP_FAILED) {
+        ngx_log_debug2(NGX_LOG_DEBUG_ALLOC, log, 0,
+                       "mmap hugetlb: %p:%uz", p, size);
+        return p;
+    }
+
+    ngx_log_error(NGX_LOG_NOTICE, log, ngx_errno,
+                  "mmap(MAP_HUGETLB, %uz) failed, ignored", size);
+
+#endif
+
+    p = ngx_memalign(NGX_HUGE_PAGE_SIZE, size, log);
+
+#if (NGX_HAVE_MADV_HUGEPAGE)
+
+    if (p && madvise(p, size, MADV_HUGEPAGE) == -1) {
+        ngx_log_error(NGX_LOG_NOTICE, log, ngx_errno,
+                      "madvise(MADV_HUGEPAGE) failed, ignored");
+    }
+
+#endif
+
+    return p;
+}
+
+
 #if (NGX_HAVE_POSIX_MEMALIGN)
 
 void *
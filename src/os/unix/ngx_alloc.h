@@ -19,6 +19,21 @@ void *ngx_calloc(size_t size, ngx_log_t *log);
 #define ngx_free          free
 
 
+#define NGX_HUGE_PAGE_SIZE  (2 * 1024 * 1024)
+
+#if (NGX_HAVE_MAP_HUGETLB)
+
+#ifdef MAP_HUGE_SHIFT
+#define NGX_MAP_HUGETLB     (MAP_HUGETLB|(21 << MAP_HUGE_SHIFT))
+#else
+#define NGX_MAP_HUGETLB     MAP_HUGETLB
+#endif
+
+#endif
+
+void *ngx_alloc_huge(size_t size, ngx_log_t *log);
+
+
 /*
  * Linux has memalign() or posix_memalign()
  * Solaris has memalign()
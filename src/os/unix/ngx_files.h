@@ -191,6 +191,7 @@ ngx_int_t ngx_set_file_time(u_char *name, ngx_fd_t fd, time_t s);
 
 
 ngx_int_t ngx_create_file_mapping(ngx_file_mapping_t *fm);
+ngx_int_t ngx_open_file_mapping(ngx_file_mapping_t *fm, ngx_file_info_t *fi);
 void ngx_close_file_mapping(ngx_file_mapping_t *fm);
 
 
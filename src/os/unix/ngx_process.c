@@ -597,12 +597,15 @@ ngx_unlock_mutexes(ngx_pid_t pid)
             i = 0;
         }
 
-        sp = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
-
-        if (ngx_shmtx_force_unlock(&sp->mutex, pid)) {
-            ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
-                          "shared memory zone \"%V\" was locked by %P",
-                          &shm_zone[i].shm.name, pid);
+        for (sp = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+             sp;
+             sp = sp->next)
+        {
+            if (ngx_shmtx_force_unlock(&sp->mutex, pid)) {
+                ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
+                              "shared memory zone \"%V\" was locked by %P",
+                              &shm_zone[i].shm.name, pid);
+            }
         }
     }
 }
@@ -337,6 +337,7 @@ ngx_single_process_cycle(ngx_cycle_t *cycle)
             ngx_reopen = 0;
             ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0, "reopening logs");
             ngx_reopen_files(cycle, (ngx_uid_t) -1);
+            ngx_pool_profile_report(cycle->log);
         }
     }
 }
@@ -729,11 +730,20 @@ ngx_worker_process_cycle(ngx_cycle_t *cycle, void *data)
 {
     ngx_int_t worker = (intptr_t) data;
 
+    ngx_core_conf_t  *ccf;
+
     ngx_process = NGX_PROCESS_WORKER;
     ngx_worker = worker;
 
     ngx_worker_process_init(cycle, worker);
 
+    /* chunks cached by a worker are returned on exit */
+    ngx_slab_magazines = 1;
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+
+    ngx_pool_cache_max = ccf->pool_cache;
+
     ngx_setproctitle("worker process");
 
     for ( ;; ) {
@@ -772,6 +782,7 @@ ngx_worker_process_cycle(ngx_cycle_t *cycle, void *data)
             ngx_reopen = 0;
             ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0, "reopening logs");
             ngx_reopen_files(cycle, -1);
+            ngx_pool_profile_report(cycle->log);
         }
     }
 }
@@ -986,6 +997,11 @@ ngx_worker_process_exit(ngx_cycle_t *cycle)
         }
     }
 
+    ngx_slab_flush_magazines();
+    ngx_pool_flush_cache();
+
+    ngx_pool_profile_report(cycle->log);
+
     if (ngx_exiting) {
         c = cycle->connections;
         for (i = 0; i < cycle->connection_n; i++) {
@@ -14,6 +14,29 @@
 ngx_int_t
 ngx_shm_alloc(ngx_shm_t *shm)
 {
+    shm->hugetlb = 0;
+
+#if (NGX_HAVE_MAP_HUGETLB)
+
+    if (shm->hugepages) {
+        shm->addr = (u_char *) mmap(NULL,
+                                    ngx_align(shm->size, NGX_HUGE_PAGE_SIZE),
+                                    PROT_READ|PROT_WRITE,
+                                    MAP_ANON|MAP_SHARED|NGX_MAP_HUGETLB,
+                                    -1, 0);
+
+        if (shm->addr != MAP_FAILED) {
+            shm->hugetlb = 1;
+            return NGX_OK;
+        }
+
+        ngx_log_error(NGX_LOG_NOTICE, shm->log, ngx_errno,
+                      "mmap(MAP_HUGETLB, %uz) failed for \"%V\", ignored",
+                      shm->size, &shm->name);
+    }
+
+#endif
+
     shm->addr = (u_char *) mmap(NULL, shm->size,
                                 PROT_READ|PROT_WRITE,
                                 MAP_ANON|MAP_SHARED, -1, 0);
@@ -24,6 +47,18 @@ ngx_shm_alloc(ngx_shm_t *shm)
         return NGX_ERROR;
     }
 
+#if (NGX_HAVE_MADV_HUGEPAGE)
+
+    if (shm->hugepages
+        && madvise((void *) shm->addr, shm->size, MADV_HUGEPAGE) == -1)
+    {
+        ngx_log_error(NGX_LOG_NOTICE, shm->log, ngx_errno,
+                      "madvise(MADV_HUGEPAGE) failed for \"%V\", ignored",
+                      &shm->name);
+    }
+
+#endif
+
     return NGX_OK;
 }
 
@@ -31,9 +66,21 @@ ngx_shm_alloc(ngx_shm_t *shm)
 void
 ngx_shm_free(ngx_shm_t *shm)
 {
-    if (munmap((void *) shm->addr, shm->size) == -1) {
+    size_t  size;
+
+    size = shm->size;
+
+#if (NGX_HAVE_MAP_HUGETLB)
+
+    if (shm->hugetlb) {
+        size = ngx_align(size, NGX_HUGE_PAGE_SIZE);
+    }
+
+#endif
+
+    if (munmap((void *) shm->addr, size) == -1) {
         ngx_log_error(NGX_LOG_ALERT, shm->log, ngx_errno,
-                      "munmap(%p, %uz) failed", shm->addr, shm->size);
+                      "munmap(%p, %uz) failed", shm->addr, size);
     }
 }
 
@@ -19,6 +19,8 @@ typedef struct {
     ngx_str_t    name;
     ngx_log_t   *log;
     ngx_uint_t   exists;   /* unsigned  exists:1;  */
+    ngx_uint_t   hugepages;
+    ngx_uint_t   hugetlb;
 } ngx_shm_t;
 
 
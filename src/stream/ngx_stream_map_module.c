@@ -25,6 +25,7 @@ typedef struct {
 #endif
 
     ngx_stream_variable_value_t  *default_value;
+    ngx_db_t                     *db;
     ngx_conf_t                   *cf;
     unsigned                      hostnames:1;
     unsigned                      no_cacheable:1;
@@ -35,6 +36,7 @@ typedef struct {
     ngx_stream_map_t              map;
     ngx_stream_complex_value_t    value;
     ngx_stream_variable_value_t  *default_value;
+    ngx_db_t                     *db;
     ngx_uint_t                    hostnames;      /* unsigned  hostnames:1 */
 } ngx_stream_map_ctx_t;
 
@@ -45,6 +47,8 @@ static void *ngx_stream_map_create_conf(ngx_conf_t *cf);
 static char *ngx_stream_map_block(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static char *ngx_stream_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf);
+static ngx_int_t ngx_stream_map_db_variable(ngx_stream_session_t *s,
+    ngx_stream_map_ctx_t *map, ngx_str_t *val, ngx_stream_variable_value_t *v);
 
 
 static ngx_command_t  ngx_stream_map_commands[] = {
@@ -108,6 +112,7 @@ ngx_stream_map_variable(ngx_stream_session_t *s, ngx_stream_variable_value_t *v,
 {
     ngx_stream_map_ctx_t  *map = (ngx_stream_map_ctx_t *) data;
 
+    ngx_int_t                     rc;
     ngx_str_t                     val, str;
     ngx_stream_complex_value_t   *cv;
     ngx_stream_variable_value_t  *value;
@@ -123,6 +128,14 @@ ngx_stream_map_variable(ngx_stream_session_t *s, ngx_stream_variable_value_t *v,
         val.len--;
     }
 
+    if (map->db) {
+        rc = ngx_stream_map_db_variable(s, map, &val, v);
+
+        if (rc != NGX_DECLINED) {
+            return rc;
+        }
+    }
+
     value = ngx_stream_map_find(s, &map->map, &val);
 
     if (value == NULL) {
@@ -153,6 +166,48 @@ ngx_stream_map_variable(ngx_stream_session_t *s, ngx_stream_variable_value_t *v,
 }
 
 
+/*
+ * database keys are lowercase, values are copied as the database
+ * may be replaced while the session is still using the variable
+ */
+
+static ngx_int_t
+ngx_stream_map_db_variable(ngx_stream_session_t *s, ngx_stream_map_ctx_t *map,
+    ngx_str_t *val, ngx_stream_variable_value_t *v)
+{
+    ngx_str_t  key, value;
+
+    key.len = val->len;
+    key.data = ngx_pnalloc(s->connection->pool, val->len);
+    if (key.data == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_strlow(key.data, val->data, val->len);
+
+    if (ngx_db_find_key(map->db, &key, &value) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    v->data = ngx_pnalloc(s->connection->pool, value.len);
+    if (v->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(v->data, value.data, value.len);
+
+    v->len = value.len;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_STREAM, s->connection->log, 0,
+                   "stream map database: \"%V\" \"%v\"", val, v);
+
+    return NGX_OK;
+}
+
+
 static void *
 ngx_stream_map_create_conf(ngx_conf_t *cf)
 {
@@ -263,6 +318,7 @@ ngx_stream_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 #endif
 
     ctx.default_value = NULL;
+    ctx.db = NULL;
     ctx.cf = &save;
     ctx.hostnames = 0;
     ctx.no_cacheable = 0;
@@ -290,6 +346,7 @@ ngx_stream_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
                                              &ngx_stream_variable_null_value;
 
     map->hostnames = ctx.hostnames;
+    map->db = ctx.db;
 
     hash.key = ngx_hash_key_lc;
     hash.max_size = mcf->hash_max_size;
@@ -407,6 +464,12 @@ ngx_stream_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf)
         return NGX_CONF_OK;
     }
 
+    if (ngx_strcmp(value[0].data, "database") == 0
+        && (cf->args->nelts == 2 || cf->args->nelts == 3))
+    {
+        return ngx_db_conf(cf, NGX_DB_KEYS, &ctx->db);
+    }
+
     if (cf->args->nelts != 2) {
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid number of the map parameters");
@@ -13,6 +13,10 @@
 #include <ngx_core.h>
 #include <ngx_stream.h>
 
+#if (NGX_THREADS)
+#include <ngx_thread_pool.h>
+#endif
+
 
 typedef struct {
     ngx_msec_t       handshake_timeout;
@@ -46,11 +50,17 @@ typedef struct {
     ngx_str_t        ciphers;
 
     ngx_array_t     *passwords;
+    ngx_ssl_cache_t *certificate_cache;
 
     ngx_shm_zone_t  *shm_zone;
 
     ngx_flag_t       session_tickets;
     ngx_array_t     *session_ticket_keys;
+    time_t           session_ticket_key_check;
+
+#if (NGX_THREADS)
+    ngx_thread_pool_t  *handshake_pool;
+#endif
 
     u_char          *file;
     ngx_uint_t       line;